@@ -0,0 +1,20 @@
+#version 450
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 1) flat in uint fragLayer;
+layout(location = 2) in vec3 fragColor;
+layout(location = 3) flat in vec4 fragTint;
+layout(location = 4) flat in vec4 fragOverlay;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set = 0, binding = 11) uniform sampler2DArray entityTextures;
+
+void main() {
+    vec4 color = texture(entityTextures, vec3(fragUV, fragLayer));
+    if (color.a < 0.5) {
+        discard;
+    }
+    vec3 tinted = mix(color.rgb * fragTint.rgb, fragOverlay.rgb, fragOverlay.a);
+    outColor = vec4(tinted * fragColor, 1.0);
+}
@@ -0,0 +1,56 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "frame.glsl"
+
+// EntityVertex, see entity_model.hpp
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in uint normalBone;
+
+layout(location = 0) out vec2 fragUV;
+layout(location = 1) flat out uint fragLayer;
+layout(location = 2) out vec3 fragColor;
+layout(location = 3) flat out vec4 fragTint;
+layout(location = 4) flat out vec4 fragOverlay;
+
+// Model space matrix of every bone, entity after entity
+layout(std430, set = 0, binding = 9) readonly buffer Bones {
+    mat4 matrices[];
+} bones;
+
+// Must match GpuEntityInstance in main.cpp
+struct Instance {
+    mat4 model;
+    uint firstBone;
+    uint textureLayer;
+    uint tint;
+    uint overlay;
+    uint light;
+};
+
+layout(std430, set = 0, binding = 10) readonly buffer Instances {
+    Instance entries[];
+} instances;
+
+// Vanilla's two entity lights, from above on either side
+const vec3 LIGHT0 = normalize(vec3(0.2, 1.0, -0.7));
+const vec3 LIGHT1 = normalize(vec3(-0.2, 1.0, 0.7));
+
+void main() {
+    // Each model's draw passes the first of its instances as firstInstance
+    Instance instance = instances.entries[gl_InstanceIndex];
+    mat4 model = instance.model *
+                 bones.matrices[instance.firstBone + (normalBone >> 24)];
+    vec3 normal = normalize(mat3(model) * unpackSnorm4x8(normalBone).xyz);
+    float diffuse = max(dot(normal, LIGHT0), 0.0) +
+                    max(dot(normal, LIGHT1), 0.0);
+
+    gl_Position = frame.viewProjection * model * vec4(position, 1.0);
+    fragUV = uv;
+    fragLayer = instance.textureLayer;
+    fragColor = lightColor(instance.light >> 4, instance.light & 15u) *
+                min(0.4 + 0.6 * diffuse, 1.0);
+    fragTint = unpackUnorm4x8(instance.tint);
+    fragOverlay = unpackUnorm4x8(instance.overlay);
+}
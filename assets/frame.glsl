@@ -0,0 +1,33 @@
+// Descriptors shared by every stage of the terrain pipelines, must match
+// FrameUniforms and createDescriptorSetLayout in main.cpp
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    // Camera relative, sections are placed relative to the camera
+    mat4 viewProjection;
+    // The section the camera is in, and its position within that section
+    ivec4 cameraSection;
+    vec4 cameraOffset;
+    // Camera relative, inside is dot(plane.xyz, p) + plane.w >= 0
+    vec4 frustumPlanes[6];
+    uint animationTick;
+    float animationSubTick;
+    // Slots of the section table in use
+    uint sectionSlots;
+    // Sections with translucent quads, each has a place in the back to front
+    // order
+    uint translucentSections;
+    // RGBA8 colour of each light level pair, block light * 16 + sky light,
+    // four to an element. See lightmap.hpp.
+    uvec4 lightmap[64];
+} frame;
+
+vec3 lightColor(uint blockLight, uint skyLight) {
+    uint entry = blockLight * 16u + skyLight;
+    return unpackUnorm4x8(frame.lightmap[entry / 4u][entry % 4u]).rgb;
+}
+
+layout(set = 0, binding = 1) uniform sampler2DArray blockTextures;
+
+layout(std430, set = 0, binding = 2) readonly buffer SpriteTable {
+    uvec4 entries[];
+} spriteTable;
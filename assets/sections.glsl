@@ -0,0 +1,26 @@
+// Every meshed section's place in the shared terrain buffers, indexed by
+// slot. Must match GpuSection in main.cpp. Expects frame.glsl to be included
+// first.
+
+struct Section {
+    // The section position, and the slot of its chunk's tint map or -1
+    ivec4 position;
+    // Mesh bounds relative to the section's minimum corner
+    vec4 boundsMin;
+    vec4 boundsMax;
+    // First index, index count and vertex offset of each render layer, all
+    // zero in free slots
+    uvec4 layers[3];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer SectionTable {
+    Section entries[];
+} sections;
+
+// The section's minimum corner relative to the camera. Only the difference
+// of section positions is converted to float, so this stays exact far from
+// the origin.
+vec3 sectionOrigin(Section section) {
+    ivec3 offset = section.position.xyz - frame.cameraSection.xyz;
+    return vec3(offset * 16) - frame.cameraOffset.xyz;
+}
@@ -1,9 +1,56 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) in vec3 fragColor;
+#include "frame.glsl"
+#include "sprite.glsl"
+
+// RenderLayer of the pipeline: 0 opaque, 1 cutout, 2 translucent
+layout(constant_id = 0) const uint RENDER_LAYER = 0;
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 1) flat in uint fragSprite;
+layout(location = 2) in vec3 fragColor;
+layout(location = 3) flat in uint fragTint;
+layout(location = 4) flat in int fragTintSlot;
+layout(location = 5) in vec2 fragColumn;
 
 layout(location = 0) out vec4 outColor;
 
+// Blended grass, foliage and water colours of every column of a chunk,
+// 768 per slot, see ChunkTints in biome_tint.hpp
+layout(std430, set = 0, binding = 8) readonly buffer ChunkTints {
+    uint colors[];
+} chunkTints;
+
+// Plains biome colours, indexed by TintType. Spruce and birch leaves always
+// look like this, the others only until their chunk's tints are blended.
+const vec3 TINT_COLORS[6] = vec3[](
+    vec3(1.0),
+    vec3(0x91, 0xbd, 0x59) / 255.0,
+    vec3(0x77, 0xab, 0x2f) / 255.0,
+    vec3(0x3f, 0x76, 0xe4) / 255.0,
+    vec3(0x61, 0x99, 0x61) / 255.0,
+    vec3(0x80, 0xa7, 0x55) / 255.0
+);
+
+// Grass, foliage and water take one colour per column from the tint map
+vec3 tintColor() {
+    if (fragTint == 0u || fragTint > 3u || fragTintSlot < 0) {
+        return TINT_COLORS[fragTint];
+    }
+    ivec2 column = clamp(ivec2(floor(fragColumn)), ivec2(0), ivec2(15));
+    uint packed = chunkTints.colors[uint(fragTintSlot) * 768u +
+                                    (fragTint - 1u) * 256u +
+                                    uint(column.y * 16 + column.x)];
+    return packed == 0u ? TINT_COLORS[fragTint] : unpackUnorm4x8(packed).rgb;
+}
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec4 color = sampleSprite(fragSprite, fragUV);
+    if (RENDER_LAYER == 0) {
+        color.a = 1.0;
+    } else if (RENDER_LAYER == 1 && color.a < 0.5) {
+        discard;
+    }
+    outColor = vec4(color.rgb * tintColor() * fragColor, color.a);
 }
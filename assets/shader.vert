@@ -1,20 +1,64 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) out vec3 fragColor;
+#include "frame.glsl"
+#include "sections.glsl"
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// Packed TerrainVertex, see mesher.hpp for the layout
+layout(location = 0) in uvec3 packedVertex;
+
+layout(location = 0) out vec2 fragUV;
+layout(location = 1) flat out uint fragSprite;
+layout(location = 2) out vec3 fragColor;
+layout(location = 3) flat out uint fragTint;
+layout(location = 4) flat out int fragTintSlot;
+layout(location = 5) out vec2 fragColumn;
+
+const float POSITION_SCALE = 2048.0;
+const float POSITION_BIAS = 8.0;
+const float UV_SCALE = 16.0;
+
+// Vanilla's fixed shading per normal direction: down, up, north, south,
+// west, east
+const float DIRECTION_SHADE[6] = float[](0.5, 1.0, 0.8, 0.8, 0.6, 0.6);
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
+// Horizontal part of each normal direction, in the same order
+const vec2 DIRECTION_XZ[6] = vec2[](
+    vec2(0.0), vec2(0.0), vec2(0.0, -1.0), vec2(0.0, 1.0), vec2(-1.0, 0.0),
+    vec2(1.0, 0.0)
 );
 
+// Brightness by ambient occlusion level, 3 is unoccluded
+const float AO_BRIGHTNESS[4] = float[](0.5, 0.7, 0.85, 1.0);
+
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    vec3 position = vec3(packedVertex.x & 0xffffu, packedVertex.x >> 16,
+                         packedVertex.y & 0xffffu) / POSITION_SCALE - POSITION_BIAS;
+    uint sprite = (packedVertex.y >> 16) & 0x1fffu;
+    uint tint = packedVertex.y >> 29;
+    vec2 uv = vec2(packedVertex.z & 0x1ffu, (packedVertex.z >> 9) & 0x1ffu) / UV_SCALE;
+    uint normal = (packedVertex.z >> 18) & 7u;
+    uint ambientOcclusion = (packedVertex.z >> 21) & 3u;
+    uint blockLight = (packedVertex.z >> 23) & 15u;
+    uint skyLight = (packedVertex.z >> 27) & 15u;
+    bool shade = (packedVertex.z >> 31) != 0u;
+
+    // Light levels are looked up like vanilla's lightmap, which changes with
+    // the time of day without touching the meshes
+    vec3 brightness = lightColor(blockLight, skyLight) *
+                      AO_BRIGHTNESS[ambientOcclusion] *
+                      (shade ? DIRECTION_SHADE[normal] : 1.0);
+
+    // Every terrain draw passes its section's slot as firstInstance
+    Section section = sections.entries[gl_InstanceIndex];
+    vec3 origin = sectionOrigin(section);
+    gl_Position = frame.viewProjection * vec4(origin + position, 1.0);
+    fragUV = uv;
+    fragSprite = sprite;
+    fragColor = brightness;
+    fragTint = tint;
+    fragTintSlot = section.position.w;
+    // Nudged back into the block, so a face on the edge of a column takes
+    // its own block's column
+    fragColumn = position.xz - DIRECTION_XZ[normal] * 0.001;
 }
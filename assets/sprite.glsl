@@ -0,0 +1,29 @@
+// Sprite sampling shared by every shader that draws from the block texture
+// array. Expects frame.glsl to be included first.
+
+const uint SPRITE_FLAG_INTERPOLATE = 1;
+
+// Picks the animation frame for the current tick and optionally blends
+// towards the next one. Frames are stored in their own array layers, so
+// this is all that's needed to animate a sprite.
+vec4 sampleSprite(uint sprite, vec2 uv) {
+    uvec4 header = spriteTable.entries[sprite];
+    if (header.y == 1) {
+        return texture(blockTextures, vec3(uv, spriteTable.entries[header.x].x));
+    }
+
+    float tick = float(frame.animationTick % header.z) + frame.animationSubTick;
+    uint i = 0;
+    while (i + 1 < header.y && tick >= float(spriteTable.entries[header.x + i + 1].y)) {
+        i++;
+    }
+
+    uvec4 current = spriteTable.entries[header.x + i];
+    vec4 color = texture(blockTextures, vec3(uv, current.x));
+    if ((header.w & SPRITE_FLAG_INTERPOLATE) != 0) {
+        uvec4 next = spriteTable.entries[header.x + (i + 1) % header.y];
+        float blend = (tick - float(current.y)) / float(current.z);
+        color = mix(color, texture(blockTextures, vec3(uv, next.x)), blend);
+    }
+    return color;
+}
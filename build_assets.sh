@@ -3,4 +3,7 @@
 # TODO: move this all to meson build
 
 glslc assets/shader.frag -o assets/shader.frag.spv
-glslc assets/shader.vert -o assets/shader.vert.spv
\ No newline at end of file
+glslc assets/shader.vert -o assets/shader.vert.spv
+glslc assets/cull.comp -o assets/cull.comp.spv
+glslc assets/entity.frag -o assets/entity.frag.spv
+glslc assets/entity.vert -o assets/entity.vert.spv
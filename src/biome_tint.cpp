@@ -0,0 +1,218 @@
+#include "biome_tint.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Blending is cheap, but a chunk load queues nine chunks of it
+const size_t JOBS_PER_WORKER = 2;
+
+// Columns of chunks that aren't loaded don't count towards the average
+const BiomeId MISSING_BIOME = UINT16_MAX;
+
+struct BiomeColorEntry {
+  std::string_view name;
+  BiomeColors colors;
+};
+
+// Water is 0x3f76e4 unless the biome sets its own. Grass and foliage come
+// from the colour maps at the biome's temperature and downfall, or from the
+// biome's overrides and modifiers: badlands, swamps, dark forests and
+// cherry groves. Swamp grass is vanilla's drier shade, vanilla picks between
+// two with noise.
+const BiomeColorEntry BIOME_COLORS[] = {
+    {"minecraft:badlands", {0x90814d, 0x9e814d, 0x3f76e4}},
+    {"minecraft:bamboo_jungle", {0x59c93c, 0x30bb0b, 0x3f76e4}},
+    {"minecraft:beach", {0x91bd59, 0x77ab2f, 0x3f76e4}},
+    {"minecraft:birch_forest", {0x88bb67, 0x6ba941, 0x3f76e4}},
+    {"minecraft:cherry_grove", {0xb6db61, 0xb6db61, 0x5db7ef}},
+    {"minecraft:cold_ocean", {0x8eb971, 0x71a74d, 0x3d57d6}},
+    {"minecraft:dark_forest", {0x507a32, 0x59ae30, 0x3f76e4}},
+    {"minecraft:deep_cold_ocean", {0x8eb971, 0x71a74d, 0x3d57d6}},
+    {"minecraft:deep_dark", {0x91bd59, 0x77ab2f, 0x3f76e4}},
+    {"minecraft:deep_frozen_ocean", {0x80b497, 0x60a17b, 0x3938c9}},
+    {"minecraft:deep_lukewarm_ocean", {0x8eb971, 0x71a74d, 0x45adf2}},
+    {"minecraft:deep_ocean", {0x8eb971, 0x71a74d, 0x3f76e4}},
+    {"minecraft:desert", {0xbfb755, 0xaea42a, 0x3f76e4}},
+    {"minecraft:dripstone_caves", {0x91bd59, 0x77ab2f, 0x3f76e4}},
+    {"minecraft:eroded_badlands", {0x90814d, 0x9e814d, 0x3f76e4}},
+    {"minecraft:flower_forest", {0x79c05a, 0x59ae30, 0x3f76e4}},
+    {"minecraft:forest", {0x79c05a, 0x59ae30, 0x3f76e4}},
+    {"minecraft:frozen_ocean", {0x80b497, 0x60a17b, 0x3938c9}},
+    {"minecraft:frozen_peaks", {0x80b497, 0x60a17b, 0x3f76e4}},
+    {"minecraft:frozen_river", {0x80b497, 0x60a17b, 0x3938c9}},
+    {"minecraft:grove", {0x80b497, 0x60a17b, 0x3f76e4}},
+    {"minecraft:ice_spikes", {0x80b497, 0x60a17b, 0x3f76e4}},
+    {"minecraft:jagged_peaks", {0x80b497, 0x60a17b, 0x3f76e4}},
+    {"minecraft:jungle", {0x59c93c, 0x30bb0b, 0x3f76e4}},
+    {"minecraft:lukewarm_ocean", {0x8eb971, 0x71a74d, 0x45adf2}},
+    {"minecraft:lush_caves", {0x8eb971, 0x71a74d, 0x3f76e4}},
+    {"minecraft:mangrove_swamp", {0x6a7039, 0x8db127, 0x3a7a6a}},
+    {"minecraft:meadow", {0x83bb6d, 0x63a948, 0x0e4ecf}},
+    {"minecraft:mushroom_fields", {0x55c93f, 0x2bbb0f, 0x3f76e4}},
+    {"minecraft:ocean", {0x8eb971, 0x71a74d, 0x3f76e4}},
+    {"minecraft:old_growth_birch_forest", {0x88bb67, 0x6ba941, 0x3f76e4}},
+    {"minecraft:old_growth_pine_taiga", {0x86b87f, 0x68a55f, 0x3f76e4}},
+    {"minecraft:old_growth_spruce_taiga", {0x86b783, 0x68a464, 0x3f76e4}},
+    {"minecraft:pale_garden", {0x778272, 0x878d76, 0x76889d}},
+    {"minecraft:plains", {0x91bd59, 0x77ab2f, 0x3f76e4}},
+    {"minecraft:river", {0x8eb971, 0x71a74d, 0x3f76e4}},
+    {"minecraft:savanna", {0xbfb755, 0xaea42a, 0x3f76e4}},
+    {"minecraft:savanna_plateau", {0xbfb755, 0xaea42a, 0x3f76e4}},
+    {"minecraft:snowy_beach", {0x83b593, 0x64a278, 0x3d57d6}},
+    {"minecraft:snowy_plains", {0x80b497, 0x60a17b, 0x3f76e4}},
+    {"minecraft:snowy_slopes", {0x80b497, 0x60a17b, 0x3f76e4}},
+    {"minecraft:snowy_taiga", {0x80b497, 0x60a17b, 0x3d57d6}},
+    {"minecraft:sparse_jungle", {0x64c73f, 0x3eb80f, 0x3f76e4}},
+    {"minecraft:stony_peaks", {0x9abe4b, 0x82ac1e, 0x3f76e4}},
+    {"minecraft:stony_shore", {0x8ab689, 0x6da36b, 0x3f76e4}},
+    {"minecraft:sunflower_plains", {0x91bd59, 0x77ab2f, 0x3f76e4}},
+    {"minecraft:swamp", {0x6a7039, 0x6a7039, 0x617b64}},
+    {"minecraft:taiga", {0x86b783, 0x68a464, 0x3f76e4}},
+    {"minecraft:warm_ocean", {0x8eb971, 0x71a74d, 0x43d5ee}},
+    {"minecraft:windswept_forest", {0x8ab689, 0x6da36b, 0x3f76e4}},
+    {"minecraft:windswept_gravelly_hills", {0x8ab689, 0x6da36b, 0x3f76e4}},
+    {"minecraft:windswept_hills", {0x8ab689, 0x6da36b, 0x3f76e4}},
+    {"minecraft:windswept_savanna", {0xbfb755, 0xaea42a, 0x3f76e4}},
+    {"minecraft:wooded_badlands", {0x90814d, 0x9e814d, 0x3f76e4}},
+};
+
+} // namespace
+
+BiomeColors biomeColors(std::string_view name) {
+  auto end = std::end(BIOME_COLORS);
+  auto it = std::lower_bound(std::begin(BIOME_COLORS), end, name,
+                             [](const BiomeColorEntry &entry,
+                                std::string_view name) {
+                               return entry.name < name;
+                             });
+  if (it != end && it->name == name) {
+    return it->colors;
+  }
+  return {0x91bd59, 0x77ab2f, 0x3f76e4};
+}
+
+BiomeTints::BiomeTints(const World &world, BiomeRegistry &biomes,
+                       ThreadPool &pool, int blendRadius)
+    : world(world), biomes(biomes),
+      blendRadius(std::clamp(blendRadius, 0, MAX_BIOME_BLEND)),
+      jobs(pool, JOBS_PER_WORKER) {}
+
+void BiomeTints::chunkInserted(ChunkPos pos) {
+  for (int dz = -1; dz <= 1; dz++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      ChunkPos neighbour{pos.x + dx, pos.z + dz};
+      if (world.chunk(neighbour)) {
+        jobs.request(neighbour);
+      }
+    }
+  }
+}
+
+void BiomeTints::chunkRemoved(ChunkPos pos) {
+  jobs.cancel(pos);
+  chunkInserted(pos);
+}
+
+void BiomeTints::biomesChanged(const std::vector<ChunkPos> &chunks) {
+  for (ChunkPos pos : chunks) {
+    chunkInserted(pos);
+  }
+}
+
+void BiomeTints::dispatch(ChunkPos center) {
+  jobs.dispatch(center, [this](ChunkPos pos) {
+    return decltype(jobs)::Job([this, pos] {
+      return blendChunk(pos);
+    });
+  });
+}
+
+std::optional<ChunkTints> BiomeTints::pollCompleted() { return jobs.poll(); }
+
+ChunkTints BiomeTints::blendChunk(ChunkPos pos) const {
+  int size = borderedSize(blendRadius);
+  thread_local std::vector<BiomeId> columns;
+  columns.resize(size * size);
+  world.extractSurfaceBiomes(pos, blendRadius, MISSING_BIOME, columns.data());
+
+  // Summed-area tables with a zero row and column in front: table[(z + 1) *
+  // stride + x + 1] sums the columns up to and including (x, z). A channel
+  // sums to at most 30 * 30 * 255, so they fit in 32 bits.
+  int stride = size + 1;
+  thread_local std::vector<uint32_t> sums[BLENDED_TINTS][3];
+  thread_local std::vector<uint32_t> counts;
+  for (auto &tint : sums) {
+    for (auto &channel : tint) {
+      channel.assign(stride * stride, 0);
+    }
+  }
+  counts.assign(stride * stride, 0);
+
+  std::unordered_map<BiomeId, BiomeColors> colors;
+  for (int z = 0; z < size; z++) {
+    for (int x = 0; x < size; x++) {
+      int to = (z + 1) * stride + x + 1;
+      int left = to - 1;
+      int above = to - stride;
+      int corner = above - 1;
+      auto accumulate = [&](std::vector<uint32_t> &table, uint32_t value) {
+        table[to] = value + table[left] + table[above] - table[corner];
+      };
+
+      BiomeId biome = columns[z * size + x];
+      bool present = biome != MISSING_BIOME;
+      accumulate(counts, present);
+      uint32_t columnColors[BLENDED_TINTS] = {};
+      if (present) {
+        auto it = colors.find(biome);
+        if (it == colors.end()) {
+          it = colors.emplace(biome, biomeColors(biomes.name(biome))).first;
+        }
+        columnColors[0] = it->second.grass;
+        columnColors[1] = it->second.foliage;
+        columnColors[2] = it->second.water;
+      }
+      for (int tint = 0; tint < BLENDED_TINTS; tint++) {
+        for (int channel = 0; channel < 3; channel++) {
+          // Channel 0 is red, the top byte of 0xRRGGBB
+          accumulate(sums[tint][channel],
+                     columnColors[tint] >> (16 - channel * 8) & 0xff);
+        }
+      }
+    }
+  }
+
+  ChunkTints tints;
+  tints.pos = pos;
+  int window = 2 * blendRadius + 1;
+  for (int z = 0; z < 16; z++) {
+    for (int x = 0; x < 16; x++) {
+      // The window of columns around (x, z), in table coordinates
+      int bottomRight = (z + window) * stride + x + window;
+      int bottomLeft = bottomRight - window;
+      int topRight = bottomRight - window * stride;
+      int topLeft = topRight - window;
+      auto boxSum = [&](const std::vector<uint32_t> &table) {
+        return table[bottomRight] - table[bottomLeft] - table[topRight] +
+               table[topLeft];
+      };
+
+      uint32_t count = boxSum(counts);
+      for (int tint = 0; tint < BLENDED_TINTS; tint++) {
+        uint32_t rgba = 0;
+        if (count > 0) {
+          rgba = 0xffu << 24;
+          for (int channel = 0; channel < 3; channel++) {
+            uint32_t average = boxSum(sums[tint][channel]) / count;
+            rgba |= average << (channel * 8);
+          }
+        }
+        tints.colors[tint * 256 + z * 16 + x] = rgba;
+      }
+    }
+  }
+  return tints;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "chunk.hpp"
+#include "chunk_jobs.hpp"
+#include "coords.hpp"
+#include "registry.hpp"
+#include "thread_pool.hpp"
+
+// Vanilla's biome blend option goes up to 7 blocks
+const int MAX_BIOME_BLEND = 7;
+
+// The colour maps a chunk has a tint map for, in TintType order from Grass
+const int BLENDED_TINTS = 3;
+const int CHUNK_TINT_COLORS = BLENDED_TINTS * 256;
+
+// 0xRRGGBB colours of a biome
+struct BiomeColors {
+  uint32_t grass;
+  uint32_t foliage;
+  uint32_t water;
+};
+
+// Vanilla's colours for the biome, with the grass and foliage colour maps
+// already looked up. Unknown biomes get plains' colours.
+BiomeColors biomeColors(std::string_view name);
+
+// Blended grass, foliage and water colours of a chunk's columns as RGBA8,
+// at colors[(tint - 1) * 256 + z * 16 + x] for TintType tint. Columns with
+// no loaded column within the blend radius are 0.
+struct ChunkTints {
+  ChunkPos pos;
+  uint64_t version = 0;
+  std::array<uint32_t, CHUNK_TINT_COLORS> colors;
+};
+
+// Works out tint maps per chunk on the thread pool. Each column takes the
+// average colour of the surface biomes of the columns within the blend
+// radius, like vanilla's biome blend, using summed-area tables so the cost
+// per column doesn't grow with the radius.
+//
+// A chunk's map only changes with the biomes around it, so it is worked out
+// again only when the chunk or one of its neighbours is loaded or has its
+// biomes changed. Block edits and remeshes never touch it.
+class BiomeTints {
+public:
+  // The pool must be drained before this is destroyed. blendRadius is
+  // clamped to 0-MAX_BIOME_BLEND.
+  BiomeTints(const World &world, BiomeRegistry &biomes, ThreadPool &pool,
+             int blendRadius);
+
+  // Main thread. Blends the chunk and the chunks around it again, since
+  // their maps reach into it.
+  void chunkInserted(ChunkPos pos);
+  // Main thread. Drops the chunk's pending map and blends its neighbours
+  // again without it.
+  void chunkRemoved(ChunkPos pos);
+  // Main thread, with World::takeChangedBiomes()
+  void biomesChanged(const std::vector<ChunkPos> &chunks);
+  // Main thread, once per frame. Starts jobs for the queued chunks nearest
+  // to center.
+  void dispatch(ChunkPos center);
+  // Main thread, never blocks
+  std::optional<ChunkTints> pollCompleted();
+  size_t pendingChunks() const { return jobs.size(); }
+
+private:
+  const World &world;
+  BiomeRegistry &biomes;
+  int blendRadius;
+  ChunkJobQueue<ChunkPos, ChunkTints> jobs;
+
+  // Worker thread
+  ChunkTints blendChunk(ChunkPos pos) const;
+};
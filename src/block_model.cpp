@@ -0,0 +1,678 @@
+#include "block_model.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <numbers>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char *DIRECTION_NAMES[DIRECTION_COUNT] = {"down",  "up",   "north",
+                                                "south", "west", "east"};
+
+uint8_t parseDirection(std::string_view name) {
+  for (int i = 0; i < DIRECTION_COUNT; i++) {
+    if (name == DIRECTION_NAMES[i]) {
+      return i;
+    }
+  }
+  // Older packs still use "bottom"
+  if (name == "bottom") {
+    return static_cast<uint8_t>(Direction::Down);
+  }
+  return NO_CULLFACE;
+}
+
+Direction nearestDirection(const float v[3]) {
+  int axis = 0;
+  for (int i = 1; i < 3; i++) {
+    if (std::abs(v[i]) > std::abs(v[axis])) {
+      axis = i;
+    }
+  }
+  static constexpr Direction negative[3] = {Direction::West, Direction::Down,
+                                            Direction::North};
+  static constexpr Direction positive[3] = {Direction::East, Direction::Up,
+                                            Direction::South};
+  return v[axis] < 0 ? negative[axis] : positive[axis];
+}
+
+// Block state variant rotations, in quarter turns around the point
+// (center, center, center). X turns north to down, Y turns north to east.
+void rotateX(float v[3], int steps, float center) {
+  for (int i = 0; i < steps; i++) {
+    float y = v[1];
+    v[1] = v[2];
+    v[2] = 2 * center - y;
+  }
+}
+
+void rotateY(float v[3], int steps, float center) {
+  for (int i = 0; i < steps; i++) {
+    float x = v[0];
+    v[0] = 2 * center - v[2];
+    v[2] = x;
+  }
+}
+
+int quarterTurns(int degrees) { return ((degrees / 90) % 4 + 4) % 4; }
+
+void readVec3(const JsonValue &json, float out[3]) {
+  const auto &array = json.asArray();
+  if (array.size() != 3) {
+    throw std::runtime_error("expected 3 numbers");
+  }
+  for (int i = 0; i < 3; i++) {
+    out[i] = static_cast<float>(array[i].asNumber());
+  }
+}
+
+std::string conditionValue(const JsonValue &value) {
+  if (value.isBool()) {
+    return value.asBool() ? "true" : "false";
+  } else if (value.isNumber()) {
+    return fmt::format("{}", value.asInt());
+  }
+  return value.asString();
+}
+
+// Multipart "when" conditions: {"prop": "a|b", ...}, {"OR": [...]} or
+// {"AND": [...]}
+bool matchesCondition(const BlockState &state, const JsonValue &condition) {
+  if (const JsonValue *any = condition.find("OR")) {
+    for (const auto &child : any->asArray()) {
+      if (matchesCondition(state, child)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (const JsonValue *all = condition.find("AND")) {
+    for (const auto &child : all->asArray()) {
+      if (!matchesCondition(state, child)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  for (const auto &[key, value] : condition.asObject()) {
+    std::string_view actual = state.property(key);
+    std::string allowed = conditionValue(value);
+    bool negate = !allowed.empty() && allowed[0] == '!';
+    std::string_view options = allowed;
+    if (negate) {
+      options.remove_prefix(1);
+    }
+
+    bool found = false;
+    while (true) {
+      size_t bar = options.find('|');
+      if (options.substr(0, bar) == actual) {
+        found = true;
+        break;
+      }
+      if (bar == std::string_view::npos) {
+        break;
+      }
+      options.remove_prefix(bar + 1);
+    }
+    if (found == negate) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Variant keys look like "facing=north,half=top" and only need to list some
+// of the properties
+bool matchesVariant(const BlockState &state, std::string_view key) {
+  if (key.empty() || key == "normal") {
+    return true;
+  }
+  while (!key.empty()) {
+    size_t comma = key.find(',');
+    std::string_view property = key.substr(0, comma);
+    size_t equals = property.find('=');
+    if (equals == std::string_view::npos ||
+        state.property(property.substr(0, equals)) !=
+            property.substr(equals + 1)) {
+      return false;
+    }
+    key = comma == std::string_view::npos ? std::string_view()
+                                          : key.substr(comma + 1);
+  }
+  return true;
+}
+
+bool endsWith(std::string_view text, std::string_view suffix) {
+  return text.size() >= suffix.size() &&
+         text.substr(text.size() - suffix.size()) == suffix;
+}
+
+Fluid fluidFor(const BlockState &state) {
+  std::string_view name = state.name;
+  if (name == "minecraft:water" || name == "minecraft:bubble_column" ||
+      name == "minecraft:kelp" || name == "minecraft:kelp_plant" ||
+      name == "minecraft:seagrass" || name == "minecraft:tall_seagrass" ||
+      state.property("waterlogged") == "true") {
+    return Fluid::Water;
+  } else if (name == "minecraft:lava") {
+    return Fluid::Lava;
+  }
+  return Fluid::None;
+}
+
+TintType tintFor(const BlockState &state) {
+  std::string_view name = state.name;
+  if (name == "minecraft:grass_block" || name == "minecraft:grass" ||
+      name == "minecraft:short_grass" || name == "minecraft:tall_grass" ||
+      name == "minecraft:fern" || name == "minecraft:large_fern" ||
+      name == "minecraft:potted_fern" || name == "minecraft:sugar_cane") {
+    return TintType::Grass;
+  } else if (name == "minecraft:spruce_leaves") {
+    return TintType::Spruce;
+  } else if (name == "minecraft:birch_leaves") {
+    return TintType::Birch;
+  } else if (endsWith(name, "_leaves") || name == "minecraft:vine") {
+    return TintType::Foliage;
+  } else if (name == "minecraft:water" || name == "minecraft:bubble_column") {
+    return TintType::Water;
+  }
+  return TintType::None;
+}
+
+uint8_t lightEmissionFor(const BlockState &state) {
+  static const std::unordered_map<std::string_view, uint8_t> always = {
+      {"minecraft:beacon", 15}, {"minecraft:conduit", 15},
+      {"minecraft:end_gateway", 15}, {"minecraft:end_portal", 15},
+      {"minecraft:fire", 15}, {"minecraft:glowstone", 15},
+      {"minecraft:jack_o_lantern", 15}, {"minecraft:lantern", 15},
+      {"minecraft:lava", 15}, {"minecraft:sea_lantern", 15},
+      {"minecraft:shroomlight", 15}, {"minecraft:end_rod", 14},
+      {"minecraft:torch", 14}, {"minecraft:wall_torch", 14},
+      {"minecraft:nether_portal", 11}, {"minecraft:crying_obsidian", 10},
+      {"minecraft:soul_fire", 10}, {"minecraft:soul_lantern", 10},
+      {"minecraft:soul_torch", 10}, {"minecraft:soul_wall_torch", 10},
+      {"minecraft:enchanting_table", 7}, {"minecraft:ender_chest", 7},
+      {"minecraft:glow_lichen", 7}, {"minecraft:amethyst_cluster", 5},
+      {"minecraft:magma_block", 3}, {"minecraft:brewing_stand", 1},
+      {"minecraft:brown_mushroom", 1}, {"minecraft:dragon_egg", 1}};
+  // Only while lit=true
+  static const std::unordered_map<std::string_view, uint8_t> whenLit = {
+      {"minecraft:campfire", 15}, {"minecraft:redstone_lamp", 15},
+      {"minecraft:furnace", 13}, {"minecraft:blast_furnace", 13},
+      {"minecraft:smoker", 13}, {"minecraft:soul_campfire", 10},
+      {"minecraft:redstone_ore", 9}, {"minecraft:deepslate_redstone_ore", 9},
+      {"minecraft:redstone_torch", 7}, {"minecraft:redstone_wall_torch", 7}};
+
+  std::string_view name = state.name;
+  bool lit = state.property("lit") == "true";
+  if (auto it = always.find(name); it != always.end()) {
+    return it->second;
+  } else if (auto it = whenLit.find(name); it != whenLit.end()) {
+    return lit ? it->second : 0;
+  } else if (endsWith(name, "_froglight")) {
+    return 15;
+  } else if (endsWith(name, "candle") && lit) {
+    // 3 per candle
+    std::string_view candles = state.property("candles");
+    return 3 * (candles.empty() ? 1 : candles[0] - '0');
+  } else if ((name == "minecraft:cave_vines" ||
+              name == "minecraft:cave_vines_plant") &&
+             state.property("berries") == "true") {
+    return 14;
+  }
+  return 0;
+}
+
+bool coversWholeSide(const BakedQuad &quad) {
+  const float from[3] = {0, 0, 0};
+  const float to[3] = {16, 16, 16};
+  float corners[4][3];
+  boxFaceCorners(quad.face, from, to, corners);
+  const float uvs[4][2] = {{0, 0}, {0, 1}, {1, 1}, {1, 0}};
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 3; j++) {
+      if (quad.positions[i][j] * 16 != corners[i][j]) {
+        return false;
+      }
+    }
+    if (quad.uvs[i][0] != uvs[i][0] || quad.uvs[i][1] != uvs[i][1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Fills in where the quad sits on the side of the block space it faces
+void locateOnSide(BakedQuad &quad) {
+  auto near = [](float a, float b) { return std::abs(a - b) < 1e-4f; };
+  int d = static_cast<int>(quad.face);
+  int normal = 3 - SIDE_AXES[d][0] - SIDE_AXES[d][1];
+  quad.onSide = true;
+  for (int i = 0; i < 4; i++) {
+    const float *position = quad.positions[i];
+    quad.onSide = quad.onSide && near(position[normal], d % 2 ? 1 : 0);
+    quad.sideCorners[i] = 0;
+    for (int a = 0; a < 2; a++) {
+      float value = position[SIDE_AXES[d][a]];
+      if (near(value, 1)) {
+        quad.sideCorners[i] |= 1 << a;
+      } else if (!near(value, 0)) {
+        quad.sideCorners[i] = -1;
+        break;
+      }
+    }
+  }
+}
+
+} // namespace
+
+void boxFaceCorners(Direction face, const float from[3], const float to[3],
+                    float out[4][3]) {
+  float x0 = from[0], y0 = from[1], z0 = from[2];
+  float x1 = to[0], y1 = to[1], z1 = to[2];
+  const float corners[DIRECTION_COUNT][4][3] = {
+      {{x0, y0, z1}, {x0, y0, z0}, {x1, y0, z0}, {x1, y0, z1}},
+      {{x0, y1, z0}, {x0, y1, z1}, {x1, y1, z1}, {x1, y1, z0}},
+      {{x1, y1, z0}, {x1, y0, z0}, {x0, y0, z0}, {x0, y1, z0}},
+      {{x0, y1, z1}, {x0, y0, z1}, {x1, y0, z1}, {x1, y1, z1}},
+      {{x0, y1, z0}, {x0, y0, z0}, {x0, y0, z1}, {x0, y1, z1}},
+      {{x1, y1, z1}, {x1, y0, z1}, {x1, y0, z0}, {x1, y1, z0}},
+  };
+  std::copy_n(&corners[static_cast<int>(face)][0][0], 12, &out[0][0]);
+}
+
+void defaultFaceUv(Direction face, const float from[3], const float to[3],
+                   float out[4]) {
+  const float uvs[DIRECTION_COUNT][4] = {
+      {from[0], 16 - to[2], to[0], 16 - from[2]},
+      {from[0], from[2], to[0], to[2]},
+      {16 - to[0], 16 - to[1], 16 - from[0], 16 - from[1]},
+      {from[0], 16 - to[1], to[0], 16 - from[1]},
+      {from[2], 16 - to[1], to[2], 16 - from[1]},
+      {16 - to[2], 16 - to[1], 16 - from[2], 16 - from[1]},
+  };
+  std::copy_n(uvs[static_cast<int>(face)], 4, out);
+}
+
+BlockModels::BlockModels(const BlockRegistry &blocks,
+                         const TextureArray &textures,
+                         std::optional<std::string> resourcePack)
+    : blocks(blocks), textures(textures),
+      resourcePack(std::move(resourcePack)),
+      baked(new std::atomic<const BlockRenderInfo *>[UINT16_MAX + 1]) {
+  for (size_t i = 0; i <= UINT16_MAX; i++) {
+    baked[i].store(nullptr, std::memory_order_relaxed);
+  }
+  waterSprite = textures.spriteIndex("minecraft:block/water_still");
+  lavaSprite = textures.spriteIndex("minecraft:block/lava_still");
+}
+
+uint32_t BlockModels::fluidSprite(Fluid fluid) const {
+  return fluid == Fluid::Lava ? lavaSprite : waterSprite;
+}
+
+const BlockRenderInfo &BlockModels::bakeState(BlockStateId id) {
+  std::lock_guard lock(bakeMutex);
+  if (const BlockRenderInfo *cached =
+          baked[id].load(std::memory_order_relaxed)) {
+    return *cached;
+  }
+
+  const BlockState &state = blocks.state(id);
+  BlockRenderInfo &info = infos.emplace_back();
+  if (id != BlockRegistry::AIR) {
+    std::string_view path = state.name;
+    path.remove_prefix(path.find(':') + 1);
+
+    if (blockStateFile(state.name)) {
+      for (const auto &reference : selectModels(state)) {
+        bakeModel(*model(reference.model), reference, info);
+      }
+    } else {
+      // Show blocks the pack doesn't know as missing texture cubes rather
+      // than leaving holes in the world
+      Model missing;
+      ModelElement &cube = missing.elements.emplace_back();
+      std::fill_n(cube.from, 3, 0.0f);
+      std::fill_n(cube.to, 3, 16.0f);
+      for (int i = 0; i < DIRECTION_COUNT; i++) {
+        cube.faces[i] = ModelFace{std::nullopt, "#missing",
+                                  static_cast<uint8_t>(i)};
+      }
+      bakeModel(missing, {}, info);
+    }
+
+    for (const auto &quad : info.quads) {
+      auto transparency = textures.transparency(quad.sprite);
+      if (transparency == SpriteTransparency::Translucent) {
+        info.layer = RenderLayer::Translucent;
+      } else if (transparency == SpriteTransparency::Cutout &&
+                 info.layer == RenderLayer::Opaque) {
+        info.layer = RenderLayer::Cutout;
+      }
+    }
+    for (int d = 0; d < DIRECTION_COUNT; d++) {
+      int found = -1;
+      int count = 0;
+      for (size_t i = 0; i < info.quads.size(); i++) {
+        if (info.quads[i].cullface == d) {
+          found = i;
+          count++;
+        }
+      }
+      if (count == 1 && info.quads[found].face == static_cast<Direction>(d) &&
+          coversWholeSide(info.quads[found])) {
+        info.mergeableQuads[d] = found;
+      }
+    }
+    info.tint = tintFor(state);
+    info.fluid = fluidFor(state);
+    info.lightEmission = lightEmissionFor(state);
+    if (info.occludes) {
+      info.lightOpacity = 15;
+    } else if (info.fluid == Fluid::Water || endsWith(path, "_leaves") ||
+               path == "ice" || path == "frosted_ice" || path == "cobweb" ||
+               path == "slime_block" || path == "honey_block") {
+      info.lightOpacity = 1;
+    }
+    info.alwaysMeshed =
+        info.fluid != Fluid::None ||
+        std::any_of(info.quads.begin(), info.quads.end(),
+                    [](const BakedQuad &quad) {
+                      return quad.cullface == NO_CULLFACE;
+                    });
+    // Glass and friends hide the faces between each other, leaves don't
+    info.selfCulling = info.selfCulling && !info.occludes &&
+                       info.layer != RenderLayer::Opaque &&
+                       !endsWith(path, "_leaves");
+  }
+
+  baked[id].store(&info, std::memory_order_release);
+  return info;
+}
+
+std::shared_ptr<const JsonValue>
+BlockModels::blockStateFile(const std::string &name) {
+  auto it = blockStateFiles.find(name);
+  if (it != blockStateFiles.end()) {
+    return it->second;
+  }
+
+  std::shared_ptr<const JsonValue> file;
+  if (resourcePack) {
+    size_t colon = name.find(':');
+    auto path = fmt::format("{}/assets/{}/blockstates/{}.json", *resourcePack,
+                            name.substr(0, colon), name.substr(colon + 1));
+    if (fs::exists(path)) {
+      try {
+        file = std::make_shared<JsonValue>(JsonValue::parseFile(path));
+      } catch (const std::exception &e) {
+        fmt::println(stderr, "Failed to load block state {}: {}", name,
+                     e.what());
+      }
+    }
+  }
+  blockStateFiles.emplace(name, file);
+  return file;
+}
+
+std::vector<BlockModels::ModelReference>
+BlockModels::selectModels(const BlockState &state) {
+  const JsonValue &file = *blockStateFile(state.name);
+  std::vector<ModelReference> references;
+
+  // Vanilla picks between weighted alternatives by position, we always take
+  // the first so a state bakes to one model
+  auto addReference = [&](const JsonValue &value) {
+    const JsonValue &chosen =
+        value.isArray() ? value.asArray().at(0) : value;
+    references.push_back({chosen.getString("model", ""),
+                          chosen.getInt("x", 0), chosen.getInt("y", 0)});
+  };
+
+  try {
+    if (const JsonValue *variants = file.find("variants")) {
+      for (const auto &[key, value] : variants->asObject()) {
+        if (matchesVariant(state, key)) {
+          addReference(value);
+          break;
+        }
+      }
+    }
+    if (const JsonValue *multipart = file.find("multipart")) {
+      for (const auto &part : multipart->asArray()) {
+        const JsonValue *when = part.find("when");
+        const JsonValue *apply = part.find("apply");
+        if (apply && (!when || matchesCondition(state, *when))) {
+          addReference(*apply);
+        }
+      }
+    }
+  } catch (const std::exception &e) {
+    fmt::println(stderr, "Invalid block state file for {}: {}", state.name,
+                 e.what());
+  }
+  return references;
+}
+
+std::shared_ptr<const BlockModels::Model>
+BlockModels::model(const std::string &name, int depth) {
+  std::string key = namespacedName(name);
+  auto it = models.find(key);
+  if (it != models.end()) {
+    return it->second;
+  }
+
+  auto result = std::make_shared<Model>();
+  if (resourcePack && !name.empty()) {
+    size_t colon = key.find(':');
+    auto path = fmt::format("{}/assets/{}/models/{}.json", *resourcePack,
+                            key.substr(0, colon), key.substr(colon + 1));
+    try {
+      JsonValue json = JsonValue::parseFile(path);
+
+      // Parent chains are short in practice, the limit only stops cycles
+      if (const JsonValue *parent = json.find("parent"); parent && depth < 32) {
+        *result = *model(parent->asString(), depth + 1);
+      }
+      if (const JsonValue *textureMap = json.find("textures")) {
+        for (const auto &[variable, texture] : textureMap->asObject()) {
+          result->textures[variable] = texture.asString();
+        }
+      }
+      result->ambientOcclusion =
+          json.getBool("ambientocclusion", result->ambientOcclusion);
+
+      if (const JsonValue *elements = json.find("elements")) {
+        result->elements.clear();
+        for (const auto &elementJson : elements->asArray()) {
+          ModelElement &element = result->elements.emplace_back();
+          readVec3(elementJson.require("from"), element.from);
+          readVec3(elementJson.require("to"), element.to);
+          element.shade = elementJson.getBool("shade", true);
+
+          if (const JsonValue *rotation = elementJson.find("rotation")) {
+            std::string axis = rotation->getString("axis", "y");
+            element.rotationAxis = axis == "x" ? 0 : axis == "y" ? 1 : 2;
+            element.rotationAngle =
+                static_cast<float>(rotation->getNumber("angle", 0));
+            element.rescale = rotation->getBool("rescale", false);
+            if (const JsonValue *origin = rotation->find("origin")) {
+              readVec3(*origin, element.rotationOrigin);
+            }
+          }
+
+          const JsonValue *faces = elementJson.find("faces");
+          if (!faces) {
+            continue;
+          }
+          for (const auto &[faceName, faceJson] : faces->asObject()) {
+            uint8_t direction = parseDirection(faceName);
+            if (direction == NO_CULLFACE) {
+              continue;
+            }
+            ModelFace face;
+            if (const JsonValue *uv = faceJson.find("uv")) {
+              const auto &values = uv->asArray();
+              if (values.size() == 4) {
+                face.uv = std::array<float, 4>{};
+                for (int i = 0; i < 4; i++) {
+                  (*face.uv)[i] = static_cast<float>(values[i].asNumber());
+                }
+              }
+            }
+            face.texture = faceJson.getString("texture", "");
+            face.cullface =
+                parseDirection(faceJson.getString("cullface", ""));
+            face.rotation = faceJson.getInt("rotation", 0);
+            face.tintIndex = faceJson.getInt("tintindex", -1);
+            element.faces[direction] = std::move(face);
+          }
+        }
+      }
+    } catch (const std::exception &e) {
+      fmt::println(stderr, "Failed to load model {}: {}", key, e.what());
+    }
+  }
+
+  models.emplace(key, result);
+  return result;
+}
+
+uint32_t BlockModels::resolveTexture(const Model &model,
+                                     std::string name) const {
+  for (int i = 0; i < 16 && !name.empty() && name[0] == '#'; i++) {
+    auto it = model.textures.find(name.substr(1));
+    if (it == model.textures.end()) {
+      return TextureArray::MISSING_SPRITE;
+    }
+    name = it->second;
+  }
+  if (name.empty() || name[0] == '#') {
+    return TextureArray::MISSING_SPRITE;
+  }
+  return textures.spriteIndex(namespacedName(name));
+}
+
+void BlockModels::bakeModel(const Model &model,
+                            const ModelReference &reference,
+                            BlockRenderInfo &info) const {
+  int turnsX = quarterTurns(reference.x);
+  int turnsY = quarterTurns(reference.y);
+  info.ambientOcclusion = info.ambientOcclusion && model.ambientOcclusion;
+
+  for (const auto &element : model.elements) {
+    bool fullCube = element.rotationAxis == -1 || element.rotationAngle == 0;
+    bool allOpaque = true;
+    for (int i = 0; i < 3; i++) {
+      fullCube = fullCube && element.from[i] == 0 && element.to[i] == 16;
+    }
+
+    float cosine = std::cos(element.rotationAngle * std::numbers::pi_v<float> /
+                            180.0f);
+    float sine = std::sin(element.rotationAngle * std::numbers::pi_v<float> /
+                          180.0f);
+    auto rotateElement = [&](float v[3], bool isPoint) {
+      if (element.rotationAxis == -1) {
+        return;
+      }
+      float p[3];
+      for (int i = 0; i < 3; i++) {
+        p[i] = isPoint ? v[i] - element.rotationOrigin[i] : v[i];
+      }
+      // The two axes the rotation moves, in right handed order
+      int a = (element.rotationAxis + 1) % 3;
+      int b = (element.rotationAxis + 2) % 3;
+      float pa = p[a] * cosine - p[b] * sine;
+      float pb = p[a] * sine + p[b] * cosine;
+      p[a] = pa;
+      p[b] = pb;
+      if (isPoint) {
+        if (element.rescale && cosine != 0) {
+          p[a] /= cosine;
+          p[b] /= cosine;
+        }
+        for (int i = 0; i < 3; i++) {
+          v[i] = p[i] + element.rotationOrigin[i];
+        }
+      } else {
+        std::copy_n(p, 3, v);
+      }
+    };
+
+    for (int d = 0; d < DIRECTION_COUNT; d++) {
+      const auto &face = element.faces[d];
+      if (!face) {
+        allOpaque = false;
+        continue;
+      }
+      auto direction = static_cast<Direction>(d);
+
+      BakedQuad quad;
+      quad.sprite = resolveTexture(model, face->texture);
+      quad.tinted = face->tintIndex >= 0;
+      quad.shade = element.shade;
+      allOpaque = allOpaque && textures.transparency(quad.sprite) ==
+                                   SpriteTransparency::Opaque;
+
+      float uv[4];
+      if (face->uv) {
+        std::copy_n(face->uv->data(), 4, uv);
+      } else {
+        defaultFaceUv(direction, element.from, element.to, uv);
+      }
+      const float uvCorners[4][2] = {
+          {uv[0], uv[1]}, {uv[0], uv[3]}, {uv[2], uv[3]}, {uv[2], uv[1]}};
+      int uvTurns = quarterTurns(face->rotation);
+      for (int i = 0; i < 4; i++) {
+        quad.uvs[i][0] = uvCorners[(i + uvTurns) % 4][0] / 16.0f;
+        quad.uvs[i][1] = uvCorners[(i + uvTurns) % 4][1] / 16.0f;
+      }
+
+      float corners[4][3];
+      boxFaceCorners(direction, element.from, element.to, corners);
+      for (int i = 0; i < 4; i++) {
+        rotateElement(corners[i], true);
+        rotateX(corners[i], turnsX, 8);
+        rotateY(corners[i], turnsY, 8);
+        for (int j = 0; j < 3; j++) {
+          quad.positions[i][j] = corners[i][j] / 16.0f;
+        }
+      }
+
+      float normal[3] = {static_cast<float>(DIRECTION_OFFSETS[d][0]),
+                         static_cast<float>(DIRECTION_OFFSETS[d][1]),
+                         static_cast<float>(DIRECTION_OFFSETS[d][2])};
+      rotateElement(normal, false);
+      rotateX(normal, turnsX, 0);
+      rotateY(normal, turnsY, 0);
+      quad.face = nearestDirection(normal);
+
+      quad.cullface = NO_CULLFACE;
+      if (face->cullface != NO_CULLFACE) {
+        float cull[3] = {
+            static_cast<float>(DIRECTION_OFFSETS[face->cullface][0]),
+            static_cast<float>(DIRECTION_OFFSETS[face->cullface][1]),
+            static_cast<float>(DIRECTION_OFFSETS[face->cullface][2])};
+        rotateX(cull, turnsX, 0);
+        rotateY(cull, turnsY, 0);
+        quad.cullface = static_cast<uint8_t>(nearestDirection(cull));
+      }
+      locateOnSide(quad);
+      info.quads.push_back(quad);
+    }
+
+    if (fullCube) {
+      info.selfCulling = true;
+      info.occludes = info.occludes || allOpaque;
+    }
+  }
+}
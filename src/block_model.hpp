@@ -0,0 +1,175 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "json.hpp"
+#include "registry.hpp"
+#include "texture_array.hpp"
+
+// Same order as vanilla's Direction, so opposite directions differ in the
+// lowest bit
+enum class Direction : uint8_t { Down, Up, North, South, West, East };
+
+const int DIRECTION_COUNT = 6;
+const int DIRECTION_OFFSETS[DIRECTION_COUNT][3] = {
+    {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}, {-1, 0, 0}, {1, 0, 0}};
+
+inline Direction opposite(Direction direction) {
+  return static_cast<Direction>(static_cast<int>(direction) ^ 1);
+}
+
+// The two axes along the side of the block space facing each direction, in
+// x, y, z order. Smooth lighting numbers the side's corners by the ends of
+// them they're at: bit 0 set at the far end of the first, bit 1 the second.
+const int SIDE_AXES[DIRECTION_COUNT][2] = {{0, 2}, {0, 2}, {0, 1},
+                                           {0, 1}, {1, 2}, {1, 2}};
+
+enum class RenderLayer : uint8_t { Opaque, Cutout, Translucent };
+
+const int RENDER_LAYER_COUNT = 3;
+
+// Which colour map tinted faces of a block take their colour from
+enum class TintType : uint8_t { None, Grass, Foliage, Water, Spruce, Birch };
+
+enum class Fluid : uint8_t { None, Water, Lava };
+
+const uint8_t NO_CULLFACE = 0xff;
+
+// A model face after resolving textures and applying every rotation.
+// Corners wind counter clockwise seen from the front and are in the order
+// top left, bottom left, bottom right, top right of the unrotated texture.
+struct BakedQuad {
+  // In blocks, a full cube spans 0 to 1
+  float positions[4][3];
+  // In sprites, a whole sprite spans 0 to 1
+  float uvs[4][2];
+  uint32_t sprite;
+  // Closest axis to the face normal, used for shading
+  Direction face;
+  // Direction whose neighbour hides this face when it's opaque, or
+  // NO_CULLFACE
+  uint8_t cullface;
+  bool tinted;
+  bool shade;
+  // Whether the quad lies on the side of the block space that face points
+  // at, and for each corner the corner of that side it's at or -1
+  bool onSide;
+  int8_t sideCorners[4];
+};
+
+struct BlockRenderInfo {
+  std::vector<BakedQuad> quads;
+  RenderLayer layer = RenderLayer::Opaque;
+  TintType tint = TintType::None;
+  // Fluid drawn in the block space, including waterlogging
+  Fluid fluid = Fluid::None;
+  // Full cube of opaque faces, hides every neighbouring face pointing at it
+  bool occludes = false;
+  // Faces between two copies of the same state are hidden, like glass
+  bool selfCulling = false;
+  // Has quads without a cullface or a fluid, so it may need meshing even
+  // when every neighbour occludes
+  bool alwaysMeshed = false;
+  bool ambientOcclusion = true;
+  // Light level the block gives off, and how much passing light drops on
+  // top of the usual 1 per block: 15 for blocks that occlude, 1 for water,
+  // leaves and the like
+  uint8_t lightEmission = 0;
+  uint8_t lightOpacity = 0;
+  // Per cullface direction, the index of the only quad on that side if it
+  // covers the whole side with the default uv mapping, or -1. Such faces
+  // look the same on neighbouring blocks and can be merged into one quad.
+  int8_t mergeableQuads[DIRECTION_COUNT] = {-1, -1, -1, -1, -1, -1};
+};
+
+// Corners of one face of the box from-to (in 1/16 blocks), in BakedQuad
+// corner order
+void boxFaceCorners(Direction face, const float from[3], const float to[3],
+                    float out[4][3]);
+// The uv rectangle {u0, v0, u1, v1} (in 1/16 sprites) vanilla uses for a face
+// of the box from-to when the model doesn't give one
+void defaultFaceUv(Direction face, const float from[3], const float to[3],
+                   float out[4]);
+
+// Bakes block states into quads from the block state and model JSON of a
+// resource pack. States are baked the first time they are looked up, which
+// may happen from any thread.
+class BlockModels {
+public:
+  BlockModels(const BlockRegistry &blocks, const TextureArray &textures,
+              std::optional<std::string> resourcePack);
+
+  const BlockRenderInfo &info(BlockStateId id) {
+    const BlockRenderInfo *cached =
+        baked[id].load(std::memory_order_acquire);
+    return cached ? *cached : bakeState(id);
+  }
+
+  // Still texture of a fluid, used on every face
+  uint32_t fluidSprite(Fluid fluid) const;
+
+private:
+  struct ModelFace {
+    std::optional<std::array<float, 4>> uv;
+    std::string texture;
+    uint8_t cullface = NO_CULLFACE;
+    int rotation = 0;
+    int tintIndex = -1;
+  };
+
+  struct ModelElement {
+    float from[3];
+    float to[3];
+    // Rotation axis 0-2 for x-z, or -1 when unrotated
+    int rotationAxis = -1;
+    float rotationAngle = 0;
+    float rotationOrigin[3] = {8, 8, 8};
+    bool rescale = false;
+    bool shade = true;
+    std::optional<ModelFace> faces[DIRECTION_COUNT];
+  };
+
+  // A model with its parents merged in
+  struct Model {
+    std::vector<ModelElement> elements;
+    std::unordered_map<std::string, std::string> textures;
+    bool ambientOcclusion = true;
+  };
+
+  struct ModelReference {
+    std::string model;
+    int x = 0;
+    int y = 0;
+  };
+
+  const BlockRegistry &blocks;
+  const TextureArray &textures;
+  std::optional<std::string> resourcePack;
+  uint32_t waterSprite;
+  uint32_t lavaSprite;
+
+  std::unique_ptr<std::atomic<const BlockRenderInfo *>[]> baked;
+  // Guards everything below
+  std::mutex bakeMutex;
+  std::deque<BlockRenderInfo> infos;
+  std::unordered_map<std::string, std::shared_ptr<const Model>> models;
+  std::unordered_map<std::string, std::shared_ptr<const JsonValue>>
+      blockStateFiles;
+
+  const BlockRenderInfo &bakeState(BlockStateId id);
+  std::vector<ModelReference> selectModels(const BlockState &state);
+  std::shared_ptr<const JsonValue> blockStateFile(const std::string &name);
+  std::shared_ptr<const Model> model(const std::string &name, int depth = 0);
+  uint32_t resolveTexture(const Model &model, std::string name) const;
+  void bakeModel(const Model &model, const ModelReference &reference,
+                 BlockRenderInfo &info) const;
+};
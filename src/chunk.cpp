@@ -0,0 +1,784 @@
+#include "chunk.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include <fmt/core.h>
+
+namespace {
+
+unsigned bitsFor(size_t paletteSize) {
+  return paletteSize <= 1 ? 0 : std::bit_width(paletteSize - 1);
+}
+
+unsigned longsFor(unsigned size, unsigned bits) {
+  if (bits == 0) {
+    return 1;
+  }
+  unsigned perLong = 64 / bits;
+  return (size + perLong - 1) / perLong;
+}
+
+} // namespace
+
+template <unsigned Size>
+PalettedContainer<Size>::PalettedContainer(uint16_t value)
+    : palette{value}, data(1, 0) {}
+
+template <unsigned Size> void PalettedContainer<Size>::setBits(unsigned newBits) {
+  bits = newBits;
+  perLong = bits == 0 ? 0 : 64 / bits;
+  mask = bits == 0 ? 0 : (uint64_t(1) << bits) - 1;
+  divideMul = bits == 0 ? 0 : ((1u << DIVIDE_SHIFT) + perLong - 1) / perLong;
+}
+
+template <unsigned Size> void PalettedContainer<Size>::fill(uint16_t value) {
+  palette.assign(1, value);
+  data.assign(1, 0);
+  setBits(0);
+}
+
+template <unsigned Size> void PalettedContainer<Size>::resize(unsigned newBits) {
+  uint16_t indices[Size];
+  for (unsigned i = 0; i < Size; i++) {
+    unsigned cell = (i * divideMul) >> DIVIDE_SHIFT;
+    unsigned shift = (i - cell * perLong) * bits;
+    indices[i] = (data[cell] >> shift) & mask;
+  }
+
+  setBits(newBits);
+  data.assign(longsFor(Size, bits), 0);
+  if (bits == 0) {
+    return;
+  }
+  for (unsigned i = 0; i < Size; i++) {
+    data[i / perLong] |= uint64_t(indices[i]) << (i % perLong * bits);
+  }
+}
+
+template <unsigned Size>
+void PalettedContainer<Size>::set(unsigned index, uint16_t value) {
+  auto it = std::find(palette.begin(), palette.end(), value);
+  unsigned paletteIndex = it - palette.begin();
+  if (bits == 0 && paletteIndex == 0) {
+    return;
+  }
+  if (it == palette.end()) {
+    if (palette.size() >= (size_t(1) << bits)) {
+      resize(bits + 1);
+    }
+    palette.push_back(value);
+  }
+
+  unsigned cell = index / perLong;
+  unsigned shift = index % perLong * bits;
+  data[cell] = (data[cell] & ~(mask << shift)) |
+               (uint64_t(paletteIndex) << shift);
+}
+
+template <unsigned Size>
+void PalettedContainer<Size>::extract(uint16_t *out) const {
+  if (bits == 0) {
+    std::fill(out, out + Size, palette[0]);
+    return;
+  }
+
+  unsigned i = 0;
+  for (uint64_t word : data) {
+    for (unsigned j = 0; j < perLong && i < Size; j++) {
+      out[i++] = palette[word & mask];
+      word >>= bits;
+    }
+  }
+}
+
+template <unsigned Size>
+void PalettedContainer<Size>::load(std::vector<uint16_t> newPalette,
+                                   NbtLongArray packed) {
+  if (newPalette.empty()) {
+    throw std::runtime_error("empty palette");
+  }
+  if (newPalette.size() == 1 || packed.empty()) {
+    fill(newPalette[0]);
+    return;
+  }
+
+  // Vanilla pads block palettes to at least 4 bits, so find the width that
+  // matches the data length rather than assuming the minimum
+  unsigned newBits = bitsFor(newPalette.size());
+  while (newBits <= 16 && longsFor(Size, newBits) != packed.count) {
+    newBits++;
+  }
+  if (newBits > 16) {
+    throw std::runtime_error(
+        fmt::format("packed data has {} longs for a palette of {}",
+                    packed.count, newPalette.size()));
+  }
+
+  palette = std::move(newPalette);
+  setBits(newBits);
+  data.resize(packed.count);
+  packed.copyTo(data.data());
+
+  // Make sure corrupt data can't index past the palette
+  uint64_t paletteSize = palette.size();
+  for (unsigned i = 0; i < Size; i++) {
+    unsigned cell = i / perLong;
+    unsigned shift = i % perLong * bits;
+    if (((data[cell] >> shift) & mask) >= paletteSize) {
+      data[cell] &= ~(mask << shift);
+    }
+  }
+
+  compact();
+}
+
+template <unsigned Size> void PalettedContainer<Size>::compact() {
+  if (bits == 0) {
+    return;
+  }
+
+  uint16_t values[Size];
+  extract(values);
+
+  std::vector<uint16_t> used{values[0]};
+  for (unsigned i = 1; i < Size; i++) {
+    if (values[i] != values[i - 1] &&
+        std::find(used.begin(), used.end(), values[i]) == used.end()) {
+      used.push_back(values[i]);
+    }
+  }
+  if (used.size() == 1) {
+    fill(used[0]);
+    return;
+  }
+
+  palette = std::move(used);
+  setBits(bitsFor(palette.size()));
+  data.assign(longsFor(Size, bits), 0);
+  data.shrink_to_fit();
+  palette.shrink_to_fit();
+
+  // Local lookup from value to new palette index, palettes are small so a
+  // linear scan per distinct run is fine
+  uint16_t lastValue = palette[0];
+  uint64_t lastIndex = 0;
+  for (unsigned i = 0; i < Size; i++) {
+    if (values[i] != lastValue) {
+      lastValue = values[i];
+      lastIndex = std::find(palette.begin(), palette.end(), lastValue) -
+                  palette.begin();
+    }
+    data[i / perLong] |= lastIndex << (i % perLong * bits);
+  }
+}
+
+template class PalettedContainer<4096>;
+template class PalettedContainer<64>;
+
+void LightArray::set(unsigned index, uint8_t level) {
+  if (data.empty()) {
+    if (level == uniform) {
+      return;
+    }
+    data.assign(2048, uniform | uniform << 4);
+  }
+  unsigned shift = (index & 1) * 4;
+  uint8_t &pair = data[index >> 1];
+  pair = (pair & ~(15 << shift)) | level << shift;
+}
+
+void LightArray::assign(const uint8_t *levels) {
+  if (std::all_of(levels, levels + 4096,
+                  [first = levels[0]](uint8_t level) {
+                    return level == first;
+                  })) {
+    data.clear();
+    data.shrink_to_fit();
+    uniform = levels[0];
+    return;
+  }
+  data.resize(2048);
+  for (unsigned i = 0; i < 2048; i++) {
+    data[i] = levels[2 * i] | levels[2 * i + 1] << 4;
+  }
+}
+
+void LightArray::load(std::span<const uint8_t> nibbles) {
+  if (nibbles.size() != 2048) {
+    throw std::runtime_error("light array is not 2048 bytes");
+  }
+  uint8_t first = nibbles[0];
+  if ((first & 15) == first >> 4 &&
+      std::all_of(nibbles.begin(), nibbles.end(),
+                  [first](uint8_t pair) { return pair == first; })) {
+    data.clear();
+    uniform = first & 15;
+    return;
+  }
+  data.assign(nibbles.begin(), nibbles.end());
+}
+
+Chunk::Chunk(ChunkPos pos, int minSection, int sectionCount)
+    : position(pos), minSectionY(minSection), sections(sectionCount) {}
+
+std::unique_ptr<Chunk> Chunk::fromNbt(const ChunkNbt &nbt,
+                                      BlockRegistry &blocks,
+                                      BiomeRegistry &biomes) {
+  // The section list also contains light-only sections above and below the
+  // world, those have no block states
+  int minY = INT32_MAX;
+  int maxY = INT32_MIN;
+  for (const auto &section : nbt.sections) {
+    if (!section.blockPalette.empty()) {
+      minY = std::min<int>(minY, section.y);
+      maxY = std::max<int>(maxY, section.y);
+    }
+  }
+  if (minY > maxY) {
+    minY = maxY = 0;
+  }
+
+  auto chunk =
+      std::make_unique<Chunk>(ChunkPos{nbt.x, nbt.z}, minY, maxY - minY + 1);
+  for (const auto &sectionNbt : nbt.sections) {
+    ChunkSection *section = chunk->section(sectionNbt.y);
+    if (!section || sectionNbt.blockPalette.empty()) {
+      continue;
+    }
+
+    std::vector<uint16_t> blockPalette;
+    blockPalette.reserve(sectionNbt.blockPalette.size());
+    for (const auto &state : sectionNbt.blockPalette) {
+      blockPalette.push_back(blocks.intern(state));
+    }
+    section->blocks.load(std::move(blockPalette), sectionNbt.blockData);
+
+    if (!sectionNbt.biomePalette.empty()) {
+      std::vector<uint16_t> biomePalette;
+      biomePalette.reserve(sectionNbt.biomePalette.size());
+      for (auto name : sectionNbt.biomePalette) {
+        biomePalette.push_back(biomes.intern(name));
+      }
+      section->biomes.load(std::move(biomePalette), sectionNbt.biomeData);
+    }
+  }
+
+  if (nbt.lightOn) {
+    chunk->loadLight(nbt);
+  }
+  return chunk;
+}
+
+void Chunk::loadLight(const ChunkNbt &nbt) {
+  auto valid = [](std::span<const uint8_t> nibbles) {
+    return nibbles.empty() || nibbles.size() == 2048;
+  };
+  std::vector<const ChunkSectionNbt *> bySection(sections.size() + 1);
+  for (const auto &section : nbt.sections) {
+    if (!valid(section.blockLight) || !valid(section.skyLight)) {
+      return;
+    }
+    int index = section.y - minSectionY;
+    if (index >= 0 && index <= static_cast<int>(sections.size())) {
+      bySection[index] = &section;
+    }
+  }
+
+  // Vanilla leaves out sky light that is the same as the bottom of the
+  // section above, starting from full light above the world
+  uint8_t above[256];
+  std::fill_n(above, 256, 15);
+  if (const ChunkSectionNbt *top = bySection.back();
+      top && !top->skyLight.empty()) {
+    LightArray light;
+    light.load(top->skyLight);
+    for (int i = 0; i < 256; i++) {
+      above[i] = light.get(i);
+    }
+  }
+  for (int index = sections.size() - 1; index >= 0; index--) {
+    ChunkSection &section = sections[index];
+    const ChunkSectionNbt *stored = bySection[index];
+    section.blockLight = LightArray(0);
+    if (stored && !stored->blockLight.empty()) {
+      section.blockLight.load(stored->blockLight);
+    }
+    if (stored && !stored->skyLight.empty()) {
+      section.skyLight.load(stored->skyLight);
+    } else {
+      uint8_t levels[4096];
+      for (int y = 0; y < 16; y++) {
+        std::copy_n(above, 256, levels + y * 256);
+      }
+      section.skyLight.assign(levels);
+    }
+    for (int i = 0; i < 256; i++) {
+      above[i] = section.skyLight.get(i);
+    }
+  }
+  lightValid = true;
+}
+
+ChunkSection *Chunk::section(int sectionY) {
+  int index = sectionY - minSectionY;
+  if (index < 0 || index >= static_cast<int>(sections.size())) {
+    return nullptr;
+  }
+  return &sections[index];
+}
+
+const ChunkSection *Chunk::section(int sectionY) const {
+  return const_cast<Chunk *>(this)->section(sectionY);
+}
+
+BlockStateId Chunk::block(int x, int y, int z) const {
+  const ChunkSection *s = section(floorDiv16(y));
+  if (!s) {
+    return BlockRegistry::AIR;
+  }
+  return s->blocks.get((floorMod16(y) * 16 + z) * 16 + x);
+}
+
+void Chunk::setBlock(int x, int y, int z, BlockStateId state) {
+  ChunkSection *s = section(floorDiv16(y));
+  if (!s) {
+    return;
+  }
+  s->blocks.set((floorMod16(y) * 16 + z) * 16 + x, state);
+}
+
+void Chunk::setBiome(int x, int y, int z, BiomeId biome) {
+  ChunkSection *s = section(floorDiv16(y));
+  if (!s) {
+    return;
+  }
+  s->biomes.set((floorMod16(y) / 4 * 4 + z / 4) * 4 + x / 4, biome);
+}
+
+BiomeId Chunk::surfaceBiome(int x, int z) const {
+  for (auto it = sections.rbegin(); it != sections.rend(); ++it) {
+    const auto &blocks = it->blocks;
+    if (blocks.isSingleValue() &&
+        blocks.paletteEntries()[0] == BlockRegistry::AIR) {
+      continue;
+    }
+    for (int y = 15; y >= 0; y--) {
+      if (blocks.get((y * 16 + z) * 16 + x) != BlockRegistry::AIR) {
+        return it->biomes.get((y / 4 * 4 + z / 4) * 4 + x / 4);
+      }
+    }
+  }
+  if (sections.empty()) {
+    return BiomeRegistry::PLAINS;
+  }
+  return sections.back().biomes.get((3 * 4 + z / 4) * 4 + x / 4);
+}
+
+size_t Chunk::memoryUsage() const {
+  size_t total = sizeof(*this);
+  for (const auto &section : sections) {
+    total += section.memoryUsage();
+  }
+  return total;
+}
+
+World::World(BlockRegistry &blocks, BiomeRegistry &biomes)
+    : blocks(blocks), biomes(biomes) {}
+
+void World::insertChunk(std::unique_ptr<Chunk> chunk) {
+  ChunkPos pos = chunk->pos();
+  {
+    std::unique_lock lock(mutex);
+    chunks[pos] = std::move(chunk);
+  }
+  markChunksAroundDirty(pos);
+}
+
+std::unique_ptr<Chunk> World::removeChunk(ChunkPos pos) {
+  std::unique_ptr<Chunk> removed;
+  {
+    std::unique_lock lock(mutex);
+    auto it = chunks.find(pos);
+    if (it == chunks.end()) {
+      return nullptr;
+    }
+    removed = std::move(it->second);
+    chunks.erase(it);
+  }
+  markChunksAroundDirty(pos);
+  return removed;
+}
+
+Chunk *World::chunk(ChunkPos pos) {
+  auto it = chunks.find(pos);
+  return it == chunks.end() ? nullptr : it->second.get();
+}
+
+const Chunk *World::chunk(ChunkPos pos) const {
+  auto it = chunks.find(pos);
+  return it == chunks.end() ? nullptr : it->second.get();
+}
+
+BlockStateId World::block(int x, int y, int z) const {
+  const Chunk *c = chunk({floorDiv16(x), floorDiv16(z)});
+  if (!c) {
+    return BlockRegistry::AIR;
+  }
+  return c->block(floorMod16(x), y, floorMod16(z));
+}
+
+void World::setBlock(int x, int y, int z, BlockStateId state) {
+  bool changed;
+  {
+    std::unique_lock lock(mutex);
+    changed = setBlockUnlocked({x, y, z, state});
+  }
+  if (changed) {
+    markBlockDirty(x, y, z);
+    changedBlocks.push_back({x, y, z, state});
+  }
+}
+
+void World::setBlocks(const std::vector<BlockEdit> &edits) {
+  std::vector<const BlockEdit *> changed;
+  {
+    std::unique_lock lock(mutex);
+    for (const auto &edit : edits) {
+      if (setBlockUnlocked(edit)) {
+        changed.push_back(&edit);
+      }
+    }
+  }
+  for (const BlockEdit *edit : changed) {
+    markBlockDirty(edit->x, edit->y, edit->z);
+    changedBlocks.push_back(*edit);
+  }
+}
+
+std::vector<BlockEdit> World::takeChangedBlocks() {
+  return std::exchange(changedBlocks, {});
+}
+
+void World::setBiome(int x, int y, int z, BiomeId biome) {
+  ChunkPos pos{floorDiv16(x), floorDiv16(z)};
+  {
+    std::unique_lock lock(mutex);
+    Chunk *c = chunk(pos);
+    if (!c) {
+      return;
+    }
+    c->setBiome(floorMod16(x), y, floorMod16(z), biome);
+  }
+  changedBiomes.insert(pos);
+}
+
+std::vector<ChunkPos> World::takeChangedBiomes() {
+  std::vector<ChunkPos> changed(changedBiomes.begin(), changedBiomes.end());
+  changedBiomes.clear();
+  return changed;
+}
+
+void World::setLight(LightType type, const std::vector<LightEdit> &edits) {
+  {
+    std::unique_lock lock(mutex);
+    for (const auto &edit : edits) {
+      Chunk *c = chunk({floorDiv16(edit.x), floorDiv16(edit.z)});
+      ChunkSection *section = c ? c->section(floorDiv16(edit.y)) : nullptr;
+      if (!section) {
+        continue;
+      }
+      unsigned index = (floorMod16(edit.y) * 16 + floorMod16(edit.z)) * 16 +
+                       floorMod16(edit.x);
+      LightArray &light =
+          type == LightType::Block ? section->blockLight : section->skyLight;
+      light.set(index, edit.level);
+    }
+  }
+  for (const auto &edit : edits) {
+    markBlockDirty(edit.x, edit.y, edit.z);
+  }
+}
+
+void World::setChunkLight(ChunkPos pos, std::vector<LightArray> blockLight,
+                          std::vector<LightArray> skyLight) {
+  std::vector<SectionPos> changed;
+  {
+    std::unique_lock lock(mutex);
+    Chunk *c = chunk(pos);
+    if (!c || c->sectionCount() != static_cast<int>(blockLight.size()) ||
+        c->sectionCount() != static_cast<int>(skyLight.size())) {
+      return;
+    }
+    for (int i = 0; i < c->sectionCount(); i++) {
+      ChunkSection &section = *c->section(c->minSection() + i);
+      if (section.blockLight == blockLight[i] &&
+          section.skyLight == skyLight[i]) {
+        continue;
+      }
+      section.blockLight = std::move(blockLight[i]);
+      section.skyLight = std::move(skyLight[i]);
+      changed.push_back({pos.x, c->minSection() + i, pos.z});
+    }
+    c->setHasLight(true);
+  }
+  for (SectionPos section : changed) {
+    markSectionsAroundDirty(section);
+  }
+}
+
+bool World::setBlockUnlocked(const BlockEdit &edit) {
+  Chunk *c = chunk({floorDiv16(edit.x), floorDiv16(edit.z)});
+  if (!c || !c->section(floorDiv16(edit.y))) {
+    return false;
+  }
+  int x = floorMod16(edit.x);
+  int z = floorMod16(edit.z);
+  if (c->block(x, edit.y, z) == edit.state) {
+    return false;
+  }
+  c->setBlock(x, edit.y, z, edit.state);
+  return true;
+}
+
+std::vector<SectionPos> World::takeDirtySections() {
+  std::vector<SectionPos> result(dirtySections.begin(), dirtySections.end());
+  dirtySections.clear();
+  return result;
+}
+
+void World::markBlockDirty(int x, int y, int z) {
+  // Per axis, the sections whose padded copy contains the block: its own,
+  // plus the neighbour on that side when it lies on the section's edge
+  int block[3] = {x, y, z};
+  int first[3];
+  int last[3];
+  for (int axis = 0; axis < 3; axis++) {
+    int section = floorDiv16(block[axis]);
+    int local = floorMod16(block[axis]);
+    first[axis] = local == 0 ? section - 1 : section;
+    last[axis] = local == 15 ? section + 1 : section;
+  }
+
+  for (int sy = first[1]; sy <= last[1]; sy++) {
+    for (int sz = first[2]; sz <= last[2]; sz++) {
+      for (int sx = first[0]; sx <= last[0]; sx++) {
+        SectionPos pos{sx, sy, sz};
+        if (sectionUnlocked(pos)) {
+          dirtySections.insert(pos);
+        }
+      }
+    }
+  }
+}
+
+void World::markChunksAroundDirty(ChunkPos center) {
+  // Border faces, and through the padded copy also edges and corners, of
+  // every surrounding chunk depend on this one
+  for (int dz = -1; dz <= 1; dz++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      const Chunk *c = chunk({center.x + dx, center.z + dz});
+      if (!c) {
+        continue;
+      }
+      for (int i = 0; i < c->sectionCount(); i++) {
+        dirtySections.insert(
+            {center.x + dx, c->minSection() + i, center.z + dz});
+      }
+    }
+  }
+}
+
+void World::markSectionsAroundDirty(SectionPos center) {
+  for (int dy = -1; dy <= 1; dy++) {
+    for (int dz = -1; dz <= 1; dz++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        SectionPos pos{center.x + dx, center.y + dy, center.z + dz};
+        if (sectionUnlocked(pos)) {
+          dirtySections.insert(pos);
+        }
+      }
+    }
+  }
+}
+
+const ChunkSection *World::sectionUnlocked(SectionPos pos) const {
+  const Chunk *c = chunk(pos.chunk());
+  return c ? c->section(pos.y) : nullptr;
+}
+
+void World::extractPadded(SectionPos pos, BlockStateId *out) const {
+  extractBordered(pos, 1, out);
+}
+
+void World::extractBordered(SectionPos pos, int border,
+                            BlockStateId *out) const {
+  std::shared_lock lock(mutex);
+
+  // Each axis splits into the border before the section, the section
+  // itself, and the border after it
+  struct Span {
+    int outStart;
+    int localStart;
+    int length;
+  };
+  const Span spans[3] = {
+      {0, 16 - border, border}, {border, 0, 16}, {16 + border, 0, border}};
+  const int size = borderedSize(border);
+  auto outIndex = [size](int x, int y, int z) {
+    return (y * size + z) * size + x;
+  };
+
+  BlockStateId center[4096];
+  for (int dy = -1; dy <= 1; dy++) {
+    for (int dz = -1; dz <= 1; dz++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        const Span &sx = spans[dx + 1];
+        const Span &sy = spans[dy + 1];
+        const Span &sz = spans[dz + 1];
+        const ChunkSection *section =
+            sectionUnlocked({pos.x + dx, pos.y + dy, pos.z + dz});
+
+        if (dx == 0 && dy == 0 && dz == 0 && section) {
+          // Bulk decode the middle, then copy it in row by row
+          section->blocks.extract(center);
+          for (int y = 0; y < 16; y++) {
+            for (int z = 0; z < 16; z++) {
+              std::copy_n(&center[(y * 16 + z) * 16], 16,
+                          &out[outIndex(border, y + border, z + border)]);
+            }
+          }
+          continue;
+        }
+
+        for (int y = 0; y < sy.length; y++) {
+          for (int z = 0; z < sz.length; z++) {
+            BlockStateId *row =
+                &out[outIndex(sx.outStart, sy.outStart + y, sz.outStart + z)];
+            if (!section) {
+              std::fill_n(row, sx.length, BlockRegistry::AIR);
+              continue;
+            }
+            int base = ((sy.localStart + y) * 16 + sz.localStart + z) * 16 +
+                       sx.localStart;
+            for (int x = 0; x < sx.length; x++) {
+              row[x] = section->blocks.get(base + x);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Visitor>
+void World::forEachRow(const int from[3], const int size[3],
+                       Visitor visit) const {
+  for (int y = 0; y < size[1]; y++) {
+    int worldY = from[1] + y;
+    for (int z = 0; z < size[2]; z++) {
+      int worldZ = from[2] + z;
+      for (int x = 0; x < size[0];) {
+        int worldX = from[0] + x;
+        int length = std::min(size[0] - x, 16 - floorMod16(worldX));
+        const Chunk *c = chunk({floorDiv16(worldX), floorDiv16(worldZ)});
+        const ChunkSection *section =
+            c ? c->section(floorDiv16(worldY)) : nullptr;
+        unsigned index =
+            (floorMod16(worldY) * 16 + floorMod16(worldZ)) * 16 +
+            floorMod16(worldX);
+        visit(c, section, worldY, index, length,
+              (static_cast<size_t>(y) * size[2] + z) * size[0] + x);
+        x += length;
+      }
+    }
+  }
+}
+
+void World::extractBlocks(const int from[3], const int size[3],
+                          BlockStateId missing, BlockStateId *out) const {
+  std::shared_lock lock(mutex);
+  forEachRow(from, size,
+             [&](const Chunk *, const ChunkSection *section, int,
+                 unsigned index, int length, size_t outIndex) {
+               if (!section) {
+                 std::fill_n(out + outIndex, length, missing);
+                 return;
+               }
+               for (int i = 0; i < length; i++) {
+                 out[outIndex + i] = section->blocks.get(index + i);
+               }
+             });
+}
+
+void World::extractLight(LightType type, const int from[3],
+                         const int size[3], uint8_t *out) const {
+  std::shared_lock lock(mutex);
+  forEachRow(from, size,
+             [&](const Chunk *c, const ChunkSection *section, int y,
+                 unsigned index, int length, size_t outIndex) {
+               if (!section) {
+                 bool skyAbove =
+                     type == LightType::Sky && c &&
+                     floorDiv16(y) >= c->minSection() + c->sectionCount();
+                 std::fill_n(out + outIndex, length, skyAbove ? 15 : 0);
+                 return;
+               }
+               const LightArray &light = type == LightType::Block
+                                             ? section->blockLight
+                                             : section->skyLight;
+               for (int i = 0; i < length; i++) {
+                 out[outIndex + i] = light.get(index + i);
+               }
+             });
+}
+
+void World::extractBorderedLight(SectionPos pos, int border,
+                                 uint8_t *out) const {
+  std::shared_lock lock(mutex);
+  const int from[3] = {pos.x * 16 - border, pos.y * 16 - border,
+                       pos.z * 16 - border};
+  const int size[3] = {borderedSize(border), borderedSize(border),
+                       borderedSize(border)};
+  forEachRow(from, size,
+             [&](const Chunk *c, const ChunkSection *section, int y,
+                 unsigned index, int length, size_t outIndex) {
+               if (!section) {
+                 bool skyAbove =
+                     c && floorDiv16(y) >= c->minSection() + c->sectionCount();
+                 std::fill_n(out + outIndex, length, skyAbove ? 15 : 0);
+                 return;
+               }
+               for (int i = 0; i < length; i++) {
+                 out[outIndex + i] = section->blockLight.get(index + i) << 4 |
+                                     section->skyLight.get(index + i);
+               }
+             });
+}
+
+void World::extractSurfaceBiomes(ChunkPos pos, int border, BiomeId missing,
+                                 BiomeId *out) const {
+  std::shared_lock lock(mutex);
+  int size = borderedSize(border);
+  for (int z = 0; z < size; z++) {
+    for (int x = 0; x < size; x++) {
+      int blockX = pos.x * 16 - border + x;
+      int blockZ = pos.z * 16 - border + z;
+      const Chunk *c = chunk({floorDiv16(blockX), floorDiv16(blockZ)});
+      out[z * size + x] =
+          c ? c->surfaceBiome(floorMod16(blockX), floorMod16(blockZ))
+            : missing;
+    }
+  }
+}
+
+size_t World::memoryUsage() const {
+  size_t total = 0;
+  for (const auto &[pos, chunk] : chunks) {
+    total += chunk->memoryUsage();
+  }
+  return total;
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "coords.hpp"
+#include "nbt.hpp"
+#include "registry.hpp"
+
+// Fixed size array of small ids stored as a local palette plus bit packed
+// indices into it, using the same layout as vanilla (1.16+) so chunk data
+// can be adopted without re-encoding: each long holds 64 / bits entries and
+// entries never straddle two longs. Indices grow from 0 bits (a single value
+// for the whole container) up to 16 as the palette fills up.
+template <unsigned Size> class PalettedContainer {
+public:
+  explicit PalettedContainer(uint16_t value = 0);
+
+  // Branch free: single value containers keep one zeroed long and a zero
+  // mask, so they take the same path as packed ones.
+  uint16_t get(unsigned index) const {
+    unsigned cell = (index * divideMul) >> DIVIDE_SHIFT;
+    unsigned shift = (index - cell * perLong) * bits;
+    return palette[(data[cell] >> shift) & mask];
+  }
+  void set(unsigned index, uint16_t value);
+  void fill(uint16_t value);
+
+  // Decodes every entry in index order into out[0..Size)
+  void extract(uint16_t *out) const;
+
+  bool isSingleValue() const { return bits == 0; }
+  const std::vector<uint16_t> &paletteEntries() const { return palette; }
+  unsigned bitsPerEntry() const { return bits; }
+
+  // Adopts vanilla packed data. The palette has already been mapped to
+  // global ids, the data may be empty for single value containers.
+  void load(std::vector<uint16_t> newPalette, NbtLongArray packed);
+  // Drops unused palette entries and repacks with as few bits as possible
+  void compact();
+
+  size_t memoryUsage() const {
+    return sizeof(*this) + palette.capacity() * sizeof(uint16_t) +
+           data.capacity() * sizeof(uint64_t);
+  }
+
+private:
+  // i / perLong == (i * divideMul) >> DIVIDE_SHIFT for every i < 4096
+  static constexpr unsigned DIVIDE_SHIFT = 20;
+
+  std::vector<uint16_t> palette;
+  std::vector<uint64_t> data;
+  uint8_t bits = 0;
+  uint8_t perLong = 0;
+  uint64_t mask = 0;
+  uint32_t divideMul = 0;
+
+  void resize(unsigned newBits);
+  void setBits(unsigned newBits);
+};
+
+extern template class PalettedContainer<4096>;
+extern template class PalettedContainer<64>;
+
+enum class LightType : uint8_t { Block, Sky };
+
+// Light levels of a section, 4 bits per block packed two to a byte with the
+// lower index in the low nibble, like vanilla's BlockLight and SkyLight
+// arrays. A section lit at one level throughout stores nothing.
+class LightArray {
+public:
+  explicit LightArray(uint8_t level = 0) : uniform(level) {}
+
+  uint8_t get(unsigned index) const {
+    return data.empty() ? uniform : data[index >> 1] >> (index & 1) * 4 & 15;
+  }
+  void set(unsigned index, uint8_t level);
+  // Packs 4096 levels indexed (y * 16 + z) * 16 + x
+  void assign(const uint8_t *levels);
+  // Adopts a vanilla array, which must be 2048 bytes
+  void load(std::span<const uint8_t> nibbles);
+
+  bool isUniform() const { return data.empty(); }
+  bool operator==(const LightArray &other) const = default;
+
+  size_t memoryUsage() const { return data.capacity(); }
+
+private:
+  std::vector<uint8_t> data;
+  uint8_t uniform;
+};
+
+struct ChunkSection {
+  // Index (y * 16 + z) * 16 + x
+  PalettedContainer<4096> blocks{BlockRegistry::AIR};
+  // 4x4x4 cells of 4 blocks each, index (y * 4 + z) * 4 + x
+  PalettedContainer<64> biomes{BiomeRegistry::PLAINS};
+  LightArray blockLight{0};
+  LightArray skyLight{15};
+
+  size_t memoryUsage() const {
+    return blocks.memoryUsage() + biomes.memoryUsage() +
+           blockLight.memoryUsage() + skyLight.memoryUsage();
+  }
+};
+
+// A 16 block wide column of sections
+class Chunk {
+public:
+  Chunk(ChunkPos pos, int minSection, int sectionCount);
+
+  // Decodes a 1.18+ chunk. Palettes are mapped to global ids and the packed
+  // data is adopted as is. Stored light is kept if the chunk says it's
+  // complete.
+  static std::unique_ptr<Chunk> fromNbt(const ChunkNbt &nbt,
+                                        BlockRegistry &blocks,
+                                        BiomeRegistry &biomes);
+
+  ChunkPos pos() const { return position; }
+  int minSection() const { return minSectionY; }
+  int sectionCount() const { return sections.size(); }
+  // Whether the sections' light levels are valid
+  bool hasLight() const { return lightValid; }
+  void setHasLight(bool valid) { lightValid = valid; }
+
+  // Nullptr above or below the world
+  ChunkSection *section(int sectionY);
+  const ChunkSection *section(int sectionY) const;
+
+  // x and z are local to the chunk, y is the world height
+  BlockStateId block(int x, int y, int z) const;
+  void setBlock(int x, int y, int z, BlockStateId state);
+  // Sets the 4x4x4 cell holding the block
+  void setBiome(int x, int y, int z, BiomeId biome);
+  // The biome at the column's highest block that isn't air, or at the top
+  // of the world if there is none
+  BiomeId surfaceBiome(int x, int z) const;
+
+  size_t memoryUsage() const;
+
+private:
+  ChunkPos position;
+  int minSectionY;
+  std::vector<ChunkSection> sections;
+  bool lightValid = false;
+
+  void loadLight(const ChunkNbt &nbt);
+};
+
+// Side length of a section extracted along with a one block border
+const int PADDED_SIZE = 18;
+const int PADDED_VOLUME = PADDED_SIZE * PADDED_SIZE * PADDED_SIZE;
+
+inline int paddedIndex(int x, int y, int z) {
+  return (y * PADDED_SIZE + z) * PADDED_SIZE + x;
+}
+
+// Side length of a section extracted with a border of the given width
+inline int borderedSize(int border) { return 16 + 2 * border; }
+
+struct BlockEdit {
+  int x;
+  int y;
+  int z;
+  BlockStateId state;
+};
+
+struct LightEdit {
+  int x;
+  int y;
+  int z;
+  uint8_t level;
+};
+
+// All loaded chunks. Only the main thread modifies the world; it takes the
+// lock exclusively when doing so. Worker threads may call the const methods
+// marked as locked below at any time.
+class World {
+public:
+  World(BlockRegistry &blocks, BiomeRegistry &biomes);
+
+  BlockRegistry &blockRegistry() { return blocks; }
+  BiomeRegistry &biomeRegistry() { return biomes; }
+
+  // Both mark the chunk and the chunks around it dirty. The removed chunk
+  // is handed back, so it can be freed without holding the lock.
+  void insertChunk(std::unique_ptr<Chunk> chunk);
+  std::unique_ptr<Chunk> removeChunk(ChunkPos pos);
+  Chunk *chunk(ChunkPos pos);
+  const Chunk *chunk(ChunkPos pos) const;
+  size_t chunkCount() const { return chunks.size(); }
+
+  BlockStateId block(int x, int y, int z) const;
+  // Edits that don't change the block are ignored, so they don't cause
+  // remeshes
+  void setBlock(int x, int y, int z, BlockStateId state);
+  // Takes the lock once for the whole batch, like the blocks of an explosion
+  void setBlocks(const std::vector<BlockEdit> &edits);
+  // Blocks that changed since the last call, for relighting
+  std::vector<BlockEdit> takeChangedBlocks();
+  // Like vanilla's /fillbiome, sets the 4x4x4 cell holding the block
+  void setBiome(int x, int y, int z, BiomeId biome);
+  // Chunks whose biomes changed since the last call, each listed once
+  std::vector<ChunkPos> takeChangedBiomes();
+
+  // Both mark the sections whose padded copy changed dirty. setChunkLight
+  // takes a LightArray per section, and is ignored if the chunk was
+  // replaced by one of another height since.
+  void setLight(LightType type, const std::vector<LightEdit> &edits);
+  void setChunkLight(ChunkPos pos, std::vector<LightArray> blockLight,
+                     std::vector<LightArray> skyLight);
+
+  // Sections whose mesh may have changed since the last call, each listed
+  // once however often it was touched: the sections of edited blocks, their
+  // neighbours when the block is in the neighbour's padded border, and all
+  // sections around inserted or removed chunks.
+  std::vector<SectionPos> takeDirtySections();
+
+  // Locked. Copies a section plus a one block border taken from its
+  // neighbours into out[PADDED_VOLUME], laid out by paddedIndex() with the
+  // section's block (0, 0, 0) at padded (1, 1, 1). Missing neighbours read
+  // as air.
+  void extractPadded(SectionPos pos, BlockStateId *out) const;
+  // Locked. Same with a border of 1-16 blocks, into borderedSize(border)^3
+  // blocks indexed (y * size + z) * size + x. A border of 1 gives the padded
+  // layout.
+  void extractBordered(SectionPos pos, int border, BlockStateId *out) const;
+  // Locked. The light of the same box, block light << 4 | sky light
+  void extractBorderedLight(SectionPos pos, int border, uint8_t *out) const;
+  // Locked. Copy the box of size blocks starting at from, indexed
+  // (y * size z + z) * size x + x. Blocks outside loaded sections read as
+  // missing. Light there is 0, except sky light above a chunk, which is 15.
+  void extractBlocks(const int from[3], const int size[3], BlockStateId missing,
+                     BlockStateId *out) const;
+  void extractLight(LightType type, const int from[3], const int size[3],
+                    uint8_t *out) const;
+  // Locked. The surface biome of each column of the chunk plus a border of
+  // 0-16 columns, borderedSize(border)^2 of them indexed z * size + x.
+  // Columns of chunks that aren't loaded read as missing.
+  void extractSurfaceBiomes(ChunkPos pos, int border, BiomeId missing,
+                            BiomeId *out) const;
+
+  size_t memoryUsage() const;
+
+private:
+  BlockRegistry &blocks;
+  BiomeRegistry &biomes;
+  mutable std::shared_mutex mutex;
+  std::unordered_map<ChunkPos, std::unique_ptr<Chunk>> chunks;
+  // Main thread only
+  std::unordered_set<SectionPos> dirtySections;
+  std::vector<BlockEdit> changedBlocks;
+  std::unordered_set<ChunkPos> changedBiomes;
+
+  const ChunkSection *sectionUnlocked(SectionPos pos) const;
+  // Returns whether the block changed
+  bool setBlockUnlocked(const BlockEdit &edit);
+  void markBlockDirty(int x, int y, int z);
+  void markChunksAroundDirty(ChunkPos center);
+  void markSectionsAroundDirty(SectionPos center);
+  // Calls visit(chunk, section, y, index, length, outIndex) for each run of
+  // up to 16 blocks along x of the box that lie in one section: index is
+  // the first block's index in the section, outIndex its index in the box.
+  // chunk and section are null where nothing is loaded. Lock held.
+  template <typename Visitor>
+  void forEachRow(const int from[3], const int size[3], Visitor visit) const;
+};
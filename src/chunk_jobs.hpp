@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "coords.hpp"
+#include "mpsc_queue.hpp"
+#include "thread_pool.hpp"
+
+// Work done per chunk or section on the thread pool, like meshing, lighting
+// or blending biome tints. Positions (Pos or SectionPos) are queued on
+// the main thread and started nearest to the camera first, a limited number
+// per worker at a time, so they can still be reordered as the camera moves.
+//
+// A position queued again while its job runs gets a new job, since the
+// running one may have read the world too early. Each job is given a version
+// and only the latest version's result is handed back. Result needs pos and
+// version members.
+template <typename Pos, typename Result> class ChunkJobQueue {
+public:
+  using Job = std::function<Result()>;
+
+  // The pool must be drained before the queue is destroyed
+  ChunkJobQueue(ThreadPool &pool, size_t jobsPerWorker)
+      : pool(pool), jobsPerWorker(jobsPerWorker) {}
+
+  // Main thread, the functions below as well
+  void request(Pos pos) {
+    queued.insert(pos);
+    latestVersions.erase(pos);
+  }
+  // Hands back a result that needed no job, replacing any queued or
+  // running one
+  void complete(Pos pos, Result result) {
+    queued.erase(pos);
+    uint64_t version = nextVersion++;
+    latestVersions[pos] = version;
+    result.version = version;
+    inFlight++;
+    completed.push(std::move(result));
+  }
+  // Drops the queued job and the result of its running one
+  void cancel(Pos pos) {
+    queued.erase(pos);
+    latestVersions.erase(pos);
+  }
+  bool queuedOrRunning(Pos pos) const {
+    return queued.contains(pos) || latestVersions.contains(pos);
+  }
+  bool running(Pos pos) const { return latestVersions.contains(pos); }
+  // Including finished jobs whose results haven't been taken yet
+  size_t size() const { return queued.size() + inFlight; }
+
+  // Starts jobs for the queued positions nearest to center. makeJob(pos)
+  // reads what the job needs on the main thread and returns the job, or an
+  // empty one to drop the position.
+  template <typename MakeJob> void dispatch(Pos center, MakeJob makeJob) {
+    size_t limit = pool.size() * jobsPerWorker;
+    if (queued.empty() || inFlight >= limit) {
+      return;
+    }
+    std::vector<Pos> nearest(queued.begin(), queued.end());
+    size_t count = std::min(nearest.size(), limit - inFlight);
+    std::partial_sort(nearest.begin(), nearest.begin() + count, nearest.end(),
+                      [center](Pos a, Pos b) {
+                        return distanceSquared(a, center) <
+                               distanceSquared(b, center);
+                      });
+    for (size_t i = 0; i < count; i++) {
+      Pos pos = nearest[i];
+      queued.erase(pos);
+      Job job = makeJob(pos);
+      if (!job) {
+        continue;
+      }
+      uint64_t version = nextVersion++;
+      latestVersions[pos] = version;
+      inFlight++;
+      pool.submit([this, job = std::move(job), version] {
+        Result result = job();
+        result.version = version;
+        completed.push(std::move(result));
+      });
+    }
+  }
+
+  // Never blocks. Skips results that were superseded or cancelled.
+  std::optional<Result> poll() {
+    while (auto result = completed.pop()) {
+      inFlight--;
+      auto it = latestVersions.find(result->pos);
+      if (it == latestVersions.end() || it->second != result->version) {
+        continue;
+      }
+      latestVersions.erase(it);
+      return result;
+    }
+    return std::nullopt;
+  }
+
+private:
+  ThreadPool &pool;
+  size_t jobsPerWorker;
+  MpscQueue<Result> completed;
+  // Jobs whose results haven't been taken off completed yet
+  size_t inFlight = 0;
+  uint64_t nextVersion = 1;
+  std::unordered_set<Pos> queued;
+  std::unordered_map<Pos, uint64_t> latestVersions;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+struct ChunkPos {
+  int32_t x;
+  int32_t z;
+
+  bool operator==(const ChunkPos &other) const = default;
+};
+
+template <> struct std::hash<ChunkPos> {
+  size_t operator()(const ChunkPos &pos) const {
+    return std::hash<uint64_t>()(static_cast<uint64_t>(pos.x) << 32 ^
+                                 static_cast<uint32_t>(pos.z));
+  }
+};
+
+// Chunk section coordinates, each section is 16x16x16 blocks
+struct SectionPos {
+  int32_t x;
+  int32_t y;
+  int32_t z;
+
+  bool operator==(const SectionPos &other) const = default;
+
+  ChunkPos chunk() const { return {x, z}; }
+};
+
+template <> struct std::hash<SectionPos> {
+  size_t operator()(const SectionPos &pos) const {
+    uint64_t key = (static_cast<uint64_t>(pos.x) & 0x3fffff) << 42 |
+                   (static_cast<uint64_t>(pos.z) & 0x3fffff) << 20 |
+                   (static_cast<uint64_t>(pos.y) & 0xfffff);
+    return std::hash<uint64_t>()(key);
+  }
+};
+
+inline int64_t distanceSquared(ChunkPos a, ChunkPos b) {
+  int64_t dx = a.x - b.x;
+  int64_t dz = a.z - b.z;
+  return dx * dx + dz * dz;
+}
+
+inline int64_t distanceSquared(SectionPos a, SectionPos b) {
+  int64_t dx = a.x - b.x;
+  int64_t dy = a.y - b.y;
+  int64_t dz = a.z - b.z;
+  return dx * dx + dy * dy + dz * dz;
+}
+
+inline int32_t floorDiv16(int32_t value) { return value >> 4; }
+inline int32_t floorMod16(int32_t value) { return value & 15; }
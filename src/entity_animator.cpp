@@ -0,0 +1,87 @@
+#include "entity_animator.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Entities claimed at once, enough to make a claim worth its atomic
+const size_t BATCH_SIZE = 64;
+
+} // namespace
+
+uint32_t EntityAnimator::add(const Skeleton &skeleton,
+                             const AnimationClip &clip, double startTime) {
+  uint32_t entity = entities.size();
+  uint32_t clock = clocks.size();
+  clocks.push_back(0);
+  entities.push_back({&skeleton, &clip, startTime,
+                      static_cast<uint32_t>(totalBones),
+                      static_cast<uint32_t>(batch.vec3Count()),
+                      static_cast<uint32_t>(batch.quatCount())});
+  for (const BoneAnimation &bone : clip.bones) {
+    if (!bone.position.empty()) {
+      batch.addVec3(bone.position, clock);
+    }
+    if (!bone.scale.empty()) {
+      batch.addVec3(bone.scale, clock);
+    }
+    if (!bone.rotation.empty()) {
+      batch.addQuat(bone.rotation, clock);
+    }
+  }
+  totalBones += skeleton.size();
+  return entity;
+}
+
+void EntityAnimator::clear() {
+  entities.clear();
+  batch.clear();
+  clocks.clear();
+  totalBones = 0;
+}
+
+void EntityAnimator::update(double time, Mat4 *out, ThreadPool &pool) {
+  for (size_t i = 0; i < entities.size(); i++) {
+    const Entity &entity = entities[i];
+    clocks[i] = entity.clip->time(time - entity.startTime);
+  }
+  batch.evaluate(clocks);
+
+  pool.parallelBatches(entities.size(), BATCH_SIZE,
+                       [this, out](size_t, size_t first, size_t end) {
+                         poseRange(first, end, out);
+                       });
+}
+
+void EntityAnimator::poseRange(size_t first, size_t end, Mat4 *out) const {
+  // Children read their parent's matrix, which is slow from write combined
+  // memory, so each entity is posed here and then copied out
+  std::vector<BonePose> poses;
+  std::vector<Mat4> matrices;
+  for (size_t i = first; i < end; i++) {
+    const Entity &entity = entities[i];
+    size_t bones = entity.skeleton->size();
+    poses.assign(bones, BonePose{});
+    matrices.resize(bones);
+
+    uint32_t vec3 = entity.firstVec3;
+    uint32_t quat = entity.firstQuat;
+    for (const BoneAnimation &bone : entity.clip->bones) {
+      BonePose &pose = poses[bone.bone];
+      if (!bone.position.empty()) {
+        pose.translation = batch.vec3(vec3++);
+      }
+      if (!bone.scale.empty()) {
+        pose.scale = batch.vec3(vec3++);
+      }
+      if (!bone.rotation.empty()) {
+        pose.rotation = batch.quat(quat++);
+      }
+    }
+
+    entity.skeleton->pose(poses.data(), matrices.data());
+    std::memcpy(out + entity.firstBone, matrices.data(),
+                bones * sizeof(Mat4));
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "entity_model.hpp"
+#include "math.hpp"
+#include "thread_pool.hpp"
+#include "transform_batch.hpp"
+
+// Poses every animated entity once a frame. Their bone tracks are evaluated
+// together in a TransformBatch, then the entities are split into batches
+// that the pool's workers and the calling thread take turns claiming, each
+// entity's bones posed in a single pass over its flattened skeleton.
+//
+// Bones are laid out entity after entity, each entity's in its skeleton's
+// order, so the matrices can be written straight into a mapped buffer the
+// shaders index.
+class EntityAnimator {
+public:
+  // The skeleton and clip have to outlive the animator. The clip starts
+  // playing at startTime. Returns the entity's index.
+  uint32_t add(const Skeleton &skeleton, const AnimationClip &clip,
+               double startTime);
+  void clear();
+
+  size_t size() const { return entities.size(); }
+  size_t boneCount() const { return totalBones; }
+  uint32_t firstBone(uint32_t entity) const {
+    return entities[entity].firstBone;
+  }
+
+  // Writes the model space matrix of every bone at time to out, which has
+  // room for boneCount(). out is only written, never read, so it can be
+  // write combined memory.
+  void update(double time, Mat4 *out, ThreadPool &pool);
+
+private:
+  struct Entity {
+    const Skeleton *skeleton;
+    const AnimationClip *clip;
+    double startTime;
+    uint32_t firstBone;
+    // Its channels in the batch, in the order of the clip's bones
+    uint32_t firstVec3;
+    uint32_t firstQuat;
+  };
+
+  std::vector<Entity> entities;
+  TransformBatch batch;
+  // Each entity's time into its clip
+  std::vector<float> clocks;
+  size_t totalBones = 0;
+
+  void poseRange(size_t first, size_t end, Mat4 *out) const;
+};
@@ -0,0 +1,350 @@
+#include "entity_model.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "json.hpp"
+
+namespace {
+
+// Plain numbers are often written as strings, anything else is Molang
+float parseNumber(const std::string &text) {
+  size_t parsed = 0;
+  float value = 0;
+  try {
+    value = std::stof(text, &parsed);
+  } catch (const std::logic_error &) {
+  }
+  if (parsed == 0 || parsed != text.size()) {
+    throw std::runtime_error(
+        fmt::format("unsupported Molang expression: {}", text));
+  }
+  return value;
+}
+
+float readNumber(const JsonValue &json) {
+  return json.isNumber() ? json.asNumber() : parseNumber(json.asString());
+}
+
+// Single numbers are the same on every axis, as for uniform scales
+Vec3 readVec3(const JsonValue &json) {
+  if (!json.isArray()) {
+    float value = readNumber(json);
+    return {value, value, value};
+  }
+  const auto &array = json.asArray();
+  if (array.size() != 3) {
+    throw std::runtime_error("expected 3 components");
+  }
+  return {readNumber(array[0]), readNumber(array[1]), readNumber(array[2])};
+}
+
+const JsonValue &firstGeometry(const JsonValue &file) {
+  if (const JsonValue *geometries = file.find("minecraft:geometry")) {
+    if (!geometries->asArray().empty()) {
+      return geometries->asArray()[0];
+    }
+  } else if (file.isObject()) {
+    for (const auto &[key, value] : file.asObject()) {
+      if (key.starts_with("geometry.")) {
+        return value;
+      }
+    }
+  }
+  throw std::runtime_error("no geometry in file");
+}
+
+// A channel is either a constant or keyframes keyed by time, each either a
+// value or a pre and post value around a jump
+std::vector<Keyframe<Vec3>> readChannel(const JsonValue &json) {
+  if (!json.isObject()) {
+    return {{0, readVec3(json), Interpolation::Step}};
+  }
+  std::vector<Keyframe<Vec3>> keyframes;
+  for (const auto &[key, value] : json.asObject()) {
+    float time = parseNumber(key);
+    if (!value.isObject()) {
+      keyframes.push_back({time, readVec3(value)});
+      continue;
+    }
+    std::string mode = value.getString("lerp_mode", "linear");
+    Interpolation interpolation = Interpolation::Linear;
+    if (mode == "catmullrom") {
+      interpolation = Interpolation::CatmullRom;
+    } else if (mode == "step") {
+      interpolation = Interpolation::Step;
+    }
+    const JsonValue *pre = value.find("pre");
+    const JsonValue *post = value.find("post");
+    if (!pre && !post) {
+      throw std::runtime_error(fmt::format("keyframe {} has no value", key));
+    }
+    if (pre) {
+      keyframes.push_back({time, readVec3(*pre), interpolation});
+    }
+    if (post) {
+      keyframes.push_back({time, readVec3(*post), interpolation});
+    }
+  }
+  return keyframes;
+}
+
+// Bedrock to world axes, see EntityModel
+Vec3 convertPosition(Vec3 position) {
+  return {-position.x, position.y, position.z};
+}
+Vec3 convertRotation(Vec3 degrees) {
+  return {-degrees.x, -degrees.y, degrees.z};
+}
+
+enum Face { NORTH, SOUTH, EAST, WEST, UP, DOWN, FACE_COUNT };
+
+const char *const FACE_NAMES[FACE_COUNT] = {"north", "south", "east",
+                                            "west",  "up",    "down"};
+const Vec3 FACE_NORMALS[FACE_COUNT] = {{0, 0, -1}, {0, 0, 1}, {1, 0, 0},
+                                       {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}};
+// Whether each corner is at the cube's maximum on x, y and z, going round
+// the face from the top left corner of its texture
+const uint8_t FACE_CORNERS[FACE_COUNT][4][3] = {
+    {{1, 1, 0}, {0, 1, 0}, {0, 0, 0}, {1, 0, 0}},
+    {{0, 1, 1}, {1, 1, 1}, {1, 0, 1}, {0, 0, 1}},
+    {{1, 1, 1}, {1, 1, 0}, {1, 0, 0}, {1, 0, 1}},
+    {{0, 1, 0}, {0, 1, 1}, {0, 0, 1}, {0, 0, 0}},
+    {{0, 1, 0}, {1, 1, 0}, {1, 1, 1}, {0, 1, 1}},
+    {{0, 0, 1}, {1, 0, 1}, {1, 0, 0}, {0, 0, 0}},
+};
+
+// Texel corners of a face's texture, u1 and v1 can be less than u0 and v0
+// for flipped faces
+struct FaceUv {
+  float u0, v0, u1, v1;
+};
+
+// Box UV unwraps the cube around its uv corner, like vanilla's models
+std::array<FaceUv, FACE_COUNT> boxUv(float u, float v, Vec3 size,
+                                     bool mirror) {
+  float w = size.x, h = size.y, d = size.z;
+  std::array<FaceUv, FACE_COUNT> faces = {{
+      {u + d, v + d, u + d + w, v + d + h},
+      {u + 2 * d + w, v + d, u + 2 * d + 2 * w, v + d + h},
+      {u, v + d, u + d, v + d + h},
+      {u + d + w, v + d, u + 2 * d + w, v + d + h},
+      {u + d + w, v + d, u + d, v},
+      {u + d + 2 * w, v, u + d + w, v + d},
+  }};
+  if (mirror) {
+    std::swap(faces[EAST], faces[WEST]);
+    for (FaceUv &face : faces) {
+      std::swap(face.u0, face.u1);
+    }
+  }
+  return faces;
+}
+
+uint32_t packNormalBone(Vec3 normal, uint32_t bone) {
+  auto snorm = [](float value) {
+    return static_cast<uint32_t>(static_cast<int8_t>(std::round(value * 127)))
+           & 0xff;
+  };
+  return snorm(normal.x) | snorm(normal.y) << 8 | snorm(normal.z) << 16 |
+         bone << 24;
+}
+
+Vec3 rotate(Quat q, Vec3 v) {
+  Quat rotated = q * Quat{v.x, v.y, v.z, 0} * Quat{-q.x, -q.y, -q.z, q.w};
+  return {rotated.x, rotated.y, rotated.z};
+}
+
+void addCube(EntityModel &model, const JsonValue &cube, uint32_t bone,
+             float textureWidth, float textureHeight) {
+  Vec3 origin = readVec3(cube.require("origin"));
+  Vec3 size = readVec3(cube.require("size"));
+  float inflate = cube.getNumber("inflate", 0);
+  Vec3 from{-(origin.x + size.x), origin.y, origin.z};
+  from = from - Vec3{inflate, inflate, inflate};
+  Vec3 to = from + size + Vec3{inflate, inflate, inflate} * 2;
+
+  // Faces without a texture aren't drawn
+  std::array<std::optional<FaceUv>, FACE_COUNT> uvs;
+  if (const JsonValue *uv = cube.find("uv"); uv && uv->isArray()) {
+    auto box = boxUv(readNumber(uv->asArray().at(0)),
+                     readNumber(uv->asArray().at(1)), size,
+                     cube.getBool("mirror", false));
+    std::copy(box.begin(), box.end(), uvs.begin());
+  } else if (uv) {
+    for (int face = 0; face < FACE_COUNT; face++) {
+      const JsonValue *faceUv = uv->find(FACE_NAMES[face]);
+      if (!faceUv) {
+        continue;
+      }
+      const auto &corner = faceUv->require("uv").asArray();
+      const auto &extent = faceUv->require("uv_size").asArray();
+      float u = readNumber(corner.at(0)), v = readNumber(corner.at(1));
+      uvs[face] = FaceUv{u, v, u + readNumber(extent.at(0)),
+                         v + readNumber(extent.at(1))};
+    }
+  }
+
+  Quat rotation;
+  Vec3 pivot;
+  if (const JsonValue *turn = cube.find("rotation")) {
+    rotation = eulerDegrees(convertRotation(readVec3(*turn)));
+    if (const JsonValue *center = cube.find("pivot")) {
+      pivot = convertPosition(readVec3(*center));
+    }
+  }
+
+  for (int face = 0; face < FACE_COUNT; face++) {
+    if (!uvs[face]) {
+      continue;
+    }
+    const FaceUv &uv = *uvs[face];
+    auto first = static_cast<uint32_t>(model.vertices.size());
+    uint32_t normalBone =
+        packNormalBone(rotate(rotation, FACE_NORMALS[face]), bone);
+    const float us[4] = {uv.u0, uv.u1, uv.u1, uv.u0};
+    const float vs[4] = {uv.v0, uv.v0, uv.v1, uv.v1};
+    for (int corner = 0; corner < 4; corner++) {
+      const uint8_t *max = FACE_CORNERS[face][corner];
+      Vec3 position{max[0] ? to.x : from.x, max[1] ? to.y : from.y,
+                    max[2] ? to.z : from.z};
+      position = pivot + rotate(rotation, position - pivot);
+      model.vertices.push_back({{position.x, position.y, position.z},
+                                {us[corner] / textureWidth,
+                                 vs[corner] / textureHeight},
+                                normalBone});
+    }
+    for (uint32_t index : {0, 1, 2, 0, 2, 3}) {
+      model.indices.push_back(first + index);
+    }
+  }
+}
+
+} // namespace
+
+EntityModel EntityModel::load(const std::string &path) {
+  JsonValue file = JsonValue::parseFile(path);
+  try {
+    const JsonValue &geometry = firstGeometry(file);
+    EntityModel model;
+    const JsonValue *description = geometry.find("description");
+    if (description) {
+      model.identifier = description->getString("identifier", "");
+    }
+
+    // 1.8 files keep the texture size in the geometry itself
+    const JsonValue &sizes = description ? *description : geometry;
+    float textureWidth = sizes.getNumber(
+        description ? "texture_width" : "texturewidth", 64);
+    float textureHeight = sizes.getNumber(
+        description ? "texture_height" : "textureheight", 64);
+
+    std::vector<Bone> bones;
+    const JsonValue *list = geometry.find("bones");
+    if (list) {
+      for (const auto &json : list->asArray()) {
+        Bone &bone = bones.emplace_back();
+        bone.name = json.getString("name", "");
+        bone.parent = json.getString("parent", "");
+        if (const JsonValue *pivot = json.find("pivot")) {
+          bone.pivot = convertPosition(readVec3(*pivot));
+        }
+        if (const JsonValue *rotation = json.find("rotation")) {
+          bone.rotation = convertRotation(readVec3(*rotation));
+        }
+      }
+    }
+    model.skeleton = Skeleton(bones);
+    // The bone index shares a byte with the normal
+    if (model.skeleton.size() > 256) {
+      throw std::runtime_error("more than 256 bones");
+    }
+
+    for (size_t i = 0; list && i < bones.size(); i++) {
+      const JsonValue *cubes = list->asArray()[i].find("cubes");
+      if (!cubes) {
+        continue;
+      }
+      uint32_t bone = *model.skeleton.find(bones[i].name);
+      for (const auto &cube : cubes->asArray()) {
+        addCube(model, cube, bone, textureWidth, textureHeight);
+      }
+    }
+    return model;
+  } catch (const std::exception &e) {
+    throw std::runtime_error(fmt::format("{}: {}", path, e.what()));
+  }
+}
+
+AnimationClip AnimationClip::load(const std::string &path,
+                                  const Skeleton &skeleton) {
+  JsonValue file = JsonValue::parseFile(path);
+  try {
+    const JsonValue *animations = file.find("animations");
+    if (!animations || animations->asObject().empty()) {
+      throw std::runtime_error("no animations in file");
+    }
+    const JsonValue &animation = animations->asObject()[0].second;
+
+    AnimationClip clip;
+    const JsonValue *loop = animation.find("loop");
+    clip.loop = loop && loop->isBool() && loop->asBool();
+    clip.length = animation.getNumber("animation_length", 0);
+    const JsonValue *bones = animation.find("bones");
+    if (!bones) {
+      return clip;
+    }
+    for (const auto &[name, channels] : bones->asObject()) {
+      std::optional<uint32_t> bone = skeleton.find(name);
+      if (!bone) {
+        continue;
+      }
+      BoneAnimation &animated = clip.bones.emplace_back();
+      animated.bone = *bone;
+      if (const JsonValue *position = channels.find("position")) {
+        std::vector<Keyframe<Vec3>> offsets = readChannel(*position);
+        for (auto &keyframe : offsets) {
+          keyframe.value = convertPosition(keyframe.value);
+        }
+        animated.position = Track<Vec3>(std::move(offsets));
+      }
+      if (const JsonValue *scale = channels.find("scale")) {
+        animated.scale = Track<Vec3>(readChannel(*scale));
+      }
+      if (const JsonValue *rotation = channels.find("rotation")) {
+        std::vector<Keyframe<Quat>> turns;
+        for (const auto &keyframe : readChannel(*rotation)) {
+          Quat turn = eulerDegrees(convertRotation(keyframe.value));
+          turns.push_back({keyframe.time, turn,
+                           keyframe.interpolation});
+        }
+        animated.rotation = Track<Quat>(std::move(turns));
+      }
+      float end = std::max({animated.position.endTime(),
+                            animated.rotation.endTime(),
+                            animated.scale.endTime()});
+      // Clips without a length last until their last keyframe
+      if (!animation.find("animation_length")) {
+        clip.length = std::max(clip.length, end);
+      }
+    }
+    return clip;
+  } catch (const std::exception &e) {
+    throw std::runtime_error(fmt::format("{}: {}", path, e.what()));
+  }
+}
+
+float AnimationClip::time(double seconds) const {
+  if (length <= 0) {
+    return 0;
+  }
+  if (loop) {
+    return static_cast<float>(std::fmod(std::max(seconds, 0.0), length));
+  }
+  return static_cast<float>(std::clamp<double>(seconds, 0, length));
+}
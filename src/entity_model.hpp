@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "skeleton.hpp"
+#include "timeline.hpp"
+
+// Vertex of an entity model in its rest pose, in model units. Posed by the
+// matrix of its bone in the shader.
+struct EntityVertex {
+  float position[3];
+  // 0-1 across the model's texture
+  float uv[2];
+  // Normal x, y, z as snorm8 | bone
+  uint32_t normalBone;
+};
+
+static_assert(sizeof(EntityVertex) == 24);
+
+// An entity model from a Bedrock geometry file (.geo.json), as Blockbench
+// exports them. Bedrock's x axis points the other way to the world's and
+// its x and y rotations turn the other way, both are converted on loading
+// like Blockbench does.
+struct EntityModel {
+  std::string identifier;
+  Skeleton skeleton;
+  // The cubes of every bone, as two triangles a face
+  std::vector<EntityVertex> vertices;
+  std::vector<uint32_t> indices;
+
+  // Loads the file's first geometry, in either the 1.8 or the 1.12+
+  // layout
+  static EntityModel load(const std::string &path);
+};
+
+// Tracks animating a bone of a skeleton, in model units and degrees like
+// the bone itself. Empty tracks leave that part of the pose at rest.
+struct BoneAnimation {
+  uint32_t bone;
+  Track<Vec3> position;
+  Track<Quat> rotation;
+  Track<Vec3> scale;
+};
+
+// An animation from a Bedrock animation file (.animation.json). Rotations
+// are interpolated as quaternions rather than Bedrock's per-axis angles,
+// which only differs for large turns between keyframes. Molang expressions
+// aren't supported, only numbers.
+struct AnimationClip {
+  // Seconds
+  float length = 0;
+  bool loop = false;
+  // Only the skeleton's bones that are animated
+  std::vector<BoneAnimation> bones;
+
+  // Loads the file's first animation, bones missing from the skeleton are
+  // skipped
+  static AnimationClip load(const std::string &path,
+                            const Skeleton &skeleton);
+
+  // The clip's time at a time since it started playing
+  float time(double seconds) const;
+};
@@ -0,0 +1,300 @@
+#include "frustum.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRUSTUM_X86
+#endif
+
+Frustum Frustum::fromViewProjection(const Mat4 &viewProjection,
+                                    const std::array<double, 3> &camera) {
+  // Clip space x, y in [-w, w] and Vulkan's z in [0, w], each bound gives a
+  // plane as a combination of the matrix rows
+  const int rows[6][2] = {{0, 1}, {0, -1}, {1, 1}, {1, -1}, {2, 0}, {2, -1}};
+
+  Frustum frustum;
+  for (int p = 0; p < 6; p++) {
+    auto [row, sign] = rows[p];
+    double plane[4];
+    for (int column = 0; column < 4; column++) {
+      double w = viewProjection.at(3, column);
+      double value = viewProjection.at(row, column);
+      plane[column] = sign == 0 ? value : w + sign * value;
+    }
+
+    double length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] +
+                              plane[2] * plane[2]);
+    plane[3] -= plane[0] * camera[0] + plane[1] * camera[1] +
+                plane[2] * camera[2];
+    for (int i = 0; i < 4; i++) {
+      frustum.planes[p][i] = static_cast<float>(plane[i] / length);
+    }
+  }
+  return frustum;
+}
+
+bool Frustum::intersects(const float min[3], const float max[3]) const {
+  for (const auto &plane : planes) {
+    float distance = plane[3];
+    for (int i = 0; i < 3; i++) {
+      distance += plane[i] * (plane[i] > 0 ? max[i] : min[i]);
+    }
+    if (distance < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t BoxList::add(const float min[3], const float max[3]) {
+  size_t index = count++;
+  if (index % LANES == 0) {
+    for (auto &values : components) {
+      values.resize(index + LANES);
+    }
+  }
+  set(index, min, max);
+  return index;
+}
+
+void BoxList::set(size_t index, const float min[3], const float max[3]) {
+  for (int i = 0; i < 3; i++) {
+    components[i][index] = min[i];
+    components[i + 3][index] = max[i];
+  }
+}
+
+void BoxList::removeSwap(size_t index) {
+  size_t last = --count;
+  for (auto &values : components) {
+    values[index] = values[last];
+  }
+  if (count % LANES == 0) {
+    for (auto &values : components) {
+      values.resize(count);
+    }
+  }
+}
+
+void BoxList::clear() {
+  for (auto &values : components) {
+    values.clear();
+  }
+  count = 0;
+}
+
+namespace {
+
+// Boxes per batch when culling in parallel
+const size_t BATCH_SIZE = 8192;
+
+// For each plane only the box corner furthest along its normal needs
+// testing: if that one is outside, the whole box is
+struct PlaneCorners {
+  const float *corner[6][3];
+};
+
+PlaneCorners planeCorners(const Frustum &frustum, const BoxList &boxes) {
+  PlaneCorners result;
+  for (int p = 0; p < 6; p++) {
+    for (int i = 0; i < 3; i++) {
+      result.corner[p][i] =
+          boxes.component(frustum.planes[p][i] > 0 ? i + 3 : i);
+    }
+  }
+  return result;
+}
+
+// Tests boxes first-end, first a multiple of BoxList::LANES, and writes
+// the visible ones' indices to out. Returns how many were written.
+size_t cullRangeScalar(const Frustum &frustum, const PlaneCorners &corners,
+                       size_t first, size_t end, uint32_t *out) {
+  size_t written = 0;
+  for (size_t i = first; i < end; i++) {
+    bool inside = true;
+    for (int p = 0; p < 6 && inside; p++) {
+      const float *plane = frustum.planes[p];
+      inside = plane[0] * corners.corner[p][0][i] +
+                   plane[1] * corners.corner[p][1][i] +
+                   plane[2] * corners.corner[p][2][i] + plane[3] >=
+               0;
+    }
+    out[written] = i;
+    written += inside;
+  }
+  return written;
+}
+
+// For every 8 bit mask, the numbers of its set bits in increasing order
+struct LanePacking {
+  uint8_t lanes[256][8];
+
+  constexpr LanePacking() : lanes() {
+    for (unsigned mask = 0; mask < 256; mask++) {
+      int count = 0;
+      for (uint8_t lane = 0; lane < 8; lane++) {
+        if (mask >> lane & 1) {
+          lanes[mask][count++] = lane;
+        }
+      }
+    }
+  }
+};
+
+constexpr LanePacking LANE_PACKING;
+
+// Adds the lanes set in mask, dropping lanes past end
+size_t writeLanes(unsigned mask, size_t base, size_t end, uint32_t *out) {
+  if (end - base < BoxList::LANES) {
+    mask &= (1u << (end - base)) - 1;
+  }
+  size_t written = 0;
+  while (mask) {
+    out[written++] = base + std::countr_zero(mask);
+    mask &= mask - 1;
+  }
+  return written;
+}
+
+#ifdef FRUSTUM_X86
+__attribute__((target("sse2"))) size_t
+cullRangeSse2(const Frustum &frustum, const PlaneCorners &corners,
+              size_t first, size_t end, uint32_t *out) {
+  __m128 normals[6][3];
+  __m128 distances[6];
+  for (int p = 0; p < 6; p++) {
+    for (int i = 0; i < 3; i++) {
+      normals[p][i] = _mm_set1_ps(frustum.planes[p][i]);
+    }
+    distances[p] = _mm_set1_ps(frustum.planes[p][3]);
+  }
+
+  size_t written = 0;
+  for (size_t base = first; base < end; base += 4) {
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+#pragma GCC unroll 6
+    for (int p = 0; p < 6; p++) {
+      __m128 distance = distances[p];
+#pragma GCC unroll 3
+      for (int i = 0; i < 3; i++) {
+        __m128 corner = _mm_loadu_ps(corners.corner[p][i] + base);
+        distance = _mm_add_ps(distance, _mm_mul_ps(normals[p][i], corner));
+      }
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+    }
+    written += writeLanes(_mm_movemask_ps(inside), base, end, out + written);
+  }
+  return written;
+}
+
+__attribute__((target("avx2"))) size_t
+cullRangeAvx2(const Frustum &frustum, const PlaneCorners &corners,
+              size_t first, size_t end, uint32_t *out) {
+  __m256 normals[6][3];
+  __m256 distances[6];
+  for (int p = 0; p < 6; p++) {
+    for (int i = 0; i < 3; i++) {
+      normals[p][i] = _mm256_set1_ps(frustum.planes[p][i]);
+    }
+    distances[p] = _mm256_set1_ps(frustum.planes[p][3]);
+  }
+
+  size_t written = 0;
+  for (size_t base = first; base < end; base += 8) {
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+#pragma GCC unroll 6
+    for (int p = 0; p < 6; p++) {
+      __m256 distance = distances[p];
+#pragma GCC unroll 3
+      for (int i = 0; i < 3; i++) {
+        __m256 corner = _mm256_loadu_ps(corners.corner[p][i] + base);
+        distance =
+            _mm256_add_ps(distance, _mm256_mul_ps(normals[p][i], corner));
+      }
+      inside = _mm256_and_ps(
+          inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+    }
+    // Stores all 8 lanes with the visible ones packed to the front, the
+    // next store overwrites the rest
+    unsigned mask = _mm256_movemask_ps(inside);
+    if (end - base < 8) {
+      mask &= (1u << (end - base)) - 1;
+    }
+    __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+        reinterpret_cast<const __m128i *>(LANE_PACKING.lanes[mask])));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(out + written),
+        _mm256_add_epi32(lanes, _mm256_set1_epi32(static_cast<int>(base))));
+    written += std::popcount(mask);
+  }
+  return written;
+}
+#endif
+
+using CullRangeFn = size_t (*)(const Frustum &, const PlaneCorners &, size_t,
+                               size_t, uint32_t *);
+
+CullRangeFn selectCullRange() {
+#ifdef FRUSTUM_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return cullRangeAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return cullRangeSse2;
+  }
+#endif
+  return cullRangeScalar;
+}
+
+size_t cullRange(const Frustum &frustum, const PlaneCorners &corners,
+                 size_t first, size_t end, uint32_t *out) {
+  static const CullRangeFn impl = selectCullRange();
+  return impl(frustum, corners, first, end, out);
+}
+
+// The SIMD loops store whole groups of lanes past the last visible box
+size_t outputSize(size_t boxCount) {
+  return (boxCount + BoxList::LANES - 1) / BoxList::LANES * BoxList::LANES;
+}
+
+} // namespace
+
+void cullBoxes(const Frustum &frustum, const BoxList &boxes,
+               std::vector<uint32_t> &visible) {
+  visible.resize(outputSize(boxes.size()));
+  PlaneCorners corners = planeCorners(frustum, boxes);
+  visible.resize(cullRange(frustum, corners, 0, boxes.size(), visible.data()));
+}
+
+void cullBoxes(const Frustum &frustum, const BoxList &boxes,
+               std::vector<uint32_t> &visible, ThreadPool &pool) {
+  size_t batches = (boxes.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+  if (batches < 2 || pool.size() == 0) {
+    cullBoxes(frustum, boxes, visible);
+    return;
+  }
+
+  // Each batch writes into its own slice of visible, the slices are packed
+  // together afterwards
+  visible.resize(outputSize(boxes.size()));
+  PlaneCorners corners = planeCorners(frustum, boxes);
+  std::vector<size_t> written(batches);
+  uint32_t *out = visible.data();
+  pool.parallelBatches(boxes.size(), BATCH_SIZE,
+                       [&](size_t batch, size_t first, size_t end) {
+                         written[batch] = cullRange(frustum, corners, first,
+                                                    end, out + first);
+                       });
+
+  size_t total = written[0];
+  for (size_t batch = 1; batch < batches; batch++) {
+    std::memmove(visible.data() + total, visible.data() + batch * BATCH_SIZE,
+                 written[batch] * sizeof(uint32_t));
+    total += written[batch];
+  }
+  visible.resize(total);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "math.hpp"
+#include "thread_pool.hpp"
+
+// The six planes of a view frustum in world space, each {a, b, c, d} with
+// a * x + b * y + c * z + d >= 0 on the inside
+struct Frustum {
+  float planes[6][4];
+
+  // viewProjection maps camera relative positions, the planes are moved out
+  // to the camera's position in double precision
+  static Frustum fromViewProjection(const Mat4 &viewProjection,
+                                    const std::array<double, 3> &camera);
+
+  // Scalar test of a single box, for when there's no batch to cull
+  bool intersects(const float min[3], const float max[3]) const;
+};
+
+// Axis aligned boxes as a structure of arrays, so culling can test 8 boxes
+// at a time. Used for section bounds, and meant for entity bounds as well.
+// Indices are stable except for removeSwap.
+class BoxList {
+public:
+  // Every array has room for a multiple of this many boxes
+  static const size_t LANES = 8;
+
+  size_t size() const { return count; }
+
+  // Returns the new box's index
+  size_t add(const float min[3], const float max[3]);
+  void set(size_t index, const float min[3], const float max[3]);
+  // Moves the last box into index
+  void removeSwap(size_t index);
+  void clear();
+
+  // Component 0-2 of the minimum corner, or 3-5 of the maximum corner
+  const float *component(int i) const { return components[i].data(); }
+
+private:
+  std::array<std::vector<float>, 6> components;
+  size_t count = 0;
+};
+
+// Fills visible with the indices of the boxes that intersect the frustum,
+// in increasing order. Boxes are tested 8 at a time with AVX2 or 4 at a
+// time with SSE2.
+void cullBoxes(const Frustum &frustum, const BoxList &boxes,
+               std::vector<uint32_t> &visible);
+
+// Same as cullBoxes, but large lists are split into batches that the pool's
+// workers and the calling thread take turns claiming. The caller only ever
+// waits for batches that are already running.
+void cullBoxes(const Frustum &frustum, const BoxList &boxes,
+               std::vector<uint32_t> &visible, ThreadPool &pool);
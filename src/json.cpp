@@ -0,0 +1,338 @@
+#include "json.hpp"
+
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+namespace {
+
+class Parser {
+public:
+  explicit Parser(std::string_view text) : text(text) {}
+
+  JsonValue parseDocument() {
+    JsonValue value = parseValue(0);
+    skipWhitespace();
+    if (pos != text.size()) {
+      fail("trailing characters");
+    }
+    return value;
+  }
+
+private:
+  static constexpr int maxDepth = 256;
+
+  std::string_view text;
+  size_t pos = 0;
+
+  [[noreturn]] void fail(const char *what) {
+    throw std::runtime_error(
+        fmt::format("json parse error at offset {}: {}", pos, what));
+  }
+
+  void skipWhitespace() {
+    while (pos < text.size()) {
+      char c = text[pos];
+      if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        pos++;
+      } else {
+        break;
+      }
+    }
+  }
+
+  bool consume(char c) {
+    skipWhitespace();
+    if (pos < text.size() && text[pos] == c) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char c) {
+    if (!consume(c)) {
+      fail(fmt::format("expected '{}'", c).c_str());
+    }
+  }
+
+  bool consumeLiteral(std::string_view literal) {
+    if (text.substr(pos, literal.size()) == literal) {
+      pos += literal.size();
+      return true;
+    }
+    return false;
+  }
+
+  JsonValue parseValue(int depth) {
+    if (depth > maxDepth) {
+      fail("nesting too deep");
+    }
+
+    skipWhitespace();
+    if (pos >= text.size()) {
+      fail("unexpected end of input");
+    }
+
+    char c = text[pos];
+    if (c == '{') {
+      return parseObject(depth);
+    } else if (c == '[') {
+      return parseArray(depth);
+    } else if (c == '"') {
+      return parseString();
+    } else if (consumeLiteral("true")) {
+      return true;
+    } else if (consumeLiteral("false")) {
+      return false;
+    } else if (consumeLiteral("null")) {
+      return nullptr;
+    }
+    return parseNumber();
+  }
+
+  JsonValue parseObject(int depth) {
+    expect('{');
+    JsonValue::Object object;
+    if (consume('}')) {
+      return object;
+    }
+    do {
+      skipWhitespace();
+      std::string key = parseString();
+      expect(':');
+      object.emplace_back(std::move(key), parseValue(depth + 1));
+    } while (consume(','));
+    expect('}');
+    return object;
+  }
+
+  JsonValue parseArray(int depth) {
+    expect('[');
+    JsonValue::Array array;
+    if (consume(']')) {
+      return array;
+    }
+    do {
+      array.push_back(parseValue(depth + 1));
+    } while (consume(','));
+    expect(']');
+    return array;
+  }
+
+  JsonValue parseNumber() {
+    size_t start = pos;
+    while (pos < text.size()) {
+      char c = text[pos];
+      if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+          c == 'e' || c == 'E') {
+        pos++;
+      } else {
+        break;
+      }
+    }
+    if (start == pos) {
+      fail("unexpected character");
+    }
+
+    // std::from_chars doesn't accept a leading '+', but neither does JSON
+    double value = 0.0;
+    auto [end, ec] =
+        std::from_chars(text.data() + start, text.data() + pos, value);
+    if (ec != std::errc() || end != text.data() + pos) {
+      fail("invalid number");
+    }
+    return value;
+  }
+
+  uint32_t parseHex4() {
+    if (pos + 4 > text.size()) {
+      fail("truncated unicode escape");
+    }
+    uint32_t value = 0;
+    auto [end, ec] =
+        std::from_chars(text.data() + pos, text.data() + pos + 4, value, 16);
+    if (ec != std::errc() || end != text.data() + pos + 4) {
+      fail("invalid unicode escape");
+    }
+    pos += 4;
+    return value;
+  }
+
+  static void appendUtf8(std::string &out, uint32_t codepoint) {
+    if (codepoint < 0x80) {
+      out += static_cast<char>(codepoint);
+    } else if (codepoint < 0x800) {
+      out += static_cast<char>(0xc0 | (codepoint >> 6));
+      out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    } else if (codepoint < 0x10000) {
+      out += static_cast<char>(0xe0 | (codepoint >> 12));
+      out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (codepoint >> 18));
+      out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    }
+  }
+
+  std::string parseString() {
+    if (pos >= text.size() || text[pos] != '"') {
+      fail("expected string");
+    }
+    pos++;
+
+    std::string out;
+    while (true) {
+      if (pos >= text.size()) {
+        fail("unterminated string");
+      }
+      char c = text[pos++];
+      if (c == '"') {
+        break;
+      }
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+
+      if (pos >= text.size()) {
+        fail("unterminated escape");
+      }
+      char escape = text[pos++];
+      switch (escape) {
+      case '"':
+      case '\\':
+      case '/':
+        out += escape;
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u': {
+        uint32_t codepoint = parseHex4();
+        if (codepoint >= 0xd800 && codepoint < 0xdc00 &&
+            text.substr(pos, 2) == "\\u") {
+          pos += 2;
+          uint32_t low = parseHex4();
+          codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+        }
+        appendUtf8(out, codepoint);
+        break;
+      }
+      default:
+        fail("invalid escape");
+      }
+    }
+    return out;
+  }
+};
+
+} // namespace
+
+bool JsonValue::asBool() const {
+  if (!isBool()) {
+    throw std::runtime_error("json value is not a bool");
+  }
+  return std::get<bool>(value);
+}
+
+double JsonValue::asNumber() const {
+  if (!isNumber()) {
+    throw std::runtime_error("json value is not a number");
+  }
+  return std::get<double>(value);
+}
+
+const std::string &JsonValue::asString() const {
+  if (!isString()) {
+    throw std::runtime_error("json value is not a string");
+  }
+  return std::get<std::string>(value);
+}
+
+const JsonValue::Array &JsonValue::asArray() const {
+  if (!isArray()) {
+    throw std::runtime_error("json value is not an array");
+  }
+  return std::get<Array>(value);
+}
+
+const JsonValue::Object &JsonValue::asObject() const {
+  if (!isObject()) {
+    throw std::runtime_error("json value is not an object");
+  }
+  return std::get<Object>(value);
+}
+
+const JsonValue *JsonValue::find(std::string_view key) const {
+  if (!isObject()) {
+    return nullptr;
+  }
+  for (const auto &[name, child] : std::get<Object>(value)) {
+    if (name == key) {
+      return &child;
+    }
+  }
+  return nullptr;
+}
+
+bool JsonValue::getBool(std::string_view key, bool fallback) const {
+  const JsonValue *child = find(key);
+  return child && child->isBool() ? child->asBool() : fallback;
+}
+
+const JsonValue &JsonValue::require(std::string_view key) const {
+  const JsonValue *child = find(key);
+  if (!child) {
+    throw std::runtime_error(fmt::format("missing field {}", key));
+  }
+  return *child;
+}
+
+double JsonValue::getNumber(std::string_view key, double fallback) const {
+  const JsonValue *child = find(key);
+  return child && child->isNumber() ? child->asNumber() : fallback;
+}
+
+int JsonValue::getInt(std::string_view key, int fallback) const {
+  const JsonValue *child = find(key);
+  return child && child->isNumber() ? child->asInt() : fallback;
+}
+
+std::string JsonValue::getString(std::string_view key,
+                                 std::string_view fallback) const {
+  const JsonValue *child = find(key);
+  return child && child->isString() ? child->asString()
+                                    : std::string(fallback);
+}
+
+JsonValue JsonValue::parse(std::string_view text) {
+  return Parser(text).parseDocument();
+}
+
+JsonValue JsonValue::parseFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error(fmt::format("failed to open {}", path));
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return parse(contents.str());
+}
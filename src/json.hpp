@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Minimal JSON document model, enough for resource pack metadata
+// (.mcmeta, block models, block states).
+class JsonValue {
+public:
+  using Array = std::vector<JsonValue>;
+  using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+  JsonValue() = default;
+  JsonValue(std::nullptr_t) {}
+  JsonValue(bool value) : value(value) {}
+  JsonValue(double value) : value(value) {}
+  JsonValue(std::string value) : value(std::move(value)) {}
+  JsonValue(Array value) : value(std::move(value)) {}
+  JsonValue(Object value) : value(std::move(value)) {}
+
+  bool isNull() const { return std::holds_alternative<std::nullptr_t>(value); }
+  bool isBool() const { return std::holds_alternative<bool>(value); }
+  bool isNumber() const { return std::holds_alternative<double>(value); }
+  bool isString() const { return std::holds_alternative<std::string>(value); }
+  bool isArray() const { return std::holds_alternative<Array>(value); }
+  bool isObject() const { return std::holds_alternative<Object>(value); }
+
+  bool asBool() const;
+  double asNumber() const;
+  int asInt() const { return static_cast<int>(asNumber()); }
+  const std::string &asString() const;
+  const Array &asArray() const;
+  const Object &asObject() const;
+
+  // Object lookup, returns nullptr if this isn't an object or the key is
+  // missing.
+  const JsonValue *find(std::string_view key) const;
+  // Object lookup for fields that must be there, throws if the key is
+  // missing
+  const JsonValue &require(std::string_view key) const;
+
+  bool getBool(std::string_view key, bool fallback) const;
+  double getNumber(std::string_view key, double fallback) const;
+  int getInt(std::string_view key, int fallback) const;
+  std::string getString(std::string_view key, std::string_view fallback) const;
+
+  static JsonValue parse(std::string_view text);
+  static JsonValue parseFile(const std::string &path);
+
+private:
+  std::variant<std::nullptr_t, bool, double, std::string, Array, Object>
+      value;
+};
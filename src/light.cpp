@@ -0,0 +1,388 @@
+#include "light.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace {
+
+// Light jobs read nine chunks each, fewer of them at a time keep the pool
+// free for meshing
+const size_t JOBS_PER_WORKER = 2;
+
+// Light reaches 15 blocks, so a box this much larger than the changed
+// blocks holds every level that can change, and its edges stay as they
+// were. Sky light going straight down is the exception, the box reaches
+// down to the bottom of the world for it.
+const int LIGHT_REACH = 16;
+
+// Blocks outside loaded chunks, which let no light through
+const BlockStateId UNLOADED = UINT16_MAX;
+
+// A box of blocks with their light properties and levels, indexed
+// (y * size z + z) * size x + x
+class LightVolume {
+public:
+  LightVolume(const World &world, BlockModels &models, const int from[3],
+              const int size[3]);
+
+  uint32_t index(int x, int y, int z) const {
+    return (static_cast<uint32_t>(y) * size[2] + z) * size[0] + x;
+  }
+  uint32_t blockCount() const { return opacity.size(); }
+  uint8_t emission(uint32_t i) const { return emissions[i]; }
+  uint8_t *levels(LightType type) {
+    return light[static_cast<int>(type)].data();
+  }
+
+  // Spreads light out from the queued blocks, whose levels are set
+  void spread(LightType type, std::vector<uint32_t> &queue);
+  // Takes away the light that came through the queued blocks, which have
+  // been set to 0 from the given levels. The lit blocks around the
+  // darkened area, which light has to spread back in from, are added to
+  // relight.
+  void unspread(LightType type,
+                std::vector<std::pair<uint32_t, uint8_t>> &queue,
+                std::vector<uint32_t> &relight);
+
+  // Full sky light straight down from the top of the box, then spread
+  // sideways and into blocks that take some of it
+  void lightSky();
+
+private:
+  int size[3];
+  std::vector<uint8_t> opacity;
+  std::vector<uint8_t> emissions;
+  std::array<std::vector<uint8_t>, 2> light;
+
+  template <typename Visitor>
+  void forEachNeighbour(uint32_t i, Visitor visit) const {
+    uint32_t layer = size[0] * size[2];
+    int x = i % size[0];
+    int z = i / size[0] % size[2];
+    int y = i / layer;
+    if (y > 0) {
+      visit(Direction::Down, i - layer);
+    }
+    if (y < size[1] - 1) {
+      visit(Direction::Up, i + layer);
+    }
+    if (z > 0) {
+      visit(Direction::North, i - size[0]);
+    }
+    if (z < size[2] - 1) {
+      visit(Direction::South, i + size[0]);
+    }
+    if (x > 0) {
+      visit(Direction::West, i - 1);
+    }
+    if (x < size[0] - 1) {
+      visit(Direction::East, i + 1);
+    }
+  }
+};
+
+LightVolume::LightVolume(const World &world, BlockModels &models,
+                         const int from[3], const int size[3]) {
+  std::copy_n(size, 3, this->size);
+  size_t count = static_cast<size_t>(size[0]) * size[1] * size[2];
+  std::vector<BlockStateId> blocks(count);
+  world.extractBlocks(from, size, UNLOADED, blocks.data());
+
+  opacity.resize(count);
+  emissions.resize(count);
+  BlockStateId lastId = UNLOADED;
+  uint8_t lastOpacity = 15;
+  uint8_t lastEmission = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (blocks[i] != lastId) {
+      lastId = blocks[i];
+      if (lastId == UNLOADED) {
+        lastOpacity = 15;
+        lastEmission = 0;
+      } else {
+        const BlockRenderInfo &info = models.info(lastId);
+        lastOpacity = info.lightOpacity;
+        lastEmission = info.lightEmission;
+      }
+    }
+    opacity[i] = lastOpacity;
+    emissions[i] = lastEmission;
+  }
+  for (auto &levels : light) {
+    levels.assign(count, 0);
+  }
+}
+
+void LightVolume::spread(LightType type, std::vector<uint32_t> &queue) {
+  uint8_t *levels = this->levels(type);
+  for (size_t head = 0; head < queue.size(); head++) {
+    uint32_t i = queue[head];
+    int level = levels[i];
+    forEachNeighbour(i, [&](Direction direction, uint32_t n) {
+      int next = level - std::max<int>(1, opacity[n]);
+      if (type == LightType::Sky && direction == Direction::Down &&
+          level == 15 && opacity[n] == 0) {
+        next = 15;
+      }
+      if (next > levels[n]) {
+        levels[n] = next;
+        queue.push_back(n);
+      }
+    });
+  }
+  queue.clear();
+}
+
+void LightVolume::unspread(LightType type,
+                           std::vector<std::pair<uint32_t, uint8_t>> &queue,
+                           std::vector<uint32_t> &relight) {
+  uint8_t *levels = this->levels(type);
+  for (size_t head = 0; head < queue.size(); head++) {
+    auto [i, level] = queue[head];
+    forEachNeighbour(i, [&](Direction direction, uint32_t n) {
+      uint8_t current = levels[n];
+      if (current == 0) {
+        return;
+      }
+      // Anything dimmer may have been lit from here, anything as bright
+      // has another source
+      bool fromHere = current < level ||
+                      (type == LightType::Sky &&
+                       direction == Direction::Down && level == 15 &&
+                       current == 15);
+      if (!fromHere) {
+        relight.push_back(n);
+        return;
+      }
+      levels[n] = 0;
+      queue.push_back({n, current});
+      if (type == LightType::Block && emissions[n]) {
+        levels[n] = emissions[n];
+        relight.push_back(n);
+      }
+    });
+  }
+  queue.clear();
+}
+
+void LightVolume::lightSky() {
+  uint8_t *levels = this->levels(LightType::Sky);
+  // Per column, the lowest block lit from straight above
+  std::vector<int> lowest(size[0] * size[2]);
+  for (int z = 0; z < size[2]; z++) {
+    for (int x = 0; x < size[0]; x++) {
+      int y = size[1] - 1;
+      for (; y >= 0 && opacity[index(x, y, z)] == 0; y--) {
+        levels[index(x, y, z)] = 15;
+      }
+      lowest[z * size[0] + x] = y + 1;
+    }
+  }
+
+  // Only the lit blocks next to a column that is lit less far down, and
+  // the bottom of each column, have anywhere new to spread to
+  std::vector<uint32_t> queue;
+  for (int z = 0; z < size[2]; z++) {
+    for (int x = 0; x < size[0]; x++) {
+      int bottom = lowest[z * size[0] + x];
+      int top = bottom + 1;
+      if (x > 0) {
+        top = std::max(top, lowest[z * size[0] + x - 1]);
+      }
+      if (x < size[0] - 1) {
+        top = std::max(top, lowest[z * size[0] + x + 1]);
+      }
+      if (z > 0) {
+        top = std::max(top, lowest[(z - 1) * size[0] + x]);
+      }
+      if (z < size[2] - 1) {
+        top = std::max(top, lowest[(z + 1) * size[0] + x]);
+      }
+      for (int y = bottom; y < std::min(top, size[1]); y++) {
+        queue.push_back(index(x, y, z));
+      }
+    }
+  }
+  spread(LightType::Sky, queue);
+}
+
+} // namespace
+
+LightEngine::LightEngine(World &world, BlockModels &models, ThreadPool &pool)
+    : world(world), models(models), jobs(pool, JOBS_PER_WORKER) {}
+
+void LightEngine::chunkInserted(ChunkPos pos) {
+  const Chunk *chunk = world.chunk(pos);
+  if (!chunk) {
+    return;
+  }
+  if (chunk->hasLight()) {
+    computed.erase(pos);
+  } else {
+    jobs.request(pos);
+  }
+
+  for (int dz = -1; dz <= 1; dz++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      ChunkPos neighbour{pos.x + dx, pos.z + dz};
+      if ((dx || dz) &&
+          (computed.contains(neighbour) || jobs.running(neighbour))) {
+        jobs.request(neighbour);
+      }
+    }
+  }
+}
+
+void LightEngine::chunkRemoved(ChunkPos pos) {
+  jobs.cancel(pos);
+  computed.erase(pos);
+}
+
+void LightEngine::blocksChanged(const std::vector<BlockEdit> &edits) {
+  std::unordered_map<ChunkPos, std::vector<BlockEdit>> byChunk;
+  for (const auto &edit : edits) {
+    byChunk[{floorDiv16(edit.x), floorDiv16(edit.z)}].push_back(edit);
+  }
+
+  for (const auto &[pos, chunkEdits] : byChunk) {
+    relight(chunkEdits);
+    // Jobs that read the chunk before the edit have to run again. Relighting
+    // spread the light of chunks still waiting for theirs, so then the
+    // chunks around them do as well.
+    bool pending = false;
+    for (int dz = -1; dz <= 1; dz++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        ChunkPos neighbour{pos.x + dx, pos.z + dz};
+        pending = pending || jobs.queuedOrRunning(neighbour);
+      }
+    }
+    if (!pending) {
+      continue;
+    }
+    for (int dz = -1; dz <= 1; dz++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        if (world.chunk({pos.x + dx, pos.z + dz})) {
+          jobs.request({pos.x + dx, pos.z + dz});
+        }
+      }
+    }
+  }
+}
+
+void LightEngine::update(ChunkPos center) {
+  while (auto light = jobs.poll()) {
+    computed.insert(light->pos);
+    world.setChunkLight(light->pos, std::move(light->blockLight),
+                        std::move(light->skyLight));
+  }
+
+  jobs.dispatch(center, [this](ChunkPos pos) -> decltype(jobs)::Job {
+    const Chunk *chunk = world.chunk(pos);
+    if (!chunk) {
+      return {};
+    }
+    int minSection = chunk->minSection();
+    int sectionCount = chunk->sectionCount();
+    return [this, pos, minSection, sectionCount] {
+      return lightChunk(pos, minSection, sectionCount);
+    };
+  });
+}
+
+ChunkLight LightEngine::lightChunk(ChunkPos pos, int minSection,
+                                   int sectionCount) const {
+  const int from[3] = {(pos.x - 1) * 16, minSection * 16, (pos.z - 1) * 16};
+  const int size[3] = {48, sectionCount * 16, 48};
+  LightVolume volume(world, models, from, size);
+
+  std::vector<uint32_t> queue;
+  uint8_t *blockLevels = volume.levels(LightType::Block);
+  for (uint32_t i = 0; i < volume.blockCount(); i++) {
+    if (volume.emission(i)) {
+      blockLevels[i] = volume.emission(i);
+      queue.push_back(i);
+    }
+  }
+  volume.spread(LightType::Block, queue);
+  volume.lightSky();
+
+  ChunkLight result;
+  result.pos = pos;
+  uint8_t levels[4096];
+  for (auto type : {LightType::Block, LightType::Sky}) {
+    const uint8_t *source = volume.levels(type);
+    auto &arrays = type == LightType::Block ? result.blockLight
+                                            : result.skyLight;
+    for (int section = 0; section < sectionCount; section++) {
+      for (int y = 0; y < 16; y++) {
+        for (int z = 0; z < 16; z++) {
+          std::copy_n(source + volume.index(16, section * 16 + y, 16 + z), 16,
+                      levels + (y * 16 + z) * 16);
+        }
+      }
+      arrays.emplace_back().assign(levels);
+    }
+  }
+  return result;
+}
+
+void LightEngine::relight(const std::vector<BlockEdit> &edits) {
+  const Chunk *chunk =
+      world.chunk({floorDiv16(edits[0].x), floorDiv16(edits[0].z)});
+  if (!chunk) {
+    return;
+  }
+  int min[3] = {edits[0].x, edits[0].y, edits[0].z};
+  int max[3] = {edits[0].x, edits[0].y, edits[0].z};
+  for (const auto &edit : edits) {
+    const int position[3] = {edit.x, edit.y, edit.z};
+    for (int i = 0; i < 3; i++) {
+      min[i] = std::min(min[i], position[i]);
+      max[i] = std::max(max[i], position[i]);
+    }
+  }
+  int bottom = chunk->minSection() * 16;
+  int top = (chunk->minSection() + chunk->sectionCount()) * 16;
+  const int from[3] = {min[0] - LIGHT_REACH, bottom, min[2] - LIGHT_REACH};
+  const int size[3] = {max[0] - min[0] + 1 + 2 * LIGHT_REACH,
+                       std::min(max[1] + LIGHT_REACH + 1, top) - bottom,
+                       max[2] - min[2] + 1 + 2 * LIGHT_REACH};
+  LightVolume volume(world, models, from, size);
+
+  std::vector<std::pair<uint32_t, uint8_t>> removed;
+  std::vector<uint32_t> relit;
+  std::vector<LightEdit> changes;
+  for (auto type : {LightType::Block, LightType::Sky}) {
+    uint8_t *levels = volume.levels(type);
+    world.extractLight(type, from, size, levels);
+    std::vector<uint8_t> before(levels, levels + volume.blockCount());
+
+    for (const auto &edit : edits) {
+      uint32_t i =
+          volume.index(edit.x - from[0], edit.y - from[1], edit.z - from[2]);
+      removed.push_back({i, levels[i]});
+      levels[i] = 0;
+      if (type == LightType::Block && volume.emission(i)) {
+        levels[i] = volume.emission(i);
+        relit.push_back(i);
+      }
+    }
+    volume.unspread(type, removed, relit);
+    volume.spread(type, relit);
+
+    changes.clear();
+    for (int y = 0; y < size[1]; y++) {
+      for (int z = 0; z < size[2]; z++) {
+        for (int x = 0; x < size[0]; x++) {
+          uint32_t i = volume.index(x, y, z);
+          if (levels[i] != before[i]) {
+            changes.push_back(
+                {from[0] + x, from[1] + y, from[2] + z, levels[i]});
+          }
+        }
+      }
+    }
+    world.setLight(type, changes);
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "block_model.hpp"
+#include "chunk.hpp"
+#include "chunk_jobs.hpp"
+#include "coords.hpp"
+#include "thread_pool.hpp"
+
+// Light levels computed for a chunk, a LightArray per section
+struct ChunkLight {
+  ChunkPos pos;
+  uint64_t version = 0;
+  std::vector<LightArray> blockLight;
+  std::vector<LightArray> skyLight;
+};
+
+// Block and sky light by breadth first flood fill, spreading the way
+// vanilla does: a level drops by 1 per block plus the block's light
+// opacity, and full sky light goes straight down without dropping.
+//
+// Chunks are lit from scratch on the thread pool. A job reads its chunk and
+// the eight around it, which holds everything light can reach the chunk
+// from, and keeps only the chunk's own levels, so jobs never wait on each
+// other. Chunks loaded with complete light keep it.
+//
+// Edits are relit incrementally on the main thread: light that came through
+// the changed blocks is taken away, then the light left around that area
+// spreads back in.
+class LightEngine {
+public:
+  // The pool must be drained before the engine is destroyed
+  LightEngine(World &world, BlockModels &models, ThreadPool &pool);
+
+  // Main thread, after the chunk was inserted. Lights it if it wasn't
+  // loaded with light, and relights the neighbours lit by the engine, which
+  // its light may reach.
+  void chunkInserted(ChunkPos pos);
+  // Main thread, after the chunk was removed. Drops its pending light.
+  void chunkRemoved(ChunkPos pos);
+  // Main thread, with the edits since the last call
+  void blocksChanged(const std::vector<BlockEdit> &edits);
+  // Main thread, once per frame. Stores finished chunks' light in the world
+  // and starts jobs for the queued chunks nearest to center.
+  void update(ChunkPos center);
+  // Including finished jobs whose light hasn't been stored yet
+  size_t pendingChunks() const { return jobs.size(); }
+
+private:
+  World &world;
+  BlockModels &models;
+  ChunkJobQueue<ChunkPos, ChunkLight> jobs;
+  // Chunks whose light came from here rather than from the save
+  std::unordered_set<ChunkPos> computed;
+
+  // Worker thread
+  ChunkLight lightChunk(ChunkPos pos, int minSection, int sectionCount) const;
+  // Relights around edits to one chunk
+  void relight(const std::vector<BlockEdit> &edits);
+};
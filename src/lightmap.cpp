@@ -0,0 +1,102 @@
+#include "lightmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "math.hpp"
+
+namespace {
+
+// A step of the flicker fades by 0.9 per tick, after this many it's gone
+const int FLICKER_HISTORY = 64;
+
+uint64_t splitMix(uint64_t value) {
+  value += 0x9e3779b97f4a7c15;
+  value = (value ^ value >> 30) * 0xbf58476d1ce4e5b9;
+  value = (value ^ value >> 27) * 0x94d049bb133111eb;
+  return value ^ value >> 31;
+}
+
+// Brightness of a light level before the lightmap's adjustments, vanilla's
+// curve for the overworld
+float levelBrightness(int level) {
+  float fraction = level / 15.0f;
+  return fraction / (4.0f - 3.0f * fraction);
+}
+
+Vec3 clamp01(Vec3 color) {
+  return {std::clamp(color.x, 0.0f, 1.0f), std::clamp(color.y, 0.0f, 1.0f),
+          std::clamp(color.z, 0.0f, 1.0f)};
+}
+
+float notGamma(float value) {
+  float inverse = 1.0f - value;
+  return 1.0f - inverse * inverse * inverse * inverse;
+}
+
+uint32_t packColor(Vec3 color) {
+  auto channel = [](float value) {
+    return static_cast<uint32_t>(std::lround(value * 255.0f));
+  };
+  return channel(color.x) | channel(color.y) << 8 | channel(color.z) << 16 |
+         0xffu << 24;
+}
+
+} // namespace
+
+float skyBrightness(double dayTime) {
+  // The sun's angle as a fraction of a turn, from noon, squeezed so days
+  // and nights are longer than dawn and dusk
+  double fraction = dayTime / TICKS_PER_DAY - 0.25;
+  fraction -= std::floor(fraction);
+  double squeezed = 0.5 - std::cos(fraction * std::numbers::pi) / 2.0;
+  double angle = (fraction * 2.0 + squeezed) / 3.0;
+
+  double cosine = std::cos(angle * 2.0 * std::numbers::pi);
+  auto darkness = static_cast<float>(1.0 - (cosine * 2.0 + 0.2));
+  return (1.0f - std::clamp(darkness, 0.0f, 1.0f)) * 0.8f + 0.2f;
+}
+
+float blockLightFlicker(uint64_t tick) {
+  float flicker = 0.0f;
+  uint64_t first = tick >= FLICKER_HISTORY ? tick - FLICKER_HISTORY : 0;
+  for (uint64_t t = first; t <= tick; t++) {
+    uint64_t bits = splitMix(t);
+    float random[4];
+    for (int i = 0; i < 4; i++) {
+      random[i] = static_cast<float>(bits >> (i * 16) & 0xffff) / 65536.0f;
+    }
+    flicker += (random[0] - random[1]) * random[2] * random[3] * 0.1f;
+    flicker *= 0.9f;
+  }
+  return flicker;
+}
+
+void computeLightmap(const LightmapSettings &settings,
+                     uint32_t out[LIGHTMAP_SIZE]) {
+  float sky = skyBrightness(settings.dayTime);
+  float skyFactor = sky * 0.95f + 0.05f;
+  float blockFactor = settings.flicker + 1.5f;
+  // Daylight is white, moonlight a dimmer grey
+  Vec3 skyColor = lerp({sky, sky, sky}, {1.0f, 1.0f, 1.0f}, 0.35f);
+  const Vec3 grey = {0.75f, 0.75f, 0.75f};
+  float gamma = std::max(settings.gamma, 0.0f);
+
+  for (int block = 0; block < 16; block++) {
+    for (int skyLevel = 0; skyLevel < 16; skyLevel++) {
+      float skyValue = levelBrightness(skyLevel) * skyFactor;
+      float blockValue = levelBrightness(block) * blockFactor;
+      // Block light fades from white at full brightness through orange
+      Vec3 color = {blockValue,
+                    blockValue * ((blockValue * 0.6f + 0.4f) * 0.6f + 0.4f),
+                    blockValue * (blockValue * blockValue * 0.6f + 0.4f)};
+      color += skyColor * skyValue;
+      color = clamp01(lerp(color, grey, 0.04f));
+
+      Vec3 bright = {notGamma(color.x), notGamma(color.y), notGamma(color.z)};
+      color = clamp01(lerp(lerp(color, bright, gamma), grey, 0.04f));
+      out[block * 16 + skyLevel] = packColor(color);
+    }
+  }
+}
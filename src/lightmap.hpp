@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Ticks in a Minecraft day. Day time 0 is sunrise, 6000 noon and 18000
+// midnight.
+const double TICKS_PER_DAY = 24000.0;
+
+// Block light and sky light levels each go from 0 to 15, so the lightmap
+// has a colour for each of the 256 pairs
+const int LIGHTMAP_SIZE = 256;
+
+struct LightmapSettings {
+  // In ticks, wraps around every TICKS_PER_DAY
+  double dayTime = 6000.0;
+  // Vanilla's brightness option, 0 for moody up to 1 for bright
+  float gamma = 0.5f;
+  // Added to block light's brightness, see blockLightFlicker()
+  float flicker = 0.0f;
+};
+
+// How bright the sky is at a day time, from 0.2 at night to 1 at noon
+float skyBrightness(double dayTime);
+
+// Vanilla makes block light flicker with a random walk stepped every tick.
+// This walk is worked out from the tick alone, so scrubbing an animation
+// gives the same flicker as playing it.
+float blockLightFlicker(uint64_t tick);
+
+// Vanilla's lightmap: the colour of every pair of light levels as RGBA8,
+// at out[blockLight * 16 + skyLight]. Block light is warmer than sky light,
+// and everything is lifted a little so darkness isn't pitch black.
+void computeLightmap(const LightmapSettings &settings,
+                     uint32_t out[LIGHTMAP_SIZE]);
@@ -1,7 +1,17 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <limits>
+#include <memory>
+#include <numbers>
 #include <optional>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <fmt/core.h>
@@ -14,11 +24,79 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "biome_tint.hpp"
+#include "block_model.hpp"
+#include "chunk.hpp"
+#include "entity_animator.hpp"
+#include "entity_model.hpp"
+#include "frustum.hpp"
+#include "json.hpp"
+#include "light.hpp"
+#include "lightmap.hpp"
+#include "math.hpp"
+#include "mesher.hpp"
+#include "mpsc_queue.hpp"
+#include "range_allocator.hpp"
+#include "region.hpp"
+#include "registry.hpp"
+#include "residency.hpp"
+#include "schematic.hpp"
+#include "texture_array.hpp"
+#include "thread_pool.hpp"
+#include "timeline.hpp"
+#include "transform_batch.hpp"
+#include "translucency.hpp"
+#include "visibility.hpp"
+#include "vk_util.hpp"
+
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// Minecraft runs game logic, and with it texture animations, at 20 ticks per
+// second
+const double TICKS_PER_SECOND = 20.0;
+
+// Upper bound on mesh data staged for upload per frame, so a burst of
+// finished meshes is spread over several frames
+const vk::DeviceSize MESH_UPLOAD_BUDGET = 32 * 1024 * 1024;
+
+// Sections with a mesh at once, each has a slot in the section table
+const uint32_t MAX_SECTIONS = 1 << 16;
+// Size of the terrain buffers every section mesh is allocated from
+const uint32_t TERRAIN_VERTEX_CAPACITY = 8 * 1024 * 1024;
+const uint32_t TERRAIN_INDEX_CAPACITY = 24 * 1024 * 1024;
+// The terrain buffers are compacted once this much of their free space is
+// outside the largest free range
+const float COMPACTION_THRESHOLD = 0.5f;
+// Must match local_size_x in cull.comp
+const uint32_t CULL_WORKGROUP_SIZE = 64;
+// Chunks with a slot in the tint buffer, chunks past this keep the default
+// colours
+const uint32_t MAX_TINT_CHUNKS = 1 << 13;
+
+const float VERTICAL_FOV = 70.0f * std::numbers::pi_v<float> / 180.0f;
+const float NEAR_PLANE = 0.05f;
+const float FAR_PLANE = 2048.0f;
+// Blocks per second, and radians per second for the arrow keys
+const float CAMERA_SPEED = 20.0f;
+const float CAMERA_TURN_SPEED = 1.5f;
+
+// Seconds ahead the camera path is extrapolated to for prefetching
+const double PREFETCH_SECONDS[] = {1.0, 2.0, 4.0};
+// Weight of the latest frame in the camera velocity the path follows
+const double VELOCITY_SMOOTHING = 0.1;
+// Chunks being read and decoded at once
+const size_t MAX_PENDING_LOADS = 64;
+// Chunks unloaded, and chunks whose meshes are freed, per frame
+const size_t MAX_EVICTIONS_PER_FRAME = 8;
+// Blocks between entities of a group
+const double ENTITY_SPACING = 2.0;
+// Blocks added to how far an entity model reaches at rest when culling, for
+// animations that move bones further out
+const float ENTITY_CULL_MARGIN = 1.0f;
+
 const std::vector<const char *> validationLayers = {
     "VK_LAYER_KHRONOS_validation"};
 
@@ -63,6 +141,271 @@ struct SwapChainSupportDetails {
   std::vector<vk::PresentModeKHR> presentModes;
 };
 
+// Copies of an animated model standing in a grid
+struct EntityGroup {
+  std::string model;
+  std::string animation;
+  // Png the model's UVs map onto
+  std::string texture;
+  size_t count;
+  // Corner of the grid
+  std::array<double, 3> origin;
+};
+
+struct Options {
+  std::optional<std::string> resourcePack;
+  std::optional<std::string> world;
+  // Pasted into the world with its minimum corner at schematicOrigin
+  std::optional<std::string> schematic;
+  std::array<int, 3> schematicOrigin{0, 0, 0};
+  std::vector<EntityGroup> entityGroups;
+  // Chunks kept loaded around the camera and its path
+  int viewDistance = 8;
+  // Far chunks are unloaded, or have their meshes freed, past these. The
+  // terrain buffers hold 192 MiB of meshes.
+  size_t cpuBudgetMiB = 2048;
+  size_t gpuBudgetMiB = 160;
+  ChunkPos center{0, 0};
+  bool greedyMeshing = true;
+  bool caveCulling = true;
+  // Cull and write draws in a compute shader when the device supports
+  // vkCmdDrawIndexedIndirectCount
+  bool gpuCulling = true;
+  // Chunks from the camera where terrain starts to be meshed at lower
+  // detail, 0 for full detail everywhere
+  double lodDistance = 12;
+  // Vanilla's biome blend radius in blocks, 0-7
+  int biomeBlend = 2;
+  // Minecraft day time at the start of the animation, in ticks, and
+  // whether it moves on as the animation plays
+  double dayTime = 6000;
+  bool daylightCycle = false;
+  float gamma = 0.5f;
+  // Defaults to above the middle of the center chunk
+  std::optional<std::array<double, 3>> cameraPosition;
+  // Keyframed camera animation replacing the keyboard controls
+  std::optional<std::string> cameraPath;
+  // Times animating this many entities and exits instead of opening a
+  // window
+  std::optional<size_t> animationBenchmark;
+};
+
+// Free flying camera. Its position is kept in doubles and the world is drawn
+// relative to it, so precision doesn't drop far from the origin.
+struct Camera {
+  std::array<double, 3> position{};
+  // Radians. A yaw of 0 looks north (-z) and increases towards east.
+  float yaw = 0;
+  float pitch = 0;
+
+  Vec3 forward() const {
+    return {std::sin(yaw) * std::cos(pitch), std::sin(pitch),
+            -std::cos(yaw) * std::cos(pitch)};
+  }
+};
+
+// Camera animation from a JSON file of keyframes:
+//
+//   {"keyframes": [{"time": 0, "position": [x, y, z], "yaw": 90,
+//                   "pitch": -10, "interpolation": "catmull_rom"}, ...]}
+//
+// Angles are in degrees, interpolation is one of step, linear, bezier and
+// catmull_rom and defaults to linear. Bézier keyframes ease in and out.
+struct ScriptedCamera {
+  // Positions are relative to the first keyframe, so they keep their
+  // precision as floats however far out the path goes
+  std::array<double, 3> origin{};
+  Timeline timeline;
+  TrackId<Vec3> position;
+  TrackId<float> yaw;
+  TrackId<float> pitch;
+
+  static ScriptedCamera load(const std::string &path) {
+    JsonValue document = JsonValue::parseFile(path);
+    const JsonValue *keyframes = document.find("keyframes");
+    if (!keyframes || !keyframes->isArray() || keyframes->asArray().empty()) {
+      throw std::runtime_error(fmt::format("no keyframes in {}", path));
+    }
+
+    struct Key {
+      float time;
+      std::array<double, 3> position;
+      float yaw;
+      float pitch;
+      Interpolation interpolation;
+    };
+    std::vector<Key> keys;
+    for (const JsonValue &keyframe : keyframes->asArray()) {
+      const JsonValue *position = keyframe.find("position");
+      if (!position || position->asArray().size() != 3) {
+        throw std::runtime_error(
+            fmt::format("keyframe without a position in {}", path));
+      }
+      Key &key = keys.emplace_back();
+      key.time = keyframe.getNumber("time", 0);
+      for (int i = 0; i < 3; i++) {
+        key.position[i] = position->asArray()[i].asNumber();
+      }
+      float radians = std::numbers::pi_v<float> / 180;
+      key.yaw = keyframe.getNumber("yaw", 0) * radians;
+      key.pitch = keyframe.getNumber("pitch", 0) * radians;
+      key.interpolation =
+          parseInterpolation(keyframe.getString("interpolation", "linear"));
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) {
+      return a.time < b.time;
+    });
+
+    ScriptedCamera scripted;
+    scripted.origin = keys[0].position;
+    std::vector<Keyframe<Vec3>> positions;
+    std::vector<Keyframe<float>> yaws;
+    std::vector<Keyframe<float>> pitches;
+    for (size_t i = 0; i < keys.size(); i++) {
+      const Key &key = keys[i];
+      Vec3 offset{static_cast<float>(key.position[0] - scripted.origin[0]),
+                  static_cast<float>(key.position[1] - scripted.origin[1]),
+                  static_cast<float>(key.position[2] - scripted.origin[2])};
+      // Flat handles a third of the way to the neighbouring keyframes
+      float before = i > 0 ? (keys[i - 1].time - key.time) / 3 : 0;
+      float after = i + 1 < keys.size() ? (keys[i + 1].time - key.time) / 3 : 0;
+      positions.push_back(
+          {key.time, offset, key.interpolation, {before, {}, after, {}}});
+      yaws.push_back(
+          {key.time, key.yaw, key.interpolation, {before, 0, after, 0}});
+      pitches.push_back(
+          {key.time, key.pitch, key.interpolation, {before, 0, after, 0}});
+    }
+    Timeline &timeline = scripted.timeline;
+    scripted.position = timeline.addTrack(Track<Vec3>(std::move(positions)));
+    scripted.yaw = timeline.addTrack(Track<float>(std::move(yaws)));
+    scripted.pitch = timeline.addTrack(Track<float>(std::move(pitches)));
+    return scripted;
+  }
+
+  static Interpolation parseInterpolation(const std::string &name) {
+    if (name == "step") {
+      return Interpolation::Step;
+    } else if (name == "linear") {
+      return Interpolation::Linear;
+    } else if (name == "bezier") {
+      return Interpolation::Bezier;
+    } else if (name == "catmull_rom") {
+      return Interpolation::CatmullRom;
+    }
+    throw std::runtime_error(fmt::format("unknown interpolation: {}", name));
+  }
+
+  void apply(double time, Camera &camera) {
+    timeline.evaluate(static_cast<float>(time));
+    camera.position = absolute(timeline.value(position));
+    camera.yaw = timeline.value(yaw);
+    camera.pitch = timeline.value(pitch);
+  }
+
+  // Where the camera will be, without moving playback along
+  std::array<double, 3> positionAt(double time) const {
+    const Track<Vec3> &track = timeline.track(position);
+    return absolute(track.sampleAt(static_cast<float>(time)));
+  }
+
+  std::array<double, 3> absolute(Vec3 offset) const {
+    return {origin[0] + offset.x, origin[1] + offset.y, origin[2] + offset.z};
+  }
+};
+
+// Must match the FrameUniforms block in the shaders
+struct FrameUniforms {
+  // Camera relative, sections are placed relative to the camera
+  Mat4 viewProjection;
+  // The section the camera is in, and its position within that section
+  int32_t cameraSection[4];
+  float cameraOffset[4];
+  // Camera relative frustum for cull.comp
+  float frustumPlanes[6][4];
+  uint32_t animationTick;
+  float animationSubTick;
+  // Slots of the section table in use
+  uint32_t sectionSlots;
+  // Sections with translucent quads, see translucentOrderBuffers
+  uint32_t translucentSections;
+  // RGBA8 colour of each block and sky light level pair, see lightmap.hpp
+  alignas(16) uint32_t lightmap[LIGHTMAP_SIZE];
+};
+
+// An entry of the section table, must match Section in sections.glsl
+struct GpuSection {
+  // The section position, and the slot of its chunk's tint map or -1
+  int32_t position[4];
+  // Mesh bounds relative to the section's minimum corner
+  float boundsMin[4];
+  float boundsMax[4];
+  // First index, index count and vertex offset of each render layer
+  uint32_t layers[RENDER_LAYER_COUNT][4];
+};
+
+// An entry of the entity instance buffer, must match Instance in
+// entity.vert
+struct GpuEntityInstance {
+  // Camera relative, from model units to blocks
+  Mat4 model;
+  uint32_t firstBone;
+  uint32_t textureLayer;
+  // RGBA8, multiplies the texture
+  uint32_t tint;
+  // RGBA8, mixed over the texture by its alpha like vanilla's hurt flash
+  uint32_t overlay;
+  // Block light * 16 + sky light where the entity stands
+  uint32_t light;
+  uint32_t padding[3];
+};
+
+static_assert(sizeof(GpuEntityInstance) == 96);
+
+// Where an entity model's mesh lives in the entity buffers, and the
+// entities drawn with it. Its instances are one range of the instance
+// buffer, so all of them are a single draw.
+struct EntityMesh {
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+  int32_t vertexOffset = 0;
+  uint32_t firstInstance = 0;
+  std::vector<uint32_t> entities;
+  // Entities in view this frame, written from firstInstance on
+  uint32_t visibleInstances = 0;
+};
+
+// Relative to the start of the section's ranges
+struct MeshLayerRange {
+  uint32_t indexOffset;
+  uint32_t indexCount;
+  uint32_t vertexOffset;
+};
+
+// Where a section's mesh lives in the shared terrain buffers. The vertices
+// of all its layers are one range, and so are the indices, so compaction
+// only has to move two ranges per section.
+struct SectionBuffers {
+  uint32_t slot;
+  uint32_t firstVertex;
+  uint32_t vertexCount;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  std::array<MeshLayerRange, RENDER_LAYER_COUNT> layers;
+  // Relative to the section's minimum corner
+  float boundsMin[3];
+  float boundsMax[3];
+  // Index of the mesh bounds in sectionBoxes
+  size_t boxIndex;
+  uint8_t lodLevel;
+};
+
+struct MeshCopy {
+  vk::Buffer source;
+  vk::Buffer destination;
+  vk::BufferCopy region;
+};
+
 class Application {
 private:
   GLFWwindow *window;
@@ -78,19 +421,161 @@ private:
   vk::Extent2D swapChainExtent;
   std::vector<vk::ImageView> swapChainImageViews;
   vk::RenderPass renderPass;
+  vk::DescriptorSetLayout descriptorSetLayout;
   vk::PipelineLayout pipelineLayout;
-  vk::Pipeline graphicsPipeline;
+  // One per render layer, differing in alpha handling and blending
+  std::array<vk::Pipeline, RENDER_LAYER_COUNT> terrainPipelines;
+  vk::Pipeline cullPipeline;
+  vk::Pipeline entityPipeline;
+  vk::Format depthFormat;
+  Image depthImage;
   std::vector<vk::Framebuffer> swapChainFrameBuffers;
   vk::CommandPool commandPool;
   std::vector<vk::CommandBuffer> commandBuffers;
   std::vector<vk::Semaphore> imageAvailableSemaphores;
   std::vector<vk::Semaphore> renderFinishedSemaphores;
   std::vector<vk::Fence> inFlightFences;
+  TextureArray blockTextures;
+  Image blockTextureImage;
+  // Entity skins, only ever one frame each
+  TextureArray entityTextures;
+  Image entityTextureImage;
+  vk::Sampler textureSampler;
+  Buffer spriteTableBuffer;
+  std::vector<Buffer> uniformBuffers;
+  vk::DescriptorPool descriptorPool;
+  std::vector<vk::DescriptorSet> descriptorSets;
   uint32_t current_frame = 0;
   bool framebufferResized = false;
+  // Seconds into the animation, everything time dependent is derived from
+  // this so scrubbing gives the same result as playing
+  double playbackTime = 0.0;
+  double lastFrameTime = 0.0;
+  Camera camera;
+  // Blocks per second, smoothed
+  std::array<double, 3> cameraVelocity{};
+  // Drives the camera instead of the keyboard when set
+  std::optional<ScriptedCamera> scriptedCamera;
+
+  ThreadPool workers;
+  BlockRegistry blockRegistry;
+  BiomeRegistry biomeRegistry;
+  World world{blockRegistry, biomeRegistry};
+  std::unique_ptr<BlockModels> blockModels;
+  std::unique_ptr<MeshScheduler> meshScheduler;
+  std::unique_ptr<LightEngine> lightEngine;
+  std::unique_ptr<TranslucentSorter> translucentSorter;
+  std::unique_ptr<BiomeTints> biomeTints;
+  std::unique_ptr<RegionReader> regionReader;
+  std::unique_ptr<ChunkResidency> residency;
+  // Decoded on the pool, inserted into the world by the main thread
+  MpscQueue<std::unique_ptr<Chunk>> loadedChunks;
+  // Requested chunks that turned out corrupt or were never generated
+  MpscQueue<ChunkPos> failedChunks;
+  MpscQueue<std::unique_ptr<Schematic>> loadedSchematics;
+  // Kept to paste into chunks loaded after it
+  std::unique_ptr<Schematic> schematic;
+  // Referred to by the animator. Groups with the same model file share it,
+  // and so its draw.
+  std::vector<std::unique_ptr<EntityModel>> entityModels;
+  std::unordered_map<std::string, uint32_t> entityModelsByPath;
+  std::vector<std::unique_ptr<AnimationClip>> entityClips;
+  EntityAnimator entityAnimator;
+  // In blocks, by entity index
+  std::vector<std::array<double, 3>> entityPositions;
+  std::vector<uint32_t> entityTextureLayers;
+  // World space bounds of every entity, by entity index, and the indices of
+  // those in view this frame
+  BoxList entityBoxes;
+  std::vector<uint32_t> visibleEntities;
+  std::vector<uint8_t> entityInView;
+  // By model index. Every model's vertices and indices, one after the other.
+  std::vector<EntityMesh> entityMeshes;
+  Buffer entityVertexBuffer;
+  Buffer entityIndexBuffer;
+  // Every section mesh is allocated from these, so drawing never has to
+  // rebind buffers
+  Buffer terrainVertexBuffer;
+  Buffer terrainIndexBuffer;
+  RangeAllocator vertexAllocator{TERRAIN_VERTEX_CAPACITY};
+  RangeAllocator indexAllocator{TERRAIN_INDEX_CAPACITY};
+  // Set when a mesh didn't fit although there was enough free space
+  bool compactionRequested = false;
+  // CHUNK_TINT_COLORS per slot, read by shader.frag. Slots are handed out
+  // as chunks are loaded and stay with the chunk until it's unloaded.
+  Buffer chunkTintBuffer;
+  std::unordered_map<ChunkPos, uint32_t> chunkTintSlots;
+  uint32_t tintSlotCount = 0;
+  std::vector<uint32_t> freeTintSlots;
+  // GpuSection of every slot, and the slots below sectionSlots not in use
+  Buffer sectionTableBuffer;
+  uint32_t sectionSlots = 0;
+  std::vector<uint32_t> freeSectionSlots;
+  std::unordered_map<SectionPos, SectionBuffers> sectionBuffers;
+  // World space mesh bounds of every section in sectionBuffers, and which
+  // section each box belongs to
+  BoxList sectionBoxes;
+  std::vector<SectionPos> boxSections;
+  // Indices into sectionBoxes of the sections in view this frame, and those
+  // of them with translucent quads from back to front
+  std::vector<uint32_t> visibleSections;
+  std::vector<uint32_t> translucentDraws;
+  bool caveCulling;
+  VisibilityGraph visibilityGraph;
+  std::unordered_set<SectionPos> reachableSections;
+  bool gpuCulling;
+  double lodDistance;
+  // Level of detail of every loaded chunk, all of a chunk's sections share
+  // one so skirts are only needed on the sides
+  std::unordered_map<ChunkPos, uint8_t> chunkLevels;
+  // Camera chunk the levels were last updated for
+  std::optional<ChunkPos> lodCenter;
+  // Light levels are turned into colours per frame, so the time of day
+  // changes without remeshing
+  double startDayTime;
+  bool daylightCycle;
+  float gamma;
+  PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+  uint32_t maxIndirectDraws = 0;
+  // Written by cull.comp: each render layer's draws, MAX_SECTIONS apart, and
+  // how many there are
+  std::array<Buffer, MAX_FRAMES_IN_FLIGHT> drawCommandBuffers;
+  std::array<Buffer, MAX_FRAMES_IN_FLIGHT> drawCountBuffers;
+  // A bit per section slot, cleared by cave culling
+  std::array<Buffer, MAX_FRAMES_IN_FLIGHT> visibleMaskBuffers;
+  // Each slot's place in the back to front order of sections with
+  // translucent quads, which cull.comp writes their draws in
+  std::array<Buffer, MAX_FRAMES_IN_FLIGHT> translucentOrderBuffers;
+  // Recorded into the next command buffer, copying out of the current
+  // frame's staging buffer
+  std::vector<MeshCopy> pendingMeshCopies;
+  std::array<Buffer, MAX_FRAMES_IN_FLIGHT> meshStagingBuffers;
+  // Every entity's bone matrices, written by the animator each frame into
+  // the slot the frame in flight isn't reading, and every entity's
+  // GpuEntityInstance
+  std::array<Buffer, MAX_FRAMES_IN_FLIGHT> boneBuffers;
+  std::array<Buffer, MAX_FRAMES_IN_FLIGHT> entityInstanceBuffers;
+  // Replaced buffers may still be read by the frame in flight, they are
+  // destroyed once this frame slot comes around again
+  std::array<std::vector<Buffer>, MAX_FRAMES_IN_FLIGHT> retiredBuffers;
 
 public:
-  Application() {
+  Application(const Options &options) {
+    if (options.resourcePack) {
+      blockTextures.loadSprites(*options.resourcePack, "block");
+    }
+    // Before the buffers and textures they need are created
+    for (const EntityGroup &group : options.entityGroups) {
+      spawnEntities(group);
+    }
+
+    gpuCulling = options.gpuCulling;
+    caveCulling = options.caveCulling;
+    lodDistance = options.lodDistance;
+    startDayTime = options.dayTime;
+    daylightCycle = options.daylightCycle;
+    gamma = options.gamma;
+
     initWindow();
     createInstance();
     createSurface();
@@ -99,32 +584,117 @@ public:
     createSwapChain();
     createImageViews();
     createRenderPass();
+    createDescriptorSetLayout();
     createGraphicsPipeline();
+    createCullPipeline();
+    createEntityPipeline();
+    createDepthResources();
     createFramebuffers();
     createCommandPool();
+    createTextureImage();
+    createTextureSampler();
+    createSpriteTable();
+    createTerrainBuffers();
+    createEntityBuffers();
+    createUniformBuffers();
+    createDescriptorPool();
+    createDescriptorSets();
     createCommandBuffers();
     createSyncObjects();
+
+    blockModels = std::make_unique<BlockModels>(blockRegistry, blockTextures,
+                                                options.resourcePack);
+    meshScheduler = std::make_unique<MeshScheduler>(
+        world, *blockModels, workers, options.greedyMeshing,
+        [this](SectionPos pos) { return meshDetail(pos); });
+    lightEngine = std::make_unique<LightEngine>(world, *blockModels, workers);
+    translucentSorter = std::make_unique<TranslucentSorter>(workers);
+    biomeTints = std::make_unique<BiomeTints>(world, biomeRegistry, workers,
+                                              options.biomeBlend);
+    residency = std::make_unique<ChunkResidency>(
+        ResidencyBudgets{options.cpuBudgetMiB << 20,
+                         options.gpuBudgetMiB << 20},
+        options.viewDistance);
+    if (options.cameraPosition) {
+      camera.position = *options.cameraPosition;
+    } else {
+      camera.position = {options.center.x * 16.0 + 8, 100.0,
+                         options.center.z * 16.0 + 8};
+    }
+    if (options.cameraPath) {
+      scriptedCamera = ScriptedCamera::load(*options.cameraPath);
+      scriptedCamera->apply(0, camera);
+    }
+    if (options.world) {
+      loadWorld(*options.world);
+    }
+    if (options.schematic) {
+      loadSchematic(*options.schematic, options.schematicOrigin);
+    }
   }
 
   void loop() {
     while (!glfwWindowShouldClose(window)) {
       glfwPollEvents();
+      playbackTime = glfwGetTime();
+      if (scriptedCamera) {
+        scriptedCamera->apply(playbackTime, camera);
+      } else {
+        updateCamera(static_cast<float>(playbackTime - lastFrameTime));
+      }
+      lastFrameTime = playbackTime;
       drawFrame();
     }
 
     device.waitIdle();
+    // Jobs still refer to the world and the mesh queue
+    workers.wait();
   }
 
   void cleanup() {
     cleanupSwapChain();
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      releaseFrameResources(i);
+      destroyBuffer(device, drawCommandBuffers[i]);
+      destroyBuffer(device, drawCountBuffers[i]);
+      destroyBuffer(device, visibleMaskBuffers[i]);
+      destroyBuffer(device, translucentOrderBuffers[i]);
+    }
+    destroyBuffer(device, terrainVertexBuffer);
+    destroyBuffer(device, terrainIndexBuffer);
+    destroyBuffer(device, sectionTableBuffer);
+    destroyBuffer(device, chunkTintBuffer);
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
       device.destroySemaphore(imageAvailableSemaphores[i]);
       device.destroySemaphore(renderFinishedSemaphores[i]);
       device.destroyFence(inFlightFences[i]);
     }
+    for (auto &buffer : uniformBuffers) {
+      destroyBuffer(device, buffer);
+    }
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      destroyBuffer(device, boneBuffers[i]);
+      destroyBuffer(device, entityInstanceBuffers[i]);
+    }
+    if (entityVertexBuffer.buffer) {
+      destroyBuffer(device, entityVertexBuffer);
+      destroyBuffer(device, entityIndexBuffer);
+    }
+    device.destroyDescriptorPool(descriptorPool);
+    destroyBuffer(device, spriteTableBuffer);
+    device.destroySampler(textureSampler);
+    destroyImage(device, blockTextureImage);
+    destroyImage(device, entityTextureImage);
     device.destroyCommandPool(commandPool);
-    device.destroyPipeline(graphicsPipeline);
+    for (auto pipeline : terrainPipelines) {
+      device.destroyPipeline(pipeline);
+    }
+    if (cullPipeline) {
+      device.destroyPipeline(cullPipeline);
+    }
+    device.destroyPipeline(entityPipeline);
     device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
     device.destroyRenderPass(renderPass);
     device.destroy();
     instance.destroySurfaceKHR(surface);
@@ -144,6 +714,7 @@ private:
     window = glfwCreateWindow(WIDTH, HEIGHT, "mcanim_vk", nullptr, nullptr);
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    glfwSetKeyCallback(window, keyCallback);
   }
 
   static void framebufferResizeCallback(GLFWwindow *window, int width,
@@ -153,6 +724,16 @@ private:
     app->framebufferResized = true;
   }
 
+  // F3 prints how full the terrain buffers are
+  static void keyCallback(GLFWwindow *window, int key, int scancode,
+                          int action, int mods) {
+    auto *app =
+        reinterpret_cast<Application *>(glfwGetWindowUserPointer(window));
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+      app->printTerrainStats();
+    }
+  }
+
   void createInstance() {
     const vk::ApplicationInfo appInfo("mcanim_vk", vk::ApiVersion10,
                                       "No Engine", vk::ApiVersion10,
@@ -366,11 +947,22 @@ private:
       queueCreateInfos.push_back({{}, queueFamily, 1, &queuePriority});
     }
 
+    std::vector<const char *> extensions = deviceExtensions;
     vk::PhysicalDeviceFeatures deviceFeatures;
+    if (gpuCulling && !supportsGpuCulling(physicalDevice)) {
+      fmt::println("vkCmdDrawIndexedIndirectCount isn't supported, culling on "
+                   "the CPU");
+      gpuCulling = false;
+    }
+    if (gpuCulling) {
+      extensions.push_back(vk::KHRDrawIndirectCountExtensionName);
+      deviceFeatures.multiDrawIndirect = vk::True;
+      deviceFeatures.drawIndirectFirstInstance = vk::True;
+    }
 
     vk::DeviceCreateInfo createInfo(
         {}, queueCreateInfos.size(), queueCreateInfos.data(), 0, nullptr,
-        deviceExtensions.size(), deviceExtensions.data(), &deviceFeatures);
+        extensions.size(), extensions.data(), &deviceFeatures);
     if (physicalDevice.createDevice(&createInfo, nullptr, &device) !=
         vk::Result::eSuccess) {
       throw std::runtime_error("failed to create logical device");
@@ -378,32 +970,131 @@ private:
 
     graphicsQueue = device.getQueue(*indices.graphicsFamily, 0);
     presentQueue = device.getQueue(*indices.presentFamily, 0);
+
+    if (gpuCulling) {
+      // Extension commands aren't exported by the loader
+      drawIndexedIndirectCount =
+          reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+              device.getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+      auto limits = physicalDevice.getProperties().limits;
+      maxIndirectDraws = std::min(MAX_SECTIONS, limits.maxDrawIndirectCount);
+    }
+  }
+
+  // Indirect draws of every visible section take multiDrawIndirect, and
+  // passing the section's slot as their first instance takes
+  // drawIndirectFirstInstance
+  bool supportsGpuCulling(vk::PhysicalDevice device) {
+    auto features = device.getFeatures();
+    if (!features.multiDrawIndirect || !features.drawIndirectFirstInstance) {
+      return false;
+    }
+    for (auto extension : device.enumerateDeviceExtensionProperties()) {
+      if (strcmp(extension.extensionName,
+                 vk::KHRDrawIndirectCountExtensionName) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  vk::Format findDepthFormat() {
+    for (auto format : {vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint,
+                        vk::Format::eD24UnormS8Uint}) {
+      auto properties = physicalDevice.getFormatProperties(format);
+      if (properties.optimalTilingFeatures &
+          vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
+        return format;
+      }
+    }
+    throw std::runtime_error("could not find a supported depth format");
   }
 
   void createRenderPass() {
-    vk::AttachmentDescription colorAttachment(
-        {}, swapChainFormat, vk::SampleCountFlagBits::e1,
-        vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
-        vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
-        vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR);
+    depthFormat = findDepthFormat();
+
+    std::array<vk::AttachmentDescription, 2> attachments = {
+        vk::AttachmentDescription(
+            {}, swapChainFormat, vk::SampleCountFlagBits::e1,
+            vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
+            vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
+            vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR),
+        vk::AttachmentDescription(
+            {}, depthFormat, vk::SampleCountFlagBits::e1,
+            vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eDontCare,
+            vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
+            vk::ImageLayout::eUndefined,
+            vk::ImageLayout::eDepthStencilAttachmentOptimal),
+    };
     vk::AttachmentReference colorAttachmentRef(
         0, vk::ImageLayout::eColorAttachmentOptimal);
+    vk::AttachmentReference depthAttachmentRef(
+        1, vk::ImageLayout::eDepthStencilAttachmentOptimal);
 
     vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics);
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+    // The depth image is shared by all frames, so the previous frame's depth
+    // writes have to finish before this one clears it
     vk::SubpassDependency dependency(
         vk::SubpassExternal, 0,
-        vk::PipelineStageFlagBits::eColorAttachmentOutput,
-        vk::PipelineStageFlagBits::eColorAttachmentOutput,
-        vk::AccessFlagBits::eNone, vk::AccessFlagBits::eColorAttachmentWrite);
-
-    vk::RenderPassCreateInfo createInfo({}, 1, &colorAttachment, 1, &subpass, 1,
+        vk::PipelineStageFlagBits::eColorAttachmentOutput |
+            vk::PipelineStageFlagBits::eLateFragmentTests,
+        vk::PipelineStageFlagBits::eColorAttachmentOutput |
+            vk::PipelineStageFlagBits::eEarlyFragmentTests,
+        vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+        vk::AccessFlagBits::eColorAttachmentWrite |
+            vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+
+    vk::RenderPassCreateInfo createInfo({}, attachments.size(),
+                                        attachments.data(), 1, &subpass, 1,
                                         &dependency);
     renderPass = device.createRenderPass(createInfo);
   }
 
+  void createDescriptorSetLayout() {
+    // Bindings 4-7 are only used by cull.comp, 9-11 by the entity pipeline
+    std::array<vk::DescriptorSetLayoutBinding, 12> bindings = {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer,
+                                       1,
+                                       vk::ShaderStageFlagBits::eVertex |
+                                           vk::ShaderStageFlagBits::eFragment |
+                                           vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(
+            1, vk::DescriptorType::eCombinedImageSampler, 1,
+            vk::ShaderStageFlagBits::eFragment),
+        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer,
+                                       1, vk::ShaderStageFlagBits::eFragment),
+        vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer,
+                                       1,
+                                       vk::ShaderStageFlagBits::eVertex |
+                                           vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer,
+                                       1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eStorageBuffer,
+                                       1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(6, vk::DescriptorType::eStorageBuffer,
+                                       1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(7, vk::DescriptorType::eStorageBuffer,
+                                       1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(8, vk::DescriptorType::eStorageBuffer,
+                                       1, vk::ShaderStageFlagBits::eFragment),
+        vk::DescriptorSetLayoutBinding(9, vk::DescriptorType::eStorageBuffer,
+                                       1, vk::ShaderStageFlagBits::eVertex),
+        vk::DescriptorSetLayoutBinding(10, vk::DescriptorType::eStorageBuffer,
+                                       1, vk::ShaderStageFlagBits::eVertex),
+        vk::DescriptorSetLayoutBinding(
+            11, vk::DescriptorType::eCombinedImageSampler, 1,
+            vk::ShaderStageFlagBits::eFragment),
+    };
+
+    vk::DescriptorSetLayoutCreateInfo createInfo({}, bindings.size(),
+                                                 bindings.data());
+    descriptorSetLayout = device.createDescriptorSetLayout(createInfo);
+  }
+
   vk::ShaderModule createShaderModule(const std::vector<char> &code) {
     vk::ShaderModuleCreateInfo createInfo(
         {}, code.size(), reinterpret_cast<const uint32_t *>(code.data()));
@@ -420,8 +1111,6 @@ private:
         {}, vk::ShaderStageFlagBits::eVertex, vertShaderModule, "main");
     vk::PipelineShaderStageCreateInfo fragShaderStageInfo(
         {}, vk::ShaderStageFlagBits::eFragment, fragShaderModule, "main");
-    vk::PipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
-                                                        fragShaderStageInfo};
 
     std::vector<vk::DynamicState> dynamicStates = {
         vk::DynamicState::eViewport,
@@ -430,8 +1119,13 @@ private:
     vk::PipelineDynamicStateCreateInfo dynamicState({}, dynamicStates.size(),
                                                     dynamicStates.data());
 
-    vk::PipelineVertexInputStateCreateInfo vertexInputInfo({}, 0, nullptr, 0,
-                                                           nullptr);
+    // The whole vertex is three words, unpacked in the shader
+    vk::VertexInputBindingDescription binding(0, sizeof(TerrainVertex),
+                                              vk::VertexInputRate::eVertex);
+    vk::VertexInputAttributeDescription attribute(
+        0, 0, vk::Format::eR32G32B32Uint, 0);
+    vk::PipelineVertexInputStateCreateInfo vertexInputInfo({}, 1, &binding, 1,
+                                                           &attribute);
 
     vk::PipelineInputAssemblyStateCreateInfo inputAssembly(
         {}, vk::PrimitiveTopology::eTriangleList, vk::False);
@@ -443,43 +1137,163 @@ private:
 
     vk::PipelineRasterizationStateCreateInfo rasterizer(
         {}, vk::False, vk::False, vk::PolygonMode::eFill,
-        vk::CullModeFlagBits::eBack, vk::FrontFace::eClockwise, vk::False, 0.0f,
-        0.0f, 0.0f, 1.0f);
+        vk::CullModeFlagBits::eBack, vk::FrontFace::eCounterClockwise,
+        vk::False, 0.0f, 0.0f, 0.0f, 1.0f);
+
+    vk::PipelineMultisampleStateCreateInfo multisampling(
+        {}, vk::SampleCountFlagBits::e1, vk::False, 1.0f, nullptr, vk::False,
+        vk::False);
+
+    // Also used by cull.comp
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo(
+        {}, 1, &descriptorSetLayout, 0, nullptr);
+    pipelineLayout = device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+    for (int i = 0; i < RENDER_LAYER_COUNT; i++) {
+      // The fragment shader ignores alpha for opaque geometry and discards
+      // transparent texels for cutout geometry. Translucent geometry is
+      // blended and drawn last without writing depth.
+      bool translucent =
+          static_cast<RenderLayer>(i) == RenderLayer::Translucent;
+      uint32_t renderLayer = i;
+      vk::SpecializationMapEntry layerEntry(0, 0, sizeof(renderLayer));
+      vk::SpecializationInfo specialization(1, &layerEntry,
+                                            sizeof(renderLayer), &renderLayer);
+      fragShaderStageInfo.pSpecializationInfo = &specialization;
+      vk::PipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
+                                                          fragShaderStageInfo};
+
+      // Less or equal so overlays drawn over the same face, like the sides
+      // of grass blocks, pass
+      vk::PipelineDepthStencilStateCreateInfo depthStencil(
+          {}, vk::True, translucent ? vk::False : vk::True,
+          vk::CompareOp::eLessOrEqual, vk::False, vk::False);
+
+      vk::PipelineColorBlendAttachmentState colorBlendAttachment(
+          translucent ? vk::True : vk::False, vk::BlendFactor::eSrcAlpha,
+          vk::BlendFactor::eOneMinusSrcAlpha, vk::BlendOp::eAdd,
+          vk::BlendFactor::eOne, vk::BlendFactor::eOneMinusSrcAlpha,
+          vk::BlendOp::eAdd);
+      colorBlendAttachment.colorWriteMask =
+          vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+          vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+      vk::PipelineColorBlendStateCreateInfo colorBlending(
+          {}, vk::False, vk::LogicOp::eCopy, 1, &colorBlendAttachment);
+
+      vk::GraphicsPipelineCreateInfo createInfo(
+          {}, 2, shaderStages, &vertexInputInfo, &inputAssembly, nullptr,
+          &viewportState, &rasterizer, &multisampling, &depthStencil,
+          &colorBlending, &dynamicState, pipelineLayout, renderPass, 0);
+
+      terrainPipelines[i] =
+          device.createGraphicsPipelines(nullptr, {createInfo}).value[0];
+    }
+
+    device.destroyShaderModule(vertShaderModule);
+    device.destroyShaderModule(fragShaderModule);
+  }
+
+  void createCullPipeline() {
+    if (!gpuCulling) {
+      return;
+    }
+    auto shaderModule = createShaderModule(readFile("assets/cull.comp.spv"));
+
+    uint32_t maxSections = MAX_SECTIONS;
+    vk::SpecializationMapEntry entry(0, 0, sizeof(maxSections));
+    vk::SpecializationInfo specialization(1, &entry, sizeof(maxSections),
+                                          &maxSections);
+    vk::PipelineShaderStageCreateInfo stage(
+        {}, vk::ShaderStageFlagBits::eCompute, shaderModule, "main",
+        &specialization);
+    vk::ComputePipelineCreateInfo createInfo({}, stage, pipelineLayout);
+    cullPipeline =
+        device.createComputePipelines(nullptr, {createInfo}).value[0];
+
+    device.destroyShaderModule(shaderModule);
+  }
+
+  // Opaque like vanilla's entities without translucent skins, cutout texels
+  // are discarded. Faces aren't culled, models rely on seeing the inside of
+  // flat cubes.
+  void createEntityPipeline() {
+    auto vertShaderModule =
+        createShaderModule(readFile("assets/entity.vert.spv"));
+    auto fragShaderModule =
+        createShaderModule(readFile("assets/entity.frag.spv"));
+    vk::PipelineShaderStageCreateInfo shaderStages[] = {
+        {{}, vk::ShaderStageFlagBits::eVertex, vertShaderModule, "main"},
+        {{}, vk::ShaderStageFlagBits::eFragment, fragShaderModule, "main"},
+    };
+
+    std::vector<vk::DynamicState> dynamicStates = {
+        vk::DynamicState::eViewport,
+        vk::DynamicState::eScissor,
+    };
+    vk::PipelineDynamicStateCreateInfo dynamicState({}, dynamicStates.size(),
+                                                    dynamicStates.data());
+
+    vk::VertexInputBindingDescription binding(0, sizeof(EntityVertex),
+                                              vk::VertexInputRate::eVertex);
+    std::array<vk::VertexInputAttributeDescription, 3> attributes = {
+        vk::VertexInputAttributeDescription(
+            0, 0, vk::Format::eR32G32B32Sfloat,
+            offsetof(EntityVertex, position)),
+        vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32G32Sfloat,
+                                            offsetof(EntityVertex, uv)),
+        vk::VertexInputAttributeDescription(
+            2, 0, vk::Format::eR32Uint, offsetof(EntityVertex, normalBone)),
+    };
+    vk::PipelineVertexInputStateCreateInfo vertexInputInfo(
+        {}, 1, &binding, attributes.size(), attributes.data());
 
+    vk::PipelineInputAssemblyStateCreateInfo inputAssembly(
+        {}, vk::PrimitiveTopology::eTriangleList, vk::False);
+    vk::PipelineViewportStateCreateInfo viewportState({}, 1, nullptr, 1,
+                                                      nullptr);
+    vk::PipelineRasterizationStateCreateInfo rasterizer(
+        {}, vk::False, vk::False, vk::PolygonMode::eFill,
+        vk::CullModeFlagBits::eNone, vk::FrontFace::eCounterClockwise,
+        vk::False, 0.0f, 0.0f, 0.0f, 1.0f);
     vk::PipelineMultisampleStateCreateInfo multisampling(
         {}, vk::SampleCountFlagBits::e1, vk::False, 1.0f, nullptr, vk::False,
         vk::False);
+    vk::PipelineDepthStencilStateCreateInfo depthStencil(
+        {}, vk::True, vk::True, vk::CompareOp::eLessOrEqual, vk::False,
+        vk::False);
 
-    vk::PipelineColorBlendAttachmentState colorBlendAttachment(vk::False);
+    vk::PipelineColorBlendAttachmentState colorBlendAttachment;
     colorBlendAttachment.colorWriteMask =
         vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
         vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
     vk::PipelineColorBlendStateCreateInfo colorBlending(
         {}, vk::False, vk::LogicOp::eCopy, 1, &colorBlendAttachment);
 
-    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo({}, 0, nullptr, 0,
-                                                          nullptr);
-    pipelineLayout = device.createPipelineLayout(pipelineLayoutCreateInfo);
-
     vk::GraphicsPipelineCreateInfo createInfo(
         {}, 2, shaderStages, &vertexInputInfo, &inputAssembly, nullptr,
-        &viewportState, &rasterizer, &multisampling, nullptr, &colorBlending,
-        &dynamicState, pipelineLayout, renderPass, 0);
-
-    graphicsPipeline =
+        &viewportState, &rasterizer, &multisampling, &depthStencil,
+        &colorBlending, &dynamicState, pipelineLayout, renderPass, 0);
+    entityPipeline =
         device.createGraphicsPipelines(nullptr, {createInfo}).value[0];
 
     device.destroyShaderModule(vertShaderModule);
     device.destroyShaderModule(fragShaderModule);
   }
 
+  void createDepthResources() {
+    depthImage = createImage(
+        context(), swapChainExtent.width, swapChainExtent.height, 1,
+        depthFormat, vk::ImageUsageFlagBits::eDepthStencilAttachment,
+        vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eDepth);
+  }
+
   void createFramebuffers() {
     swapChainFrameBuffers.resize(swapChainImageViews.size());
 
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-      vk::ImageView attachments[] = {swapChainImageViews[i]};
+      vk::ImageView attachments[] = {swapChainImageViews[i], depthImage.view};
 
-      vk::FramebufferCreateInfo createInfo({}, renderPass, 1, attachments,
+      vk::FramebufferCreateInfo createInfo({}, renderPass, 2, attachments,
                                            swapChainExtent.width,
                                            swapChainExtent.height, 1);
       swapChainFrameBuffers[i] = device.createFramebuffer(createInfo);
@@ -494,6 +1308,217 @@ private:
     commandPool = device.createCommandPool(createInfo);
   }
 
+  VulkanContext context() {
+    return {physicalDevice, device, graphicsQueue, commandPool};
+  }
+
+  // Every animation frame is a layer of its own, so a pack with many
+  // animated textures can run past the device's limit
+  Image createArrayImage(const TextureArray &textures) {
+    uint32_t layers = textures.layerCount();
+    uint32_t maxLayers =
+        physicalDevice.getProperties().limits.maxImageArrayLayers;
+    if (layers > maxLayers) {
+      throw std::runtime_error(
+          fmt::format("textures need {} array layers, the device supports {}",
+                      layers, maxLayers));
+    }
+    auto pixels = textures.layerPixels();
+    uint32_t tileSize = textures.tileSize();
+
+    auto ctx = context();
+    Image image = createImage(
+        ctx, tileSize, tileSize, layers, vk::Format::eR8G8B8A8Srgb,
+        vk::ImageUsageFlagBits::eTransferDst |
+            vk::ImageUsageFlagBits::eSampled,
+        vk::ImageViewType::e2DArray, vk::ImageAspectFlagBits::eColor);
+    uploadImageLayers(ctx, image.image, tileSize, tileSize, layers,
+                      pixels.data(), pixels.size());
+    return image;
+  }
+
+  void createTextureImage() {
+    blockTextureImage = createArrayImage(blockTextures);
+    entityTextureImage = createArrayImage(entityTextures);
+  }
+
+  void createTextureSampler() {
+    // Nearest filtering for pixel art. Repeat addressing tiles within a
+    // single layer, which is what lets one quad span several blocks.
+    vk::SamplerCreateInfo createInfo(
+        {}, vk::Filter::eNearest, vk::Filter::eNearest,
+        vk::SamplerMipmapMode::eNearest, vk::SamplerAddressMode::eRepeat,
+        vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat, 0.0f,
+        vk::False, 1.0f, vk::False, vk::CompareOp::eAlways, 0.0f, 0.0f,
+        vk::BorderColor::eIntOpaqueBlack, vk::False);
+    textureSampler = device.createSampler(createInfo);
+  }
+
+  void createSpriteTable() {
+    auto table = blockTextures.buildSpriteTable();
+    spriteTableBuffer = createDeviceLocalBuffer(
+        context(), table.data(), table.size() * sizeof(SpriteTableEntry),
+        vk::BufferUsageFlagBits::eStorageBuffer);
+  }
+
+  // Copied from when compacting
+  Buffer createTerrainBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage) {
+    return createBuffer(context(), size,
+                        usage | vk::BufferUsageFlagBits::eTransferSrc |
+                            vk::BufferUsageFlagBits::eTransferDst,
+                        vk::MemoryPropertyFlagBits::eDeviceLocal);
+  }
+
+  void createTerrainBuffers() {
+    auto ctx = context();
+    terrainVertexBuffer = createTerrainBuffer(
+        TERRAIN_VERTEX_CAPACITY * sizeof(TerrainVertex),
+        vk::BufferUsageFlagBits::eVertexBuffer);
+    terrainIndexBuffer =
+        createTerrainBuffer(TERRAIN_INDEX_CAPACITY * sizeof(uint32_t),
+                            vk::BufferUsageFlagBits::eIndexBuffer);
+    sectionTableBuffer =
+        createBuffer(ctx, MAX_SECTIONS * sizeof(GpuSection),
+                     vk::BufferUsageFlagBits::eStorageBuffer |
+                         vk::BufferUsageFlagBits::eTransferDst,
+                     vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      drawCommandBuffers[i] = createBuffer(
+          ctx,
+          RENDER_LAYER_COUNT * MAX_SECTIONS *
+              sizeof(vk::DrawIndexedIndirectCommand),
+          vk::BufferUsageFlagBits::eStorageBuffer |
+              vk::BufferUsageFlagBits::eIndirectBuffer,
+          vk::MemoryPropertyFlagBits::eDeviceLocal);
+      drawCountBuffers[i] =
+          createBuffer(ctx, RENDER_LAYER_COUNT * sizeof(uint32_t),
+                       vk::BufferUsageFlagBits::eStorageBuffer |
+                           vk::BufferUsageFlagBits::eIndirectBuffer |
+                           vk::BufferUsageFlagBits::eTransferDst,
+                       vk::MemoryPropertyFlagBits::eDeviceLocal);
+      visibleMaskBuffers[i] =
+          createMappedBuffer(ctx, MAX_SECTIONS / 8,
+                             vk::BufferUsageFlagBits::eStorageBuffer);
+      translucentOrderBuffers[i] =
+          createMappedBuffer(ctx, MAX_SECTIONS * sizeof(uint32_t),
+                             vk::BufferUsageFlagBits::eStorageBuffer);
+    }
+
+    chunkTintBuffer = createBuffer(
+        ctx, MAX_TINT_CHUNKS * CHUNK_TINT_COLORS * sizeof(uint32_t),
+        vk::BufferUsageFlagBits::eStorageBuffer |
+            vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+    // Slots are all empty until a mesh is uploaded to them. Zeroed tints
+    // mean not blended yet, shader.frag uses the default colours.
+    auto commandBuffer = beginSingleTimeCommands(ctx);
+    commandBuffer.fillBuffer(sectionTableBuffer.buffer, 0, vk::WholeSize, 0);
+    commandBuffer.fillBuffer(chunkTintBuffer.buffer, 0, vk::WholeSize, 0);
+    endSingleTimeCommands(ctx, commandBuffer);
+  }
+
+  void createUniformBuffers() {
+    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    for (auto &buffer : uniformBuffers) {
+      buffer = createMappedBuffer(context(), sizeof(FrameUniforms),
+                                  vk::BufferUsageFlagBits::eUniformBuffer);
+    }
+  }
+
+  void createDescriptorPool() {
+    std::array<vk::DescriptorPoolSize, 3> poolSizes = {
+        vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer,
+                               MAX_FRAMES_IN_FLIGHT),
+        vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler,
+                               2 * MAX_FRAMES_IN_FLIGHT),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer,
+                               9 * MAX_FRAMES_IN_FLIGHT),
+    };
+
+    vk::DescriptorPoolCreateInfo createInfo({}, MAX_FRAMES_IN_FLIGHT,
+                                            poolSizes.size(), poolSizes.data());
+    descriptorPool = device.createDescriptorPool(createInfo);
+  }
+
+  void createDescriptorSets() {
+    std::vector<vk::DescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
+                                                 descriptorSetLayout);
+    vk::DescriptorSetAllocateInfo allocInfo(descriptorPool, layouts.size(),
+                                            layouts.data());
+    descriptorSets = device.allocateDescriptorSets(allocInfo);
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      vk::DescriptorBufferInfo uniformInfo(uniformBuffers[i].buffer, 0,
+                                           sizeof(FrameUniforms));
+      vk::DescriptorImageInfo imageInfo(
+          textureSampler, blockTextureImage.view,
+          vk::ImageLayout::eShaderReadOnlyOptimal);
+      vk::DescriptorBufferInfo spriteTableInfo(spriteTableBuffer.buffer, 0,
+                                               vk::WholeSize);
+      vk::DescriptorBufferInfo sectionTableInfo(sectionTableBuffer.buffer, 0,
+                                                vk::WholeSize);
+      vk::DescriptorBufferInfo drawCommandInfo(drawCommandBuffers[i].buffer, 0,
+                                               vk::WholeSize);
+      vk::DescriptorBufferInfo drawCountInfo(drawCountBuffers[i].buffer, 0,
+                                             vk::WholeSize);
+      vk::DescriptorBufferInfo visibleMaskInfo(visibleMaskBuffers[i].buffer, 0,
+                                               vk::WholeSize);
+      vk::DescriptorBufferInfo translucentOrderInfo(
+          translucentOrderBuffers[i].buffer, 0, vk::WholeSize);
+      vk::DescriptorBufferInfo chunkTintInfo(chunkTintBuffer.buffer, 0,
+                                             vk::WholeSize);
+      vk::DescriptorBufferInfo boneInfo(boneBuffers[i].buffer, 0,
+                                        vk::WholeSize);
+      vk::DescriptorBufferInfo entityInstanceInfo(
+          entityInstanceBuffers[i].buffer, 0, vk::WholeSize);
+      vk::DescriptorImageInfo entityImageInfo(
+          textureSampler, entityTextureImage.view,
+          vk::ImageLayout::eShaderReadOnlyOptimal);
+
+      std::array<vk::WriteDescriptorSet, 12> writes = {
+          vk::WriteDescriptorSet(descriptorSets[i], 0, 0, 1,
+                                 vk::DescriptorType::eUniformBuffer, nullptr,
+                                 &uniformInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 1, 0, 1,
+                                 vk::DescriptorType::eCombinedImageSampler,
+                                 &imageInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 2, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &spriteTableInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 3, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &sectionTableInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 4, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &drawCommandInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 5, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &drawCountInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 6, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &visibleMaskInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 7, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &translucentOrderInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 8, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &chunkTintInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 9, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &boneInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 10, 0, 1,
+                                 vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &entityInstanceInfo),
+          vk::WriteDescriptorSet(descriptorSets[i], 11, 0, 1,
+                                 vk::DescriptorType::eCombinedImageSampler,
+                                 &entityImageInfo),
+      };
+      device.updateDescriptorSets(writes, {});
+    }
+  }
+
   void createCommandBuffers() {
     vk::CommandBufferAllocateInfo allocInfo(
         commandPool, vk::CommandBufferLevel::ePrimary, 2);
@@ -507,16 +1532,21 @@ private:
       throw std::runtime_error("failed to begin recording command buffer");
     }
 
-    vk::ClearValue clearColor = {{0.0f, 0.0f, 1.0f, 1.0f}};
+    recordMeshCopies(commandBuffer);
+    if (gpuCulling) {
+      recordCulling(commandBuffer);
+    }
+
+    std::array<vk::ClearValue, 2> clearValues = {
+        vk::ClearColorValue(0.19f, 0.39f, 1.0f, 1.0f),
+        vk::ClearDepthStencilValue(1.0f, 0),
+    };
     vk::RenderPassBeginInfo renderPassInfo(
         renderPass, swapChainFrameBuffers[imageIndex],
-        {{0, 0}, swapChainExtent}, 1, &clearColor);
+        {{0, 0}, swapChainExtent}, clearValues.size(), clearValues.data());
     commandBuffer.beginRenderPass(&renderPassInfo,
                                   vk::SubpassContents::eInline);
 
-    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
-                               graphicsPipeline);
-
     vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(swapChainExtent.width),
                           static_cast<float>(swapChainExtent.height), 0.0f,
                           1.0f);
@@ -525,11 +1555,1137 @@ private:
     VkRect2D scissor{{0, 0}, swapChainExtent};
     commandBuffer.setScissor(0, {scissor});
 
-    commandBuffer.draw(3, 1, 0, 0);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                     pipelineLayout, 0,
+                                     {descriptorSets[current_frame]}, {});
+    recordEntities(commandBuffer);
+    commandBuffer.bindVertexBuffers(0, {terrainVertexBuffer.buffer}, {0});
+    commandBuffer.bindIndexBuffer(terrainIndexBuffer.buffer, 0,
+                                  vk::IndexType::eUint32);
+
+    for (int i = 0; i < RENDER_LAYER_COUNT; i++) {
+      commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                                 terrainPipelines[i]);
+      if (gpuCulling) {
+        drawIndexedIndirectCount(
+            static_cast<VkCommandBuffer>(commandBuffer),
+            drawCommandBuffers[current_frame].buffer,
+            i * MAX_SECTIONS * sizeof(vk::DrawIndexedIndirectCommand),
+            drawCountBuffers[current_frame].buffer, i * sizeof(uint32_t),
+            maxIndirectDraws, sizeof(vk::DrawIndexedIndirectCommand));
+        continue;
+      }
+      bool translucent =
+          static_cast<RenderLayer>(i) == RenderLayer::Translucent;
+      for (uint32_t index : translucent ? translucentDraws : visibleSections) {
+        const SectionBuffers &section = sectionBuffers.at(boxSections[index]);
+        const MeshLayerRange &range = section.layers[i];
+        if (range.indexCount > 0) {
+          commandBuffer.drawIndexed(
+              range.indexCount, 1, section.firstIndex + range.indexOffset,
+              section.firstVertex + range.vertexOffset, section.slot);
+        }
+      }
+    }
+
     commandBuffer.endRenderPass();
     commandBuffer.end();
   }
 
+  // One instanced draw per model however many entities there are, the
+  // vertex shader finds each one's bones through its instance. Drawn before
+  // the terrain, entities are opaque.
+  void recordEntities(vk::CommandBuffer commandBuffer) {
+    if (entityMeshes.empty()) {
+      return;
+    }
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                               entityPipeline);
+    commandBuffer.bindVertexBuffers(0, {entityVertexBuffer.buffer}, {0});
+    commandBuffer.bindIndexBuffer(entityIndexBuffer.buffer, 0,
+                                  vk::IndexType::eUint32);
+    for (const EntityMesh &mesh : entityMeshes) {
+      if (mesh.indexCount > 0 && mesh.visibleInstances > 0) {
+        commandBuffer.drawIndexed(mesh.indexCount, mesh.visibleInstances,
+                                  mesh.firstIndex, mesh.vertexOffset,
+                                  mesh.firstInstance);
+      }
+    }
+  }
+
+  // Writes this frame's draws with cull.comp, so recording costs the same
+  // however many sections there are
+  void recordCulling(vk::CommandBuffer commandBuffer) {
+    // Translucent draws have a fixed place each, hidden sections get empty
+    // ones, so their count is known up front
+    auto translucentLayer = static_cast<uint32_t>(RenderLayer::Translucent);
+    vk::Buffer counts = drawCountBuffers[current_frame].buffer;
+    commandBuffer.fillBuffer(counts, 0, translucentLayer * sizeof(uint32_t),
+                             0);
+    commandBuffer.fillBuffer(
+        counts, translucentLayer * sizeof(uint32_t), sizeof(uint32_t),
+        static_cast<uint32_t>(translucentSorter->backToFront().size()));
+    vk::MemoryBarrier clearBarrier(vk::AccessFlagBits::eTransferWrite,
+                                   vk::AccessFlagBits::eShaderRead |
+                                       vk::AccessFlagBits::eShaderWrite);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eComputeShader,
+                                  {}, {clearBarrier}, {}, {});
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                     pipelineLayout, 0,
+                                     {descriptorSets[current_frame]}, {});
+    commandBuffer.dispatch(
+        (sectionSlots + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    vk::MemoryBarrier drawBarrier(vk::AccessFlagBits::eShaderWrite,
+                                  vk::AccessFlagBits::eIndirectCommandRead);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eDrawIndirect, {},
+                                  {drawBarrier}, {}, {});
+  }
+
+  // WASD moves horizontally, space and shift move up and down, control
+  // speeds up and the arrow keys look around
+  void updateCamera(float seconds) {
+    auto held = [this](int key) {
+      return glfwGetKey(window, key) == GLFW_PRESS;
+    };
+
+    float turn = CAMERA_TURN_SPEED * seconds;
+    camera.yaw += turn * (held(GLFW_KEY_RIGHT) - held(GLFW_KEY_LEFT));
+    camera.pitch += turn * (held(GLFW_KEY_UP) - held(GLFW_KEY_DOWN));
+    float limit = std::numbers::pi_v<float> / 2 - 0.01f;
+    camera.pitch = std::clamp(camera.pitch, -limit, limit);
+
+    Vec3 forward{std::sin(camera.yaw), 0, -std::cos(camera.yaw)};
+    Vec3 right{std::cos(camera.yaw), 0, std::sin(camera.yaw)};
+    Vec3 motion = forward * (held(GLFW_KEY_W) - held(GLFW_KEY_S)) +
+                  right * (held(GLFW_KEY_D) - held(GLFW_KEY_A));
+    motion.y = held(GLFW_KEY_SPACE) - held(GLFW_KEY_LEFT_SHIFT);
+
+    float distance = CAMERA_SPEED * seconds *
+                     (held(GLFW_KEY_LEFT_CONTROL) ? 5.0f : 1.0f);
+    camera.position[0] += motion.x * distance;
+    camera.position[1] += motion.y * distance;
+    camera.position[2] += motion.z * distance;
+
+    if (seconds > 0) {
+      const float moved[3] = {motion.x, motion.y, motion.z};
+      for (int i = 0; i < 3; i++) {
+        double velocity = moved[i] * distance / seconds;
+        cameraVelocity[i] +=
+            (velocity - cameraVelocity[i]) * VELOCITY_SMOOTHING;
+      }
+    }
+  }
+
+  // The camera followed by where it's headed, going by its keyframes or
+  // how it has been moving
+  std::vector<std::array<double, 3>> cameraPath() const {
+    std::vector<std::array<double, 3>> path{camera.position};
+    for (double seconds : PREFETCH_SECONDS) {
+      if (scriptedCamera) {
+        path.push_back(scriptedCamera->positionAt(playbackTime + seconds));
+        continue;
+      }
+      auto &point = path.emplace_back();
+      for (int i = 0; i < 3; i++) {
+        point[i] = camera.position[i] + cameraVelocity[i] * seconds;
+      }
+    }
+    return path;
+  }
+
+  // Camera relative
+  Mat4 viewProjection() const {
+    float aspect = static_cast<float>(swapChainExtent.width) /
+                   static_cast<float>(swapChainExtent.height);
+    return perspective(VERTICAL_FOV, aspect, NEAR_PLANE, FAR_PLANE) *
+           lookDirection(camera.forward(), {0, 1, 0});
+  }
+
+  void cullSections() {
+    Frustum frustum =
+        Frustum::fromViewProjection(viewProjection(), camera.position);
+    if (gpuCulling) {
+      updateVisibleMask(frustum);
+      updateTranslucentOrder();
+      return;
+    }
+    cullBoxes(frustum, sectionBoxes, visibleSections, workers);
+
+    if (caveCulling && visibilityGraph.findVisible(cameraSection(), frustum,
+                                                   reachableSections)) {
+      std::erase_if(visibleSections, [this](uint32_t index) {
+        return !reachableSections.contains(boxSections[index]);
+      });
+    }
+
+    const auto &order = translucentSorter->backToFront();
+    std::unordered_map<SectionPos, uint32_t> ranks;
+    for (uint32_t rank = 0; rank < order.size(); rank++) {
+      ranks.emplace(order[rank], rank);
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> draws;
+    for (uint32_t index : visibleSections) {
+      auto it = ranks.find(boxSections[index]);
+      if (it != ranks.end()) {
+        draws.push_back({it->second, index});
+      }
+    }
+    std::sort(draws.begin(), draws.end());
+    translucentDraws.clear();
+    for (auto [rank, index] : draws) {
+      translucentDraws.push_back(index);
+    }
+  }
+
+  // Every section with translucent quads gets its place in the back to front
+  // order, cull.comp writes their draws there
+  void updateTranslucentOrder() {
+    auto *ranks =
+        static_cast<uint32_t *>(translucentOrderBuffers[current_frame].mapped);
+    uint32_t rank = 0;
+    for (SectionPos pos : translucentSorter->backToFront()) {
+      ranks[sectionBuffers.at(pos).slot] = rank++;
+    }
+  }
+
+  // cull.comp does the frustum test, only cave culling is left to the CPU
+  void updateVisibleMask(const Frustum &frustum) {
+    auto *bits =
+        static_cast<uint32_t *>(visibleMaskBuffers[current_frame].mapped);
+    if (!caveCulling || !visibilityGraph.findVisible(cameraSection(), frustum,
+                                                     reachableSections)) {
+      memset(bits, 0xff, MAX_SECTIONS / 8);
+      return;
+    }
+    memset(bits, 0, MAX_SECTIONS / 8);
+    for (SectionPos pos : reachableSections) {
+      auto it = sectionBuffers.find(pos);
+      if (it != sectionBuffers.end()) {
+        uint32_t slot = it->second.slot;
+        bits[slot / 32] |= 1u << slot % 32;
+      }
+    }
+  }
+
+  void updateUniformBuffer(uint32_t frame) {
+    // Split into whole and fractional ticks so animations stay exact however
+    // far into the timeline we are
+    double ticks = playbackTime * TICKS_PER_SECOND;
+    double wholeTicks = std::floor(ticks);
+
+    SectionPos section = cameraSection();
+    const int32_t sectionCoords[3] = {section.x, section.y, section.z};
+    Frustum frustum =
+        Frustum::fromViewProjection(viewProjection(), {0.0, 0.0, 0.0});
+
+    FrameUniforms uniforms{};
+    uniforms.viewProjection = viewProjection();
+    for (int i = 0; i < 3; i++) {
+      uniforms.cameraSection[i] = sectionCoords[i];
+      uniforms.cameraOffset[i] =
+          static_cast<float>(camera.position[i] - sectionCoords[i] * 16.0);
+    }
+    memcpy(uniforms.frustumPlanes, frustum.planes, sizeof(frustum.planes));
+    uniforms.sectionSlots = sectionSlots;
+    uniforms.translucentSections =
+        static_cast<uint32_t>(translucentSorter->backToFront().size());
+    uniforms.animationTick = static_cast<uint32_t>(wholeTicks);
+    uniforms.animationSubTick = static_cast<float>(ticks - wholeTicks);
+
+    LightmapSettings lightmap;
+    lightmap.dayTime = startDayTime + (daylightCycle ? ticks : 0.0);
+    lightmap.gamma = gamma;
+    lightmap.flicker = blockLightFlicker(static_cast<uint64_t>(wholeTicks));
+    computeLightmap(lightmap, uniforms.lightmap);
+    memcpy(uniformBuffers[frame].mapped, &uniforms, sizeof(uniforms));
+  }
+
+  // Chunks are streamed in around the camera by updateResidency()
+  void loadWorld(const std::string &path) {
+    regionReader = std::make_unique<RegionReader>(path, workers);
+    fmt::println("Streaming chunks from {}", path);
+  }
+
+  // Loads the chunk on the pool if the world has it. Chunks only the
+  // schematic has are pasted right away.
+  void requestChunk(ChunkPos pos) {
+    size_t queued = 0;
+    if (regionReader) {
+      queued = regionReader->requestChunks(
+          pos, pos,
+          [this](ChunkPos pos, std::vector<uint8_t> &&nbt) {
+            try {
+              ChunkNbt parsed = parseChunkNbt(nbt);
+              loadedChunks.push(
+                  Chunk::fromNbt(parsed, blockRegistry, biomeRegistry));
+            } catch (const std::exception &e) {
+              fmt::println(stderr, "Skipping chunk {},{}: {}", pos.x, pos.z,
+                           e.what());
+              failedChunks.push(pos);
+            }
+          },
+          [this](ChunkPos pos) { failedChunks.push(pos); });
+    }
+    if (queued == 0) {
+      chunkUnavailable(pos);
+    }
+  }
+
+  // The world has nothing for the chunk, the schematic may still cover it
+  void chunkUnavailable(ChunkPos pos) {
+    if (schematic && schematic->covers(pos)) {
+      insertChunk(schematic->paste(pos, nullptr));
+    } else {
+      residency->chunkMissing(pos);
+    }
+  }
+
+  // Streams in chunks along the camera path and meshes chunks whose meshes
+  // were freed once they're near it again. Chunks are evicted in
+  // uploadCompletedMeshes(), which looks after the freed slots.
+  void updateResidency() {
+    residency->update(cameraPath());
+    for (ChunkPos pos : residency->takeMeshRestores()) {
+      if (const Chunk *chunk = world.chunk(pos)) {
+        for (int i = 0; i < chunk->sectionCount(); i++) {
+          meshScheduler->requestMesh(
+              {pos.x, chunk->minSection() + i, pos.z});
+        }
+      }
+    }
+    size_t pending = residency->pendingLoads();
+    if (pending < MAX_PENDING_LOADS) {
+      for (ChunkPos pos :
+           residency->takePrefetch(MAX_PENDING_LOADS - pending)) {
+        requestChunk(pos);
+      }
+    }
+  }
+
+  // Unloads far chunks, and frees the meshes of others, until they're back
+  // under their budgets. Nothing here waits on the GPU: freed ranges and
+  // slots are only written again after the barrier in recordMeshCopies(),
+  // and unloaded chunks are freed on the pool.
+  void evictChunks(std::vector<uint32_t> &freedSlots,
+                   std::vector<uint32_t> &freedTintSlots) {
+    for (ChunkPos pos :
+         residency->takeGpuEvictions(MAX_EVICTIONS_PER_FRAME)) {
+      freeChunkMeshes(pos, freedSlots);
+    }
+    for (ChunkPos pos :
+         residency->takeCpuEvictions(MAX_EVICTIONS_PER_FRAME)) {
+      const Chunk *chunk = world.chunk(pos);
+      if (!chunk) {
+        continue;
+      }
+      freeChunkMeshes(pos, freedSlots);
+      for (int i = 0; i < chunk->sectionCount(); i++) {
+        visibilityGraph.remove({pos.x, chunk->minSection() + i, pos.z});
+      }
+      auto tintSlot = chunkTintSlots.find(pos);
+      if (tintSlot != chunkTintSlots.end()) {
+        freedTintSlots.push_back(tintSlot->second);
+        chunkTintSlots.erase(tintSlot);
+      }
+      chunkLevels.erase(pos);
+      lightEngine->chunkRemoved(pos);
+      // Freeing every section's storage takes a while, the pool does it
+      workers.submit([removed = std::shared_ptr<Chunk>(world.removeChunk(
+                          pos))]() mutable { removed.reset(); });
+      biomeTints->chunkRemoved(pos);
+    }
+  }
+
+  // Frees the meshes of the chunk's sections, leaving their slots to the
+  // caller
+  void freeChunkMeshes(ChunkPos pos, std::vector<uint32_t> &freedSlots) {
+    const Chunk *chunk = world.chunk(pos);
+    if (!chunk) {
+      return;
+    }
+    for (int i = 0; i < chunk->sectionCount(); i++) {
+      auto it = sectionBuffers.find({pos.x, chunk->minSection() + i, pos.z});
+      if (it != sectionBuffers.end()) {
+        freedSlots.push_back(it->second.slot);
+        removeSection(it);
+      }
+    }
+  }
+
+  // Entities play the animation from different points, so the group
+  // doesn't move in lockstep
+  void spawnEntities(const EntityGroup &group) {
+    auto [found, added] =
+        entityModelsByPath.emplace(group.model, entityModels.size());
+    if (added) {
+      entityModels.push_back(
+          std::make_unique<EntityModel>(EntityModel::load(group.model)));
+      entityMeshes.emplace_back();
+    }
+    const EntityModel &model = *entityModels[found->second];
+    EntityMesh &mesh = entityMeshes[found->second];
+    auto &clip = entityClips.emplace_back(std::make_unique<AnimationClip>(
+        AnimationClip::load(group.animation, model.skeleton)));
+    uint32_t textureLayer = entityTextures.firstLayer(
+        entityTextures.loadTexture(group.texture));
+
+    auto side = static_cast<size_t>(
+        std::ceil(std::sqrt(static_cast<double>(group.count))));
+    for (size_t i = 0; i < group.count; i++) {
+      double phase = std::fmod(i * std::numbers::phi, 1.0);
+      mesh.entities.push_back(
+          entityAnimator.add(model.skeleton, *clip, -phase * clip->length));
+      entityPositions.push_back({group.origin[0] + i % side * ENTITY_SPACING,
+                                 group.origin[1],
+                                 group.origin[2] + i / side * ENTITY_SPACING});
+      entityTextureLayers.push_back(textureLayer);
+    }
+    fmt::println("Spawned {} entities of {}", group.count, model.identifier);
+  }
+
+  // Every entity is spawned by now, so the per frame buffers never grow.
+  // They hold at least one element to have something to bind. Entities
+  // never move, so their bounds are set here once: a cube around each one
+  // that its model's rest pose can turn in, plus ENTITY_CULL_MARGIN.
+  void createEntityBuffers() {
+    std::vector<EntityVertex> vertices;
+    std::vector<uint32_t> indices;
+    uint32_t firstInstance = 0;
+    const float empty[3] = {0, 0, 0};
+    for (size_t entity = 0; entity < entityAnimator.size(); entity++) {
+      entityBoxes.add(empty, empty);
+    }
+    for (size_t i = 0; i < entityMeshes.size(); i++) {
+      const EntityModel &model = *entityModels[i];
+      EntityMesh &mesh = entityMeshes[i];
+      mesh.firstIndex = indices.size();
+      mesh.indexCount = model.indices.size();
+      mesh.vertexOffset = vertices.size();
+      mesh.firstInstance = firstInstance;
+      firstInstance += mesh.entities.size();
+      vertices.insert(vertices.end(), model.vertices.begin(),
+                      model.vertices.end());
+      indices.insert(indices.end(), model.indices.begin(),
+                     model.indices.end());
+
+      float reach = 0;
+      for (const EntityVertex &vertex : model.vertices) {
+        const float *p = vertex.position;
+        reach = std::max(reach, p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+      }
+      reach = std::sqrt(reach) / 16 + ENTITY_CULL_MARGIN;
+      for (uint32_t entity : mesh.entities) {
+        float min[3], max[3];
+        for (int axis = 0; axis < 3; axis++) {
+          auto center = static_cast<float>(entityPositions[entity][axis]);
+          min[axis] = center - reach;
+          max[axis] = center + reach;
+        }
+        entityBoxes.set(entity, min, max);
+      }
+    }
+
+    auto ctx = context();
+    if (!indices.empty()) {
+      entityVertexBuffer = createDeviceLocalBuffer(
+          ctx, vertices.data(), vertices.size() * sizeof(EntityVertex),
+          vk::BufferUsageFlagBits::eVertexBuffer);
+      entityIndexBuffer = createDeviceLocalBuffer(
+          ctx, indices.data(), indices.size() * sizeof(uint32_t),
+          vk::BufferUsageFlagBits::eIndexBuffer);
+    }
+    size_t bones = std::max<size_t>(entityAnimator.boneCount(), 1);
+    size_t instances = std::max<size_t>(entityAnimator.size(), 1);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      boneBuffers[i] =
+          createMappedBuffer(ctx, bones * sizeof(Mat4),
+                             vk::BufferUsageFlagBits::eStorageBuffer);
+      entityInstanceBuffers[i] = createMappedBuffer(
+          ctx, instances * sizeof(GpuEntityInstance),
+          vk::BufferUsageFlagBits::eStorageBuffer);
+    }
+  }
+
+  // The fence has been waited on, nothing reads this slot's buffers
+  void updateEntities() {
+    if (entityAnimator.size() == 0) {
+      return;
+    }
+    entityAnimator.update(
+        playbackTime, static_cast<Mat4 *>(boneBuffers[current_frame].mapped),
+        workers);
+
+    Frustum frustum =
+        Frustum::fromViewProjection(viewProjection(), camera.position);
+    cullBoxes(frustum, entityBoxes, visibleEntities, workers);
+    entityInView.assign(entityAnimator.size(), 0);
+    for (uint32_t entity : visibleEntities) {
+      entityInView[entity] = 1;
+    }
+
+    // Each model's visible instances are packed at the start of its range,
+    // which its draw covers
+    auto *instances = static_cast<GpuEntityInstance *>(
+        entityInstanceBuffers[current_frame].mapped);
+    const int size[3] = {1, 1, 1};
+    for (EntityMesh &mesh : entityMeshes) {
+      GpuEntityInstance *out = instances + mesh.firstInstance;
+      mesh.visibleInstances = 0;
+      for (uint32_t entity : mesh.entities) {
+        if (!entityInView[entity]) {
+          continue;
+        }
+        mesh.visibleInstances++;
+        const auto &position = entityPositions[entity];
+        GpuEntityInstance instance{};
+        int block[3];
+        for (int i = 0; i < 3; i++) {
+          instance.model.at(i, i) = 1.0f / 16;
+          instance.model.at(i, 3) =
+              static_cast<float>(position[i] - camera.position[i]);
+          block[i] = static_cast<int>(std::floor(position[i]));
+        }
+        instance.model.at(3, 3) = 1;
+        instance.firstBone = entityAnimator.firstBone(entity);
+        instance.textureLayer = entityTextureLayers[entity];
+        instance.tint = 0xffffffff;
+        uint8_t blockLight, skyLight;
+        world.extractLight(LightType::Block, block, size, &blockLight);
+        world.extractLight(LightType::Sky, block, size, &skyLight);
+        instance.light = blockLight * 16 + skyLight;
+        // Written whole, the buffer is write combined
+        *out++ = instance;
+      }
+    }
+  }
+
+  void loadSchematic(const std::string &path,
+                     const std::array<int, 3> &origin) {
+    workers.submit([this, path, origin] {
+      auto schematic = std::make_unique<Schematic>(
+          Schematic::load(path, origin, blockRegistry));
+      fmt::println("Loaded {} sections from {}", schematic->sectionCount(),
+                   path);
+      loadedSchematics.push(std::move(schematic));
+    });
+  }
+
+  // Chunks loaded before the schematic have it pasted over them when it
+  // arrives, chunks loaded after get it pasted as they're inserted. The rest
+  // of it is only pasted as its chunks are requested, so it never grows the
+  // world past the budgets.
+  void insertLoadedChunks() {
+    while (auto loaded = loadedSchematics.pop()) {
+      schematic = std::move(*loaded);
+      for (ChunkPos pos : schematic->chunks()) {
+        if (const Chunk *chunk = world.chunk(pos)) {
+          insertChunk(schematic->paste(pos, chunk));
+        }
+      }
+      residency->forgetMissing();
+    }
+    while (auto chunk = loadedChunks.pop()) {
+      ChunkPos pos = (*chunk)->pos();
+      if (schematic && schematic->covers(pos)) {
+        *chunk = schematic->paste(pos, chunk->get());
+      }
+      insertChunk(std::move(*chunk));
+    }
+    while (auto pos = failedChunks.pop()) {
+      chunkUnavailable(*pos);
+    }
+  }
+
+  void insertChunk(std::unique_ptr<Chunk> chunk) {
+    ChunkPos pos = chunk->pos();
+    if (lodDistance > 0) {
+      chunkLevels[pos] = lodLevelAt(chunkDistance(pos), lodDistance);
+    }
+    residency->chunkLoaded(pos, chunk->memoryUsage());
+    world.insertChunk(std::move(chunk));
+    lightEngine->chunkInserted(pos);
+    if (!chunkTintSlots.contains(pos)) {
+      if (!freeTintSlots.empty()) {
+        chunkTintSlots.emplace(pos, freeTintSlots.back());
+        freeTintSlots.pop_back();
+      } else if (tintSlotCount < MAX_TINT_CHUNKS) {
+        chunkTintSlots.emplace(pos, tintSlotCount++);
+      }
+    }
+    biomeTints->chunkInserted(pos);
+  }
+
+  // Tint maps only change with biomes, they're uploaded without remeshing
+  void updateBiomeTints() {
+    biomeTints->biomesChanged(world.takeChangedBiomes());
+    biomeTints->dispatch(cameraSection().chunk());
+  }
+
+  // Relights around edits right away, so they're remeshed with their new
+  // light, and stores the light of chunks lit on the pool
+  void updateLight() {
+    lightEngine->blocksChanged(world.takeChangedBlocks());
+    lightEngine->update(cameraSection().chunk());
+  }
+
+  // Horizontal distance from the camera to the chunk's center, in chunks
+  double chunkDistance(ChunkPos pos) const {
+    double dx = pos.x + 0.5 - camera.position[0] / 16;
+    double dz = pos.z + 0.5 - camera.position[2] / 16;
+    return std::sqrt(dx * dx + dz * dz);
+  }
+
+  // When the camera enters another chunk, moves chunks to the level for
+  // their new distance and remeshes them, along with their neighbours whose
+  // skirts change
+  void updateLevelsOfDetail() {
+    ChunkPos center = cameraSection().chunk();
+    if (chunkLevels.empty() || lodCenter == center) {
+      return;
+    }
+    lodCenter = center;
+
+    std::unordered_set<ChunkPos> changed;
+    for (auto &[pos, level] : chunkLevels) {
+      int next = updateLodLevel(level, chunkDistance(pos), lodDistance);
+      if (next == level) {
+        continue;
+      }
+      level = next;
+      changed.insert(pos);
+      for (int d = static_cast<int>(Direction::North); d < DIRECTION_COUNT;
+           d++) {
+        changed.insert({pos.x + DIRECTION_OFFSETS[d][0],
+                        pos.z + DIRECTION_OFFSETS[d][2]});
+      }
+    }
+    for (ChunkPos pos : changed) {
+      const Chunk *chunk = world.chunk(pos);
+      if (!chunk) {
+        continue;
+      }
+      for (int y = chunk->minSection();
+           y < chunk->minSection() + chunk->sectionCount(); y++) {
+        meshScheduler->requestMesh({pos.x, y, pos.z});
+      }
+    }
+  }
+
+  // Called by the mesh scheduler as each job starts
+  MeshDetail meshDetail(SectionPos pos) const {
+    MeshDetail detail;
+    auto it = chunkLevels.find(pos.chunk());
+    if (it == chunkLevels.end()) {
+      return detail;
+    }
+    detail.level = it->second;
+    for (int d = static_cast<int>(Direction::North); d < DIRECTION_COUNT;
+         d++) {
+      auto neighbour = chunkLevels.find(
+          {pos.x + DIRECTION_OFFSETS[d][0], pos.z + DIRECTION_OFFSETS[d][2]});
+      if (neighbour != chunkLevels.end() &&
+          neighbour->second != detail.level) {
+        detail.skirtSides |= 1 << d;
+      }
+    }
+    return detail;
+  }
+
+  // Remeshes only the sections changed since the last frame, once each
+  // however many edits touched them
+  void scheduleMeshes() {
+    updateLevelsOfDetail();
+    for (SectionPos pos : world.takeDirtySections()) {
+      meshScheduler->requestMesh(pos);
+    }
+    meshScheduler->dispatch(cameraSection());
+  }
+
+  SectionPos cameraSection() const {
+    return {static_cast<int32_t>(std::floor(camera.position[0] / 16)),
+            static_cast<int32_t>(std::floor(camera.position[1] / 16)),
+            static_cast<int32_t>(std::floor(camera.position[2] / 16))};
+  }
+
+  // Allocates finished meshes in the terrain buffers and stages their data
+  // and section table entries in this frame's staging buffer. The copies are
+  // recorded at the start of the frame's command buffer.
+  void uploadCompletedMeshes() {
+    // Compaction rewrites every section's table entry, meshes wait for the
+    // next frame so no entry is written twice by one frame's copies
+    if (compactTerrainBuffersIfNeeded()) {
+      return;
+    }
+
+    std::vector<SectionMesh> meshes;
+    // Only reused from the next frame on, for the same reason
+    std::vector<uint32_t> freedSlots;
+    std::vector<uint32_t> freedTintSlots;
+    evictChunks(freedSlots, freedTintSlots);
+    vk::DeviceSize stagingSize =
+        freedTintSlots.size() * CHUNK_TINT_COLORS * sizeof(uint32_t);
+    while (stagingSize < MESH_UPLOAD_BUDGET) {
+      auto mesh = meshScheduler->pollCompleted();
+      if (!mesh) {
+        break;
+      }
+      // Finished after its chunk was unloaded or had its meshes freed
+      if (!residency->meshesWanted(mesh->pos.chunk())) {
+        continue;
+      }
+
+      visibilityGraph.set(mesh->pos, mesh->faceConnections);
+      if (mesh->empty()) {
+        auto it = sectionBuffers.find(mesh->pos);
+        if (it != sectionBuffers.end()) {
+          freedSlots.push_back(it->second.slot);
+          removeSection(it);
+        }
+        continue;
+      }
+      for (const auto &layer : mesh->layers) {
+        stagingSize += layer.vertices.size() * sizeof(TerrainVertex) +
+                       layer.indices.size() * sizeof(uint32_t);
+      }
+      // Before taking sorts off the queue, so ones for the old mesh are
+      // dropped
+      translucentSorter->setSection(
+          mesh->pos,
+          mesh->layers[static_cast<int>(RenderLayer::Translucent)]);
+      meshes.push_back(std::move(*mesh));
+    }
+    stagingSize += (meshes.size() + freedSlots.size()) * sizeof(GpuSection);
+    // Sorted translucent indices replace the old ones in place
+    std::vector<SortedIndices> sorts;
+    while (auto sorted = translucentSorter->pollCompleted()) {
+      stagingSize += sorted->indices.size() * sizeof(uint32_t);
+      sorts.push_back(std::move(*sorted));
+    }
+    std::vector<ChunkTints> tints;
+    while (auto chunkTints = biomeTints->pollCompleted()) {
+      stagingSize += sizeof(chunkTints->colors);
+      tints.push_back(std::move(*chunkTints));
+    }
+    if (stagingSize == 0) {
+      return;
+    }
+
+    Buffer &staging = meshStagingBuffers[current_frame];
+    staging = createMappedBuffer(context(), stagingSize,
+                                 vk::BufferUsageFlagBits::eTransferSrc);
+    auto *stagingData = static_cast<uint8_t *>(staging.mapped);
+    vk::DeviceSize stagingOffset = 0;
+    auto stage = [&](const Buffer &destination, vk::DeviceSize offset,
+                     const void *data, vk::DeviceSize size) {
+      if (size == 0) {
+        return;
+      }
+      memcpy(stagingData + stagingOffset, data, size);
+      vk::BufferCopy region(stagingOffset, offset, size);
+      pendingMeshCopies.push_back({staging.buffer, destination.buffer, region});
+      stagingOffset += size;
+    };
+    // Cleared entries have no draws, cull.comp skips them
+    auto clearSlot = [&](uint32_t slot) {
+      GpuSection empty{};
+      stage(sectionTableBuffer, slot * sizeof(GpuSection), &empty,
+            sizeof(empty));
+    };
+
+    for (uint32_t slot : freedSlots) {
+      clearSlot(slot);
+    }
+    // Unloaded chunks' tint maps, so the next chunk in the slot starts out
+    // with the default colours
+    static const std::array<uint32_t, CHUNK_TINT_COLORS> noTints{};
+    for (uint32_t slot : freedTintSlots) {
+      stage(chunkTintBuffer, slot * sizeof(noTints), noTints.data(),
+            sizeof(noTints));
+    }
+
+    for (const auto &mesh : meshes) {
+      auto it = sectionBuffers.find(mesh.pos);
+      bool remesh = it != sectionBuffers.end();
+      SectionBuffers section = remesh ? it->second : SectionBuffers{};
+      if (!remesh) {
+        if (freeSectionSlots.empty() && sectionSlots == MAX_SECTIONS) {
+          fmt::println("Section table is full, not drawing section {} {} {}",
+                       mesh.pos.x, mesh.pos.y, mesh.pos.z);
+          translucentSorter->removeSection(mesh.pos);
+          continue;
+        }
+        if (freeSectionSlots.empty()) {
+          section.slot = sectionSlots++;
+        } else {
+          section.slot = freeSectionSlots.back();
+          freeSectionSlots.pop_back();
+        }
+      }
+
+      uint32_t vertexCount = 0;
+      uint32_t indexCount = 0;
+      for (int i = 0; i < RENDER_LAYER_COUNT; i++) {
+        const MeshLayer &layer = mesh.layers[i];
+        section.layers[i] = {indexCount,
+                             static_cast<uint32_t>(layer.indices.size()),
+                             vertexCount};
+        vertexCount += layer.vertices.size();
+        indexCount += layer.indices.size();
+      }
+      if (!allocateRanges(section, vertexCount, indexCount)) {
+        handleFullTerrainBuffers(mesh.pos, vertexCount, indexCount);
+        translucentSorter->removeSection(mesh.pos);
+        freedSlots.push_back(section.slot);
+        if (remesh) {
+          // Its old ranges are gone already
+          residency->addMeshBytes(mesh.pos.chunk(), -meshBytes(it->second));
+          removeSectionBox(it->second.boxIndex);
+          sectionBuffers.erase(it);
+          clearSlot(section.slot);
+        }
+        continue;
+      }
+
+      for (int i = 0; i < RENDER_LAYER_COUNT; i++) {
+        const MeshLayer &layer = mesh.layers[i];
+        const MeshLayerRange &range = section.layers[i];
+        stage(terrainVertexBuffer,
+              (section.firstVertex + range.vertexOffset) *
+                  sizeof(TerrainVertex),
+              layer.vertices.data(),
+              layer.vertices.size() * sizeof(TerrainVertex));
+        stage(terrainIndexBuffer,
+              (section.firstIndex + range.indexOffset) * sizeof(uint32_t),
+              layer.indices.data(), layer.indices.size() * sizeof(uint32_t));
+      }
+
+      float min[3];
+      float max[3];
+      const int origin[3] = {mesh.pos.x * 16, mesh.pos.y * 16,
+                             mesh.pos.z * 16};
+      for (int i = 0; i < 3; i++) {
+        section.boundsMin[i] = mesh.boundsMin[i];
+        section.boundsMax[i] = mesh.boundsMax[i];
+        min[i] = origin[i] + mesh.boundsMin[i];
+        max[i] = origin[i] + mesh.boundsMax[i];
+      }
+      section.lodLevel = mesh.lodLevel;
+      GpuSection entry = sectionEntry(mesh.pos, section);
+      stage(sectionTableBuffer, section.slot * sizeof(GpuSection), &entry,
+            sizeof(entry));
+
+      residency->addMeshBytes(mesh.pos.chunk(),
+                              meshBytes(section) -
+                                  (remesh ? meshBytes(it->second) : 0));
+      if (remesh) {
+        sectionBoxes.set(section.boxIndex, min, max);
+        it->second = section;
+      } else {
+        section.boxIndex = sectionBoxes.add(min, max);
+        boxSections.push_back(mesh.pos);
+        sectionBuffers.emplace(mesh.pos, section);
+      }
+    }
+
+    for (const auto &sorted : sorts) {
+      auto it = sectionBuffers.find(sorted.pos);
+      if (it == sectionBuffers.end()) {
+        continue;
+      }
+      const SectionBuffers &section = it->second;
+      const MeshLayerRange &range =
+          section.layers[static_cast<int>(RenderLayer::Translucent)];
+      if (range.indexCount != sorted.indices.size()) {
+        continue;
+      }
+      stage(terrainIndexBuffer,
+            (section.firstIndex + range.indexOffset) * sizeof(uint32_t),
+            sorted.indices.data(), sorted.indices.size() * sizeof(uint32_t));
+    }
+
+    for (const auto &chunkTints : tints) {
+      auto it = chunkTintSlots.find(chunkTints.pos);
+      if (it != chunkTintSlots.end()) {
+        stage(chunkTintBuffer, it->second * sizeof(chunkTints.colors),
+              chunkTints.colors.data(), sizeof(chunkTints.colors));
+      }
+    }
+
+    freeSectionSlots.insert(freeSectionSlots.end(), freedSlots.begin(),
+                            freedSlots.end());
+    freeTintSlots.insert(freeTintSlots.end(), freedTintSlots.begin(),
+                         freedTintSlots.end());
+  }
+
+  // Finds room for a mesh's vertices and indices. A remeshed section keeps
+  // its ranges when the new mesh fits in them or in the free space right
+  // after them. On failure the section is left without ranges.
+  bool allocateRanges(SectionBuffers &section, uint32_t vertexCount,
+                      uint32_t indexCount) {
+    if (section.vertexCount > 0 &&
+        vertexAllocator.resize(section.firstVertex, section.vertexCount,
+                               vertexCount)) {
+      section.vertexCount = vertexCount;
+      if (indexAllocator.resize(section.firstIndex, section.indexCount,
+                                indexCount)) {
+        section.indexCount = indexCount;
+        return true;
+      }
+    }
+    vertexAllocator.free(section.firstVertex, section.vertexCount);
+    indexAllocator.free(section.firstIndex, section.indexCount);
+    section.vertexCount = 0;
+    section.indexCount = 0;
+
+    auto firstVertex = vertexAllocator.allocate(vertexCount);
+    auto firstIndex = indexAllocator.allocate(indexCount);
+    if (!firstVertex || !firstIndex) {
+      if (firstVertex) {
+        vertexAllocator.free(*firstVertex, vertexCount);
+      }
+      if (firstIndex) {
+        indexAllocator.free(*firstIndex, indexCount);
+      }
+      return false;
+    }
+    section.firstVertex = *firstVertex;
+    section.vertexCount = vertexCount;
+    section.firstIndex = *firstIndex;
+    section.indexCount = indexCount;
+    return true;
+  }
+
+  // If there would be room after compacting, compacts next frame and meshes
+  // the section again. Otherwise it's dropped.
+  void handleFullTerrainBuffers(SectionPos pos, uint32_t vertexCount,
+                                uint32_t indexCount) {
+    auto vertexStats = vertexAllocator.stats();
+    auto indexStats = indexAllocator.stats();
+    if (vertexStats.capacity - vertexStats.used >= vertexCount &&
+        indexStats.capacity - indexStats.used >= indexCount) {
+      compactionRequested = true;
+      meshScheduler->requestMesh(pos);
+      return;
+    }
+    fmt::println("Terrain buffers are full, not drawing section {} {} {}",
+                 pos.x, pos.y, pos.z);
+  }
+
+  GpuSection sectionEntry(SectionPos pos, const SectionBuffers &section) {
+    GpuSection entry{};
+    entry.position[0] = pos.x;
+    entry.position[1] = pos.y;
+    entry.position[2] = pos.z;
+    auto tintSlot = chunkTintSlots.find(pos.chunk());
+    entry.position[3] = tintSlot == chunkTintSlots.end()
+                            ? -1
+                            : static_cast<int32_t>(tintSlot->second);
+    for (int i = 0; i < 3; i++) {
+      entry.boundsMin[i] = section.boundsMin[i];
+      entry.boundsMax[i] = section.boundsMax[i];
+    }
+    for (int i = 0; i < RENDER_LAYER_COUNT; i++) {
+      const MeshLayerRange &range = section.layers[i];
+      entry.layers[i][0] = section.firstIndex + range.indexOffset;
+      entry.layers[i][1] = range.indexCount;
+      entry.layers[i][2] = section.firstVertex + range.vertexOffset;
+    }
+    return entry;
+  }
+
+  static int64_t meshBytes(const SectionBuffers &section) {
+    return section.vertexCount * sizeof(TerrainVertex) +
+           section.indexCount * sizeof(uint32_t);
+  }
+
+  // Frees the section's ranges, its slot is left to the caller
+  void removeSection(
+      std::unordered_map<SectionPos, SectionBuffers>::iterator it) {
+    const SectionBuffers &section = it->second;
+    vertexAllocator.free(section.firstVertex, section.vertexCount);
+    indexAllocator.free(section.firstIndex, section.indexCount);
+    residency->addMeshBytes(it->first.chunk(), -meshBytes(section));
+    removeSectionBox(section.boxIndex);
+    translucentSorter->removeSection(it->first);
+    sectionBuffers.erase(it);
+  }
+
+  // Compacts when an allocation failed for lack of a big enough free range,
+  // or once free space has splintered past COMPACTION_THRESHOLD
+  bool compactTerrainBuffersIfNeeded() {
+    if (sectionBuffers.empty()) {
+      return false;
+    }
+    float fragmentation =
+        std::max(vertexAllocator.stats().fragmentation(),
+                 indexAllocator.stats().fragmentation());
+    if (!compactionRequested && fragmentation < COMPACTION_THRESHOLD) {
+      return false;
+    }
+    compactionRequested = false;
+    compactTerrainBuffers();
+    return true;
+  }
+
+  // Packs every section's vertices and indices to the start of new terrain
+  // buffers and points the sections and their table entries at the new
+  // ranges. The copies run on the GPU at the start of this frame without
+  // anything waiting on them, and the old buffers are destroyed once the
+  // frame is done.
+  void compactTerrainBuffers() {
+    Buffer vertices = createTerrainBuffer(
+        TERRAIN_VERTEX_CAPACITY * sizeof(TerrainVertex),
+        vk::BufferUsageFlagBits::eVertexBuffer);
+    Buffer indices =
+        createTerrainBuffer(TERRAIN_INDEX_CAPACITY * sizeof(uint32_t),
+                            vk::BufferUsageFlagBits::eIndexBuffer);
+    Buffer &staging = meshStagingBuffers[current_frame];
+    staging = createMappedBuffer(context(),
+                                 sectionBuffers.size() * sizeof(GpuSection),
+                                 vk::BufferUsageFlagBits::eTransferSrc);
+    auto *entries = static_cast<GpuSection *>(staging.mapped);
+
+    // Grouped by buffer so each group is recorded as one copy
+    std::vector<MeshCopy> vertexCopies;
+    std::vector<MeshCopy> indexCopies;
+    std::vector<MeshCopy> entryCopies;
+    uint32_t nextVertex = 0;
+    uint32_t nextIndex = 0;
+    for (auto &[pos, section] : sectionBuffers) {
+      vertexCopies.push_back(
+          {terrainVertexBuffer.buffer, vertices.buffer,
+           vk::BufferCopy(section.firstVertex * sizeof(TerrainVertex),
+                          nextVertex * sizeof(TerrainVertex),
+                          section.vertexCount * sizeof(TerrainVertex))});
+      indexCopies.push_back(
+          {terrainIndexBuffer.buffer, indices.buffer,
+           vk::BufferCopy(section.firstIndex * sizeof(uint32_t),
+                          nextIndex * sizeof(uint32_t),
+                          section.indexCount * sizeof(uint32_t))});
+      section.firstVertex = nextVertex;
+      section.firstIndex = nextIndex;
+      nextVertex += section.vertexCount;
+      nextIndex += section.indexCount;
+
+      entries[entryCopies.size()] = sectionEntry(pos, section);
+      entryCopies.push_back(
+          {staging.buffer, sectionTableBuffer.buffer,
+           vk::BufferCopy(entryCopies.size() * sizeof(GpuSection),
+                          section.slot * sizeof(GpuSection),
+                          sizeof(GpuSection))});
+    }
+    for (auto *copies : {&vertexCopies, &indexCopies, &entryCopies}) {
+      pendingMeshCopies.insert(pendingMeshCopies.end(), copies->begin(),
+                               copies->end());
+    }
+
+    retiredBuffers[current_frame].push_back(terrainVertexBuffer);
+    retiredBuffers[current_frame].push_back(terrainIndexBuffer);
+    terrainVertexBuffer = vertices;
+    terrainIndexBuffer = indices;
+    vertexAllocator = RangeAllocator(TERRAIN_VERTEX_CAPACITY);
+    vertexAllocator.allocate(nextVertex);
+    indexAllocator = RangeAllocator(TERRAIN_INDEX_CAPACITY);
+    indexAllocator.allocate(nextIndex);
+
+    fmt::println("Compacted the terrain buffers");
+    printTerrainStats();
+  }
+
+  void printTerrainStats() {
+    auto print = [](const char *name, const AllocatorStats &stats) {
+      fmt::println("Terrain {}: {} of {} used ({:.1f}%), {} free ranges, "
+                   "largest {}, fragmentation {:.2f}",
+                   name, stats.used, stats.capacity,
+                   100.0 * stats.used / stats.capacity, stats.freeRanges,
+                   stats.largestFreeRange, stats.fragmentation());
+    };
+    print("vertices", vertexAllocator.stats());
+    print("indices", indexAllocator.stats());
+    fmt::println("Section slots: {} in use of {}",
+                 sectionBuffers.size(), MAX_SECTIONS);
+
+    struct LevelStats {
+      size_t sections = 0;
+      size_t triangles = 0;
+      size_t bytes = 0;
+    };
+    std::array<LevelStats, LOD_LEVELS> levels;
+    for (const auto &[pos, section] : sectionBuffers) {
+      LevelStats &level = levels[section.lodLevel];
+      level.sections++;
+      level.triangles += section.indexCount / 3;
+      level.bytes += section.vertexCount * sizeof(TerrainVertex) +
+                     section.indexCount * sizeof(uint32_t);
+    }
+    for (int i = 0; i < LOD_LEVELS; i++) {
+      fmt::println("LOD {}: {} sections, {} triangles, {:.1f} MiB", i,
+                   levels[i].sections, levels[i].triangles,
+                   levels[i].bytes / 1048576.0);
+    }
+  }
+
+  void removeSectionBox(size_t index) {
+    // The last box moves into the hole
+    sectionBoxes.removeSwap(index);
+    if (index < boxSections.size() - 1) {
+      boxSections[index] = boxSections.back();
+      sectionBuffers.at(boxSections[index]).boxIndex = index;
+    }
+    boxSections.pop_back();
+  }
+
+  void recordMeshCopies(vk::CommandBuffer commandBuffer) {
+    if (pendingMeshCopies.empty()) {
+      return;
+    }
+    // Freed ranges are reused right away, so the frame still in flight has
+    // to be done reading them
+    const auto readStages = vk::PipelineStageFlagBits::eDrawIndirect |
+                            vk::PipelineStageFlagBits::eVertexInput |
+                            vk::PipelineStageFlagBits::eVertexShader |
+                            vk::PipelineStageFlagBits::eFragmentShader |
+                            vk::PipelineStageFlagBits::eComputeShader;
+    commandBuffer.pipelineBarrier(readStages,
+                                  vk::PipelineStageFlagBits::eTransfer, {}, {},
+                                  {}, {});
+    std::vector<vk::BufferCopy> regions;
+    for (size_t i = 0; i < pendingMeshCopies.size();) {
+      const MeshCopy &first = pendingMeshCopies[i];
+      regions.clear();
+      for (; i < pendingMeshCopies.size() &&
+             pendingMeshCopies[i].source == first.source &&
+             pendingMeshCopies[i].destination == first.destination;
+           i++) {
+        regions.push_back(pendingMeshCopies[i].region);
+      }
+      commandBuffer.copyBuffer(first.source, first.destination, regions);
+    }
+    vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,
+                              vk::AccessFlagBits::eVertexAttributeRead |
+                                  vk::AccessFlagBits::eIndexRead |
+                                  vk::AccessFlagBits::eShaderRead);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  readStages, {}, {barrier}, {}, {});
+    pendingMeshCopies.clear();
+  }
+
+  // Called once the frame's fence has signalled
+  void releaseFrameResources(uint32_t frame) {
+    for (auto &buffer : retiredBuffers[frame]) {
+      destroyBuffer(device, buffer);
+    }
+    retiredBuffers[frame].clear();
+    if (meshStagingBuffers[frame].buffer) {
+      destroyBuffer(device, meshStagingBuffers[frame]);
+    }
+  }
+
   void createSyncObjects() {
     imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -555,6 +2711,7 @@ private:
     for (auto framebuffer : swapChainFrameBuffers) {
       device.destroyFramebuffer(framebuffer);
     }
+    destroyImage(device, depthImage);
     for (auto imageView : swapChainImageViews) {
       device.destroyImageView(imageView);
     }
@@ -575,6 +2732,7 @@ private:
 
     createSwapChain();
     createImageViews();
+    createDepthResources();
     createFramebuffers();
   }
 
@@ -584,6 +2742,7 @@ private:
         vk::Result::eSuccess) {
       throw std::runtime_error("failed to wait for in flight fence");
     }
+    releaseFrameResources(current_frame);
 
     auto acquireResult = device.acquireNextImageKHR(
         swapChain, std::numeric_limits<uint64_t>::max(),
@@ -599,6 +2758,17 @@ private:
 
     device.resetFences(inFlightFences[current_frame]);
 
+    insertLoadedChunks();
+    updateResidency();
+    updateLight();
+    updateBiomeTints();
+    scheduleMeshes();
+    uploadCompletedMeshes();
+    translucentSorter->update(camera.position);
+    cullSections();
+    updateEntities();
+    updateUniformBuffer(current_frame);
+
     commandBuffers[current_frame].reset();
     recordCommandBuffer(commandBuffers[current_frame], imageIndex);
 
@@ -630,7 +2800,154 @@ private:
   }
 };
 
-int main() {
-  Application app;
+// A clip like a walk cycle, on a skeleton the size of an armor stand's,
+// played by every entity from a different point so their keyframe
+// intervals don't line up. Prints how many entities are animated per
+// millisecond, sampling their tracks one at a time and in a batch.
+static void benchmarkAnimation(size_t entities) {
+  const int BONES = 12;
+  const int KEYFRAMES = 9;
+  const int FRAMES = 240;
+  const float CLIP_SECONDS = 2;
+
+  std::vector<Track<Vec3>> translations;
+  std::vector<Track<Quat>> rotations;
+  for (int bone = 0; bone < BONES; bone++) {
+    std::vector<Keyframe<Vec3>> offsets;
+    std::vector<Keyframe<Quat>> turns;
+    for (int key = 0; key < KEYFRAMES; key++) {
+      float time = CLIP_SECONDS * key / (KEYFRAMES - 1);
+      float phase = std::sin(bone + key * 0.8f);
+      auto interpolation =
+          key % 2 ? Interpolation::CatmullRom : Interpolation::Linear;
+      offsets.push_back({time, {0, phase * 0.1f, phase * 0.2f}, interpolation});
+      turns.push_back({time, axisAngle({1, 0, phase}, phase), interpolation});
+    }
+    translations.emplace_back(std::move(offsets));
+    rotations.emplace_back(std::move(turns));
+  }
+
+  TransformBatch batch;
+  std::vector<float> clocks(entities);
+  for (size_t entity = 0; entity < entities; entity++) {
+    for (int bone = 0; bone < BONES; bone++) {
+      batch.addVec3(translations[bone], entity);
+      batch.addQuat(rotations[bone], entity);
+    }
+  }
+  auto advance = [&](int frame) {
+    for (size_t entity = 0; entity < entities; entity++) {
+      float start = CLIP_SECONDS * entity / entities;
+      clocks[entity] = std::fmod(start + frame / 60.0f, CLIP_SECONDS);
+    }
+  };
+  auto report = [entities](const char *name, auto evaluate) {
+    auto start = std::chrono::steady_clock::now();
+    float checksum = 0;
+    for (int frame = 0; frame < FRAMES; frame++) {
+      checksum += evaluate(frame);
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    double perFrame = elapsed.count() / FRAMES;
+    fmt::println("{}: {:.3f} ms a frame, {:.0f} entities per ms", name,
+                 perFrame, entities / perFrame);
+    // Keeps the work from being optimized out, and shows both agree
+    fmt::println("  checksum {:.2f}", checksum);
+  };
+
+  fmt::println("{} entities of {} bones", entities, BONES);
+  report("One at a time", [&](int frame) {
+    advance(frame);
+    float checksum = 0;
+    for (size_t entity = 0; entity < entities; entity++) {
+      for (int bone = 0; bone < BONES; bone++) {
+        checksum += translations[bone].sampleAt(clocks[entity]).y;
+        checksum += rotations[bone].sampleAt(clocks[entity]).w;
+      }
+    }
+    return checksum;
+  });
+  std::string name = fmt::format("Batched, {}", batch.instructionSet());
+  report(name.c_str(), [&](int frame) {
+    advance(frame);
+    batch.evaluate(clocks);
+    float checksum = 0;
+    for (size_t channel = 0; channel < batch.vec3Count(); channel++) {
+      checksum += batch.vec3(channel).y + batch.quat(channel).w;
+    }
+    return checksum;
+  });
+}
+
+static Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--resource-pack" && i + 1 < argc) {
+      options.resourcePack = argv[++i];
+    } else if (arg == "--world" && i + 1 < argc) {
+      options.world = argv[++i];
+    } else if (arg == "--schematic" && i + 4 < argc) {
+      options.schematic = argv[i + 1];
+      options.schematicOrigin = {std::stoi(argv[i + 2]),
+                                 std::stoi(argv[i + 3]),
+                                 std::stoi(argv[i + 4])};
+      i += 4;
+    } else if (arg == "--entities" && i + 7 < argc) {
+      options.entityGroups.push_back(
+          {argv[i + 1], argv[i + 2], argv[i + 3], std::stoul(argv[i + 4]),
+           {std::stod(argv[i + 5]), std::stod(argv[i + 6]),
+            std::stod(argv[i + 7])}});
+      i += 7;
+    } else if (arg == "--view-distance" && i + 1 < argc) {
+      options.viewDistance = std::stoi(argv[++i]);
+    } else if (arg == "--cpu-budget" && i + 1 < argc) {
+      options.cpuBudgetMiB = std::stoul(argv[++i]);
+    } else if (arg == "--gpu-budget" && i + 1 < argc) {
+      options.gpuBudgetMiB = std::stoul(argv[++i]);
+    } else if (arg == "--no-greedy") {
+      options.greedyMeshing = false;
+    } else if (arg == "--no-cave-culling") {
+      options.caveCulling = false;
+    } else if (arg == "--cpu-culling") {
+      options.gpuCulling = false;
+    } else if (arg == "--lod-distance" && i + 1 < argc) {
+      options.lodDistance = std::stod(argv[++i]);
+    } else if (arg == "--no-lod") {
+      options.lodDistance = 0;
+    } else if (arg == "--biome-blend" && i + 1 < argc) {
+      options.biomeBlend = std::stoi(argv[++i]);
+    } else if (arg == "--time" && i + 1 < argc) {
+      options.dayTime = std::stod(argv[++i]);
+    } else if (arg == "--daylight-cycle") {
+      options.daylightCycle = true;
+    } else if (arg == "--gamma" && i + 1 < argc) {
+      options.gamma = std::stof(argv[++i]);
+    } else if (arg == "--camera" && i + 3 < argc) {
+      options.cameraPosition = {std::stod(argv[i + 1]), std::stod(argv[i + 2]),
+                                std::stod(argv[i + 3])};
+      i += 3;
+    } else if (arg == "--benchmark-animation" && i + 1 < argc) {
+      options.animationBenchmark = std::stoul(argv[++i]);
+    } else if (arg == "--camera-path" && i + 1 < argc) {
+      options.cameraPath = argv[++i];
+    } else if (arg == "--center" && i + 2 < argc) {
+      options.center.x = std::stoi(argv[++i]);
+      options.center.z = std::stoi(argv[++i]);
+    } else {
+      throw std::runtime_error(fmt::format("unknown argument: {}", arg));
+    }
+  }
+  return options;
+}
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  if (options.animationBenchmark) {
+    benchmarkAnimation(*options.animationBenchmark);
+    return 0;
+  }
+  Application app(options);
   app.loop();
 }
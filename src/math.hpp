@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cmath>
+
+struct Vec3 {
+  float x = 0;
+  float y = 0;
+  float z = 0;
+
+  Vec3 operator+(Vec3 other) const {
+    return {x + other.x, y + other.y, z + other.z};
+  }
+  Vec3 operator-(Vec3 other) const {
+    return {x - other.x, y - other.y, z - other.z};
+  }
+  Vec3 operator*(float scale) const {
+    return {x * scale, y * scale, z * scale};
+  }
+  Vec3 &operator+=(Vec3 other) { return *this = *this + other; }
+};
+
+inline float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+inline Vec3 cross(Vec3 a, Vec3 b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+          a.x * b.y - a.y * b.x};
+}
+
+inline Vec3 normalize(Vec3 v) { return v * (1.0f / std::sqrt(dot(v, v))); }
+
+inline Vec3 lerp(Vec3 a, Vec3 b, float t) { return a + (b - a) * t; }
+
+// Unit quaternion rotation
+struct Quat {
+  float x = 0;
+  float y = 0;
+  float z = 0;
+  float w = 1;
+
+  Quat operator+(Quat other) const {
+    return {x + other.x, y + other.y, z + other.z, w + other.w};
+  }
+  Quat operator-(Quat other) const {
+    return {x - other.x, y - other.y, z - other.z, w - other.w};
+  }
+  Quat operator*(float scale) const {
+    return {x * scale, y * scale, z * scale, w * scale};
+  }
+  Quat operator-() const { return {-x, -y, -z, -w}; }
+};
+
+inline float dot(Quat a, Quat b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+inline Quat normalize(Quat q) { return q * (1.0f / std::sqrt(dot(q, q))); }
+
+// Rotation by a, then b
+inline Quat operator*(Quat b, Quat a) {
+  return {b.w * a.x + b.x * a.w + b.y * a.z - b.z * a.y,
+          b.w * a.y - b.x * a.z + b.y * a.w + b.z * a.x,
+          b.w * a.z + b.x * a.y - b.y * a.x + b.z * a.w,
+          b.w * a.w - b.x * a.x - b.y * a.y - b.z * a.z};
+}
+
+inline Quat axisAngle(Vec3 axis, float radians) {
+  float s = std::sin(radians / 2);
+  Vec3 n = normalize(axis);
+  return {n.x * s, n.y * s, n.z * s, std::cos(radians / 2)};
+}
+
+// Takes the shorter way round. Falls back to a normalized lerp when the
+// rotations are too close for the angle to be accurate.
+inline Quat slerp(Quat a, Quat b, float t) {
+  float cosine = dot(a, b);
+  if (cosine < 0) {
+    b = -b;
+    cosine = -cosine;
+  }
+  if (cosine > 0.9995f) {
+    return normalize(a + (b - a) * t);
+  }
+  float angle = std::acos(cosine);
+  float inverseSine = 1.0f / std::sin(angle);
+  return a * (std::sin((1 - t) * angle) * inverseSine) +
+         b * (std::sin(t * angle) * inverseSine);
+}
+
+// Column major, like GLSL's mat4: m[column * 4 + row]
+struct Mat4 {
+  float m[16] = {};
+
+  static Mat4 identity() {
+    Mat4 result;
+    result.m[0] = result.m[5] = result.m[10] = result.m[15] = 1;
+    return result;
+  }
+
+  float &at(int row, int column) { return m[column * 4 + row]; }
+  float at(int row, int column) const { return m[column * 4 + row]; }
+
+  Mat4 operator*(const Mat4 &other) const {
+    Mat4 result;
+    for (int column = 0; column < 4; column++) {
+      for (int row = 0; row < 4; row++) {
+        float sum = 0;
+        for (int k = 0; k < 4; k++) {
+          sum += at(row, k) * other.at(k, column);
+        }
+        result.at(row, column) = sum;
+      }
+    }
+    return result;
+  }
+};
+
+// Right handed with y up, mapping depth to Vulkan's 0-1 range. Y is flipped
+// so that up is up in Vulkan's y down clip space.
+inline Mat4 perspective(float verticalFov, float aspect, float near,
+                        float far) {
+  float focal = 1.0f / std::tan(verticalFov / 2);
+  Mat4 result;
+  result.at(0, 0) = focal / aspect;
+  result.at(1, 1) = -focal;
+  result.at(2, 2) = far / (near - far);
+  result.at(2, 3) = near * far / (near - far);
+  result.at(3, 2) = -1;
+  return result;
+}
+
+// Rotation only view matrix for a camera looking along forward
+inline Mat4 lookDirection(Vec3 forward, Vec3 up) {
+  Vec3 f = normalize(forward);
+  Vec3 r = normalize(cross(f, up));
+  Vec3 u = cross(r, f);
+  Mat4 result = Mat4::identity();
+  result.at(0, 0) = r.x;
+  result.at(0, 1) = r.y;
+  result.at(0, 2) = r.z;
+  result.at(1, 0) = u.x;
+  result.at(1, 1) = u.y;
+  result.at(1, 2) = u.z;
+  result.at(2, 0) = -f.x;
+  result.at(2, 1) = -f.y;
+  result.at(2, 2) = -f.z;
+  return result;
+}
@@ -0,0 +1,1078 @@
+#include "mesher.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MESHER_X86
+#endif
+
+namespace {
+
+// For merging, faces are stored by direction in slices along the axis they
+// point at. Per direction: {normal axis, row axis, column axis}.
+const int SLICE_AXES[DIRECTION_COUNT][3] = {{1, 0, 2}, {1, 0, 2}, {2, 0, 1},
+                                            {2, 0, 1}, {0, 2, 1}, {0, 2, 1}};
+
+// Mesh jobs handed to the pool at once, per worker. Enough to keep the
+// workers busy for a frame while leaving the rest queued, where they can
+// still be reordered as the camera moves.
+const size_t JOBS_PER_WORKER = 16;
+
+// Offset between neighbouring blocks in a padded section, by direction
+const int PADDED_OFFSETS[DIRECTION_COUNT] = {
+    -PADDED_SIZE * PADDED_SIZE, PADDED_SIZE * PADDED_SIZE, -PADDED_SIZE,
+    PADDED_SIZE,                -1,                        1};
+
+// Chunks past a level boundary before switching levels
+const double LOD_HYSTERESIS = 1.0;
+
+uint32_t packPosition(float value) {
+  long fixed = std::lround((value + TERRAIN_POSITION_BIAS) *
+                           TERRAIN_POSITION_SCALE);
+  return static_cast<uint32_t>(std::clamp(fixed, 0L, 0xffffL));
+}
+
+uint32_t packUv(float value) {
+  long fixed = std::lround(value * TERRAIN_UV_SCALE);
+  return static_cast<uint32_t>(std::clamp(fixed, 0L, 0x1ffL));
+}
+
+// A vertex's lighting the way TerrainVertex::z holds it from bit 21:
+// ambient occlusion (2) | block light (4) | sky light (4). light is packed
+// block light << 4 | sky light, like the light World extracts.
+uint32_t vertexLight(uint32_t ambientOcclusion, uint32_t light) {
+  return ambientOcclusion | (light >> 4) << 2 | (light & 15) << 6;
+}
+
+// Roughly the brightness shader.vert gives a vertex's lighting
+uint32_t vertexBrightness(uint32_t light) {
+  const uint32_t AO_WEIGHTS[4] = {10, 14, 17, 20};
+  return AO_WEIGHTS[light & 3] * (std::max(light >> 2 & 15, light >> 6) + 1);
+}
+
+// Tint colours and directional shading are applied in the vertex shader from
+// the tint type and normal. light holds vertexLight() values.
+void emitQuad(MeshLayer &layer, const float origin[3],
+              const float positions[4][3], const float uvs[4][2],
+              uint32_t sprite, TintType tint, Direction normal, bool shade,
+              const uint32_t light[4]) {
+  auto base = static_cast<uint32_t>(layer.vertices.size());
+  for (int i = 0; i < 4; i++) {
+    TerrainVertex &vertex = layer.vertices.emplace_back();
+    vertex.x = packPosition(origin[0] + positions[i][0]) |
+               packPosition(origin[1] + positions[i][1]) << 16;
+    vertex.y = packPosition(origin[2] + positions[i][2]) |
+               (sprite & 0x1fff) << 16 | static_cast<uint32_t>(tint) << 29;
+    vertex.z = packUv(uvs[i][0]) | packUv(uvs[i][1]) << 9 |
+               static_cast<uint32_t>(normal) << 18 | light[i] << 21 |
+               static_cast<uint32_t>(shade) << 31;
+  }
+
+  // Split along the diagonal between the brighter pair of corners, so a
+  // quad with one dark corner shades the same whichever way it's rotated
+  bool flip = vertexBrightness(light[0]) + vertexBrightness(light[2]) <
+              vertexBrightness(light[1]) + vertexBrightness(light[3]);
+  static const uint32_t ORDERS[2][6] = {{0, 1, 2, 2, 3, 0},
+                                        {1, 2, 3, 3, 0, 1}};
+  for (uint32_t index : ORDERS[flip]) {
+    layer.indices.push_back(base + index);
+  }
+}
+
+// The same lighting on every vertex
+void emitQuad(MeshLayer &layer, const float origin[3],
+              const float positions[4][3], const float uvs[4][2],
+              uint32_t sprite, TintType tint, Direction normal, bool shade,
+              uint32_t light) {
+  const uint32_t uniform[4] = {light, light, light, light};
+  emitQuad(layer, origin, positions, uvs, sprite, tint, normal, shade,
+           uniform);
+}
+
+void computeBounds(SectionMesh &mesh) {
+  uint32_t min[3] = {0xffff, 0xffff, 0xffff};
+  uint32_t max[3] = {0, 0, 0};
+  for (const auto &layer : mesh.layers) {
+    for (const auto &vertex : layer.vertices) {
+      uint32_t position[3] = {vertex.x & 0xffff, vertex.x >> 16,
+                              vertex.y & 0xffff};
+      for (int i = 0; i < 3; i++) {
+        min[i] = std::min(min[i], position[i]);
+        max[i] = std::max(max[i], position[i]);
+      }
+    }
+  }
+  if (mesh.empty()) {
+    return;
+  }
+  for (int i = 0; i < 3; i++) {
+    mesh.boundsMin[i] = min[i] / TERRAIN_POSITION_SCALE - TERRAIN_POSITION_BIAS;
+    mesh.boundsMax[i] = max[i] / TERRAIN_POSITION_SCALE - TERRAIN_POSITION_BIAS;
+  }
+}
+
+// Corners of a face of the box from-to, given in 1/16 blocks, in blocks
+void faceCorners(Direction direction, const float from[3], const float to[3],
+                 float positions[4][3]) {
+  boxFaceCorners(direction, from, to, positions);
+  for (int i = 0; i < 4; i++) {
+    for (float &value : positions[i]) {
+      value /= 16.0f;
+    }
+  }
+}
+
+// The default mapping of a face spanning several blocks continues across
+// them, shift it by whole sprites so it starts at 0. The sprite repeats once
+// per block.
+void repeatingFaceUvs(Direction direction, const float from[3],
+                      const float to[3], float uvs[4][2]) {
+  float rect[4];
+  defaultFaceUv(direction, from, to, rect);
+  float u = std::floor(std::min(rect[0], rect[2]) / 16);
+  float v = std::floor(std::min(rect[1], rect[3]) / 16);
+  float u0 = rect[0] / 16 - u, v0 = rect[1] / 16 - v;
+  float u1 = rect[2] / 16 - u, v1 = rect[3] / 16 - v;
+  const float corners[4][2] = {{u0, v0}, {u0, v1}, {u1, v1}, {u1, v0}};
+  std::copy(&corners[0][0], &corners[0][0] + 8, &uvs[0][0]);
+}
+
+// Whether a block can stand in for a whole cube at lower detail: it has a
+// face on some side of the block space, or is a fluid. Plants, torches and
+// the like vanish in the distance.
+bool representable(const BlockRenderInfo &info) {
+  return info.fluid != Fluid::None ||
+         std::any_of(info.quads.begin(), info.quads.end(),
+                     [](const BakedQuad &quad) {
+                       return quad.cullface != NO_CULLFACE;
+                     });
+}
+
+RenderLayer cellLayer(const BlockRenderInfo &info) {
+  if (info.quads.empty() && info.fluid == Fluid::Water) {
+    return RenderLayer::Translucent;
+  }
+  return info.layer;
+}
+
+// Cells are drawn as full cubes, so any filled neighbour hides a face unless
+// it can be seen through
+bool hidesCellFace(BlockModels &models, BlockStateId id,
+                   BlockStateId neighbour) {
+  if (neighbour == BlockRegistry::AIR) {
+    return false;
+  }
+  const BlockRenderInfo &info = models.info(neighbour);
+  return representable(info) &&
+         (neighbour == id || cellLayer(info) != RenderLayer::Translucent);
+}
+
+// Packed light, the larger block and sky light of the two
+uint8_t maxLight(uint8_t a, uint8_t b) {
+  return std::max(a & 0xf0, b & 0xf0) | std::max(a & 15, b & 15);
+}
+
+// A block's 3x3x3 neighbourhood, gathered from the padded section before its
+// faces are lit. Indexed (y * 3 + z) * 3 + x, the block itself is 13.
+struct Neighbourhood {
+  // Packed light, with room to load it as two SSE registers
+  alignas(16) uint8_t light[32];
+  // A bit per block that occludes
+  uint32_t occluders;
+};
+
+Neighbourhood gatherNeighbourhood(const uint8_t *light,
+                                  const uint32_t *occluding, int r, int x) {
+  // Rows are copied 4 bytes at a time, each overwriting the last one's
+  // extra byte, except the last which could read past the padded section.
+  // Only the first 27 bytes are ever looked at.
+  Neighbourhood around;
+  around.occluders = 0;
+  for (int y = 0; y < 3; y++) {
+    for (int z = 0; z < 3; z++) {
+      int row = r + (y - 1) * PADDED_SIZE + z - 1;
+      int cell = (y * 3 + z) * 3;
+      std::memcpy(around.light + cell, light + row * PADDED_SIZE + x - 1,
+                  cell == 24 ? 3 : 4);
+      around.occluders |= (occluding[row] >> (x - 1) & 7) << cell;
+    }
+  }
+  return around;
+}
+
+// The blocks of a neighbourhood lighting each corner of a face: the two
+// beside the corner, the one diagonally across and the one in front of the
+// face, all in the layer in front of the face, or in the block's own layer
+// for faces inside the block. Corners are numbered as by SIDE_AXES.
+struct FaceSamples {
+  // Per sample, per corner
+  uint8_t cells[4][4];
+  // All nine blocks sampled, as indices and as a mask
+  uint8_t layer[9];
+  uint32_t layerMask;
+  // The same as pshufb controls on either half of Neighbourhood::light
+  uint8_t shuffleLow[16];
+  uint8_t shuffleHigh[16];
+};
+
+struct FaceSampleTable {
+  // By direction, then whether the face lies on the side of the block
+  FaceSamples faces[DIRECTION_COUNT][2];
+
+  constexpr FaceSampleTable() : faces() {
+    for (int d = 0; d < DIRECTION_COUNT; d++) {
+      const int axes[3] = {3 - SIDE_AXES[d][0] - SIDE_AXES[d][1],
+                           SIDE_AXES[d][0], SIDE_AXES[d][1]};
+      for (int flush = 0; flush < 2; flush++) {
+        FaceSamples &samples = faces[d][flush];
+        samples.layerMask = 0;
+        for (int i = 0; i < 9; i++) {
+          int c[3] = {};
+          c[axes[0]] = flush ? (d % 2 ? 2 : 0) : 1;
+          c[axes[1]] = i % 3;
+          c[axes[2]] = i / 3;
+          samples.layer[i] = static_cast<uint8_t>((c[1] * 3 + c[2]) * 3 + c[0]);
+          samples.layerMask |= 1u << samples.layer[i];
+        }
+        for (int corner = 0; corner < 4; corner++) {
+          int u = corner & 1 ? 2 : 0;
+          int v = corner & 2 ? 2 : 0;
+          const int offsets[4][2] = {{u, 1}, {1, v}, {u, v}, {1, 1}};
+          for (int sample = 0; sample < 4; sample++) {
+            int c[3] = {};
+            c[axes[0]] = flush ? (d % 2 ? 2 : 0) : 1;
+            c[axes[1]] = offsets[sample][0];
+            c[axes[2]] = offsets[sample][1];
+            auto cell = static_cast<uint8_t>((c[1] * 3 + c[2]) * 3 + c[0]);
+            int byte = sample * 4 + corner;
+            samples.cells[sample][corner] = cell;
+            samples.shuffleLow[byte] = cell < 16 ? cell : 0x80;
+            samples.shuffleHigh[byte] = cell < 16 ? 0x80 : cell - 16;
+          }
+        }
+      }
+    }
+  }
+};
+
+constexpr FaceSampleTable FACE_SAMPLES;
+
+// Vanilla's smooth light for the four corners of a face, packed a byte per
+// corner: the rounded average of the corner's samples, where samples in the
+// dark (inside opaque blocks or unloaded chunks) take the light in front of
+// the face instead. Bit c of hidden drops corner c's diagonal sample, when
+// the blocks on both sides of it occlude.
+uint32_t cornerLightScalar(const Neighbourhood &around,
+                           const FaceSamples &samples, unsigned hidden) {
+  uint32_t packed = 0;
+  for (int corner = 0; corner < 4; corner++) {
+    uint32_t front = around.light[samples.cells[3][corner]];
+    uint32_t block = front >> 4;
+    uint32_t sky = front & 15;
+    for (int sample = 0; sample < 3; sample++) {
+      uint32_t light = around.light[samples.cells[sample][corner]];
+      if (sample == 2 && (hidden >> corner & 1)) {
+        light = 0;
+      }
+      light = light ? light : front;
+      block += light >> 4;
+      sky += light & 15;
+    }
+    packed |= ((block + 2) >> 2 << 4 | (sky + 2) >> 2) << corner * 8;
+  }
+  return packed;
+}
+
+#ifdef MESHER_X86
+// Byte masks for the corners in hidden
+struct HiddenMasks {
+  uint32_t masks[16];
+
+  constexpr HiddenMasks() : masks() {
+    for (unsigned hidden = 0; hidden < 16; hidden++) {
+      for (int corner = 0; corner < 4; corner++) {
+        masks[hidden] |= (hidden >> corner & 1 ? 0xffu : 0) << corner * 8;
+      }
+    }
+  }
+};
+
+constexpr HiddenMasks HIDDEN_MASKS;
+
+// Rounded averages of the four 4-byte groups of nibbles, in the low 4 bytes
+__attribute__((target("sse2"))) __m128i averageGroups(__m128i values) {
+  values = _mm_add_epi8(values, _mm_srli_si128(values, 8));
+  values = _mm_add_epi8(values, _mm_srli_si128(values, 4));
+  values = _mm_add_epi8(values, _mm_set1_epi8(2));
+  return _mm_and_si128(_mm_srli_epi16(values, 2), _mm_set1_epi8(15));
+}
+
+// All 16 samples of a face at once, a sample per 4-byte group
+__attribute__((target("ssse3"))) uint32_t
+cornerLightSsse3(const Neighbourhood &around, const FaceSamples &samples,
+                 unsigned hidden) {
+  const auto *light = reinterpret_cast<const __m128i *>(around.light);
+  __m128i values = _mm_or_si128(
+      _mm_shuffle_epi8(_mm_load_si128(light),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                           samples.shuffleLow))),
+      _mm_shuffle_epi8(_mm_load_si128(light + 1),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                           samples.shuffleHigh))));
+  values = _mm_andnot_si128(
+      _mm_set_epi32(0, static_cast<int>(HIDDEN_MASKS.masks[hidden]), 0, 0),
+      values);
+  __m128i front = _mm_shuffle_epi32(values, 0xff);
+  __m128i dark = _mm_cmpeq_epi8(values, _mm_setzero_si128());
+  values =
+      _mm_or_si128(_mm_andnot_si128(dark, values), _mm_and_si128(dark, front));
+
+  const __m128i nibble = _mm_set1_epi8(15);
+  __m128i sky = averageGroups(_mm_and_si128(values, nibble));
+  __m128i block =
+      averageGroups(_mm_and_si128(_mm_srli_epi16(values, 4), nibble));
+  return static_cast<uint32_t>(
+      _mm_cvtsi128_si32(_mm_or_si128(_mm_slli_epi16(block, 4), sky)));
+}
+#endif
+
+using CornerLightFn = uint32_t (*)(const Neighbourhood &, const FaceSamples &,
+                                   unsigned);
+
+CornerLightFn selectCornerLight() {
+#ifdef MESHER_X86
+  if (__builtin_cpu_supports("ssse3")) {
+    return cornerLightSsse3;
+  }
+#endif
+  return cornerLightScalar;
+}
+
+// Smooth light and ambient occlusion of a face's corners as vertexLight()
+// values. A corner is darker for each of its three side and diagonal blocks
+// that occlude, and fully dark when both sides do.
+void smoothFaceLight(const Neighbourhood &around, const FaceSamples &samples,
+                     uint32_t out[4]) {
+  static const CornerLightFn cornerLight = selectCornerLight();
+  // Most faces look out on open space of a single light level
+  if (!(around.occluders & samples.layerMask)) {
+    uint8_t light = around.light[samples.layer[0]];
+    if (std::all_of(samples.layer + 1, samples.layer + 9, [&](uint8_t cell) {
+          return around.light[cell] == light;
+        })) {
+      std::fill_n(out, 4, vertexLight(3, light));
+      return;
+    }
+  }
+  uint32_t occlusion[4];
+  unsigned hidden = 0;
+  for (int corner = 0; corner < 4; corner++) {
+    uint32_t side = around.occluders >> samples.cells[0][corner] & 1;
+    uint32_t otherSide = around.occluders >> samples.cells[1][corner] & 1;
+    uint32_t diagonal = around.occluders >> samples.cells[2][corner] & 1;
+    hidden |= (side & otherSide) << corner;
+    occlusion[corner] = side & otherSide ? 0 : 3 - side - otherSide - diagonal;
+  }
+  uint32_t light = cornerLight(around, samples, hidden);
+  for (int corner = 0; corner < 4; corner++) {
+    out[corner] = vertexLight(occlusion[corner], light >> corner * 8 & 0xff);
+  }
+}
+
+// Lights a quad's vertices from the corners of the face they lie in,
+// interpolating for vertices inside it
+void quadVertexLight(const BakedQuad &quad, const uint32_t corners[4],
+                     uint32_t out[4]) {
+  const int *axes = SIDE_AXES[static_cast<int>(quad.face)];
+  for (int i = 0; i < 4; i++) {
+    if (quad.sideCorners[i] >= 0) {
+      out[i] = corners[quad.sideCorners[i]];
+      continue;
+    }
+    float u = std::clamp(quad.positions[i][axes[0]], 0.0f, 1.0f);
+    float v = std::clamp(quad.positions[i][axes[1]], 0.0f, 1.0f);
+    const float weights[4] = {(1 - u) * (1 - v), u * (1 - v), (1 - u) * v,
+                              u * v};
+    float occlusion = 0, block = 0, sky = 0;
+    for (int corner = 0; corner < 4; corner++) {
+      occlusion += weights[corner] * (corners[corner] & 3);
+      block += weights[corner] * (corners[corner] >> 2 & 15);
+      sky += weights[corner] * (corners[corner] >> 6);
+    }
+    auto round = [](float value) {
+      return static_cast<uint32_t>(value + 0.5f);
+    };
+    out[i] = round(occlusion) | round(block) << 2 | round(sky) << 6;
+  }
+}
+
+// Everything that has to match for two faces to be merged, packed so 0
+// means no face: light << 21 | sprite << 8 | 1 << 7 | shade << 6 |
+// tinted << 5 | tint << 2 | layer, light being the vertexLight() shared by
+// all four corners
+uint32_t faceKey(const BakedQuad &quad, const BlockRenderInfo &info,
+                 uint32_t light) {
+  return light << 21 | (quad.sprite & 0x1fff) << 8 | 1 << 7 |
+         quad.shade << 6 | quad.tinted << 5 |
+         static_cast<uint32_t>(info.tint) << 2 |
+         static_cast<uint32_t>(info.layer);
+}
+
+// Flat light for a face of a cube of cell^3 blocks at cell position c in a
+// bordered section: the light in front of the middle of the face, at the top
+// of the cell where surfaces are. In the dark, that above the cell.
+uint32_t cellFaceLight(const uint8_t *light, int cell, const int c[3],
+                       Direction direction) {
+  const int size = borderedSize(cell);
+  int block[3];
+  for (int a = 0; a < 3; a++) {
+    block[a] = c[a] * cell + cell / 2;
+  }
+  block[1] = c[1] * cell + cell - 1;
+  int d = static_cast<int>(direction);
+  int axis = SLICE_AXES[d][0];
+  block[axis] = d % 2 ? (c[axis] + 1) * cell : c[axis] * cell - 1;
+  uint8_t value = light[(block[1] * size + block[2]) * size + block[0]];
+  if (!value) {
+    int y = (c[1] + 1) * cell;
+    int x = c[0] * cell + cell / 2;
+    int z = c[2] * cell + cell / 2;
+    value = light[(y * size + z) * size + x];
+  }
+  return vertexLight(3, value);
+}
+
+// Visible face rows are only computed for y in 1-16, which keeps the rows
+// above and below in bounds
+const int FIRST_ROW = PADDED_SIZE;
+const int END_ROW = PADDED_SIZE * (PADDED_SIZE - 1);
+
+// Row offsets of the neighbouring rows below, above, north and south
+const int ROW_OFFSETS[4] = {-PADDED_SIZE, PADDED_SIZE, -1, 1};
+
+void computeVisibleFacesScalar(const uint32_t *solid,
+                               const uint32_t *occluding,
+                               uint32_t (*visible)[MASK_ROWS], int first,
+                               int end) {
+  for (int r = first; r < end; r++) {
+    for (int d = 0; d < 4; d++) {
+      visible[d][r] = solid[r] & ~occluding[r + ROW_OFFSETS[d]];
+    }
+    // Within a row a block's west neighbour is the next lower bit
+    visible[4][r] = solid[r] & ~(occluding[r] << 1);
+    visible[5][r] = solid[r] & ~(occluding[r] >> 1);
+  }
+}
+
+#ifdef MESHER_X86
+__attribute__((target("sse2"))) void
+computeVisibleFacesSse2(const uint32_t *solid, const uint32_t *occluding,
+                        uint32_t (*visible)[MASK_ROWS]) {
+  static_assert((END_ROW - FIRST_ROW) % 4 == 0);
+  for (int r = FIRST_ROW; r < END_ROW; r += 4) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(solid + r));
+    for (int d = 0; d < 4; d++) {
+      __m128i o = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(occluding + r + ROW_OFFSETS[d]));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(visible[d] + r),
+                       _mm_andnot_si128(o, s));
+    }
+    __m128i o =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(occluding + r));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(visible[4] + r),
+                     _mm_andnot_si128(_mm_slli_epi32(o, 1), s));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(visible[5] + r),
+                     _mm_andnot_si128(_mm_srli_epi32(o, 1), s));
+  }
+}
+
+__attribute__((target("avx2"))) void
+computeVisibleFacesAvx2(const uint32_t *solid, const uint32_t *occluding,
+                        uint32_t (*visible)[MASK_ROWS]) {
+  static_assert((END_ROW - FIRST_ROW) % 8 == 0);
+  for (int r = FIRST_ROW; r < END_ROW; r += 8) {
+    __m256i s =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(solid + r));
+    for (int d = 0; d < 4; d++) {
+      __m256i o = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(occluding + r + ROW_OFFSETS[d]));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(visible[d] + r),
+                          _mm256_andnot_si256(o, s));
+    }
+    __m256i o =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(occluding + r));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(visible[4] + r),
+                        _mm256_andnot_si256(_mm256_slli_epi32(o, 1), s));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(visible[5] + r),
+                        _mm256_andnot_si256(_mm256_srli_epi32(o, 1), s));
+  }
+}
+#endif
+
+using VisibleFacesFn = void (*)(const uint32_t *, const uint32_t *,
+                                uint32_t (*)[MASK_ROWS]);
+
+VisibleFacesFn selectComputeVisibleFaces() {
+#ifdef MESHER_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return computeVisibleFacesAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return computeVisibleFacesSse2;
+  }
+#endif
+  return [](const uint32_t *solid, const uint32_t *occluding,
+            uint32_t(*visible)[MASK_ROWS]) {
+    computeVisibleFacesScalar(solid, occluding, visible, FIRST_ROW, END_ROW);
+  };
+}
+
+} // namespace
+
+void computeVisibleFaces(const uint32_t *solid, const uint32_t *occluding,
+                         uint32_t (*visible)[MASK_ROWS]) {
+  static const VisibleFacesFn impl = selectComputeVisibleFaces();
+  impl(solid, occluding, visible);
+}
+
+bool SectionMesh::empty() const {
+  return std::all_of(layers.begin(), layers.end(), [](const MeshLayer &layer) {
+    return layer.indices.empty();
+  });
+}
+
+Mesher::Mesher(BlockModels &models, bool greedy)
+    : models(models), greedy(greedy) {}
+
+void Mesher::meshSection(const BlockStateId *padded, const uint8_t *light,
+                         SectionMesh &out) const {
+  // Mergeable faces by direction and slice, filled in below and turned into
+  // quads at the end. Merging clears every key it consumes, so the buffer is
+  // all zero again for the next section.
+  thread_local std::vector<uint32_t> faceKeys(DIRECTION_COUNT * 4096);
+  uint16_t sliceFaces[DIRECTION_COUNT * 16] = {};
+
+  // Runs of the same state are common, so only look up when it changes.
+  // The masks get a bit for every block that isn't air, and for every
+  // block that occludes its neighbours.
+  const BlockRenderInfo *infos[PADDED_VOLUME];
+  uint32_t solid[MASK_ROWS];
+  uint32_t occluding[MASK_ROWS];
+  uint32_t alwaysMeshed[MASK_ROWS];
+  BlockStateId lastId = padded[0];
+  const BlockRenderInfo *lastInfo = &models.info(lastId);
+  for (int r = 0; r < MASK_ROWS; r++) {
+    uint32_t solidRow = 0;
+    uint32_t occludingRow = 0;
+    uint32_t alwaysRow = 0;
+    for (int x = 0; x < PADDED_SIZE; x++) {
+      int i = r * PADDED_SIZE + x;
+      if (padded[i] != lastId) {
+        lastId = padded[i];
+        lastInfo = &models.info(lastId);
+      }
+      infos[i] = lastInfo;
+      solidRow |= uint32_t(lastId != BlockRegistry::AIR) << x;
+      occludingRow |= uint32_t(lastInfo->occludes) << x;
+      alwaysRow |= uint32_t(lastInfo->alwaysMeshed) << x;
+    }
+    solid[r] = solidRow;
+    occluding[r] = occludingRow;
+    alwaysMeshed[r] = alwaysRow;
+  }
+
+  out.faceConnections = computeFaceConnections(occluding);
+
+  uint32_t visible[DIRECTION_COUNT][MASK_ROWS];
+  computeVisibleFaces(solid, occluding, visible);
+
+  for (int y = 1; y <= 16; y++) {
+    for (int z = 1; z <= 16; z++) {
+      int r = y * PADDED_SIZE + z;
+      // Blocks with at least one side that isn't covered up, leaving out
+      // the border
+      uint32_t candidates = visible[0][r] | visible[1][r] | visible[2][r] |
+                            visible[3][r] | visible[4][r] | visible[5][r] |
+                            (alwaysMeshed[r] & solid[r]);
+      candidates &= 0x1fffe;
+
+      while (candidates) {
+        int x = std::countr_zero(candidates);
+        candidates &= candidates - 1;
+        int i = r * PADDED_SIZE + x;
+        BlockStateId id = padded[i];
+        const BlockRenderInfo &info = *infos[i];
+        float origin[3] = {static_cast<float>(x - 1),
+                           static_cast<float>(y - 1),
+                           static_cast<float>(z - 1)};
+
+        // Blocks that give off light and models without ambient occlusion
+        // are lit flat, by the light in front of each face. The rest get
+        // smooth light per corner, worked out once per face direction from
+        // the block's neighbourhood.
+        bool smooth = info.ambientOcclusion && info.lightEmission == 0;
+        Neighbourhood around;
+        if (smooth) {
+          around = gatherNeighbourhood(light, occluding, r, x);
+        }
+        uint32_t faceLight[DIRECTION_COUNT][2][4];
+        uint32_t litFaces = 0;
+
+        MeshLayer &layer = out.layers[static_cast<int>(info.layer)];
+        for (size_t q = 0; q < info.quads.size(); q++) {
+          const BakedQuad &quad = info.quads[q];
+          if (quad.cullface != NO_CULLFACE &&
+              (!(visible[quad.cullface][r] >> x & 1) ||
+               (info.selfCulling &&
+                padded[i + PADDED_OFFSETS[quad.cullface]] == id))) {
+            continue;
+          }
+
+          int face = static_cast<int>(quad.face);
+          bool onSide = quad.onSide;
+          uint32_t vertices[4];
+          if (smooth) {
+            uint32_t *corners = faceLight[face][onSide];
+            if (!(litFaces >> (face * 2 + onSide) & 1)) {
+              litFaces |= 1u << (face * 2 + onSide);
+              smoothFaceLight(around, FACE_SAMPLES.faces[face][onSide],
+                              corners);
+            }
+            quadVertexLight(quad, corners, vertices);
+          } else {
+            uint8_t front = light[onSide ? i + PADDED_OFFSETS[face] : i];
+            front = maxLight(front, info.lightEmission << 4);
+            std::fill_n(vertices, 4, vertexLight(3, front));
+          }
+
+          if (greedy && quad.cullface != NO_CULLFACE &&
+              info.mergeableQuads[quad.cullface] == static_cast<int>(q) &&
+              std::all_of(vertices + 1, vertices + 4,
+                          [&](uint32_t v) { return v == vertices[0]; })) {
+            const int *axes = SLICE_AXES[quad.cullface];
+            int local[3] = {x - 1, y - 1, z - 1};
+            int slice = quad.cullface * 16 + local[axes[0]];
+            faceKeys[(slice * 16 + local[axes[2]]) * 16 + local[axes[1]]] =
+                faceKey(quad, info, vertices[0]);
+            sliceFaces[slice]++;
+            continue;
+          }
+
+          emitQuad(layer, origin, quad.positions, quad.uvs, quad.sprite,
+                   quad.tinted ? info.tint : TintType::None, quad.face,
+                   quad.shade, vertices);
+        }
+
+        if (info.fluid == Fluid::None) {
+          continue;
+        }
+
+        // Fluids are boxes whose faces touching the same fluid or an opaque
+        // block are hidden. The surface sits a little below the top of the
+        // block unless more fluid is stacked on it.
+        Fluid fluid = info.fluid;
+        bool covered = infos[i + PADDED_OFFSETS[1]]->fluid == fluid;
+        const float from[3] = {0, 0, 0};
+        const float to[3] = {16, covered ? 16.0f : 14.0f, 16};
+        MeshLayer &fluidLayer =
+            out.layers[static_cast<int>(fluid == Fluid::Water
+                                            ? RenderLayer::Translucent
+                                            : RenderLayer::Opaque)];
+        TintType fluidTint =
+            fluid == Fluid::Water ? TintType::Water : TintType::None;
+
+        for (int d = 0; d < DIRECTION_COUNT; d++) {
+          if (!(visible[d][r] >> x & 1) ||
+              infos[i + PADDED_OFFSETS[d]]->fluid == fluid) {
+            continue;
+          }
+          auto direction = static_cast<Direction>(d);
+          float positions[4][3];
+          float rect[4];
+          faceCorners(direction, from, to, positions);
+          defaultFaceUv(direction, from, to, rect);
+          const float uvs[4][2] = {{rect[0] / 16, rect[1] / 16},
+                                   {rect[0] / 16, rect[3] / 16},
+                                   {rect[2] / 16, rect[3] / 16},
+                                   {rect[2] / 16, rect[1] / 16}};
+          emitQuad(fluidLayer, origin, positions, uvs,
+                   models.fluidSprite(fluid), fluidTint, direction, true,
+                   vertexLight(3, maxLight(light[i],
+                                           light[i + PADDED_OFFSETS[d]])));
+        }
+      }
+    }
+  }
+
+  if (greedy) {
+    mergeFaces(faceKeys.data(), sliceFaces, out);
+  }
+  computeBounds(out);
+}
+
+void Mesher::mergeFaces(uint32_t *faceKeys, const uint16_t *sliceFaces,
+                        SectionMesh &out) const {
+  for (int d = 0; d < DIRECTION_COUNT; d++) {
+    auto direction = static_cast<Direction>(d);
+    int normal = SLICE_AXES[d][0];
+    int axisA = SLICE_AXES[d][1];
+    int axisB = SLICE_AXES[d][2];
+
+    for (int slice = 0; slice < 16; slice++) {
+      if (sliceFaces[d * 16 + slice] == 0) {
+        continue;
+      }
+      auto mask = reinterpret_cast<uint32_t(*)[16]>(
+          faceKeys + (d * 16 + slice) * 256);
+
+      for (int b = 0; b < 16; b++) {
+        for (int a = 0; a < 16;) {
+          uint32_t key = mask[b][a];
+          if (!key) {
+            a++;
+            continue;
+          }
+
+          int width = 1;
+          while (a + width < 16 && mask[b][a + width] == key) {
+            width++;
+          }
+          int height = 1;
+          while (b + height < 16 &&
+                 std::all_of(&mask[b + height][a], &mask[b + height][a + width],
+                             [key](uint32_t other) { return other == key; })) {
+            height++;
+          }
+          for (int row = b; row < b + height; row++) {
+            std::fill_n(&mask[row][a], width, 0);
+          }
+
+          float from[3];
+          float to[3];
+          from[normal] = slice * 16.0f;
+          to[normal] = (slice + 1) * 16.0f;
+          from[axisA] = a * 16.0f;
+          to[axisA] = (a + width) * 16.0f;
+          from[axisB] = b * 16.0f;
+          to[axisB] = (b + height) * 16.0f;
+
+          float positions[4][3];
+          float uvs[4][2];
+          faceCorners(direction, from, to, positions);
+          repeatingFaceUvs(direction, from, to, uvs);
+
+          auto layer = static_cast<RenderLayer>(key & 3);
+          auto tint = static_cast<TintType>(key >> 2 & 7);
+          bool tinted = key >> 5 & 1;
+          bool shade = key >> 6 & 1;
+          const float origin[3] = {0, 0, 0};
+          emitQuad(out.layers[static_cast<int>(layer)], origin, positions,
+                   uvs, key >> 8 & 0x1fff, tinted ? tint : TintType::None,
+                   direction, shade, key >> 21);
+          a += width;
+        }
+      }
+    }
+  }
+}
+
+void Mesher::meshSection(const BlockStateId *bordered, const uint8_t *light,
+                         MeshDetail detail, SectionMesh &out) const {
+  out.lodLevel = detail.level;
+  if (detail.level == 0) {
+    meshSection(bordered, light, out);
+    if (detail.skirtSides) {
+      addSkirts(bordered, light, 0, detail.skirtSides, out);
+      computeBounds(out);
+    }
+    return;
+  }
+
+  int grid = (16 >> detail.level) + 2;
+  thread_local std::vector<BlockStateId> cells;
+  cells.resize(grid * grid * grid);
+  meshDownsampled(bordered, light, detail.level, cells.data(), out);
+  if (detail.skirtSides) {
+    addSkirts(cells.data(), light, detail.level, detail.skirtSides, out);
+  }
+  computeBounds(out);
+}
+
+void Mesher::meshDownsampled(const BlockStateId *bordered,
+                             const uint8_t *light, int level,
+                             BlockStateId *cells, SectionMesh &out) const {
+  const int cell = 1 << level;
+  const int size = borderedSize(cell);
+  const int grid = (16 >> level) + 2;
+  auto block = [&](int x, int y, int z) {
+    return bordered[(y * size + z) * size + x];
+  };
+  // Runs of the same state are common, so only look up when it changes
+  BlockStateId lastId = BlockRegistry::AIR;
+  bool lastFilled = false;
+  auto filled = [&](BlockStateId id) {
+    if (id != lastId) {
+      lastId = id;
+      lastFilled =
+          id != BlockRegistry::AIR && representable(models.info(id));
+    }
+    return lastFilled;
+  };
+
+  // Cave culling works from the full detail blocks, so what's culled doesn't
+  // change with distance
+  uint32_t occluding[MASK_ROWS] = {};
+  for (int y = 1; y <= 16; y++) {
+    for (int z = 1; z <= 16; z++) {
+      uint32_t row = 0;
+      for (int x = 0; x < PADDED_SIZE; x++) {
+        BlockStateId id = block(x + cell - 1, y + cell - 1, z + cell - 1);
+        row |= uint32_t(models.info(id).occludes) << x;
+      }
+      occluding[y * PADDED_SIZE + z] = row;
+    }
+  }
+  out.faceConnections = computeFaceConnections(occluding);
+
+  // Each cell takes the most common state of its highest layer that has
+  // anything in it, if at least half of its blocks are filled
+  struct Count {
+    BlockStateId id;
+    int count;
+  };
+  Count counts[64];
+  for (int cy = 0; cy < grid; cy++) {
+    for (int cz = 0; cz < grid; cz++) {
+      for (int cx = 0; cx < grid; cx++) {
+        int filledBlocks = 0;
+        BlockStateId top = BlockRegistry::AIR;
+        for (int y = cy * cell + cell - 1; y >= cy * cell; y--) {
+          int distinct = 0;
+          for (int z = cz * cell; z < (cz + 1) * cell; z++) {
+            for (int x = cx * cell; x < (cx + 1) * cell; x++) {
+              BlockStateId id = block(x, y, z);
+              if (!filled(id)) {
+                continue;
+              }
+              filledBlocks++;
+              if (top != BlockRegistry::AIR) {
+                continue;
+              }
+              Count *it = std::find_if(
+                  counts, counts + distinct,
+                  [id](const Count &count) { return count.id == id; });
+              if (it == counts + distinct) {
+                counts[distinct++] = {id, 0};
+              }
+              it->count++;
+            }
+          }
+          if (distinct) {
+            top = std::max_element(counts, counts + distinct,
+                                   [](const Count &a, const Count &b) {
+                                     return a.count < b.count;
+                                   })
+                      ->id;
+          }
+        }
+        cells[(cy * grid + cz) * grid + cx] =
+            filledBlocks * 2 >= cell * cell * cell ? top : BlockRegistry::AIR;
+      }
+    }
+  }
+
+  const int offsets[DIRECTION_COUNT] = {-grid * grid, grid * grid, -grid,
+                                        grid,         -1,          1};
+  for (int cy = 1; cy < grid - 1; cy++) {
+    for (int cz = 1; cz < grid - 1; cz++) {
+      for (int cx = 1; cx < grid - 1; cx++) {
+        int i = (cy * grid + cz) * grid + cx;
+        BlockStateId id = cells[i];
+        if (id == BlockRegistry::AIR) {
+          continue;
+        }
+        const BlockRenderInfo &info = models.info(id);
+        const float from[3] = {(cx - 1) * cell * 16.0f,
+                               (cy - 1) * cell * 16.0f,
+                               (cz - 1) * cell * 16.0f};
+        const float to[3] = {from[0] + cell * 16, from[1] + cell * 16,
+                             from[2] + cell * 16};
+        const int c[3] = {cx, cy, cz};
+        for (int d = 0; d < DIRECTION_COUNT; d++) {
+          if (!hidesCellFace(models, id, cells[i + offsets[d]])) {
+            auto direction = static_cast<Direction>(d);
+            emitCellFace(out, info, direction, from, to,
+                         cellFaceLight(light, cell, c, direction));
+          }
+        }
+      }
+    }
+  }
+}
+
+void Mesher::addSkirts(const BlockStateId *cells, const uint8_t *light,
+                       int level, uint8_t sides, SectionMesh &out) const {
+  const int cell = 1 << level;
+  const int count = 16 >> level;
+  const int grid = count + 2;
+  // A coarser neighbour's surface may be up to one of its cells off
+  const float depth = 2 * cell * 16.0f;
+
+  for (int d = static_cast<int>(Direction::North); d < DIRECTION_COUNT; d++) {
+    if (!(sides >> d & 1)) {
+      continue;
+    }
+    auto direction = static_cast<Direction>(d);
+    int axis = direction < Direction::West ? 2 : 0;
+    int offset = axis == 2 ? grid : 1;
+    if (d % 2 == 0) {
+      offset = -offset;
+    }
+
+    for (int cy = 1; cy <= count; cy++) {
+      for (int along = 1; along <= count; along++) {
+        int c[3];
+        c[1] = cy;
+        c[axis] = d % 2 ? count : 1;
+        c[2 - axis] = along;
+        int i = (c[1] * grid + c[2]) * grid + c[0];
+        BlockStateId id = cells[i];
+        // Only along the surface, where this side was hidden by the
+        // neighbour but may not be by its other level
+        if (id == BlockRegistry::AIR ||
+            !representable(models.info(id)) ||
+            hidesCellFace(models, id, cells[i + grid * grid]) ||
+            !hidesCellFace(models, id, cells[i + offset])) {
+          continue;
+        }
+
+        float from[3];
+        float to[3];
+        for (int a = 0; a < 3; a++) {
+          from[a] = (c[a] - 1) * cell * 16.0f;
+          to[a] = from[a] + cell * 16;
+        }
+        from[1] = to[1] - depth;
+        emitCellFace(out, models.info(id), direction, from, to,
+                     cellFaceLight(light, cell, c, direction));
+      }
+    }
+  }
+}
+
+void Mesher::emitCellFace(SectionMesh &out, const BlockRenderInfo &info,
+                          Direction direction, const float from[3],
+                          const float to[3], uint32_t light) const {
+  // The block's own face on that side if it has one, or else anything that
+  // faces that way
+  auto facing = [&](auto predicate) {
+    return std::find_if(info.quads.begin(), info.quads.end(), predicate);
+  };
+  auto quad = facing([direction](const BakedQuad &quad) {
+    return quad.cullface == static_cast<uint8_t>(direction);
+  });
+  if (quad == info.quads.end()) {
+    quad = facing(
+        [direction](const BakedQuad &quad) { return quad.face == direction; });
+  }
+
+  uint32_t sprite;
+  TintType tint;
+  bool shade;
+  if (quad != info.quads.end()) {
+    sprite = quad->sprite;
+    tint = quad->tinted ? info.tint : TintType::None;
+    shade = quad->shade;
+  } else if (info.fluid != Fluid::None) {
+    sprite = models.fluidSprite(info.fluid);
+    tint = info.fluid == Fluid::Water ? TintType::Water : TintType::None;
+    shade = true;
+  } else if (!info.quads.empty()) {
+    sprite = info.quads[0].sprite;
+    tint = info.quads[0].tinted ? info.tint : TintType::None;
+    shade = info.quads[0].shade;
+  } else {
+    return;
+  }
+
+  float positions[4][3];
+  float uvs[4][2];
+  faceCorners(direction, from, to, positions);
+  repeatingFaceUvs(direction, from, to, uvs);
+  const float origin[3] = {0, 0, 0};
+  emitQuad(out.layers[static_cast<int>(cellLayer(info))], origin, positions,
+           uvs, sprite, tint, direction, shade, light);
+}
+
+int lodLevelAt(double distance, double lodDistance) {
+  int level = 0;
+  while (level < LOD_LEVELS - 1 && distance >= lodDistance) {
+    level++;
+    lodDistance *= 2;
+  }
+  return level;
+}
+
+int updateLodLevel(int current, double distance, double lodDistance) {
+  int coarser = lodLevelAt(distance - LOD_HYSTERESIS, lodDistance);
+  if (coarser > current) {
+    return coarser;
+  }
+  int finer = lodLevelAt(distance + LOD_HYSTERESIS, lodDistance);
+  return finer < current ? finer : current;
+}
+
+MeshScheduler::MeshScheduler(const World &world, BlockModels &models,
+                             ThreadPool &pool, bool greedy,
+                             std::function<MeshDetail(SectionPos)> detail)
+    : world(world), mesher(models, greedy), detail(std::move(detail)),
+      jobs(pool, JOBS_PER_WORKER) {}
+
+void MeshScheduler::requestMesh(SectionPos pos) {
+  // Sections that are all air have nothing to mesh, skip the round trip
+  // through the pool
+  const Chunk *chunk = world.chunk(pos.chunk());
+  const ChunkSection *section = chunk ? chunk->section(pos.y) : nullptr;
+  if (!section || (section->blocks.isSingleValue() &&
+                   section->blocks.paletteEntries()[0] == BlockRegistry::AIR)) {
+    SectionMesh mesh;
+    mesh.pos = pos;
+    jobs.complete(pos, std::move(mesh));
+    return;
+  }
+  jobs.request(pos);
+}
+
+void MeshScheduler::dispatch(SectionPos center) {
+  jobs.dispatch(center, [this](SectionPos pos) {
+    MeshDetail sectionDetail = detail(pos);
+    return decltype(jobs)::Job([this, pos, sectionDetail] {
+      return meshJob(pos, sectionDetail);
+    });
+  });
+}
+
+SectionMesh MeshScheduler::meshJob(SectionPos pos,
+                                   MeshDetail sectionDetail) const {
+  // Coarser levels read a cell's worth of their neighbours
+  thread_local std::vector<BlockStateId> bordered;
+  thread_local std::vector<uint8_t> light;
+  int border = 1 << sectionDetail.level;
+  int size = borderedSize(border);
+  bordered.resize(size * size * size);
+  light.resize(size * size * size);
+  SectionMesh mesh;
+  mesh.pos = pos;
+  world.extractBordered(pos, border, bordered.data());
+  world.extractBorderedLight(pos, border, light.data());
+  mesher.meshSection(bordered.data(), light.data(), sectionDetail, mesh);
+  return mesh;
+}
+
+std::optional<SectionMesh> MeshScheduler::pollCompleted() {
+  return jobs.poll();
+}
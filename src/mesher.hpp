@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "block_model.hpp"
+#include "chunk.hpp"
+#include "chunk_jobs.hpp"
+#include "coords.hpp"
+#include "thread_pool.hpp"
+#include "visibility.hpp"
+
+// Section relative positions are stored in 16-bit fixed point with this many
+// steps per block, offset so models poking out of the section still fit
+const float TERRAIN_POSITION_SCALE = 2048.0f;
+const float TERRAIN_POSITION_BIAS = 8.0f;
+// Uvs are stored in 1/16 sprites, up to 32 sprites
+const float TERRAIN_UV_SCALE = 16.0f;
+
+// 12 bytes per vertex, unpacked in shader.vert:
+//   x:  position x (16) | position y (16)
+//   y:  position z (16) | sprite (13) | tint type (3)
+//   z:  u (9) | v (9) | normal direction (3) | ambient occlusion (2) |
+//       block light (4) | sky light (4) | directional shading (1)
+struct TerrainVertex {
+  uint32_t x;
+  uint32_t y;
+  uint32_t z;
+};
+
+static_assert(sizeof(TerrainVertex) == 12);
+
+// Levels of detail for distant terrain: level l meshes sections as cubes of
+// 2^l blocks, level 0 is full detail
+const int LOD_LEVELS = 4;
+
+// How a section is meshed
+struct MeshDetail {
+  uint8_t level = 0;
+  // A bit per horizontal Direction whose neighbour is at another level.
+  // Those sides get skirts hanging down from the surface, so the steps
+  // between the two meshes don't leave gaps.
+  uint8_t skirtSides = 0;
+};
+
+// The level for a chunk distance chunks from the camera: full detail up to
+// lodDistance, then each level reaches twice as far as the one before
+int lodLevelAt(double distance, double lodDistance);
+// Moves away from current only once distance is a chunk past a level
+// boundary, so hovering around one doesn't keep remeshing
+int updateLodLevel(int current, double distance, double lodDistance);
+
+struct MeshLayer {
+  std::vector<TerrainVertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+struct SectionMesh {
+  SectionPos pos;
+  // Increases with every request, used to drop results that were
+  // overtaken by a newer request for the same section
+  uint64_t version = 0;
+  std::array<MeshLayer, RENDER_LAYER_COUNT> layers;
+  uint8_t lodLevel = 0;
+  // Bounds of every vertex relative to the section's minimum corner, for
+  // culling. Models may reach a little outside the section.
+  float boundsMin[3] = {};
+  float boundsMax[3] = {};
+  // Used for cave culling, sections that are all air connect everything
+  FaceConnections faceConnections = ALL_FACES_CONNECTED;
+
+  bool empty() const;
+};
+
+// A padded section as one bit per block: a 32-bit row per (y, z) at index
+// y * PADDED_SIZE + z, with bit x set for x in 0-17
+const int MASK_ROWS = PADDED_SIZE * PADDED_SIZE;
+
+// For every row with y in 1-16, sets visible[d][row] to the solid blocks whose
+// neighbour in direction d doesn't occlude. Works on 8 or 4 rows at a time
+// with AVX2 or SSE2.
+void computeVisibleFaces(const uint32_t *solid, const uint32_t *occluding,
+                         uint32_t (*visible)[MASK_ROWS]);
+
+// Turns one section into quads. Only faces that can be seen are emitted: a
+// face with a cullface is dropped when the neighbour in that direction is an
+// opaque full cube, or the same self culling block (like glass). Occlusion
+// is worked out a row of blocks at a time from bit masks, and only blocks
+// with a visible side are visited at all.
+//
+// Vertices get vanilla's smooth lighting: each corner of a face averages
+// the light of the four blocks in front of it that touch the corner, and is
+// darkened by those of them that occlude. Each block's 3x3x3 neighbourhood is
+// gathered first, then the four corners of a face are worked out together
+// with SSSE3.
+//
+// With greedy meshing, whole block faces that look the same (sprite, tint,
+// shading, layer and light on every corner) are merged into larger
+// rectangles per slice. Their uvs run past 1 so the sprite repeats once per
+// block.
+class Mesher {
+public:
+  Mesher(BlockModels &models, bool greedy);
+
+  // padded is a section with its border, as filled by World::extractPadded,
+  // and light its light as filled by World::extractBorderedLight
+  void meshSection(const BlockStateId *padded, const uint8_t *light,
+                   SectionMesh &out) const;
+  // bordered is a section with a border of 2^level blocks, as filled by
+  // World::extractBordered. Levels above 0 are meshed as cubes standing in
+  // for 2^level blocks each: a cell is filled if at least half its blocks
+  // are, and looks like the most common block of its highest filled layer,
+  // so surfaces keep their top blocks. Cubes are lit flat.
+  void meshSection(const BlockStateId *bordered, const uint8_t *light,
+                   MeshDetail detail, SectionMesh &out) const;
+
+private:
+  BlockModels &models;
+  bool greedy;
+
+  void mergeFaces(uint32_t *faceKeys, const uint16_t *sliceFaces,
+                  SectionMesh &out) const;
+  void meshDownsampled(const BlockStateId *bordered, const uint8_t *light,
+                       int level, BlockStateId *cells, SectionMesh &out) const;
+  // cells is a padded grid of cells of 2^level blocks, (16 >> level) + 2
+  // on each side, light the bordered section's light
+  void addSkirts(const BlockStateId *cells, const uint8_t *light, int level,
+                 uint8_t sides, SectionMesh &out) const;
+  void emitCellFace(SectionMesh &out, const BlockRenderInfo &info,
+                    Direction direction, const float from[3],
+                    const float to[3], uint32_t light) const;
+};
+
+// Meshes sections on the thread pool. Finished meshes are handed back
+// through a lock free queue, so the main thread only ever polls.
+//
+// Requests are queued and only handed to the pool a limited number at a
+// time, nearest to the camera first, so an edit next to the camera isn't
+// stuck behind a whole world load.
+class MeshScheduler {
+public:
+  // The pool must be drained before the scheduler is destroyed. detail is
+  // asked how to mesh each section as its job starts, on the main thread.
+  MeshScheduler(const World &world, BlockModels &models, ThreadPool &pool,
+                bool greedy, std::function<MeshDetail(SectionPos)> detail);
+
+  // Main thread. Meshes the section as it will be once the job runs.
+  // Requests for a section that hasn't been dispatched yet are merged, and
+  // results overtaken by a newer request are dropped.
+  void requestMesh(SectionPos pos);
+  // Main thread, once per frame. Starts jobs for the queued sections nearest
+  // to center until the pool has enough work.
+  void dispatch(SectionPos center);
+  // Main thread, never blocks
+  std::optional<SectionMesh> pollCompleted();
+  size_t pendingMeshes() const { return jobs.size(); }
+
+private:
+  const World &world;
+  Mesher mesher;
+  std::function<MeshDetail(SectionPos)> detail;
+  ChunkJobQueue<SectionPos, SectionMesh> jobs;
+
+  SectionMesh meshJob(SectionPos pos, MeshDetail sectionDetail) const;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+// Unbounded lock free queue with any number of producers and a single
+// consumer (Vyukov's intrusive MPSC design). Pushing is a single atomic
+// exchange, so worker threads never wait on the consumer, and popping never
+// blocks: it just returns nothing while the queue is empty.
+template <typename T> class MpscQueue {
+public:
+  MpscQueue() : head(new Node), tail(head.load()) {}
+  ~MpscQueue() {
+    while (tail) {
+      Node *next = tail->next.load();
+      delete tail;
+      tail = next;
+    }
+  }
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // Any thread
+  void push(T value) {
+    Node *node = new Node;
+    node->value.emplace(std::move(value));
+    Node *previous = head.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+  }
+
+  // Consumer thread only. An item whose push is still in progress may be
+  // missed until the next call.
+  std::optional<T> pop() {
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (!next) {
+      return std::nullopt;
+    }
+    std::optional<T> value = std::move(next->value);
+    next->value.reset();
+    delete tail;
+    tail = next;
+    return value;
+  }
+
+private:
+  struct Node {
+    std::atomic<Node *> next = nullptr;
+    std::optional<T> value;
+  };
+
+  // Producers append at the head, the consumer follows the tail. The tail
+  // node is always a stub whose value has already been taken.
+  std::atomic<Node *> head;
+  Node *tail;
+};
@@ -0,0 +1,206 @@
+#include "nbt.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NBT_X86
+#endif
+
+namespace {
+
+void loadBigEndianLongsScalar(const uint8_t *src, uint64_t *dst,
+                              size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    uint64_t value;
+    memcpy(&value, src + i * 8, 8);
+    dst[i] = __builtin_bswap64(value);
+  }
+}
+
+#ifdef NBT_X86
+__attribute__((target("ssse3"))) void
+loadBigEndianLongsSsse3(const uint8_t *src, uint64_t *dst, size_t count) {
+  const __m128i reverse =
+      _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m128i value =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_shuffle_epi8(value, reverse));
+  }
+  loadBigEndianLongsScalar(src + i * 8, dst + i, count - i);
+}
+
+__attribute__((target("avx2"))) void
+loadBigEndianLongsAvx2(const uint8_t *src, uint64_t *dst, size_t count) {
+  // vpshufb shuffles within each 128-bit lane, so the same pattern is
+  // repeated for both halves
+  const __m256i reverse = _mm256_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2,
+      1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 8));
+    __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 8 + 32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_shuffle_epi8(a, reverse));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 4),
+                        _mm256_shuffle_epi8(b, reverse));
+  }
+  for (; i + 4 <= count; i += 4) {
+    __m256i value =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_shuffle_epi8(value, reverse));
+  }
+  loadBigEndianLongsScalar(src + i * 8, dst + i, count - i);
+}
+#endif
+
+using LoadLongsFn = void (*)(const uint8_t *, uint64_t *, size_t);
+
+LoadLongsFn selectLoadBigEndianLongs() {
+#ifdef NBT_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return loadBigEndianLongsAvx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return loadBigEndianLongsSsse3;
+  }
+#endif
+  return loadBigEndianLongsScalar;
+}
+
+template <bool Checked>
+void readPaletteContainer(NbtCursor<Checked> &cursor,
+                          std::vector<NbtBlockState> &palette,
+                          NbtLongArray &data) {
+  cursor.forEachEntry([&](std::string_view name, TagType type) {
+    if (name == "palette" && type == TagType::List) {
+      cursor.forEachElement([&](uint32_t, TagType elementType) {
+        if (elementType != TagType::Compound) {
+          throw NbtError("block palette entry is not a compound");
+        }
+        palette.push_back(readBlockState(cursor));
+      });
+    } else if (name == "data" && type == TagType::LongArray) {
+      data = cursor.readLongArray();
+    } else {
+      cursor.skip(type);
+    }
+  });
+}
+
+template <bool Checked>
+void readBiomeContainer(NbtCursor<Checked> &cursor,
+                        std::vector<std::string_view> &palette,
+                        NbtLongArray &data) {
+  cursor.forEachEntry([&](std::string_view name, TagType type) {
+    if (name == "palette" && type == TagType::List) {
+      cursor.forEachElement([&](uint32_t, TagType elementType) {
+        if (elementType != TagType::String) {
+          throw NbtError("biome palette entry is not a string");
+        }
+        palette.push_back(cursor.readString());
+      });
+    } else if (name == "data" && type == TagType::LongArray) {
+      data = cursor.readLongArray();
+    } else {
+      cursor.skip(type);
+    }
+  });
+}
+
+template <bool Checked>
+ChunkSectionNbt readSection(NbtCursor<Checked> &cursor) {
+  ChunkSectionNbt section;
+  cursor.forEachEntry([&](std::string_view name, TagType type) {
+    if (name == "Y") {
+      section.y = static_cast<int8_t>(cursor.readInteger(type));
+    } else if (name == "block_states" && type == TagType::Compound) {
+      readPaletteContainer(cursor, section.blockPalette, section.blockData);
+    } else if (name == "biomes" && type == TagType::Compound) {
+      readBiomeContainer(cursor, section.biomePalette, section.biomeData);
+    } else if (name == "BlockLight" && type == TagType::ByteArray) {
+      section.blockLight = cursor.readByteArray();
+    } else if (name == "SkyLight" && type == TagType::ByteArray) {
+      section.skyLight = cursor.readByteArray();
+    } else {
+      cursor.skip(type);
+    }
+  });
+  return section;
+}
+
+} // namespace
+
+void loadBigEndianLongs(const uint8_t *src, uint64_t *dst, size_t count) {
+  static const LoadLongsFn impl = selectLoadBigEndianLongs();
+  impl(src, dst, count);
+}
+
+template <bool Checked>
+NbtBlockState readBlockState(NbtCursor<Checked> &cursor) {
+  NbtBlockState state;
+  cursor.forEachEntry([&](std::string_view name, TagType type) {
+    if (name == "Name" && type == TagType::String) {
+      state.name = cursor.readString();
+    } else if (name == "Properties" && type == TagType::Compound) {
+      cursor.forEachEntry([&](std::string_view key, TagType valueType) {
+        if (valueType != TagType::String) {
+          throw NbtError("block state property is not a string");
+        }
+        state.properties.emplace_back(key, cursor.readString());
+      });
+    } else {
+      cursor.skip(type);
+    }
+  });
+  return state;
+}
+
+template <bool Checked>
+ChunkNbt parseChunkNbt(std::span<const uint8_t> data) {
+  NbtCursor<Checked> cursor(data);
+  cursor.readRoot();
+
+  ChunkNbt chunk;
+  cursor.forEachEntry([&](std::string_view name, TagType type) {
+    if (name == "DataVersion") {
+      chunk.dataVersion = cursor.readInteger(type);
+    } else if (name == "xPos") {
+      chunk.x = cursor.readInteger(type);
+    } else if (name == "zPos") {
+      chunk.z = cursor.readInteger(type);
+    } else if (name == "Status" && type == TagType::String) {
+      chunk.status = cursor.readString();
+    } else if (name == "isLightOn") {
+      chunk.lightOn = cursor.readInteger(type) != 0;
+    } else if (name == "sections" && type == TagType::List) {
+      cursor.forEachElement([&](uint32_t, TagType elementType) {
+        if (elementType != TagType::Compound) {
+          throw NbtError("chunk section is not a compound");
+        }
+        chunk.sections.push_back(readSection(cursor));
+      });
+    } else if (name == "block_entities" && type == TagType::List) {
+      cursor.forEachElement([&](uint32_t, TagType elementType) {
+        const uint8_t *start = cursor.position();
+        cursor.skip(elementType);
+        if (elementType == TagType::Compound) {
+          chunk.blockEntities.emplace_back(start, cursor.position());
+        }
+      });
+    } else {
+      cursor.skip(type);
+    }
+  });
+  return chunk;
+}
+
+template NbtBlockState readBlockState<true>(NbtCursor<true> &cursor);
+template NbtBlockState readBlockState<false>(NbtCursor<false> &cursor);
+template ChunkNbt parseChunkNbt<true>(std::span<const uint8_t> data);
+template ChunkNbt parseChunkNbt<false>(std::span<const uint8_t> data);
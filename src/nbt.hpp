@@ -0,0 +1,422 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+enum class TagType : uint8_t {
+  End = 0,
+  Byte = 1,
+  Short = 2,
+  Int = 3,
+  Long = 4,
+  Float = 5,
+  Double = 6,
+  ByteArray = 7,
+  String = 8,
+  List = 9,
+  Compound = 10,
+  IntArray = 11,
+  LongArray = 12,
+};
+
+class NbtError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// Converts big endian 64-bit values to native order, 4 or 2 at a time when
+// the CPU has AVX2 or SSSE3.
+void loadBigEndianLongs(const uint8_t *src, uint64_t *dst, size_t count);
+
+// View of a TAG_Long_Array still in the NBT buffer, in big endian order
+struct NbtLongArray {
+  const uint8_t *data = nullptr;
+  uint32_t count = 0;
+
+  bool empty() const { return count == 0; }
+  uint64_t operator[](size_t index) const {
+    uint64_t value;
+    memcpy(&value, data + index * 8, 8);
+    return __builtin_bswap64(value);
+  }
+  void copyTo(uint64_t *dst) const { loadBigEndianLongs(data, dst, count); }
+};
+
+// View of a TAG_Int_Array still in the NBT buffer, in big endian order
+struct NbtIntArray {
+  const uint8_t *data = nullptr;
+  uint32_t count = 0;
+
+  int32_t operator[](size_t index) const {
+    uint32_t value;
+    memcpy(&value, data + index * 4, 4);
+    return static_cast<int32_t>(__builtin_bswap32(value));
+  }
+};
+
+struct NbtListHeader {
+  TagType elementType;
+  uint32_t count;
+};
+
+// Forward only pull parser over an uncompressed NBT buffer. Nothing is
+// copied: strings and arrays are returned as views into the buffer, which
+// must outlive them. Every value has to be consumed, either by reading it
+// or by skip(), before moving on to the next one.
+//
+// With Checked set, every read is bounds checked and nesting depth is
+// limited, throwing NbtError on malformed input. This is the mode to use for
+// anything read from disk. Unchecked cursors trust the buffer completely.
+template <bool Checked = true> class NbtCursor {
+public:
+  static constexpr int MAX_DEPTH = 512;
+
+  explicit NbtCursor(std::span<const uint8_t> buffer)
+      : pos(buffer.data()), end(buffer.data() + buffer.size()) {}
+
+  const uint8_t *position() const { return pos; }
+  bool atEnd() const { return pos == end; }
+
+  // Reads the root tag header, which must be a compound, and returns its
+  // name. The cursor is then positioned at the compound's payload.
+  std::string_view readRoot() {
+    if (readTagType() != TagType::Compound) {
+      throw NbtError("nbt root is not a compound");
+    }
+    return readString();
+  }
+
+  TagType readTagType() {
+    uint8_t type = readU8();
+    if constexpr (Checked) {
+      if (type > static_cast<uint8_t>(TagType::LongArray)) {
+        throw NbtError("invalid nbt tag type");
+      }
+    }
+    return static_cast<TagType>(type);
+  }
+
+  int8_t readByte() { return static_cast<int8_t>(readU8()); }
+  int16_t readShort() { return static_cast<int16_t>(readU16()); }
+  int32_t readInt() { return static_cast<int32_t>(readU32()); }
+  int64_t readLong() { return static_cast<int64_t>(readU64()); }
+  float readFloat() {
+    uint32_t bits = readU32();
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+  }
+  double readDouble() {
+    uint64_t bits = readU64();
+    double value;
+    memcpy(&value, &bits, 8);
+    return value;
+  }
+
+  // Reads any integral tag as an int64, since some fields changed width
+  // between versions
+  int64_t readInteger(TagType type) {
+    switch (type) {
+    case TagType::Byte:
+      return readByte();
+    case TagType::Short:
+      return readShort();
+    case TagType::Int:
+      return readInt();
+    case TagType::Long:
+      return readLong();
+    default:
+      throw NbtError("nbt tag is not an integer");
+    }
+  }
+
+  // Strings are modified UTF-8, which is plain UTF-8 for everything that
+  // shows up in block and biome names
+  std::string_view readString() {
+    uint16_t length = readU16();
+    need(length);
+    std::string_view value(reinterpret_cast<const char *>(pos), length);
+    pos += length;
+    return value;
+  }
+
+  std::span<const uint8_t> readByteArray() {
+    uint32_t count = readCount();
+    need(count);
+    std::span<const uint8_t> value(pos, count);
+    pos += count;
+    return value;
+  }
+
+  NbtIntArray readIntArray() {
+    uint32_t count = readCount();
+    need(static_cast<size_t>(count) * 4);
+    NbtIntArray value{pos, count};
+    pos += static_cast<size_t>(count) * 4;
+    return value;
+  }
+
+  NbtLongArray readLongArray() {
+    uint32_t count = readCount();
+    need(static_cast<size_t>(count) * 8);
+    NbtLongArray value{pos, count};
+    pos += static_cast<size_t>(count) * 8;
+    return value;
+  }
+
+  NbtListHeader readListHeader() {
+    TagType elementType = readTagType();
+    uint32_t count = readCount();
+    if constexpr (Checked) {
+      // Every element takes at least one byte, which bounds the count by
+      // what's left of the buffer. Only empty lists may have no type.
+      if (elementType == TagType::End && count != 0) {
+        throw NbtError("nbt list of TAG_End is not empty");
+      }
+      need(count);
+    }
+    return {elementType, count};
+  }
+
+  // Iterates a compound's payload, calling f(name, type) for each entry.
+  // f must consume the value. Stops after the terminating TAG_End.
+  template <typename F> void forEachEntry(F &&f) {
+    enter();
+    while (true) {
+      TagType type = readTagType();
+      if (type == TagType::End) {
+        break;
+      }
+      std::string_view name = readString();
+      f(name, type);
+    }
+    leave();
+  }
+
+  // Iterates a list's payload, calling f(index, elementType) for each
+  // element. f must consume the element.
+  template <typename F> void forEachElement(F &&f) {
+    forEachElement(readListHeader(), std::forward<F>(f));
+  }
+
+  // Same as above for when the list header has already been read
+  template <typename F> void forEachElement(NbtListHeader header, F &&f) {
+    enter();
+    for (uint32_t i = 0; i < header.count; i++) {
+      f(i, header.elementType);
+    }
+    leave();
+  }
+
+  void skip(TagType type) {
+    switch (type) {
+    case TagType::End:
+      break;
+    case TagType::Byte:
+      advance(1);
+      break;
+    case TagType::Short:
+      advance(2);
+      break;
+    case TagType::Int:
+    case TagType::Float:
+      advance(4);
+      break;
+    case TagType::Long:
+    case TagType::Double:
+      advance(8);
+      break;
+    case TagType::ByteArray:
+      advance(readCount());
+      break;
+    case TagType::String:
+      advance(readU16());
+      break;
+    case TagType::IntArray:
+      advance(static_cast<size_t>(readCount()) * 4);
+      break;
+    case TagType::LongArray:
+      advance(static_cast<size_t>(readCount()) * 8);
+      break;
+    case TagType::List: {
+      NbtListHeader header = readListHeader();
+      size_t fixedSize = fixedPayloadSize(header.elementType);
+      if (fixedSize != 0 || header.elementType == TagType::End) {
+        advance(fixedSize * header.count);
+      } else {
+        enter();
+        for (uint32_t i = 0; i < header.count; i++) {
+          skip(header.elementType);
+        }
+        leave();
+      }
+      break;
+    }
+    case TagType::Compound:
+      forEachEntry([this](std::string_view, TagType type) { skip(type); });
+      break;
+    default:
+      throw NbtError("invalid nbt tag type");
+    }
+  }
+
+private:
+  const uint8_t *pos;
+  const uint8_t *end;
+  int depth = 0;
+
+  static size_t fixedPayloadSize(TagType type) {
+    switch (type) {
+    case TagType::Byte:
+      return 1;
+    case TagType::Short:
+      return 2;
+    case TagType::Int:
+    case TagType::Float:
+      return 4;
+    case TagType::Long:
+    case TagType::Double:
+      return 8;
+    default:
+      return 0;
+    }
+  }
+
+  void need(size_t bytes) const {
+    if constexpr (Checked) {
+      if (static_cast<size_t>(end - pos) < bytes) {
+        throw NbtError("unexpected end of nbt data");
+      }
+    }
+  }
+
+  void advance(size_t bytes) {
+    need(bytes);
+    pos += bytes;
+  }
+
+  void enter() {
+    if constexpr (Checked) {
+      if (++depth > MAX_DEPTH) {
+        throw NbtError("nbt nesting too deep");
+      }
+    }
+  }
+
+  void leave() {
+    if constexpr (Checked) {
+      depth--;
+    }
+  }
+
+  uint32_t readCount() {
+    int32_t count = readInt();
+    if constexpr (Checked) {
+      if (count < 0) {
+        throw NbtError("negative nbt array length");
+      }
+    }
+    return static_cast<uint32_t>(count);
+  }
+
+  uint8_t readU8() {
+    need(1);
+    return *pos++;
+  }
+
+  uint16_t readU16() {
+    need(2);
+    uint16_t value;
+    memcpy(&value, pos, 2);
+    pos += 2;
+    return __builtin_bswap16(value);
+  }
+
+  uint32_t readU32() {
+    need(4);
+    uint32_t value;
+    memcpy(&value, pos, 4);
+    pos += 4;
+    return __builtin_bswap32(value);
+  }
+
+  uint64_t readU64() {
+    need(8);
+    uint64_t value;
+    memcpy(&value, pos, 8);
+    pos += 8;
+    return __builtin_bswap64(value);
+  }
+};
+
+// Generic visitor walk over a value, for callers that want every tag. The
+// visitor provides:
+//   void value(std::string_view name, TagType type, NbtCursor<Checked> &c)
+//     for scalars, strings and arrays, which it must consume
+//   void beginCompound(std::string_view name), void endCompound()
+//   void beginList(std::string_view name, NbtListHeader header),
+//   void endList()
+// List elements are reported with an empty name.
+template <bool Checked, typename Visitor>
+void visitNbt(NbtCursor<Checked> &cursor, std::string_view name, TagType type,
+              Visitor &visitor) {
+  if (type == TagType::Compound) {
+    visitor.beginCompound(name);
+    cursor.forEachEntry([&](std::string_view childName, TagType childType) {
+      visitNbt(cursor, childName, childType, visitor);
+    });
+    visitor.endCompound();
+  } else if (type == TagType::List) {
+    NbtListHeader header = cursor.readListHeader();
+    visitor.beginList(name, header);
+    cursor.forEachElement(header, [&](uint32_t, TagType elementType) {
+      visitNbt(cursor, {}, elementType, visitor);
+    });
+    visitor.endList();
+  } else {
+    visitor.value(name, type, cursor);
+  }
+}
+
+struct NbtBlockState {
+  std::string_view name;
+  std::vector<std::pair<std::string_view, std::string_view>> properties;
+};
+
+struct ChunkSectionNbt {
+  int8_t y = 0;
+  // Empty palettes mean the section had no block_states or biomes
+  std::vector<NbtBlockState> blockPalette;
+  NbtLongArray blockData;
+  std::vector<std::string_view> biomePalette;
+  NbtLongArray biomeData;
+  // Nibble arrays, empty when left out
+  std::span<const uint8_t> blockLight;
+  std::span<const uint8_t> skyLight;
+};
+
+// The parts of a chunk (1.18+ format) the renderer needs, pointing into the
+// decompressed buffer. Everything else is skipped without being decoded.
+struct ChunkNbt {
+  int32_t dataVersion = 0;
+  int32_t x = 0;
+  int32_t z = 0;
+  std::string_view status;
+  // Set once the stored light is complete
+  bool lightOn = false;
+  std::vector<ChunkSectionNbt> sections;
+  // Compound payloads, read them with NbtCursor::forEachEntry
+  std::vector<std::span<const uint8_t>> blockEntities;
+};
+
+template <bool Checked = true>
+ChunkNbt parseChunkNbt(std::span<const uint8_t> data);
+
+// Reads a block state compound ({Name, Properties}) from a palette
+template <bool Checked>
+NbtBlockState readBlockState(NbtCursor<Checked> &cursor);
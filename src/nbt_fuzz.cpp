@@ -0,0 +1,32 @@
+// libFuzzer entry point for the checked NBT cursor, built with
+// -Dfuzz=true. Malformed input may only ever surface as NbtError, anything
+// else (a crash, or a sanitizer report) is a bug in the bounds checks.
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "nbt.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  try {
+    ChunkNbt chunk = parseChunkNbt<true>({data, size});
+    // Touch every view the parser handed out, so reads past the buffer show
+    // up under ASan
+    std::vector<uint64_t> longs;
+    for (const ChunkSectionNbt &section : chunk.sections) {
+      longs.resize(section.blockData.count);
+      section.blockData.copyTo(longs.data());
+      longs.resize(section.biomeData.count);
+      section.biomeData.copyTo(longs.data());
+    }
+    for (std::span<const uint8_t> entity : chunk.blockEntities) {
+      NbtCursor<true> cursor(entity);
+      cursor.forEachEntry(
+          [&](std::string_view, TagType type) { cursor.skip(type); });
+    }
+  } catch (const NbtError &) {
+  }
+  return 0;
+}
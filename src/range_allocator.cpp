@@ -0,0 +1,89 @@
+#include "range_allocator.hpp"
+
+#include <iterator>
+
+RangeAllocator::RangeAllocator(uint32_t capacity) : capacity(capacity) {
+  if (capacity > 0) {
+    addFreeRange(0, capacity);
+  }
+}
+
+std::optional<uint32_t> RangeAllocator::allocate(uint32_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  // Smallest range that fits, lowest offset among equals
+  auto best = freeBySize.lower_bound({size, 0});
+  if (best == freeBySize.end()) {
+    return std::nullopt;
+  }
+  auto [rangeSize, offset] = *best;
+  removeFreeRange(freeRanges.find(offset));
+  if (rangeSize > size) {
+    addFreeRange(offset + size, rangeSize - size);
+  }
+  used += size;
+  return offset;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t size) {
+  if (size == 0) {
+    return;
+  }
+  used -= size;
+  auto next = freeRanges.lower_bound(offset);
+  if (next != freeRanges.end() && offset + size == next->first) {
+    size += next->second;
+    auto merged = next++;
+    removeFreeRange(merged);
+  }
+  if (next != freeRanges.begin()) {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      offset = previous->first;
+      size += previous->second;
+      removeFreeRange(previous);
+    }
+  }
+  addFreeRange(offset, size);
+}
+
+bool RangeAllocator::resize(uint32_t offset, uint32_t size,
+                            uint32_t newSize) {
+  if (newSize <= size) {
+    free(offset + newSize, size - newSize);
+    return true;
+  }
+  auto next = freeRanges.find(offset + size);
+  uint32_t extra = newSize - size;
+  if (next == freeRanges.end() || next->second < extra) {
+    return false;
+  }
+  uint32_t rest = next->second - extra;
+  removeFreeRange(next);
+  if (rest > 0) {
+    addFreeRange(offset + newSize, rest);
+  }
+  used += extra;
+  return true;
+}
+
+AllocatorStats RangeAllocator::stats() const {
+  AllocatorStats stats{capacity, used,
+                       static_cast<uint32_t>(freeRanges.size()), 0};
+  if (!freeBySize.empty()) {
+    stats.largestFreeRange = freeBySize.rbegin()->first;
+  }
+  return stats;
+}
+
+void RangeAllocator::addFreeRange(uint32_t offset, uint32_t size) {
+  freeRanges.emplace(offset, size);
+  freeBySize.emplace(size, offset);
+}
+
+void RangeAllocator::removeFreeRange(
+    std::map<uint32_t, uint32_t>::iterator it) {
+  freeBySize.erase({it->second, it->first});
+  freeRanges.erase(it);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+
+struct AllocatorStats {
+  uint32_t capacity;
+  uint32_t used;
+  uint32_t freeRanges;
+  uint32_t largestFreeRange;
+
+  // 0 while all free space is one range, approaching 1 as it splinters into
+  // many small ones
+  float fragmentation() const {
+    uint32_t free = capacity - used;
+    if (free == 0) {
+      return 0.0f;
+    }
+    return 1.0f - static_cast<float>(largestFreeRange) / free;
+  }
+};
+
+// Hands out ranges of a fixed size space, like the elements of a buffer
+// shared by many meshes. Best fit, freed ranges are merged with free
+// neighbours.
+class RangeAllocator {
+public:
+  explicit RangeAllocator(uint32_t capacity);
+
+  // Returns the range's offset, or nothing if no free range is big enough
+  std::optional<uint32_t> allocate(uint32_t size);
+  void free(uint32_t offset, uint32_t size);
+  // Shrinks a range or grows it into the free space right after it. Returns
+  // false, leaving the range as it was, if that space is taken.
+  bool resize(uint32_t offset, uint32_t size, uint32_t newSize);
+
+  AllocatorStats stats() const;
+
+private:
+  void addFreeRange(uint32_t offset, uint32_t size);
+  void removeFreeRange(std::map<uint32_t, uint32_t>::iterator it);
+
+  uint32_t capacity;
+  uint32_t used = 0;
+  // Offset to size of every free range, and the same ranges by size
+  std::map<uint32_t, uint32_t> freeRanges;
+  std::set<std::pair<uint32_t, uint32_t>> freeBySize;
+};
@@ -0,0 +1,310 @@
+#include "region.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+#include <lz4.h>
+#include <zlib.h>
+
+namespace {
+
+const size_t SECTOR_SIZE = 4096;
+// Chunks too big for the region file are stored in c.<x>.<z>.mcc next to it
+const uint8_t EXTERNAL_FLAG = 0x80;
+
+uint32_t readBigEndian32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+         static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+uint32_t readLittleEndian32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[3]) << 24 | static_cast<uint32_t>(p[2]) << 16 |
+         static_cast<uint32_t>(p[1]) << 8 | p[0];
+}
+
+// Handles both zlib and gzip streams, inflate detects the header
+std::vector<uint8_t> inflateChunk(std::span<const uint8_t> data) {
+  z_stream stream{};
+  if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+    throw std::runtime_error("failed to initialize zlib");
+  }
+
+  std::vector<uint8_t> out(std::max<size_t>(data.size() * 4, 4096));
+  stream.next_in = const_cast<Bytef *>(data.data());
+  stream.avail_in = data.size();
+
+  int result;
+  do {
+    if (stream.total_out == out.size()) {
+      out.resize(out.size() * 2);
+    }
+    stream.next_out = out.data() + stream.total_out;
+    stream.avail_out = out.size() - stream.total_out;
+    result = inflate(&stream, Z_NO_FLUSH);
+  } while (result == Z_OK);
+
+  out.resize(stream.total_out);
+  inflateEnd(&stream);
+  if (result != Z_STREAM_END) {
+    throw std::runtime_error(fmt::format("corrupt chunk data: {}",
+                                         stream.msg ? stream.msg : "zlib"));
+  }
+  return out;
+}
+
+// Minecraft's LZ4 option writes lz4-java's LZ4BlockOutputStream framing:
+// a sequence of "LZ4Block" headers each followed by one compressed block.
+std::vector<uint8_t> decompressLZ4(std::span<const uint8_t> data) {
+  const size_t headerSize = 8 + 1 + 4 + 4 + 4;
+  const uint8_t methodRaw = 0x10;
+  const uint8_t methodLZ4 = 0x20;
+
+  std::vector<uint8_t> out;
+  size_t pos = 0;
+  while (pos + headerSize <= data.size()) {
+    const uint8_t *header = data.data() + pos;
+    if (memcmp(header, "LZ4Block", 8) != 0) {
+      throw std::runtime_error("corrupt chunk data: bad LZ4 block magic");
+    }
+    uint8_t method = header[8] & 0xf0;
+    uint32_t compressedLength = readLittleEndian32(header + 9);
+    uint32_t decompressedLength = readLittleEndian32(header + 13);
+    pos += headerSize;
+
+    if (decompressedLength == 0) {
+      break;
+    }
+    if (compressedLength > data.size() - pos || decompressedLength > 1 << 26) {
+      throw std::runtime_error("corrupt chunk data: truncated LZ4 block");
+    }
+
+    size_t offset = out.size();
+    out.resize(offset + decompressedLength);
+    if (method == methodRaw) {
+      if (compressedLength != decompressedLength) {
+        throw std::runtime_error("corrupt chunk data: bad raw LZ4 block");
+      }
+      memcpy(out.data() + offset, data.data() + pos, compressedLength);
+    } else if (method == methodLZ4) {
+      int written = LZ4_decompress_safe(
+          reinterpret_cast<const char *>(data.data() + pos),
+          reinterpret_cast<char *>(out.data() + offset), compressedLength,
+          decompressedLength);
+      if (written != static_cast<int>(decompressedLength)) {
+        throw std::runtime_error("corrupt chunk data: bad LZ4 block");
+      }
+    } else {
+      throw std::runtime_error("corrupt chunk data: unknown LZ4 method");
+    }
+    pos += compressedLength;
+  }
+  return out;
+}
+
+std::vector<uint8_t> readWholeFile(const std::string &path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error(fmt::format("failed to open {}", path));
+  }
+  std::vector<uint8_t> buffer(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+  return buffer;
+}
+
+int32_t floorDiv32(int32_t value) {
+  return value >= 0 ? value / 32 : (value - 31) / 32;
+}
+
+} // namespace
+
+std::vector<uint8_t> decompressChunk(ChunkCompression compression,
+                                     std::span<const uint8_t> data) {
+  switch (compression) {
+  case ChunkCompression::GZip:
+  case ChunkCompression::Zlib:
+    return inflateChunk(data);
+  case ChunkCompression::None:
+    return std::vector<uint8_t>(data.begin(), data.end());
+  case ChunkCompression::LZ4:
+    return decompressLZ4(data);
+  }
+  throw std::runtime_error(fmt::format("unsupported chunk compression {}",
+                                       static_cast<int>(compression)));
+}
+
+RegionFile::RegionFile(const std::string &path, int32_t regionX,
+                       int32_t regionZ)
+    : path(path), regionX(regionX), regionZ(regionZ) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(fmt::format("failed to open {}", path));
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error(fmt::format("failed to stat {}", path));
+  }
+  size = info.st_size;
+
+  // Region files are created empty and grow lazily, anything smaller than
+  // the header simply has no chunks
+  if (size >= 2 * SECTOR_SIZE) {
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error(fmt::format("failed to map {}", path));
+    }
+    data = static_cast<const uint8_t *>(mapping);
+  }
+  close(fd);
+}
+
+RegionFile::~RegionFile() {
+  if (data) {
+    munmap(const_cast<uint8_t *>(data), size);
+  }
+}
+
+uint32_t RegionFile::location(int localX, int localZ) const {
+  if (!data) {
+    return 0;
+  }
+  return readBigEndian32(data + 4 * (localX + localZ * 32));
+}
+
+bool RegionFile::hasChunk(int localX, int localZ) const {
+  return location(localX, localZ) != 0;
+}
+
+uint32_t RegionFile::timestamp(int localX, int localZ) const {
+  if (!data) {
+    return 0;
+  }
+  return readBigEndian32(data + SECTOR_SIZE + 4 * (localX + localZ * 32));
+}
+
+std::optional<std::vector<uint8_t>> RegionFile::readChunk(int localX,
+                                                          int localZ) const {
+  // The top three bytes are the offset in sectors, the bottom byte the
+  // number of sectors
+  uint32_t loc = location(localX, localZ);
+  size_t offset = static_cast<size_t>(loc >> 8) * SECTOR_SIZE;
+  if (loc == 0) {
+    return std::nullopt;
+  }
+  if (offset < 2 * SECTOR_SIZE || offset + 5 > size) {
+    throw std::runtime_error(fmt::format(
+        "chunk {},{} in {} points outside the file", localX, localZ, path));
+  }
+
+  const uint8_t *chunk = data + offset;
+  uint32_t length = readBigEndian32(chunk);
+  uint8_t compression = chunk[4];
+  if (length == 0 || length - 1 > size - offset - 5) {
+    throw std::runtime_error(fmt::format(
+        "chunk {},{} in {} has an invalid length", localX, localZ, path));
+  }
+
+  auto type = static_cast<ChunkCompression>(compression & ~EXTERNAL_FLAG);
+  if (compression & EXTERNAL_FLAG) {
+    auto external = std::filesystem::path(path).parent_path() /
+                    fmt::format("c.{}.{}.mcc", regionX * 32 + localX,
+                                regionZ * 32 + localZ);
+    return decompressChunk(type, readWholeFile(external.string()));
+  }
+  return decompressChunk(type, {chunk + 5, length - 1});
+}
+
+RegionReader::RegionReader(const std::string &worldDir, ThreadPool &pool)
+    : regionDir((std::filesystem::path(worldDir) / "region").string()),
+      pool(pool) {
+  if (!std::filesystem::is_directory(regionDir)) {
+    throw std::runtime_error(
+        fmt::format("{} has no region directory", worldDir));
+  }
+}
+
+std::shared_ptr<RegionFile> RegionReader::region(int32_t regionX,
+                                                 int32_t regionZ) {
+  std::lock_guard lock(regionsMutex);
+  auto it = regions.find({regionX, regionZ});
+  if (it != regions.end()) {
+    return it->second;
+  }
+
+  auto path = std::filesystem::path(regionDir) /
+              fmt::format("r.{}.{}.mca", regionX, regionZ);
+  std::shared_ptr<RegionFile> file;
+  if (std::filesystem::exists(path)) {
+    file = std::make_shared<RegionFile>(path.string(), regionX, regionZ);
+  }
+  regions.emplace(ChunkPos{regionX, regionZ}, file);
+  return file;
+}
+
+size_t RegionReader::requestChunks(ChunkPos min, ChunkPos max,
+                                   ChunkCallback onChunk,
+                                   MissingChunkCallback onMissing) {
+  size_t queued = 0;
+  for (int32_t regionZ = floorDiv32(min.z); regionZ <= floorDiv32(max.z);
+       regionZ++) {
+    for (int32_t regionX = floorDiv32(min.x); regionX <= floorDiv32(max.x);
+         regionX++) {
+      auto file = region(regionX, regionZ);
+      if (!file) {
+        continue;
+      }
+
+      for (int32_t z = std::max(min.z, regionZ * 32);
+           z <= std::min(max.z, regionZ * 32 + 31); z++) {
+        for (int32_t x = std::max(min.x, regionX * 32);
+             x <= std::min(max.x, regionX * 32 + 31); x++) {
+          int localX = x - regionX * 32;
+          int localZ = z - regionZ * 32;
+          if (!file->hasChunk(localX, localZ)) {
+            continue;
+          }
+
+          queued++;
+          pool.submit([file, onChunk, onMissing, localX, localZ,
+                       pos = ChunkPos{x, z}] {
+            std::optional<std::vector<uint8_t>> nbt;
+            try {
+              nbt = file->readChunk(localX, localZ);
+            } catch (const std::exception &e) {
+              fmt::println(stderr, "Skipping chunk {},{}: {}", pos.x, pos.z,
+                           e.what());
+            }
+            if (nbt) {
+              onChunk(pos, std::move(*nbt));
+            } else {
+              onMissing(pos);
+            }
+          });
+        }
+      }
+    }
+  }
+  return queued;
+}
+
+std::optional<std::vector<uint8_t>> RegionReader::readChunk(ChunkPos pos) {
+  int32_t regionX = floorDiv32(pos.x);
+  int32_t regionZ = floorDiv32(pos.z);
+  auto file = region(regionX, regionZ);
+  if (!file) {
+    return std::nullopt;
+  }
+  return file->readChunk(pos.x - regionX * 32, pos.z - regionZ * 32);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "coords.hpp"
+#include "thread_pool.hpp"
+
+enum class ChunkCompression : uint8_t {
+  GZip = 1,
+  Zlib = 2,
+  None = 3,
+  LZ4 = 4,
+};
+
+std::vector<uint8_t> decompressChunk(ChunkCompression compression,
+                                     std::span<const uint8_t> data);
+
+// A memory mapped Anvil region file (r.<x>.<z>.mca) holding 32x32 chunks.
+// Reads are thread safe, the mapping is never written to.
+class RegionFile {
+public:
+  RegionFile(const std::string &path, int32_t regionX, int32_t regionZ);
+  ~RegionFile();
+
+  RegionFile(const RegionFile &) = delete;
+  RegionFile &operator=(const RegionFile &) = delete;
+
+  // Local coordinates are 0-31 within the region
+  bool hasChunk(int localX, int localZ) const;
+  // Seconds since the epoch of the last save, 0 if never saved
+  uint32_t timestamp(int localX, int localZ) const;
+  // Decompressed chunk NBT, or nothing if the chunk hasn't been generated
+  std::optional<std::vector<uint8_t>> readChunk(int localX, int localZ) const;
+
+private:
+  std::string path;
+  int32_t regionX;
+  int32_t regionZ;
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+
+  uint32_t location(int localX, int localZ) const;
+};
+
+using ChunkCallback =
+    std::function<void(ChunkPos pos, std::vector<uint8_t> &&nbt)>;
+using MissingChunkCallback = std::function<void(ChunkPos pos)>;
+
+// Reads chunks out of a world's region directory, keeping region files
+// mapped once opened.
+class RegionReader {
+public:
+  RegionReader(const std::string &worldDir, ThreadPool &pool);
+
+  // Decompresses every existing chunk in the inclusive rectangle on the
+  // thread pool, one job per chunk. onChunk is called from worker threads as
+  // each one finishes, in no particular order, or onMissing if the chunk
+  // turns out to be corrupt or was never generated. Returns the number of
+  // chunks queued, each gets exactly one of the two calls.
+  size_t requestChunks(ChunkPos min, ChunkPos max, ChunkCallback onChunk,
+                       MissingChunkCallback onMissing);
+  std::optional<std::vector<uint8_t>> readChunk(ChunkPos pos);
+
+private:
+  std::string regionDir;
+  ThreadPool &pool;
+  std::mutex regionsMutex;
+  // Missing region files are cached as nullptr
+  std::unordered_map<ChunkPos, std::shared_ptr<RegionFile>> regions;
+
+  std::shared_ptr<RegionFile> region(int32_t regionX, int32_t regionZ);
+};
@@ -0,0 +1,153 @@
+#include "registry.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+std::string namespacedName(std::string_view name) {
+  if (name.find(':') == std::string_view::npos) {
+    return fmt::format("minecraft:{}", name);
+  }
+  return std::string(name);
+}
+
+std::string_view BlockState::property(std::string_view name) const {
+  for (const auto &[key, value] : properties) {
+    if (key == name) {
+      return value;
+    }
+  }
+  return {};
+}
+
+BlockRegistry::BlockRegistry() {
+  BlockState air;
+  air.name = air.key = "minecraft:air";
+  ids.emplace(air.key, AIR);
+  states.push_back(std::move(air));
+}
+
+BlockStateId BlockRegistry::intern(std::string_view name,
+                                   std::span<const PropertyView> properties) {
+  std::string fullName = namespacedName(name);
+  if (fullName == "minecraft:cave_air" || fullName == "minecraft:void_air") {
+    return AIR;
+  }
+
+  std::vector<PropertyView> sorted(properties.begin(), properties.end());
+  std::sort(sorted.begin(), sorted.end());
+
+  std::string key = fullName;
+  if (!sorted.empty()) {
+    key += '[';
+    for (size_t i = 0; i < sorted.size(); i++) {
+      if (i != 0) {
+        key += ',';
+      }
+      key += sorted[i].first;
+      key += '=';
+      key += sorted[i].second;
+    }
+    key += ']';
+  }
+
+  {
+    std::shared_lock lock(mutex);
+    auto it = ids.find(key);
+    if (it != ids.end()) {
+      return it->second;
+    }
+  }
+
+  std::unique_lock lock(mutex);
+  auto it = ids.find(key);
+  if (it != ids.end()) {
+    return it->second;
+  }
+  if (states.size() > UINT16_MAX) {
+    throw std::runtime_error("too many block states");
+  }
+
+  BlockState state;
+  state.name = std::move(fullName);
+  for (const auto &[propertyKey, value] : sorted) {
+    state.properties.emplace_back(propertyKey, value);
+  }
+  state.key = key;
+
+  BlockStateId id = states.size();
+  states.push_back(std::move(state));
+  ids.emplace(std::move(key), id);
+  return id;
+}
+
+BlockStateId BlockRegistry::parse(std::string_view key) {
+  size_t open = key.find('[');
+  if (open == std::string_view::npos) {
+    return intern(key);
+  }
+  if (key.back() != ']') {
+    throw std::runtime_error(fmt::format("invalid block state {}", key));
+  }
+
+  std::vector<PropertyView> properties;
+  std::string_view list = key.substr(open + 1, key.size() - open - 2);
+  while (!list.empty()) {
+    size_t comma = list.find(',');
+    std::string_view property = list.substr(0, comma);
+    size_t equals = property.find('=');
+    if (equals == std::string_view::npos) {
+      throw std::runtime_error(fmt::format("invalid block state {}", key));
+    }
+    properties.emplace_back(property.substr(0, equals),
+                            property.substr(equals + 1));
+    list = comma == std::string_view::npos ? std::string_view()
+                                           : list.substr(comma + 1);
+  }
+  return intern(key.substr(0, open), properties);
+}
+
+const BlockState &BlockRegistry::state(BlockStateId id) const {
+  std::shared_lock lock(mutex);
+  return states[id];
+}
+
+size_t BlockRegistry::size() const {
+  std::shared_lock lock(mutex);
+  return states.size();
+}
+
+BiomeRegistry::BiomeRegistry() {
+  names.push_back("minecraft:plains");
+  ids.emplace(names.back(), PLAINS);
+}
+
+BiomeId BiomeRegistry::intern(std::string_view name) {
+  std::string fullName = namespacedName(name);
+  {
+    std::shared_lock lock(mutex);
+    auto it = ids.find(fullName);
+    if (it != ids.end()) {
+      return it->second;
+    }
+  }
+
+  std::unique_lock lock(mutex);
+  auto [it, inserted] = ids.emplace(fullName, names.size());
+  if (inserted) {
+    names.push_back(std::move(fullName));
+  }
+  return it->second;
+}
+
+const std::string &BiomeRegistry::name(BiomeId id) const {
+  std::shared_lock lock(mutex);
+  return names[id];
+}
+
+size_t BiomeRegistry::size() const {
+  std::shared_lock lock(mutex);
+  return names.size();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "nbt.hpp"
+
+using BlockStateId = uint16_t;
+using BiomeId = uint16_t;
+
+using PropertyView = std::pair<std::string_view, std::string_view>;
+
+struct BlockState {
+  // Always namespaced, e.g. "minecraft:oak_log"
+  std::string name;
+  // Sorted by key
+  std::vector<std::pair<std::string, std::string>> properties;
+  // Canonical "name[key=value,...]" form
+  std::string key;
+
+  std::string_view property(std::string_view name) const;
+};
+
+// Assigns small global ids to every block state seen while loading, which
+// is what chunk palettes refer to. Thread safe, since chunks are decoded on
+// worker threads.
+class BlockRegistry {
+public:
+  // Air, cave air and void air all map here
+  static constexpr BlockStateId AIR = 0;
+
+  BlockRegistry();
+
+  BlockStateId intern(std::string_view name,
+                      std::span<const PropertyView> properties = {});
+  BlockStateId intern(const NbtBlockState &state) {
+    return intern(state.name, state.properties);
+  }
+  // Parses the "minecraft:oak_log[axis=y]" form used in commands
+  BlockStateId parse(std::string_view key);
+
+  // References stay valid as more states are interned
+  const BlockState &state(BlockStateId id) const;
+  size_t size() const;
+
+private:
+  mutable std::shared_mutex mutex;
+  std::deque<BlockState> states;
+  std::unordered_map<std::string, BlockStateId> ids;
+};
+
+class BiomeRegistry {
+public:
+  static constexpr BiomeId PLAINS = 0;
+
+  BiomeRegistry();
+
+  BiomeId intern(std::string_view name);
+  const std::string &name(BiomeId id) const;
+  size_t size() const;
+
+private:
+  mutable std::shared_mutex mutex;
+  std::deque<std::string> names;
+  std::unordered_map<std::string, BiomeId> ids;
+};
+
+// Adds the minecraft: namespace to bare names
+std::string namespacedName(std::string_view name);
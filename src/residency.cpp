@@ -0,0 +1,207 @@
+#include "residency.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+
+// Victims are picked among this many of the least recently used chunks
+const size_t EVICTION_WINDOW = 64;
+// Frames of disuse a chunk away from the path is worth per chunk of
+// distance, so far chunks go before ones that were merely left behind
+const double FRAMES_PER_CHUNK = 30.0;
+
+ChunkPos chunkAt(const std::array<double, 3> &point) {
+  return {static_cast<int32_t>(std::floor(point[0] / 16)),
+          static_cast<int32_t>(std::floor(point[2] / 16))};
+}
+
+} // namespace
+
+ChunkResidency::ChunkResidency(ResidencyBudgets budgets, int radius)
+    : budgets(budgets), radius(std::max(radius, 0)) {}
+
+void ChunkResidency::update(
+    const std::vector<std::array<double, 3>> &points) {
+  frame++;
+  path = points;
+  std::vector<ChunkPos> current;
+  for (const auto &point : path) {
+    current.push_back(chunkAt(point));
+  }
+  if (current != pathChunks) {
+    pathChunks = std::move(current);
+    findWanted();
+  }
+
+  for (size_t i = 0; i < cameraChunks; i++) {
+    auto it = chunks.find(wanted[i]);
+    if (it != chunks.end()) {
+      it->second.lastUsed = frame;
+      lru.splice(lru.begin(), lru, it->second.use);
+    }
+  }
+}
+
+void ChunkResidency::findWanted() {
+  wanted.clear();
+  wantedSet.clear();
+  cameraChunks = 0;
+  std::vector<std::pair<int, ChunkPos>> around;
+  for (size_t i = 0; i < pathChunks.size(); i++) {
+    ChunkPos center = pathChunks[i];
+    around.clear();
+    for (int dz = -radius; dz <= radius; dz++) {
+      for (int dx = -radius; dx <= radius; dx++) {
+        if (dx * dx + dz * dz <= radius * radius) {
+          around.push_back(
+              {dx * dx + dz * dz, {center.x + dx, center.z + dz}});
+        }
+      }
+    }
+    std::sort(around.begin(), around.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+    for (const auto &[distance, pos] : around) {
+      if (wantedSet.insert(pos).second) {
+        wanted.push_back(pos);
+      }
+    }
+    if (i == 0) {
+      cameraChunks = wanted.size();
+    }
+  }
+
+  // Requests that went out of range may never come back, and missing chunks
+  // are only remembered while they'd be asked for
+  std::erase_if(pending,
+                [this](ChunkPos pos) { return !wantedSet.contains(pos); });
+  std::erase_if(missing,
+                [this](ChunkPos pos) { return !wantedSet.contains(pos); });
+  for (ChunkPos pos : wanted) {
+    auto it = chunks.find(pos);
+    if (it != chunks.end() && it->second.meshesFreed) {
+      it->second.meshesFreed = false;
+      restores.push_back(pos);
+    }
+  }
+}
+
+std::vector<ChunkPos> ChunkResidency::takePrefetch(size_t limit) {
+  std::vector<ChunkPos> result;
+  for (ChunkPos pos : wanted) {
+    if (result.size() >= limit) {
+      break;
+    }
+    if (!chunks.contains(pos) && !missing.contains(pos) &&
+        pending.insert(pos).second) {
+      result.push_back(pos);
+    }
+  }
+  return result;
+}
+
+void ChunkResidency::chunkLoaded(ChunkPos pos, size_t cpuBytes) {
+  pending.erase(pos);
+  missing.erase(pos);
+  auto [it, inserted] = chunks.try_emplace(pos);
+  Entry &entry = it->second;
+  if (inserted) {
+    lru.push_front(pos);
+    entry.use = lru.begin();
+    entry.lastUsed = frame;
+  }
+  cpuTotal = cpuTotal - entry.cpuBytes + cpuBytes;
+  entry.cpuBytes = cpuBytes;
+}
+
+void ChunkResidency::chunkMissing(ChunkPos pos) {
+  pending.erase(pos);
+  if (wantedSet.contains(pos)) {
+    missing.insert(pos);
+  }
+}
+
+void ChunkResidency::addMeshBytes(ChunkPos pos, int64_t bytes) {
+  auto it = chunks.find(pos);
+  if (it == chunks.end()) {
+    return;
+  }
+  it->second.gpuBytes += bytes;
+  gpuTotal += bytes;
+}
+
+std::vector<ChunkPos> ChunkResidency::takeCpuEvictions(size_t limit) {
+  std::vector<ChunkPos> victims = pickVictims(false, limit);
+  for (ChunkPos pos : victims) {
+    auto it = chunks.find(pos);
+    cpuTotal -= it->second.cpuBytes;
+    gpuTotal -= it->second.gpuBytes;
+    lru.erase(it->second.use);
+    chunks.erase(it);
+  }
+  return victims;
+}
+
+std::vector<ChunkPos> ChunkResidency::takeGpuEvictions(size_t limit) {
+  std::vector<ChunkPos> victims = pickVictims(true, limit);
+  for (ChunkPos pos : victims) {
+    chunks.at(pos).meshesFreed = true;
+  }
+  return victims;
+}
+
+std::vector<ChunkPos> ChunkResidency::takeMeshRestores() {
+  return std::exchange(restores, {});
+}
+
+bool ChunkResidency::meshesWanted(ChunkPos pos) const {
+  auto it = chunks.find(pos);
+  return it != chunks.end() && !it->second.meshesFreed;
+}
+
+double ChunkResidency::pathDistance(ChunkPos pos) const {
+  double nearest = std::numeric_limits<double>::infinity();
+  for (const auto &point : path) {
+    double dx = pos.x + 0.5 - point[0] / 16;
+    double dz = pos.z + 0.5 - point[2] / 16;
+    nearest = std::min(nearest, dx * dx + dz * dz);
+  }
+  return std::sqrt(nearest);
+}
+
+std::vector<ChunkPos> ChunkResidency::pickVictims(bool gpu, size_t limit) {
+  size_t total = gpu ? gpuTotal : cpuTotal;
+  size_t budget = gpu ? budgets.gpuBytes : budgets.cpuBytes;
+  if (total <= budget || limit == 0) {
+    return {};
+  }
+
+  std::vector<std::pair<double, ChunkPos>> candidates;
+  for (auto it = lru.rbegin();
+       it != lru.rend() && candidates.size() < EVICTION_WINDOW; ++it) {
+    const Entry &entry = chunks.at(*it);
+    if (wantedSet.contains(*it) ||
+        (gpu && (entry.meshesFreed || entry.gpuBytes == 0))) {
+      continue;
+    }
+    double score =
+        frame - entry.lastUsed + FRAMES_PER_CHUNK * pathDistance(*it);
+    candidates.push_back({score, *it});
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  std::vector<ChunkPos> victims;
+  for (const auto &[score, pos] : candidates) {
+    if (total <= budget || victims.size() >= limit) {
+      break;
+    }
+    const Entry &entry = chunks.at(pos);
+    size_t freed = gpu ? entry.gpuBytes : entry.cpuBytes;
+    total -= std::min(total, freed);
+    victims.push_back(pos);
+  }
+  return victims;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "coords.hpp"
+
+struct ResidencyBudgets {
+  // Decoded chunks, as Chunk::memoryUsage() counts them
+  size_t cpuBytes;
+  // Vertices and indices of their meshes
+  size_t gpuBytes;
+};
+
+// Decides which chunks stay loaded, and which of those keep their meshes, as
+// the camera moves through a world bigger than the budgets. It only keeps
+// the books, the caller loads, unloads and meshes what it's told to. Main
+// thread only.
+//
+// Chunks are kept in least recently used order, a chunk being used while
+// it's within the radius of the camera. Once a budget is exceeded, victims
+// are picked from the least recently used end, those furthest from the
+// camera path first. Chunks within the radius of the path are never picked,
+// they'd only be loaded again.
+//
+// The path is the camera followed by where it's expected to be next.
+// Missing chunks around it are prefetched in path order, so the ones needed
+// soonest come first.
+class ChunkResidency {
+public:
+  // radius is in chunks
+  ChunkResidency(ResidencyBudgets budgets, int radius);
+
+  // Once per frame, points[0] being the camera
+  void update(const std::vector<std::array<double, 3>> &points);
+
+  // Up to limit chunks near the path that aren't loaded, soonest needed
+  // first. They're pending until chunkLoaded() or chunkMissing().
+  std::vector<ChunkPos> takePrefetch(size_t limit);
+  size_t pendingLoads() const { return pending.size(); }
+  // Also for chunks that weren't prefetched, and when a chunk is replaced
+  void chunkLoaded(ChunkPos pos, size_t cpuBytes);
+  // There's nothing to load at pos, it isn't asked for again while it stays
+  // near the path
+  void chunkMissing(ChunkPos pos);
+  // Something that can fill missing chunks turned up, they're asked for
+  // again
+  void forgetMissing() { missing.clear(); }
+  // As the chunk's section meshes are added, replaced and freed
+  void addMeshBytes(ChunkPos pos, int64_t bytes);
+
+  // Up to limit chunks to unload to get under the CPU budget. They're
+  // forgotten along with their mesh bytes, so the caller doesn't have to
+  // report freeing those.
+  std::vector<ChunkPos> takeCpuEvictions(size_t limit);
+  // Up to limit chunks to free the meshes of to get under the GPU budget.
+  // The chunks stay loaded, and their meshes aren't wanted until they're
+  // near the path again.
+  std::vector<ChunkPos> takeGpuEvictions(size_t limit);
+  // Chunks whose meshes were freed and are near the path again, to be
+  // meshed again
+  std::vector<ChunkPos> takeMeshRestores();
+  // Whether a finished mesh of the chunk's sections should be kept
+  bool meshesWanted(ChunkPos pos) const;
+
+  size_t cpuBytes() const { return cpuTotal; }
+  size_t gpuBytes() const { return gpuTotal; }
+  size_t residentChunks() const { return chunks.size(); }
+
+private:
+  struct Entry {
+    size_t cpuBytes = 0;
+    size_t gpuBytes = 0;
+    uint64_t lastUsed = 0;
+    bool meshesFreed = false;
+    // Position in lru
+    std::list<ChunkPos>::iterator use;
+  };
+
+  ResidencyBudgets budgets;
+  int radius;
+  uint64_t frame = 0;
+  size_t cpuTotal = 0;
+  size_t gpuTotal = 0;
+  std::unordered_map<ChunkPos, Entry> chunks;
+  // Most recently used first
+  std::list<ChunkPos> lru;
+  std::unordered_set<ChunkPos> pending;
+  std::unordered_set<ChunkPos> missing;
+  std::vector<ChunkPos> restores;
+
+  std::vector<std::array<double, 3>> path;
+  // The chunks of the path's points the wanted chunks were found for
+  std::vector<ChunkPos> pathChunks;
+  // Chunks within the radius of the path in the order they're needed, the
+  // first cameraChunks of them around the camera
+  std::vector<ChunkPos> wanted;
+  std::unordered_set<ChunkPos> wantedSet;
+  size_t cameraChunks = 0;
+
+  void findWanted();
+  // Horizontal distance from the chunk's center to the nearest point of the
+  // path, in chunks
+  double pathDistance(ChunkPos pos) const;
+  std::vector<ChunkPos> pickVictims(bool gpu, size_t limit);
+};
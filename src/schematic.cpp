@@ -0,0 +1,433 @@
+#include "schematic.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <fmt/core.h>
+
+#include "region.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Sponge stores sizes as unsigned shorts, nothing bigger makes sense
+const int MAX_SCHEMATIC_SIZE = 65535;
+
+std::vector<uint8_t> readSchematicFile(const std::string &path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error(fmt::format("failed to open {}", path));
+  }
+  std::vector<uint8_t> data(file.tellg());
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(data.data()), data.size());
+
+  // Every format is normally gzipped, but some tools write them raw
+  if (data.size() >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+    return decompressChunk(ChunkCompression::GZip, data);
+  }
+  return data;
+}
+
+// Sponge's sizes are unsigned shorts, which read back negative past 32767
+int readDimension(NbtCursor<true> &cursor, TagType type) {
+  int64_t value = cursor.readInteger(type);
+  return type == TagType::Short ? value & 0xffff : value;
+}
+
+// Litematica's {x, y, z} compounds
+void readVector(NbtCursor<true> &cursor, int out[3]) {
+  cursor.forEachEntry([&](std::string_view name, TagType type) {
+    if (name.size() == 1 && name[0] >= 'x' && name[0] <= 'z') {
+      out[name[0] - 'x'] = cursor.readInteger(type);
+    } else {
+      cursor.skip(type);
+    }
+  });
+}
+
+// Structure files' [x, y, z] int lists
+void readIntList(NbtCursor<true> &cursor, int out[3]) {
+  NbtListHeader header = cursor.readListHeader();
+  if (header.count != 3) {
+    throw NbtError("position list doesn't have three entries");
+  }
+  cursor.forEachElement(header, [&](uint32_t i, TagType type) {
+    out[i] = cursor.readInteger(type);
+  });
+}
+
+std::vector<BlockStateId> readBlockPalette(NbtCursor<true> &cursor,
+                                           BlockRegistry &blocks) {
+  std::vector<BlockStateId> palette;
+  cursor.forEachElement([&](uint32_t, TagType type) {
+    if (type != TagType::Compound) {
+      throw NbtError("block palette entry is not a compound");
+    }
+    palette.push_back(blocks.intern(readBlockState(cursor)));
+  });
+  return palette;
+}
+
+} // namespace
+
+Schematic Schematic::load(const std::string &path,
+                          const std::array<int, 3> &origin,
+                          BlockRegistry &blocks) {
+  Schematic schematic;
+  schematic.boxMin = origin;
+  schematic.voidState = blocks.intern("minecraft:structure_void");
+
+  std::string extension = fs::path(path).extension().string();
+  std::vector<uint8_t> nbt = readSchematicFile(path);
+  if (extension == ".schem") {
+    schematic.readSponge(nbt, blocks);
+  } else if (extension == ".litematic") {
+    schematic.readLitematica(nbt, blocks);
+  } else if (extension == ".nbt") {
+    schematic.readStructure(nbt, blocks);
+  } else {
+    throw std::runtime_error(
+        fmt::format("unknown schematic format {}", extension));
+  }
+
+  schematic.current = nullptr;
+  for (auto it = schematic.sections.begin(); it != schematic.sections.end();) {
+    it->second.compact();
+    if (it->second.isSingleValue() &&
+        it->second.paletteEntries()[0] == schematic.voidState) {
+      it = schematic.sections.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  schematic.minSectionY = floorDiv16(schematic.boxMin[1]);
+  schematic.maxSectionY = floorDiv16(schematic.boxMax[1]);
+  return schematic;
+}
+
+void Schematic::setSize(const int size[3]) {
+  for (int axis = 0; axis < 3; axis++) {
+    if (size[axis] <= 0 || size[axis] > MAX_SCHEMATIC_SIZE) {
+      throw std::runtime_error(fmt::format("invalid schematic size {}x{}x{}",
+                                           size[0], size[1], size[2]));
+    }
+    boxMax[axis] = boxMin[axis] + size[axis] - 1;
+  }
+}
+
+void Schematic::setBlock(int x, int y, int z, BlockStateId state) {
+  x += boxMin[0];
+  y += boxMin[1];
+  z += boxMin[2];
+  SectionPos pos{floorDiv16(x), floorDiv16(y), floorDiv16(z)};
+  if (!current || !(pos == currentPos)) {
+    current = &sections.try_emplace(pos, voidState).first->second;
+    currentPos = pos;
+  }
+  current->set((floorMod16(y) * 16 + floorMod16(z)) * 16 + floorMod16(x),
+               state);
+}
+
+// Sponge schematics (.schem) list every block as a varint palette index,
+// x fastest, then z, then y. Version 3 moved the palette and data into a
+// Blocks compound under a Schematic compound.
+void Schematic::readSponge(std::span<const uint8_t> nbt,
+                           BlockRegistry &blocks) {
+  int size[3] = {};
+  std::vector<BlockStateId> palette;
+  std::span<const uint8_t> data;
+
+  NbtCursor<true> cursor(nbt);
+  cursor.readRoot();
+  auto readPalette = [&] {
+    cursor.forEachEntry([&](std::string_view key, TagType type) {
+      int64_t index = cursor.readInteger(type);
+      if (index < 0 || index > UINT16_MAX) {
+        throw NbtError("sponge palette index out of range");
+      }
+      if (static_cast<size_t>(index) >= palette.size()) {
+        palette.resize(index + 1, BlockRegistry::AIR);
+      }
+      palette[index] = blocks.parse(key);
+    });
+  };
+  std::function<void()> readFields = [&] {
+    cursor.forEachEntry([&](std::string_view name, TagType type) {
+      if (name == "Width") {
+        size[0] = readDimension(cursor, type);
+      } else if (name == "Height") {
+        size[1] = readDimension(cursor, type);
+      } else if (name == "Length") {
+        size[2] = readDimension(cursor, type);
+      } else if (name == "Palette" && type == TagType::Compound) {
+        readPalette();
+      } else if ((name == "BlockData" || name == "Data") &&
+                 type == TagType::ByteArray) {
+        data = cursor.readByteArray();
+      } else if ((name == "Schematic" || name == "Blocks") &&
+                 type == TagType::Compound) {
+        readFields();
+      } else {
+        cursor.skip(type);
+      }
+    });
+  };
+  readFields();
+  setSize(size);
+  if (palette.empty()) {
+    throw NbtError("sponge schematic has no palette");
+  }
+
+  const uint8_t *pos = data.data();
+  const uint8_t *end = pos + data.size();
+  for (int y = 0; y < size[1]; y++) {
+    for (int z = 0; z < size[2]; z++) {
+      for (int x = 0; x < size[0]; x++) {
+        uint32_t index = 0;
+        for (int shift = 0;; shift += 7) {
+          if (pos == end || shift > 28) {
+            throw NbtError("sponge block data is truncated or corrupt");
+          }
+          uint8_t byte = *pos++;
+          index |= static_cast<uint32_t>(byte & 0x7f) << shift;
+          if (!(byte & 0x80)) {
+            break;
+          }
+        }
+        if (index >= palette.size()) {
+          throw NbtError("sponge block data indexes past the palette");
+        }
+        setBlock(x, y, z, palette[index]);
+      }
+    }
+  }
+}
+
+// Litematica schematics (.litematic) hold regions that may each extend
+// either way from their position. Blocks are palette indices packed into
+// longs at the smallest width of at least 2 bits, and unlike chunk data
+// they do straddle longs.
+void Schematic::readLitematica(std::span<const uint8_t> nbt,
+                               BlockRegistry &blocks) {
+  struct Region {
+    int position[3] = {};
+    int size[3] = {};
+    std::vector<BlockStateId> palette;
+    NbtLongArray states;
+  };
+  std::vector<Region> regions;
+
+  NbtCursor<true> cursor(nbt);
+  cursor.readRoot();
+  cursor.forEachEntry([&](std::string_view name, TagType type) {
+    if (name != "Regions" || type != TagType::Compound) {
+      cursor.skip(type);
+      return;
+    }
+    cursor.forEachEntry([&](std::string_view, TagType regionType) {
+      if (regionType != TagType::Compound) {
+        cursor.skip(regionType);
+        return;
+      }
+      Region &region = regions.emplace_back();
+      cursor.forEachEntry([&](std::string_view field, TagType fieldType) {
+        if (field == "Position" && fieldType == TagType::Compound) {
+          readVector(cursor, region.position);
+        } else if (field == "Size" && fieldType == TagType::Compound) {
+          readVector(cursor, region.size);
+        } else if (field == "BlockStatePalette" &&
+                   fieldType == TagType::List) {
+          region.palette = readBlockPalette(cursor, blocks);
+        } else if (field == "BlockStates" &&
+                   fieldType == TagType::LongArray) {
+          region.states = cursor.readLongArray();
+        } else {
+          cursor.skip(fieldType);
+        }
+      });
+    });
+  });
+  if (regions.empty()) {
+    throw NbtError("litematic has no regions");
+  }
+
+  // A negative size means the region extends towards negative coordinates
+  // from its position, inclusive
+  int regionMin[3] = {INT32_MAX, INT32_MAX, INT32_MAX};
+  int regionMax[3] = {INT32_MIN, INT32_MIN, INT32_MIN};
+  for (Region &region : regions) {
+    for (int axis = 0; axis < 3; axis++) {
+      int size = region.size[axis];
+      if (size == 0 || std::abs(size) > MAX_SCHEMATIC_SIZE) {
+        throw NbtError("litematic region has an invalid size");
+      }
+      if (size < 0) {
+        region.position[axis] += size + 1;
+        region.size[axis] = -size;
+      }
+      regionMin[axis] = std::min(regionMin[axis], region.position[axis]);
+      regionMax[axis] = std::max(regionMax[axis], region.position[axis] +
+                                                      region.size[axis] - 1);
+    }
+  }
+  int size[3];
+  for (int axis = 0; axis < 3; axis++) {
+    size[axis] = regionMax[axis] - regionMin[axis] + 1;
+  }
+  setSize(size);
+
+  for (const Region &region : regions) {
+    if (region.palette.empty()) {
+      throw NbtError("litematic region has no palette");
+    }
+    unsigned bits = std::max<unsigned>(
+        2, std::bit_width(region.palette.size() - 1));
+    uint64_t mask = (uint64_t(1) << bits) - 1;
+    uint64_t volume = static_cast<uint64_t>(region.size[0]) *
+                      region.size[1] * region.size[2];
+    if ((volume * bits + 63) / 64 > region.states.count) {
+      throw NbtError("litematic block states are truncated");
+    }
+
+    const int *offset = region.position;
+    uint64_t bit = 0;
+    for (int y = 0; y < region.size[1]; y++) {
+      for (int z = 0; z < region.size[2]; z++) {
+        for (int x = 0; x < region.size[0]; x++, bit += bits) {
+          size_t cell = bit >> 6;
+          unsigned shift = bit & 63;
+          uint64_t index = region.states[cell] >> shift;
+          if (shift + bits > 64) {
+            index |= region.states[cell + 1] << (64 - shift);
+          }
+          index &= mask;
+          if (index >= region.palette.size()) {
+            throw NbtError("litematic block states index past the palette");
+          }
+          setBlock(offset[0] - regionMin[0] + x, offset[1] - regionMin[1] + y,
+                   offset[2] - regionMin[2] + z, region.palette[index]);
+        }
+      }
+    }
+  }
+}
+
+// Vanilla structure files (.nbt) list blocks one by one with their
+// position, leaving out structure voids. Structures with several palettes,
+// like shipwrecks, are placed with the first.
+void Schematic::readStructure(std::span<const uint8_t> nbt,
+                              BlockRegistry &blocks) {
+  int size[3] = {};
+  std::vector<BlockStateId> palette;
+  // The block list may come before the palette, so it's read afterwards
+  std::span<const uint8_t> blockList;
+
+  NbtCursor<true> cursor(nbt);
+  cursor.readRoot();
+  cursor.forEachEntry([&](std::string_view name, TagType type) {
+    if (name == "size" && type == TagType::List) {
+      readIntList(cursor, size);
+    } else if (name == "palette" && type == TagType::List) {
+      palette = readBlockPalette(cursor, blocks);
+    } else if (name == "palettes" && type == TagType::List) {
+      cursor.forEachElement([&](uint32_t i, TagType elementType) {
+        if (i == 0 && elementType == TagType::List) {
+          palette = readBlockPalette(cursor, blocks);
+        } else {
+          cursor.skip(elementType);
+        }
+      });
+    } else if (name == "blocks" && type == TagType::List) {
+      const uint8_t *start = cursor.position();
+      cursor.skip(type);
+      blockList = {start, cursor.position()};
+    } else {
+      cursor.skip(type);
+    }
+  });
+  setSize(size);
+
+  if (blockList.empty()) {
+    return;
+  }
+  NbtCursor<true> blockCursor(blockList);
+  blockCursor.forEachElement([&](uint32_t, TagType type) {
+    if (type != TagType::Compound) {
+      throw NbtError("structure block is not a compound");
+    }
+    int pos[3] = {-1, -1, -1};
+    int64_t state = -1;
+    blockCursor.forEachEntry([&](std::string_view name, TagType fieldType) {
+      if (name == "pos" && fieldType == TagType::List) {
+        readIntList(blockCursor, pos);
+      } else if (name == "state") {
+        state = blockCursor.readInteger(fieldType);
+      } else {
+        blockCursor.skip(fieldType);
+      }
+    });
+    if (state < 0 || static_cast<size_t>(state) >= palette.size()) {
+      throw NbtError("structure block state index out of range");
+    }
+    for (int axis = 0; axis < 3; axis++) {
+      if (pos[axis] < 0 || pos[axis] >= size[axis]) {
+        throw NbtError("structure block is outside the structure");
+      }
+    }
+    setBlock(pos[0], pos[1], pos[2], palette[state]);
+  });
+}
+
+bool Schematic::covers(ChunkPos pos) const {
+  return pos.x >= floorDiv16(boxMin[0]) && pos.x <= floorDiv16(boxMax[0]) &&
+         pos.z >= floorDiv16(boxMin[2]) && pos.z <= floorDiv16(boxMax[2]);
+}
+
+std::vector<ChunkPos> Schematic::chunks() const {
+  std::unordered_set<ChunkPos> unique;
+  for (const auto &[pos, section] : sections) {
+    unique.insert(pos.chunk());
+  }
+  return {unique.begin(), unique.end()};
+}
+
+std::unique_ptr<Chunk> Schematic::paste(ChunkPos pos,
+                                        const Chunk *existing) const {
+  auto chunk = existing ? std::make_unique<Chunk>(*existing)
+                        : std::make_unique<Chunk>(
+                              pos, minSectionY, maxSectionY - minSectionY + 1);
+  for (int sectionY = minSectionY; sectionY <= maxSectionY; sectionY++) {
+    auto it = sections.find({pos.x, sectionY, pos.z});
+    ChunkSection *section = chunk->section(sectionY);
+    if (it == sections.end() || !section) {
+      continue;
+    }
+
+    // Sections without voids replace the chunk's outright
+    const PalettedContainer<4096> &from = it->second;
+    const auto &palette = from.paletteEntries();
+    if (std::find(palette.begin(), palette.end(), voidState) ==
+        palette.end()) {
+      section->blocks = from;
+      continue;
+    }
+    uint16_t states[4096];
+    from.extract(states);
+    for (unsigned i = 0; i < 4096; i++) {
+      if (states[i] != voidState) {
+        section->blocks.set(i, states[i]);
+      }
+    }
+    section->blocks.compact();
+  }
+  chunk->setHasLight(false);
+  return chunk;
+}
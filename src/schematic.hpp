@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chunk.hpp"
+#include "coords.hpp"
+#include "registry.hpp"
+
+// A schematic placed in the world, kept as paletted sections in world
+// coordinates. Blocks are decoded straight into the sections as they're
+// read, so memory grows with the number of sections rather than blocks.
+//
+// Positions a schematic leaves out, like structure voids or the space
+// between Litematica regions, are stored as minecraft:structure_void and
+// keep whatever block was there when pasted.
+class Schematic {
+public:
+  // Reads a Sponge .schem (versions 1-3), Litematica .litematic or vanilla
+  // structure .nbt file, gzipped or not, picked by extension. The minimum
+  // corner of the schematic is placed at origin. Throws NbtError or
+  // std::runtime_error on files it can't read.
+  static Schematic load(const std::string &path,
+                        const std::array<int, 3> &origin,
+                        BlockRegistry &blocks);
+
+  // Inclusive world block bounds
+  const std::array<int, 3> &min() const { return boxMin; }
+  const std::array<int, 3> &max() const { return boxMax; }
+  size_t sectionCount() const { return sections.size(); }
+
+  bool covers(ChunkPos pos) const;
+  // Every chunk with one of the schematic's sections
+  std::vector<ChunkPos> chunks() const;
+  // A copy of existing, or a new chunk spanning the schematic's sections if
+  // there is none, with the schematic's blocks written over it, air
+  // included. Blocks above or below existing are dropped.
+  std::unique_ptr<Chunk> paste(ChunkPos pos, const Chunk *existing) const;
+
+private:
+  std::unordered_map<SectionPos, PalettedContainer<4096>> sections;
+  std::array<int, 3> boxMin{};
+  std::array<int, 3> boxMax{};
+  int minSectionY = 0;
+  int maxSectionY = 0;
+  BlockStateId voidState = BlockRegistry::AIR;
+  // Section setBlock() last wrote to, blocks mostly come in rows
+  PalettedContainer<4096> *current = nullptr;
+  SectionPos currentPos{};
+
+  void readSponge(std::span<const uint8_t> nbt, BlockRegistry &blocks);
+  void readLitematica(std::span<const uint8_t> nbt, BlockRegistry &blocks);
+  void readStructure(std::span<const uint8_t> nbt, BlockRegistry &blocks);
+  // x, y and z are relative to the schematic's minimum corner, which must
+  // already be in boxMin
+  void setBlock(int x, int y, int z, BlockStateId state);
+  // Sets boxMax from the size, boxMin already holds the origin
+  void setSize(const int size[3]);
+};
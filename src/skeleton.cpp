@@ -0,0 +1,127 @@
+#include "skeleton.hpp"
+
+#include <algorithm>
+#include <numbers>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fmt/core.h>
+
+namespace {
+
+// Translate(pivot + translation) * Rotate * Scale * Translate(-pivot)
+Mat4 boneMatrix(Vec3 pivot, Quat rotation, const BonePose &pose) {
+  Quat q = rotation;
+  float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+  const float columns[3][3] = {
+      {1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy)},
+      {2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx)},
+      {2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy)},
+  };
+  const float scale[3] = {pose.scale.x, pose.scale.y, pose.scale.z};
+  const float p[3] = {pivot.x, pivot.y, pivot.z};
+  const float t[3] = {pose.translation.x, pose.translation.y,
+                      pose.translation.z};
+
+  Mat4 result = Mat4::identity();
+  for (int row = 0; row < 3; row++) {
+    float moved = p[row] + t[row];
+    for (int column = 0; column < 3; column++) {
+      float value = columns[column][row] * scale[column];
+      result.at(row, column) = value;
+      moved -= value * p[column];
+    }
+    result.at(row, 3) = moved;
+  }
+  return result;
+}
+
+// Affine matrices only, skips the bottom rows
+void multiplyAffine(const Mat4 &a, const Mat4 &b, Mat4 &out) {
+  for (int column = 0; column < 4; column++) {
+    out.at(3, column) = column == 3 ? 1 : 0;
+    for (int row = 0; row < 3; row++) {
+      float sum = column == 3 ? a.at(row, 3) : 0;
+      for (int k = 0; k < 3; k++) {
+        sum += a.at(row, k) * b.at(k, column);
+      }
+      out.at(row, column) = sum;
+    }
+  }
+}
+
+} // namespace
+
+Skeleton::Skeleton(const std::vector<Bone> &bones) {
+  std::unordered_map<std::string, uint32_t> byName;
+  for (uint32_t i = 0; i < bones.size(); i++) {
+    byName.emplace(bones[i].name, i);
+  }
+
+  // Children of each bone, then a depth first walk from the roots keeps
+  // siblings in their authored order
+  std::vector<std::vector<uint32_t>> children(bones.size());
+  std::vector<uint32_t> stack;
+  for (uint32_t i = 0; i < bones.size(); i++) {
+    if (bones[i].parent.empty()) {
+      stack.push_back(i);
+      continue;
+    }
+    auto parent = byName.find(bones[i].parent);
+    if (parent == byName.end()) {
+      throw std::runtime_error(fmt::format("bone {} has unknown parent {}",
+                                           bones[i].name, bones[i].parent));
+    }
+    children[parent->second].push_back(i);
+  }
+  std::reverse(stack.begin(), stack.end());
+
+  std::vector<int32_t> flattened(bones.size(), -1);
+  while (!stack.empty()) {
+    uint32_t bone = stack.back();
+    stack.pop_back();
+    flattened[bone] = names.size();
+    const Bone &authored = bones[bone];
+    names.push_back(authored.name);
+    parents.push_back(authored.parent.empty()
+                          ? -1
+                          : flattened[byName.at(authored.parent)]);
+    pivots.push_back(authored.pivot);
+    restRotations.push_back(eulerDegrees(authored.rotation));
+    stack.insert(stack.end(), children[bone].rbegin(), children[bone].rend());
+  }
+  // Bones in a cycle are never reached from a root
+  if (names.size() != bones.size()) {
+    throw std::runtime_error("bones are their own ancestors");
+  }
+}
+
+std::optional<uint32_t> Skeleton::find(const std::string &name) const {
+  for (uint32_t bone = 0; bone < names.size(); bone++) {
+    if (names[bone] == name) {
+      return bone;
+    }
+  }
+  return std::nullopt;
+}
+
+void Skeleton::pose(const BonePose *poses, Mat4 *out) const {
+  for (size_t bone = 0; bone < parents.size(); bone++) {
+    Quat rotation = restRotations[bone] * poses[bone].rotation;
+    Mat4 local = boneMatrix(pivots[bone], rotation, poses[bone]);
+    if (parents[bone] < 0) {
+      out[bone] = local;
+    } else {
+      multiplyAffine(out[parents[bone]], local, out[bone]);
+    }
+  }
+}
+
+Quat eulerDegrees(Vec3 degrees) {
+  float radians = std::numbers::pi_v<float> / 180;
+  return axisAngle({0, 0, 1}, degrees.z * radians) *
+         axisAngle({0, 1, 0}, degrees.y * radians) *
+         axisAngle({1, 0, 0}, degrees.x * radians);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "math.hpp"
+
+// A bone of a model as it's authored, in Bedrock's model units of 1/16
+// block
+struct Bone {
+  std::string name;
+  // Empty for root bones
+  std::string parent;
+  // Rotation and scale are about this point
+  Vec3 pivot;
+  // Rest rotation, in degrees about x, then y, then z
+  Vec3 rotation;
+};
+
+// Animated transform of a bone relative to its rest pose
+struct BonePose {
+  Vec3 translation;
+  Quat rotation;
+  Vec3 scale{1, 1, 1};
+};
+
+// A bone tree flattened into arrays with every bone after its parent, so
+// posing is a single pass over them that finds each parent's matrix already
+// computed
+class Skeleton {
+public:
+  Skeleton() = default;
+  // Bones can come in any order. Throws if a parent doesn't exist or bones
+  // are their own ancestors.
+  explicit Skeleton(const std::vector<Bone> &bones);
+
+  size_t size() const { return parents.size(); }
+  const std::string &name(uint32_t bone) const { return names[bone]; }
+  // -1 for root bones
+  int32_t parent(uint32_t bone) const { return parents[bone]; }
+  std::optional<uint32_t> find(const std::string &name) const;
+
+  // Model space matrices of every bone, given each bone's pose. Both arrays
+  // have size() entries.
+  void pose(const BonePose *poses, Mat4 *out) const;
+
+private:
+  std::vector<std::string> names;
+  std::vector<int32_t> parents;
+  std::vector<Vec3> pivots;
+  std::vector<Quat> restRotations;
+};
+
+// Bedrock's rotation order, x first
+Quat eulerDegrees(Vec3 degrees);
@@ -0,0 +1,273 @@
+#include "texture_array.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fmt/core.h>
+#include <png.h>
+
+#include "json.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Image {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<uint8_t> pixels;
+};
+
+Image loadPng(const std::string &path) {
+  png_image png{};
+  png.version = PNG_IMAGE_VERSION;
+  if (!png_image_begin_read_from_file(&png, path.c_str())) {
+    throw std::runtime_error(
+        fmt::format("failed to read {}: {}", path, png.message));
+  }
+  png.format = PNG_FORMAT_RGBA;
+
+  Image image;
+  image.width = png.width;
+  image.height = png.height;
+  image.pixels.resize(PNG_IMAGE_SIZE(png));
+  if (!png_image_finish_read(&png, nullptr, image.pixels.data(), 0,
+                             nullptr)) {
+    png_image_free(&png);
+    throw std::runtime_error(
+        fmt::format("failed to decode {}: {}", path, png.message));
+  }
+  return image;
+}
+
+SpriteTransparency classify(const std::vector<uint8_t> &pixels) {
+  auto result = SpriteTransparency::Opaque;
+  for (size_t i = 3; i < pixels.size(); i += 4) {
+    uint8_t alpha = pixels[i];
+    if (alpha != 0 && alpha != 255) {
+      return SpriteTransparency::Translucent;
+    } else if (alpha == 0) {
+      result = SpriteTransparency::Cutout;
+    }
+  }
+  return result;
+}
+
+// Mirrors vanilla's AnimationMetadataSection::calculateFrameSize
+void frameSize(const JsonValue &animation, uint32_t width, uint32_t height,
+               uint32_t &frameWidth, uint32_t &frameHeight) {
+  int w = animation.getInt("width", -1);
+  int h = animation.getInt("height", -1);
+  if (w != -1) {
+    frameWidth = w;
+    frameHeight = h != -1 ? h : height;
+  } else if (h != -1) {
+    frameWidth = width;
+    frameHeight = h;
+  } else {
+    frameWidth = frameHeight = std::min(width, height);
+  }
+}
+
+} // namespace
+
+TextureArray::TextureArray() {
+  // Magenta and black checkerboard, like vanilla's missingno
+  Layer missing{2, 2, {}};
+  for (int i = 0; i < 4; i++) {
+    bool magenta = i == 0 || i == 3;
+    missing.pixels.insert(missing.pixels.end(),
+                          {static_cast<uint8_t>(magenta ? 248 : 0), 0,
+                           static_cast<uint8_t>(magenta ? 248 : 0), 255});
+  }
+  layers.push_back(std::move(missing));
+
+  Sprite sprite;
+  sprite.name = "minecraft:missingno";
+  sprite.frames.push_back({0, 1});
+  spritesByName.emplace(sprite.name, MISSING_SPRITE);
+  sprites.push_back(std::move(sprite));
+}
+
+void TextureArray::loadSprites(const std::string &resourcePack,
+                               std::string_view category) {
+  fs::path assets = fs::path(resourcePack) / "assets";
+  if (!fs::is_directory(assets)) {
+    throw std::runtime_error(
+        fmt::format("{} is not a resource pack", resourcePack));
+  }
+
+  for (const auto &ns : fs::directory_iterator(assets)) {
+    fs::path root = ns.path() / "textures" / category;
+    if (!fs::is_directory(root)) {
+      continue;
+    }
+
+    std::string prefix = fmt::format("{}:{}/", ns.path().filename().string(),
+                                     category);
+    for (const auto &entry : fs::recursive_directory_iterator(root)) {
+      if (!entry.is_regular_file() || entry.path().extension() != ".png") {
+        continue;
+      }
+      std::string relative =
+          fs::relative(entry.path(), root).replace_extension().generic_string();
+      addSprite(prefix + relative, entry.path().string());
+    }
+  }
+
+  for (const auto &layer : layers) {
+    tile = std::max({tile, layer.width, layer.height});
+  }
+  fmt::println("Loaded {} {} sprites into {} layers of {}x{}",
+               sprites.size() - 1, category, layers.size(), tile, tile);
+}
+
+uint32_t TextureArray::loadTexture(const std::string &pngPath) {
+  addSprite(pngPath, pngPath);
+  for (const auto &layer : layers) {
+    tile = std::max({tile, layer.width, layer.height});
+  }
+  return spritesByName.at(pngPath);
+}
+
+void TextureArray::addSprite(std::string name, const std::string &pngPath) {
+  if (spritesByName.count(name)) {
+    return;
+  }
+
+  Image image = loadPng(pngPath);
+
+  Sprite sprite;
+  sprite.name = std::move(name);
+
+  std::string metaPath = pngPath + ".mcmeta";
+  const JsonValue *animation = nullptr;
+  JsonValue meta;
+  if (fs::exists(metaPath)) {
+    meta = JsonValue::parseFile(metaPath);
+    animation = meta.find("animation");
+  }
+
+  if (!animation) {
+    sprite.transparency = classify(image.pixels);
+    sprite.frames.push_back({static_cast<uint32_t>(layers.size()), 1});
+    layers.push_back({image.width, image.height, std::move(image.pixels)});
+  } else {
+    uint32_t frameWidth, frameHeight;
+    frameSize(*animation, image.width, image.height, frameWidth, frameHeight);
+    if (frameWidth == 0 || frameHeight == 0 || image.width % frameWidth != 0 ||
+        image.height % frameHeight != 0) {
+      throw std::runtime_error(
+          fmt::format("{} has an invalid animation frame size", pngPath));
+    }
+    uint32_t columns = image.width / frameWidth;
+    uint32_t frameCount = columns * (image.height / frameHeight);
+    int defaultTicks = std::max(1, animation->getInt("frametime", 1));
+    sprite.interpolate = animation->getBool("interpolate", false);
+
+    // Each distinct source frame gets one layer, the playback order can
+    // reference the same frame several times
+    std::vector<uint32_t> frameLayers(frameCount, UINT32_MAX);
+    auto layerForFrame = [&](uint32_t index) {
+      if (index >= frameCount) {
+        throw std::runtime_error(fmt::format(
+            "{} references missing animation frame {}", pngPath, index));
+      }
+      if (frameLayers[index] == UINT32_MAX) {
+        Layer layer{frameWidth, frameHeight, {}};
+        layer.pixels.resize(frameWidth * frameHeight * 4);
+        uint32_t originX = (index % columns) * frameWidth;
+        uint32_t originY = (index / columns) * frameHeight;
+        for (uint32_t y = 0; y < frameHeight; y++) {
+          const uint8_t *row =
+              &image.pixels[((originY + y) * image.width + originX) * 4];
+          std::copy(row, row + frameWidth * 4,
+                    &layer.pixels[y * frameWidth * 4]);
+        }
+        sprite.transparency =
+            std::max(sprite.transparency, classify(layer.pixels));
+        frameLayers[index] = layers.size();
+        layers.push_back(std::move(layer));
+      }
+      return frameLayers[index];
+    };
+
+    if (const JsonValue *frames = animation->find("frames")) {
+      for (const auto &frame : frames->asArray()) {
+        if (frame.isNumber()) {
+          sprite.frames.push_back(
+              {layerForFrame(frame.asInt()),
+               static_cast<uint32_t>(defaultTicks)});
+        } else {
+          int ticks = std::max(1, frame.getInt("time", defaultTicks));
+          sprite.frames.push_back({layerForFrame(frame.getInt("index", 0)),
+                                   static_cast<uint32_t>(ticks)});
+        }
+      }
+    }
+    if (sprite.frames.empty()) {
+      for (uint32_t i = 0; i < frameCount; i++) {
+        sprite.frames.push_back(
+            {layerForFrame(i), static_cast<uint32_t>(defaultTicks)});
+      }
+    }
+  }
+
+  spritesByName.emplace(sprite.name, sprites.size());
+  sprites.push_back(std::move(sprite));
+}
+
+std::optional<uint32_t> TextureArray::findSprite(std::string_view name) const {
+  auto it = spritesByName.find(std::string(name));
+  if (it == spritesByName.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+uint32_t TextureArray::spriteIndex(std::string_view name) const {
+  return findSprite(name).value_or(MISSING_SPRITE);
+}
+
+const std::string &TextureArray::spriteName(uint32_t sprite) const {
+  return sprites[sprite].name;
+}
+
+std::vector<uint8_t> TextureArray::layerPixels() const {
+  size_t layerSize = tile * tile * 4;
+  std::vector<uint8_t> pixels(layerSize * layers.size());
+
+  // Nearest neighbour resampling keeps pixel art crisp and handles packs
+  // mixing resolutions
+  for (size_t i = 0; i < layers.size(); i++) {
+    const Layer &layer = layers[i];
+    uint8_t *out = &pixels[i * layerSize];
+    for (uint32_t y = 0; y < tile; y++) {
+      uint32_t srcY = y * layer.height / tile;
+      for (uint32_t x = 0; x < tile; x++) {
+        uint32_t srcX = x * layer.width / tile;
+        const uint8_t *src = &layer.pixels[(srcY * layer.width + srcX) * 4];
+        std::copy(src, src + 4, out + (y * tile + x) * 4);
+      }
+    }
+  }
+  return pixels;
+}
+
+std::vector<SpriteTableEntry> TextureArray::buildSpriteTable() const {
+  std::vector<SpriteTableEntry> table(sprites.size());
+  for (size_t i = 0; i < sprites.size(); i++) {
+    const Sprite &sprite = sprites[i];
+    uint32_t firstFrame = table.size();
+    uint32_t startTick = 0;
+    for (const Frame &frame : sprite.frames) {
+      table.push_back({frame.layer, startTick, frame.ticks, 0});
+      startTick += frame.ticks;
+    }
+    table[i] = {firstFrame, static_cast<uint32_t>(sprite.frames.size()),
+                startTick,
+                sprite.interpolate ? SPRITE_FLAG_INTERPOLATE : 0};
+  }
+  return table;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class SpriteTransparency : uint8_t { Opaque, Cutout, Translucent };
+
+// One entry of the sprite table uploaded to the GPU. The table starts with
+// one header per sprite followed by the frame entries they point at:
+//   header: {firstFrameEntry, frameCount, totalTicks, flags}
+//   frame:  {layer, startTick, ticks, 0}
+struct SpriteTableEntry {
+  uint32_t x, y, z, w;
+};
+
+const uint32_t SPRITE_FLAG_INTERPOLATE = 1;
+
+// All sprites are stored as layers of a single 2D array texture, including
+// every frame of animated sprites. Animation playback happens entirely in
+// the fragment shader using the sprite table, so advancing or scrubbing the
+// timeline never touches texture memory.
+class TextureArray {
+public:
+  // Sprite 0 is always the missing texture.
+  static constexpr uint32_t MISSING_SPRITE = 0;
+
+  TextureArray();
+
+  // Loads every png under assets/<namespace>/textures/<category> of a
+  // resource pack, along with its .png.mcmeta animation if present. Sprite
+  // names look like "minecraft:block/stone".
+  void loadSprites(const std::string &resourcePack,
+                   std::string_view category);
+
+  // Loads a single png, named by its path, for textures that aren't part of
+  // a resource pack such as entity skins. Returns its sprite.
+  uint32_t loadTexture(const std::string &pngPath);
+
+  std::optional<uint32_t> findSprite(std::string_view name) const;
+  uint32_t spriteIndex(std::string_view name) const;
+  const std::string &spriteName(uint32_t sprite) const;
+
+  uint32_t spriteCount() const { return sprites.size(); }
+  uint32_t tileSize() const { return tile; }
+  uint32_t layerCount() const { return layers.size(); }
+  uint32_t firstLayer(uint32_t sprite) const {
+    return sprites[sprite].frames[0].layer;
+  }
+  SpriteTransparency transparency(uint32_t sprite) const {
+    return sprites[sprite].transparency;
+  }
+
+  // Tightly packed RGBA8 pixels for all layers, resampled to tileSize().
+  std::vector<uint8_t> layerPixels() const;
+  std::vector<SpriteTableEntry> buildSpriteTable() const;
+
+private:
+  struct Frame {
+    uint32_t layer;
+    uint32_t ticks;
+  };
+
+  struct Sprite {
+    std::string name;
+    std::vector<Frame> frames;
+    bool interpolate = false;
+    SpriteTransparency transparency = SpriteTransparency::Opaque;
+  };
+
+  struct Layer {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> pixels;
+  };
+
+  uint32_t tile = 16;
+  std::vector<Sprite> sprites;
+  std::vector<Layer> layers;
+  std::unordered_map<std::string, uint32_t> spritesByName;
+
+  void addSprite(std::string name, const std::string &pngPath);
+};
@@ -0,0 +1,162 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+#include <fmt/core.h>
+
+namespace {
+
+// Lets submit() find the calling worker's own queue
+thread_local const ThreadPool *currentPool = nullptr;
+thread_local unsigned currentWorker = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+  threadCount = std::max(threadCount, 1u);
+  for (unsigned i = 0; i < threadCount; i++) {
+    queues.push_back(std::make_unique<WorkQueue>());
+  }
+  for (unsigned i = 0; i < threadCount; i++) {
+    workers.emplace_back([this, i] { workerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(sleepMutex);
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+  unsigned index = currentPool == this
+                       ? currentWorker
+                       : nextQueue.fetch_add(1, std::memory_order_relaxed) %
+                             queues.size();
+
+  unfinishedJobs.fetch_add(1);
+  {
+    std::lock_guard lock(queues[index]->mutex);
+    queues[index]->jobs.push_back(std::move(job));
+  }
+  {
+    // Taking the lock here makes sure a worker can't miss the wakeup
+    // between checking for jobs and going to sleep
+    std::lock_guard lock(sleepMutex);
+    queuedJobs.fetch_add(1);
+  }
+  jobAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock(sleepMutex);
+  jobsDone.wait(lock, [this] { return unfinishedJobs.load() == 0; });
+}
+
+void ThreadPool::parallelBatches(
+    size_t count, size_t batchSize,
+    const std::function<void(size_t batch, size_t first, size_t end)> &fn) {
+  size_t batches = (count + batchSize - 1) / batchSize;
+  if (batches < 2) {
+    if (count > 0) {
+      fn(0, 0, count);
+    }
+    return;
+  }
+
+  // Helper jobs may only start after we've returned, by then there's
+  // nothing left for them to claim and fn is never touched
+  struct State {
+    const std::function<void(size_t, size_t, size_t)> *fn;
+    size_t count;
+    size_t batchSize;
+    size_t batches;
+    std::atomic<size_t> nextBatch = 0;
+    std::atomic<size_t> finishedBatches = 0;
+
+    void run() {
+      size_t batch;
+      while ((batch = nextBatch.fetch_add(1)) < batches) {
+        size_t first = batch * batchSize;
+        (*fn)(batch, first, std::min(first + batchSize, count));
+        if (finishedBatches.fetch_add(1) + 1 == batches) {
+          finishedBatches.notify_all();
+        }
+      }
+    }
+  };
+
+  auto state = std::make_shared<State>();
+  state->fn = &fn;
+  state->count = count;
+  state->batchSize = batchSize;
+  state->batches = batches;
+  size_t helpers = std::min<size_t>(size(), batches - 1);
+  for (size_t i = 0; i < helpers; i++) {
+    submit([state] { state->run(); });
+  }
+  state->run();
+  size_t finished;
+  while ((finished = state->finishedBatches.load()) < batches) {
+    state->finishedBatches.wait(finished);
+  }
+}
+
+bool ThreadPool::popJob(unsigned index, std::function<void()> &job) {
+  {
+    WorkQueue &own = *queues[index];
+    std::lock_guard lock(own.mutex);
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < queues.size(); i++) {
+    WorkQueue &victim = *queues[(index + i) % queues.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+  currentPool = this;
+  currentWorker = index;
+
+  while (true) {
+    std::function<void()> job;
+    if (!popJob(index, job)) {
+      std::unique_lock lock(sleepMutex);
+      jobAvailable.wait(lock,
+                        [this] { return stopping || queuedJobs.load() > 0; });
+      if (stopping && queuedJobs.load() == 0) {
+        return;
+      }
+      continue;
+    }
+    queuedJobs.fetch_sub(1);
+
+    try {
+      job();
+    } catch (const std::exception &e) {
+      fmt::println(stderr, "Background job failed: {}", e.what());
+    }
+
+    if (unfinishedJobs.fetch_sub(1) == 1) {
+      std::lock_guard lock(sleepMutex);
+      jobsDone.notify_all();
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool for CPU heavy background work like chunk decompression
+// and meshing. Every worker has its own deque: jobs submitted from a worker
+// go to its own deque and are popped newest first, idle workers steal the
+// oldest jobs from the others. Jobs submitted from other threads are spread
+// round robin.
+class ThreadPool {
+public:
+  explicit ThreadPool(
+      unsigned threadCount = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> job);
+  // Blocks until every job submitted so far has finished
+  void wait();
+  // Splits [0, count) into batches of batchSize and calls fn(batch, first,
+  // end) for each. The workers and the calling thread take turns claiming
+  // batches, and this returns once every batch has finished, so the caller
+  // only ever waits for batches that are already running. Small counts are
+  // run on the calling thread.
+  void parallelBatches(
+      size_t count, size_t batchSize,
+      const std::function<void(size_t batch, size_t first, size_t end)> &fn);
+
+  unsigned size() const { return workers.size(); }
+
+private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> jobs;
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::atomic<unsigned> nextQueue = 0;
+  // Jobs sitting in a queue, and jobs that haven't finished yet
+  std::atomic<size_t> queuedJobs = 0;
+  std::atomic<size_t> unfinishedJobs = 0;
+
+  std::mutex sleepMutex;
+  std::condition_variable jobAvailable;
+  std::condition_variable jobsDone;
+  bool stopping = false;
+
+  bool popJob(unsigned index, std::function<void()> &job);
+  void workerLoop(unsigned index);
+};
@@ -0,0 +1,241 @@
+#include "timeline.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+namespace {
+
+// Newton steps when finding the Bézier parameter for a time
+const int BEZIER_ITERATIONS = 6;
+
+float blend(float a, float b, float t) { return a + (b - a) * t; }
+Vec3 blend(Vec3 a, Vec3 b, float t) { return lerp(a, b, t); }
+Quat blend(Quat a, Quat b, float t) { return slerp(a, b, t); }
+Color blend(Color a, Color b, float t) { return a + (b - a) * t; }
+
+// Rotations are blended component wise by the cubic curves, which only
+// works if neighbouring keyframes are in the same hemisphere, and needs
+// the result normalized
+template <typename T> T align(T, T value) { return value; }
+Quat align(Quat reference, Quat value) {
+  return dot(reference, value) < 0 ? -value : value;
+}
+template <typename T> T finish(T value) { return value; }
+Quat finish(Quat value) { return normalize(value); }
+
+template <typename T> T hermite(T p0, T m0, T p1, T m1, float t) {
+  float t2 = t * t;
+  float t3 = t2 * t;
+  return p0 * (2 * t3 - 3 * t2 + 1) + m0 * (t3 - 2 * t2 + t) +
+         p1 * (-2 * t3 + 3 * t2) + m1 * (t3 - t2);
+}
+
+template <typename T> T bezier(T p0, T p1, T p2, T p3, float s) {
+  float r = 1 - s;
+  return p0 * (r * r * r) + p1 * (3 * r * r * s) + p2 * (3 * r * s * s) +
+         p3 * (s * s * s);
+}
+
+// The Bézier parameter where the curve through 0, x1, x2, 1 reaches x.
+// Handles are kept within the interval so the curve never turns back.
+float bezierParameter(float x1, float x2, float x) {
+  float s = x;
+  for (int i = 0; i < BEZIER_ITERATIONS; i++) {
+    float r = 1 - s;
+    float error = bezier(0.0f, x1, x2, 1.0f, s) - x;
+    float slope =
+        3 * r * r * x1 + 6 * r * s * (x2 - x1) + 3 * s * s * (1 - x2);
+    if (slope < 1e-6f) {
+      break;
+    }
+    s = std::clamp(s - error / slope, 0.0f, 1.0f);
+  }
+  return s;
+}
+
+} // namespace
+
+template <typename T> Track<T>::Track(std::vector<Keyframe<T>> keyframes) {
+  std::stable_sort(keyframes.begin(), keyframes.end(),
+                   [](const Keyframe<T> &a, const Keyframe<T> &b) {
+                     return a.time < b.time;
+                   });
+  bool curved = std::any_of(keyframes.begin(), keyframes.end(),
+                            [](const Keyframe<T> &keyframe) {
+                              return keyframe.interpolation ==
+                                     Interpolation::Bezier;
+                            });
+  for (const auto &keyframe : keyframes) {
+    times.push_back(keyframe.time);
+    values.push_back(keyframe.value);
+    interpolations.push_back(std::is_integral_v<T> ? Interpolation::Step
+                                                   : keyframe.interpolation);
+    if (curved) {
+      handles.push_back(keyframe.handles);
+    }
+  }
+}
+
+template <typename T> T Track<T>::sample(float time) {
+  if (times.empty()) {
+    return T{};
+  }
+  cursor = find(time, cursor);
+  return interpolate(cursor, time);
+}
+
+template <typename T> T Track<T>::sampleAt(float time) const {
+  if (times.empty()) {
+    return T{};
+  }
+  return interpolate(search(time), time);
+}
+
+template <typename T>
+uint32_t Track<T>::find(float time, uint32_t hint) const {
+  uint32_t count = times.size();
+  if (hint >= count) {
+    return search(time);
+  }
+  if (time < times[hint]) {
+    return hint == 0 ? 0 : search(time);
+  }
+  if (hint + 1 < count && time >= times[hint + 1]) {
+    // Playback usually moves on by at most one keyframe a frame
+    bool skipped = hint + 2 < count && time >= times[hint + 2];
+    return skipped ? search(time) : hint + 1;
+  }
+  return hint;
+}
+
+template <typename T> uint32_t Track<T>::search(float time) const {
+  auto after = std::upper_bound(times.begin(), times.end(), time);
+  return after == times.begin() ? 0 : after - times.begin() - 1;
+}
+
+template <typename T>
+T Track<T>::interpolate(uint32_t key, float time) const {
+  uint32_t next = key + 1;
+  if (next >= times.size() || time <= times[key] ||
+      interpolations[key] == Interpolation::Step) {
+    return values[key];
+  }
+  if constexpr (std::is_integral_v<T>) {
+    return values[key];
+  } else {
+    float span = times[next] - times[key];
+    float t = (time - times[key]) / span;
+    T p0 = values[key];
+    T p1 = align(p0, values[next]);
+
+    switch (interpolations[key]) {
+    case Interpolation::Bezier: {
+      const BezierHandles<T> &out = handles[key];
+      const BezierHandles<T> &in = handles[next];
+      float x1 = std::clamp(out.outTime / span, 0.0f, 1.0f);
+      float x2 = std::clamp(1 + in.inTime / span, 0.0f, 1.0f);
+      float s = bezierParameter(x1, x2, t);
+      return finish(
+          bezier(p0, p0 + out.outValue, p1 + in.inValue, p1, s));
+    }
+    case Interpolation::CatmullRom: {
+      // Ends repeat their keyframe, which flattens the curve there
+      uint32_t before = key == 0 ? key : key - 1;
+      uint32_t after = next + 1 < times.size() ? next + 1 : next;
+      T previous = align(p0, values[before]);
+      T following = align(p1, values[after]);
+      T m0 = (p1 - previous) * (span / (times[next] - times[before]));
+      T m1 = (following - p0) * (span / (times[after] - times[key]));
+      return finish(hermite(p0, m0, p1, m1, t));
+    }
+    default:
+      return blend(p0, values[next], t);
+    }
+  }
+}
+
+template <typename T>
+HermiteSegment<T> Track<T>::segment(uint32_t key) const {
+  HermiteSegment<T> segment;
+  segment.start = times[key];
+  segment.end = std::numeric_limits<float>::infinity();
+  segment.p0 = values[key];
+  segment.p1 = values[key];
+  // Zero, which a default Quat isn't
+  segment.m0 = values[key] - values[key];
+  segment.m1 = segment.m0;
+  uint32_t next = key + 1;
+  if (next >= times.size()) {
+    return segment;
+  }
+  segment.end = times[next];
+  if constexpr (!std::is_integral_v<T>) {
+    float span = times[next] - times[key];
+    T p0 = values[key];
+    T p1 = align(p0, values[next]);
+    switch (interpolations[key]) {
+    case Interpolation::Step:
+      return segment;
+    case Interpolation::Bezier: {
+      float outTime = handles[key].outTime;
+      float inTime = handles[next].inTime;
+      T out = handles[key].outValue;
+      T in = handles[next].inValue;
+      segment.m0 = outTime > 0 ? out * (span / outTime) : out * 3;
+      segment.m1 = inTime < 0 ? in * (span / inTime) : in * -3;
+      break;
+    }
+    case Interpolation::CatmullRom: {
+      uint32_t before = key == 0 ? key : key - 1;
+      uint32_t after = next + 1 < times.size() ? next + 1 : next;
+      T previous = align(p0, values[before]);
+      T following = align(p1, values[after]);
+      segment.m0 = (p1 - previous) * (span / (times[next] - times[before]));
+      segment.m1 = (following - p0) * (span / (times[after] - times[key]));
+      break;
+    }
+    default:
+      segment.m0 = p1 - p0;
+      segment.m1 = p1 - p0;
+      segment.spherical = std::is_same_v<T, Quat>;
+      break;
+    }
+    segment.p1 = p1;
+  }
+  return segment;
+}
+
+template class Track<float>;
+template class Track<Vec3>;
+template class Track<Quat>;
+template class Track<Color>;
+template class Track<BlockStateId>;
+
+void Timeline::evaluate(float time) {
+  std::apply(
+      [time](auto &...lane) {
+        auto sampleLane = [time](auto &lane) {
+          for (size_t i = 0; i < lane.tracks.size(); i++) {
+            lane.values[i] = lane.tracks[i].sample(time);
+          }
+        };
+        (sampleLane(lane), ...);
+      },
+      lanes);
+}
+
+float Timeline::endTime() const {
+  float end = 0;
+  std::apply(
+      [&end](const auto &...lane) {
+        auto laneEnd = [&end](const auto &lane) {
+          for (const auto &track : lane.tracks) {
+            end = std::max(end, track.endTime());
+          }
+        };
+        (laneEnd(lane), ...);
+      },
+      lanes);
+  return end;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "math.hpp"
+#include "registry.hpp"
+
+// Straight RGBA, 0-1
+struct Color {
+  float r = 0;
+  float g = 0;
+  float b = 0;
+  float a = 1;
+
+  Color operator+(Color other) const {
+    return {r + other.r, g + other.g, b + other.b, a + other.a};
+  }
+  Color operator-(Color other) const {
+    return {r - other.r, g - other.g, b - other.b, a - other.a};
+  }
+  Color operator*(float scale) const {
+    return {r * scale, g * scale, b * scale, a * scale};
+  }
+};
+
+// How a track gets from a keyframe to the next one
+enum class Interpolation : uint8_t {
+  // Holds the value until the next keyframe
+  Step,
+  // Straight lines, slerp for rotations
+  Linear,
+  // Cubic Bézier shaped by the keyframes' handles, like Blockbench's
+  Bezier,
+  // Passes smoothly through every keyframe, with tangents taken from the
+  // neighbouring keyframes and scaled for uneven spacing
+  CatmullRom,
+};
+
+// Handles are relative to their keyframe, in seconds and value. The out
+// handle shapes the curve to the next keyframe and the in handle the curve
+// from the previous one, so inTime is normally negative.
+template <typename T> struct BezierHandles {
+  float inTime = 0;
+  T inValue{};
+  float outTime = 0;
+  T outValue{};
+};
+
+// The curve from a keyframe to the next as a cubic Hermite spline,
+// value = h00(u) p0 + h10(u) m0 + h01(u) p1 + h11(u) m1 with
+// u = (time - start) / (end - start) clamped to 0-1. Steps, lines and the
+// last keyframe's hold all fit, which lets many tracks be evaluated in
+// lanes with no branching.
+template <typename T> struct HermiteSegment {
+  float start = 0;
+  // Infinite after the last keyframe
+  float end = 0;
+  T p0{};
+  T m0{};
+  T p1{};
+  T m1{};
+  // Linear rotations, which are meant to be slerped rather than lerped
+  bool spherical = false;
+};
+
+template <typename T> struct Keyframe {
+  // Seconds
+  float time = 0;
+  T value{};
+  Interpolation interpolation = Interpolation::Linear;
+  BezierHandles<T> handles{};
+};
+
+// Keyframes of one animated value, sorted by time. Before the first
+// keyframe and after the last the track holds their values. Block states
+// can't be blended, their tracks always step.
+//
+// sample() keeps a cursor on the keyframe it last landed on, so playback
+// that moves forward by less than an interval a call costs O(1), and seeks
+// fall back to a binary search.
+template <typename T> class Track {
+public:
+  Track() = default;
+  // Keyframes at the same time keep their order, the track jumps to the
+  // last of them
+  explicit Track(std::vector<Keyframe<T>> keyframes);
+
+  T sample(float time);
+  // Leaves the cursor where it is, for looking ahead
+  T sampleAt(float time) const;
+
+  // The last keyframe at or before time, or 0 if there's none. Costs O(1)
+  // if time is at most one keyframe on from hint.
+  uint32_t find(float time, uint32_t hint) const;
+  // Bézier segments keep the slopes their handles give at the keyframes,
+  // which matches the curve exactly when the handles are a third of the
+  // way in time
+  HermiteSegment<T> segment(uint32_t key) const;
+
+  bool empty() const { return times.empty(); }
+  float startTime() const { return times.empty() ? 0 : times.front(); }
+  float endTime() const { return times.empty() ? 0 : times.back(); }
+
+private:
+  std::vector<float> times;
+  std::vector<T> values;
+  std::vector<Interpolation> interpolations;
+  // Only filled if some keyframe is Bezier
+  std::vector<BezierHandles<T>> handles;
+  // The last keyframe at or before the time sample() was last called with
+  uint32_t cursor = 0;
+
+  uint32_t search(float time) const;
+  T interpolate(uint32_t key, float time) const;
+};
+
+extern template class Track<float>;
+extern template class Track<Vec3>;
+extern template class Track<Quat>;
+extern template class Track<Color>;
+extern template class Track<BlockStateId>;
+
+template <typename T> struct TrackId {
+  uint32_t index;
+};
+
+// Tracks sampled together, once a frame, with the values kept for whatever
+// they animate to read
+class Timeline {
+public:
+  template <typename T> TrackId<T> addTrack(Track<T> track) {
+    Lane<T> &lane = std::get<Lane<T>>(lanes);
+    lane.tracks.push_back(std::move(track));
+    lane.values.emplace_back();
+    return {static_cast<uint32_t>(lane.tracks.size() - 1)};
+  }
+
+  template <typename T> Track<T> &track(TrackId<T> id) {
+    return std::get<Lane<T>>(lanes).tracks[id.index];
+  }
+  template <typename T> const Track<T> &track(TrackId<T> id) const {
+    return std::get<Lane<T>>(lanes).tracks[id.index];
+  }
+  // As of the last evaluate()
+  template <typename T> const T &value(TrackId<T> id) const {
+    return std::get<Lane<T>>(lanes).values[id.index];
+  }
+
+  // Samples every track at time
+  void evaluate(float time);
+  // Time of the last keyframe of any track
+  float endTime() const;
+
+private:
+  template <typename T> struct Lane {
+    std::vector<Track<T>> tracks;
+    std::vector<T> values;
+  };
+
+  std::tuple<Lane<float>, Lane<Vec3>, Lane<Quat>, Lane<Color>,
+             Lane<BlockStateId>>
+      lanes;
+};
@@ -0,0 +1,322 @@
+#include "transform_batch.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORM_BATCH_X86
+#endif
+
+namespace {
+
+const float INFINITE = std::numeric_limits<float>::infinity();
+
+template <int C> struct LanePointers {
+  const float *time;
+  const float *start;
+  const float *inverseSpan;
+  const float *correctionA;
+  const float *correctionB;
+  const float *p0[C];
+  const float *m0[C];
+  const float *p1[C];
+  const float *m1[C];
+  float *out[C];
+};
+
+// Rotations have 4 components and get the slerp correction and normalized
+template <int C>
+void hermiteScalar(const LanePointers<C> &lanes, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    float u = (lanes.time[i] - lanes.start[i]) * lanes.inverseSpan[i];
+    u = std::clamp(u, 0.0f, 1.0f);
+    if constexpr (C == 4) {
+      float c = u - 0.5f;
+      float k = lanes.correctionA[i] * c * c + lanes.correctionB[i];
+      u += u * c * (u - 1) * k;
+    }
+    float u2 = u * u;
+    float u3 = u2 * u;
+    float h01 = 3 * u2 - 2 * u3;
+    float h00 = 1 - h01;
+    float h11 = u3 - u2;
+    float h10 = h11 - u2 + u;
+
+    float result[C];
+    float length = 0;
+    for (int c = 0; c < C; c++) {
+      result[c] = h00 * lanes.p0[c][i] + h10 * lanes.m0[c][i] +
+                  h01 * lanes.p1[c][i] + h11 * lanes.m1[c][i];
+      length += result[c] * result[c];
+    }
+    float scale = C == 4 ? 1 / std::sqrt(length) : 1;
+    for (int c = 0; c < C; c++) {
+      lanes.out[c][i] = result[c] * scale;
+    }
+  }
+}
+
+#ifdef TRANSFORM_BATCH_X86
+template <int C>
+__attribute__((target("sse2"))) void
+hermiteSse2(const LanePointers<C> &lanes, size_t count) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 two = _mm_set1_ps(2);
+  const __m128 three = _mm_set1_ps(3);
+
+  for (size_t i = 0; i < count; i += 4) {
+    __m128 u = _mm_mul_ps(
+        _mm_sub_ps(_mm_loadu_ps(lanes.time + i), _mm_loadu_ps(lanes.start + i)),
+        _mm_loadu_ps(lanes.inverseSpan + i));
+    u = _mm_min_ps(_mm_max_ps(u, zero), one);
+    if constexpr (C == 4) {
+      __m128 c = _mm_sub_ps(u, half);
+      __m128 k = _mm_add_ps(
+          _mm_mul_ps(_mm_loadu_ps(lanes.correctionA + i), _mm_mul_ps(c, c)),
+          _mm_loadu_ps(lanes.correctionB + i));
+      __m128 bump = _mm_mul_ps(_mm_mul_ps(u, c), _mm_sub_ps(u, one));
+      u = _mm_add_ps(u, _mm_mul_ps(bump, k));
+    }
+    __m128 u2 = _mm_mul_ps(u, u);
+    __m128 u3 = _mm_mul_ps(u2, u);
+    __m128 h01 = _mm_sub_ps(_mm_mul_ps(three, u2), _mm_mul_ps(two, u3));
+    __m128 h00 = _mm_sub_ps(one, h01);
+    __m128 h11 = _mm_sub_ps(u3, u2);
+    __m128 h10 = _mm_add_ps(_mm_sub_ps(h11, u2), u);
+
+    __m128 result[C];
+    __m128 length = zero;
+    for (int c = 0; c < C; c++) {
+      __m128 start =
+          _mm_add_ps(_mm_mul_ps(h00, _mm_loadu_ps(lanes.p0[c] + i)),
+                     _mm_mul_ps(h10, _mm_loadu_ps(lanes.m0[c] + i)));
+      __m128 end = _mm_add_ps(_mm_mul_ps(h01, _mm_loadu_ps(lanes.p1[c] + i)),
+                              _mm_mul_ps(h11, _mm_loadu_ps(lanes.m1[c] + i)));
+      result[c] = _mm_add_ps(start, end);
+      length = _mm_add_ps(length, _mm_mul_ps(result[c], result[c]));
+    }
+    __m128 scale = C == 4 ? _mm_div_ps(one, _mm_sqrt_ps(length)) : one;
+    for (int c = 0; c < C; c++) {
+      _mm_storeu_ps(lanes.out[c] + i, _mm_mul_ps(result[c], scale));
+    }
+  }
+}
+
+template <int C>
+__attribute__((target("avx2"))) void
+hermiteAvx2(const LanePointers<C> &lanes, size_t count) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 two = _mm256_set1_ps(2);
+  const __m256 three = _mm256_set1_ps(3);
+
+  for (size_t i = 0; i < count; i += 8) {
+    __m256 u = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(lanes.time + i),
+                                           _mm256_loadu_ps(lanes.start + i)),
+                             _mm256_loadu_ps(lanes.inverseSpan + i));
+    u = _mm256_min_ps(_mm256_max_ps(u, zero), one);
+    if constexpr (C == 4) {
+      __m256 c = _mm256_sub_ps(u, half);
+      __m256 a = _mm256_loadu_ps(lanes.correctionA + i);
+      __m256 b = _mm256_loadu_ps(lanes.correctionB + i);
+      __m256 k = _mm256_add_ps(_mm256_mul_ps(a, _mm256_mul_ps(c, c)), b);
+      __m256 bump = _mm256_mul_ps(_mm256_mul_ps(u, c), _mm256_sub_ps(u, one));
+      u = _mm256_add_ps(u, _mm256_mul_ps(bump, k));
+    }
+    __m256 u2 = _mm256_mul_ps(u, u);
+    __m256 u3 = _mm256_mul_ps(u2, u);
+    __m256 h01 =
+        _mm256_sub_ps(_mm256_mul_ps(three, u2), _mm256_mul_ps(two, u3));
+    __m256 h00 = _mm256_sub_ps(one, h01);
+    __m256 h11 = _mm256_sub_ps(u3, u2);
+    __m256 h10 = _mm256_add_ps(_mm256_sub_ps(h11, u2), u);
+
+    __m256 result[C];
+    __m256 length = zero;
+    for (int c = 0; c < C; c++) {
+      __m256 start =
+          _mm256_add_ps(_mm256_mul_ps(h00, _mm256_loadu_ps(lanes.p0[c] + i)),
+                        _mm256_mul_ps(h10, _mm256_loadu_ps(lanes.m0[c] + i)));
+      __m256 end =
+          _mm256_add_ps(_mm256_mul_ps(h01, _mm256_loadu_ps(lanes.p1[c] + i)),
+                        _mm256_mul_ps(h11, _mm256_loadu_ps(lanes.m1[c] + i)));
+      result[c] = _mm256_add_ps(start, end);
+      length = _mm256_add_ps(length, _mm256_mul_ps(result[c], result[c]));
+    }
+    __m256 scale =
+        C == 4 ? _mm256_div_ps(one, _mm256_sqrt_ps(length)) : one;
+    for (int c = 0; c < C; c++) {
+      _mm256_storeu_ps(lanes.out[c] + i, _mm256_mul_ps(result[c], scale));
+    }
+  }
+}
+#endif
+
+template <int C>
+using HermiteFn = void (*)(const LanePointers<C> &, size_t);
+
+template <int C> HermiteFn<C> selectHermite() {
+#ifdef TRANSFORM_BATCH_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return hermiteAvx2<C>;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return hermiteSse2<C>;
+  }
+#endif
+  return hermiteScalar<C>;
+}
+
+template <int C> void hermite(const LanePointers<C> &lanes, size_t count) {
+  static const HermiteFn<C> impl = selectHermite<C>();
+  impl(lanes, count);
+}
+
+size_t paddedSize(size_t count) {
+  return (count + TransformBatch::LANES - 1) / TransformBatch::LANES *
+         TransformBatch::LANES;
+}
+
+} // namespace
+
+template <typename T>
+uint32_t TransformBatch::Channels<T>::add(const Track<T> &track,
+                                          uint32_t clock) {
+  uint32_t channel = count++;
+  tracks.push_back(&track);
+  clocks.push_back(clock);
+  keys.push_back(0);
+  // Loaded on the first evaluate()
+  from.push_back(INFINITE);
+  until.push_back(INFINITE);
+
+  size_t padded = paddedSize(count);
+  for (auto *lane : {&time, &start, &inverseSpan, &correctionA,
+                     &correctionB}) {
+    lane->resize(padded);
+  }
+  for (int c = 0; c < COMPONENTS; c++) {
+    // Padding rotations are identities, so normalizing them stays finite
+    p0[c].resize(padded, COMPONENTS == 4 && c == 3 ? 1.0f : 0.0f);
+    m0[c].resize(padded);
+    p1[c].resize(padded);
+    m1[c].resize(padded);
+    out[c].resize(padded);
+  }
+  return channel;
+}
+
+template <typename T>
+void TransformBatch::Channels<T>::load(size_t channel, uint32_t key) {
+  HermiteSegment<T> segment;
+  segment.end = INFINITE;
+  segment.m0 = segment.m1 = segment.p0 - segment.p0;
+  if (!tracks[channel]->empty()) {
+    segment = tracks[channel]->segment(key);
+  }
+  from[channel] = key == 0 ? -INFINITE : segment.start;
+  until[channel] = segment.end;
+  start[channel] = segment.start;
+  float span = segment.end - segment.start;
+  inverseSpan[channel] = span > 0 && span < INFINITE ? 1 / span : 0;
+
+  correctionA[channel] = 0;
+  correctionB[channel] = 0;
+  if constexpr (std::is_same_v<T, Quat>) {
+    if (segment.spherical) {
+      // Fitted to slerp for rotations this close
+      float d = dot(segment.p0, segment.p1);
+      correctionA[channel] =
+          1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+      correctionB[channel] = 0.848013f + d * (-1.06021f + d * 0.215638f);
+    }
+  }
+
+  auto store = [channel](auto &lane, T value) {
+    auto components = std::bit_cast<std::array<float, COMPONENTS>>(value);
+    for (int c = 0; c < COMPONENTS; c++) {
+      lane[c][channel] = components[c];
+    }
+  };
+  store(p0, segment.p0);
+  store(m0, segment.m0);
+  store(p1, segment.p1);
+  store(m1, segment.m1);
+}
+
+template <typename T>
+void TransformBatch::Channels<T>::evaluate(const std::vector<float> &times) {
+  for (size_t i = 0; i < count; i++) {
+    float now = times[clocks[i]];
+    time[i] = now;
+    if (now < from[i] || !(now < until[i])) {
+      keys[i] = tracks[i]->find(now, keys[i]);
+      load(i, keys[i]);
+    }
+  }
+
+  LanePointers<COMPONENTS> lanes{};
+  lanes.time = time.data();
+  lanes.start = start.data();
+  lanes.inverseSpan = inverseSpan.data();
+  lanes.correctionA = correctionA.data();
+  lanes.correctionB = correctionB.data();
+  for (int c = 0; c < COMPONENTS; c++) {
+    lanes.p0[c] = p0[c].data();
+    lanes.m0[c] = m0[c].data();
+    lanes.p1[c] = p1[c].data();
+    lanes.m1[c] = m1[c].data();
+    lanes.out[c] = out[c].data();
+  }
+  hermite(lanes, count);
+}
+
+template <typename T> void TransformBatch::Channels<T>::clear() {
+  *this = Channels();
+}
+
+uint32_t TransformBatch::addVec3(const Track<Vec3> &track, uint32_t clock) {
+  return vec3s.add(track, clock);
+}
+
+uint32_t TransformBatch::addQuat(const Track<Quat> &track, uint32_t clock) {
+  return quats.add(track, clock);
+}
+
+void TransformBatch::clear() {
+  vec3s.clear();
+  quats.clear();
+}
+
+void TransformBatch::evaluate(const std::vector<float> &clocks) {
+  vec3s.evaluate(clocks);
+  quats.evaluate(clocks);
+}
+
+Vec3 TransformBatch::vec3(uint32_t channel) const {
+  const auto &out = vec3s.out;
+  return {out[0][channel], out[1][channel], out[2][channel]};
+}
+
+Quat TransformBatch::quat(uint32_t channel) const {
+  const auto &out = quats.out;
+  return {out[0][channel], out[1][channel], out[2][channel], out[3][channel]};
+}
+
+const char *TransformBatch::instructionSet() {
+#ifdef TRANSFORM_BATCH_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return "AVX2";
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return "SSE2";
+  }
+#endif
+  return "scalar";
+}
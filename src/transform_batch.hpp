@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "math.hpp"
+#include "timeline.hpp"
+
+// Animated translations, scales and rotations of many entities, evaluated
+// together once a frame. Each channel plays a track at the time of one of
+// the caller's clocks, so entities sharing an animation share its tracks
+// but not their playback.
+//
+// Channels are kept as a structure of arrays, one set per value type. Each
+// channel holds the Hermite segment of the keyframe interval it's in, only
+// reloaded from its track when its clock leaves the interval, so
+// evaluating is a straight pass over the segments 8 channels at a time
+// with AVX2, 4 with SSE2, or one by one. Linear rotations are slerped by
+// correcting the lerp's parameter with a polynomial fitted to slerp, which
+// keeps them within a thousandth of a radian of it.
+class TransformBatch {
+public:
+  // Every array has room for a multiple of this many channels
+  static const size_t LANES = 8;
+
+  // The track has to outlive the batch. Returns the channel's index among
+  // channels of its type.
+  uint32_t addVec3(const Track<Vec3> &track, uint32_t clock);
+  uint32_t addQuat(const Track<Quat> &track, uint32_t clock);
+  void clear();
+
+  size_t vec3Count() const { return vec3s.count; }
+  size_t quatCount() const { return quats.count; }
+
+  // clocks holds the time of every clock, in seconds
+  void evaluate(const std::vector<float> &clocks);
+
+  // As of the last evaluate()
+  Vec3 vec3(uint32_t channel) const;
+  Quat quat(uint32_t channel) const;
+
+  // The instruction set evaluate() uses on this CPU
+  static const char *instructionSet();
+
+private:
+  template <typename T> struct Channels {
+    static constexpr int COMPONENTS = sizeof(T) / sizeof(float);
+
+    size_t count = 0;
+    std::vector<const Track<T> *> tracks;
+    std::vector<uint32_t> clocks;
+    std::vector<uint32_t> keys;
+    // The segment is reloaded once the clock leaves [from, until)
+    std::vector<float> from;
+    std::vector<float> until;
+
+    // Lanes
+    std::vector<float> time;
+    std::vector<float> start;
+    std::vector<float> inverseSpan;
+    // Coefficients of the slerp correction, 0 for channels without one
+    std::vector<float> correctionA;
+    std::vector<float> correctionB;
+    std::array<std::vector<float>, COMPONENTS> p0;
+    std::array<std::vector<float>, COMPONENTS> m0;
+    std::array<std::vector<float>, COMPONENTS> p1;
+    std::array<std::vector<float>, COMPONENTS> m1;
+    std::array<std::vector<float>, COMPONENTS> out;
+
+    uint32_t add(const Track<T> &track, uint32_t clock);
+    void load(size_t channel, uint32_t key);
+    void evaluate(const std::vector<float> &clocks);
+    void clear();
+  };
+
+  Channels<Vec3> vec3s;
+  Channels<Quat> quats;
+};
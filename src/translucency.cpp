@@ -0,0 +1,240 @@
+#include "translucency.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+// Sorts are small, a few at a time per worker is plenty
+const size_t JOBS_PER_WORKER = 4;
+
+// A section with quads that aren't axis aligned is sorted again once the
+// camera has moved this fraction of its distance to the section, and at
+// least MIN_RESORT_DISTANCE blocks
+const float RESORT_ANGLE = 0.1f;
+const float MIN_RESORT_DISTANCE = 1.0f;
+
+const float INFINITY_F = std::numeric_limits<float>::infinity();
+
+float unpackPosition(uint32_t value) {
+  return value / TERRAIN_POSITION_SCALE - TERRAIN_POSITION_BIAS;
+}
+
+void relativeCamera(const std::array<double, 3> &camera, SectionPos pos,
+                    float out[3]) {
+  const int32_t origin[3] = {pos.x, pos.y, pos.z};
+  for (int i = 0; i < 3; i++) {
+    out[i] = static_cast<float>(camera[i] - origin[i] * 16.0);
+  }
+}
+
+// Sorts order by keys, smallest first, a byte per pass. Passes where every
+// key has the same byte are skipped, which for quads of one section at a
+// similar distance is usually the top one or two.
+void radixSort(const std::vector<uint32_t> &keys,
+               std::vector<uint32_t> &order) {
+  size_t count = keys.size();
+  order.resize(count);
+  std::iota(order.begin(), order.end(), 0);
+  if (count < 2) {
+    return;
+  }
+
+  uint32_t counts[4][256] = {};
+  for (uint32_t key : keys) {
+    for (int pass = 0; pass < 4; pass++) {
+      counts[pass][key >> pass * 8 & 255]++;
+    }
+  }
+
+  thread_local std::vector<uint32_t> scratch;
+  scratch.resize(count);
+  for (int pass = 0; pass < 4; pass++) {
+    uint32_t *offsets = counts[pass];
+    int shift = pass * 8;
+    if (offsets[keys[0] >> shift & 255] == count) {
+      continue;
+    }
+    uint32_t offset = 0;
+    for (int bucket = 0; bucket < 256; bucket++) {
+      uint32_t bucketCount = offsets[bucket];
+      offsets[bucket] = offset;
+      offset += bucketCount;
+    }
+    for (uint32_t quad : order) {
+      scratch[offsets[keys[quad] >> shift & 255]++] = quad;
+    }
+    order.swap(scratch);
+  }
+}
+
+} // namespace
+
+TranslucentSorter::TranslucentSorter(ThreadPool &pool) : pool(pool) {}
+
+void TranslucentSorter::setSection(SectionPos pos, const MeshLayer &layer) {
+  if (layer.indices.empty()) {
+    removeSection(pos);
+    return;
+  }
+
+  auto quads = std::make_shared<SectionQuads>();
+  quads->indices = layer.indices;
+  size_t quadCount = layer.indices.size() / 6;
+  quads->centroids.resize(quadCount * 3);
+  for (size_t quad = 0; quad < quadCount; quad++) {
+    // The diagonal may start at any corner, the quad's first vertex is the
+    // lowest index
+    const uint32_t *indices = &layer.indices[quad * 6];
+    uint32_t first = *std::min_element(indices, indices + 6);
+    uint32_t packed[4][3];
+    for (int i = 0; i < 4; i++) {
+      const TerrainVertex &vertex = layer.vertices[first + i];
+      packed[i][0] = vertex.x & 0xffff;
+      packed[i][1] = vertex.x >> 16;
+      packed[i][2] = vertex.y & 0xffff;
+    }
+
+    bool aligned = false;
+    for (int axis = 0; axis < 3; axis++) {
+      float sum = 0;
+      for (int i = 0; i < 4; i++) {
+        sum += unpackPosition(packed[i][axis]);
+      }
+      quads->centroids[quad * 3 + axis] = sum / 4;
+
+      if (packed[0][axis] == packed[1][axis] &&
+          packed[0][axis] == packed[2][axis] &&
+          packed[0][axis] == packed[3][axis]) {
+        quads->planes[axis].push_back(unpackPosition(packed[0][axis]));
+        aligned = true;
+      }
+    }
+    quads->unaligned |= !aligned;
+  }
+  for (auto &planes : quads->planes) {
+    std::sort(planes.begin(), planes.end());
+    planes.erase(std::unique(planes.begin(), planes.end()), planes.end());
+  }
+
+  SectionState &state = sections[pos];
+  state = SectionState{};
+  state.quads = std::move(quads);
+  state.version = nextVersion++;
+}
+
+void TranslucentSorter::removeSection(SectionPos pos) { sections.erase(pos); }
+
+void TranslucentSorter::update(const std::array<double, 3> &camera) {
+  std::vector<std::pair<float, SectionPos>> distances;
+  std::vector<std::pair<float, SectionPos>> due;
+  distances.reserve(sections.size());
+  for (auto &[pos, state] : sections) {
+    float relative[3];
+    relativeCamera(camera, pos, relative);
+    float distance = 0;
+    for (int i = 0; i < 3; i++) {
+      float offset = relative[i] - 8.0f;
+      distance += offset * offset;
+    }
+    distance = std::sqrt(distance);
+    distances.push_back({distance, pos});
+    if (state.sorting) {
+      continue;
+    }
+
+    bool crossed = !state.sorted;
+    float moved = 0;
+    for (int i = 0; i < 3; i++) {
+      crossed |= relative[i] < state.cellMin[i] ||
+                 relative[i] >= state.cellMax[i];
+      float offset = relative[i] - state.sortedCamera[i];
+      moved += offset * offset;
+    }
+    float threshold = std::max(MIN_RESORT_DISTANCE, distance * RESORT_ANGLE);
+    if (crossed ||
+        (state.quads->unaligned && moved > threshold * threshold)) {
+      due.push_back({distance, pos});
+    }
+  }
+
+  std::sort(distances.begin(), distances.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+  order.clear();
+  for (const auto &[distance, pos] : distances) {
+    order.push_back(pos);
+  }
+
+  size_t limit = pool.size() * JOBS_PER_WORKER;
+  if (due.empty() || inFlight >= limit) {
+    return;
+  }
+  size_t count = std::min(due.size(), limit - inFlight);
+  std::partial_sort(
+      due.begin(), due.begin() + count, due.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+  for (size_t i = 0; i < count; i++) {
+    SectionPos pos = due[i].second;
+    float relative[3];
+    relativeCamera(camera, pos, relative);
+    startSort(pos, sections.at(pos), relative);
+  }
+}
+
+void TranslucentSorter::startSort(SectionPos pos, SectionState &state,
+                                  const float camera[3]) {
+  state.sorting = true;
+  state.sorted = true;
+  for (int axis = 0; axis < 3; axis++) {
+    state.sortedCamera[axis] = camera[axis];
+    const auto &planes = state.quads->planes[axis];
+    auto above = std::upper_bound(planes.begin(), planes.end(), camera[axis]);
+    state.cellMin[axis] = above == planes.begin() ? -INFINITY_F : above[-1];
+    state.cellMax[axis] = above == planes.end() ? INFINITY_F : *above;
+  }
+
+  inFlight++;
+  pool.submit([this, pos, version = state.version, quads = state.quads,
+               x = camera[0], y = camera[1], z = camera[2]] {
+    size_t quadCount = quads->centroids.size() / 3;
+    // Squared distances are non-negative floats, which order the same as
+    // their bits. Inverted so the furthest quad comes first.
+    thread_local std::vector<uint32_t> keys;
+    keys.resize(quadCount);
+    for (size_t quad = 0; quad < quadCount; quad++) {
+      const float *centroid = &quads->centroids[quad * 3];
+      float dx = centroid[0] - x;
+      float dy = centroid[1] - y;
+      float dz = centroid[2] - z;
+      keys[quad] = ~std::bit_cast<uint32_t>(dx * dx + dy * dy + dz * dz);
+    }
+    thread_local std::vector<uint32_t> order;
+    radixSort(keys, order);
+
+    SortedIndices sorted;
+    sorted.pos = pos;
+    sorted.version = version;
+    sorted.indices.resize(quads->indices.size());
+    for (size_t i = 0; i < quadCount; i++) {
+      std::copy_n(&quads->indices[order[i] * 6], 6, &sorted.indices[i * 6]);
+    }
+    completed.push(std::move(sorted));
+  });
+}
+
+std::optional<SortedIndices> TranslucentSorter::pollCompleted() {
+  while (auto sorted = completed.pop()) {
+    inFlight--;
+    auto it = sections.find(sorted->pos);
+    if (it == sections.end() || it->second.version != sorted->version) {
+      continue;
+    }
+    it->second.sorting = false;
+    return sorted;
+  }
+  return std::nullopt;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "coords.hpp"
+#include "mesher.hpp"
+#include "mpsc_queue.hpp"
+#include "thread_pool.hpp"
+
+// A section's translucent indices in a new order
+struct SortedIndices {
+  SectionPos pos;
+  uint64_t version = 0;
+  std::vector<uint32_t> indices;
+};
+
+// Keeps the translucent quads of every section sorted back to front, so
+// blending comes out right within a section.
+//
+// Sorting is by distance to each quad's centroid, with a radix sort on the
+// thread pool. A section is only sorted again once the camera crosses one of
+// the planes its axis aligned quads lie in, since between those planes they
+// stay in the same order. Sections with other quads are also sorted again
+// once the camera has moved far enough relative to them.
+//
+// Sections themselves are drawn back to front too, in backToFront() order.
+class TranslucentSorter {
+public:
+  // The pool must be drained before the sorter is destroyed
+  explicit TranslucentSorter(ThreadPool &pool);
+
+  // Main thread, when a section's mesh is uploaded. layer is its translucent
+  // layer, six indices per quad as the mesher emits them.
+  void setSection(SectionPos pos, const MeshLayer &layer);
+  // Main thread
+  void removeSection(SectionPos pos);
+  // Main thread, once per frame. Starts sorts for the sections the camera
+  // moved too far relative to, nearest first, and orders sections back to
+  // front.
+  void update(const std::array<double, 3> &camera);
+  // Main thread, never blocks. Sorts overtaken by a new mesh are dropped.
+  std::optional<SortedIndices> pollCompleted();
+
+  // Every section with translucent quads, furthest first, as of the last
+  // update
+  const std::vector<SectionPos> &backToFront() const { return order; }
+
+private:
+  // The part of a section jobs read, replaced rather than changed
+  struct SectionQuads {
+    // Three per quad, relative to the section's minimum corner
+    std::vector<float> centroids;
+    std::vector<uint32_t> indices;
+    // Sorted coordinates of the planes axis aligned quads lie in, per axis
+    std::array<std::vector<float>, 3> planes;
+    // Some quads aren't axis aligned, so crossing planes isn't enough
+    bool unaligned = false;
+  };
+
+  struct SectionState {
+    std::shared_ptr<const SectionQuads> quads;
+    uint64_t version = 0;
+    bool sorting = false;
+    bool sorted = false;
+    // Where the camera was, relative to the section, for the last sort
+    float sortedCamera[3] = {};
+    // The cell between the planes the camera was in then
+    float cellMin[3] = {};
+    float cellMax[3] = {};
+  };
+
+  ThreadPool &pool;
+  MpscQueue<SortedIndices> completed;
+  size_t inFlight = 0;
+  uint64_t nextVersion = 1;
+  std::unordered_map<SectionPos, SectionState> sections;
+  std::vector<SectionPos> order;
+
+  void startSort(SectionPos pos, SectionState &state, const float camera[3]);
+};
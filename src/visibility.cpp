@@ -0,0 +1,142 @@
+#include "visibility.hpp"
+
+#include <bit>
+#include <vector>
+
+#include "chunk.hpp"
+
+FaceConnections computeFaceConnections(const uint32_t *occluding) {
+  // Blocks that don't occlude as 16-bit rows indexed y * 16 + z. Flood fill
+  // clears the bits it visits.
+  uint16_t open[256];
+  int openCount = 0;
+  for (int y = 0; y < 16; y++) {
+    for (int z = 0; z < 16; z++) {
+      uint32_t row = occluding[(y + 1) * PADDED_SIZE + z + 1];
+      open[y * 16 + z] = ~(row >> 1) & 0xffff;
+      openCount += std::popcount(open[y * 16 + z]);
+    }
+  }
+  if (openCount == 0) {
+    return 0;
+  }
+  // Walling off any part of the section takes at least 256 blocks, like
+  // vanilla don't bother with fewer
+  if (4096 - openCount < 256) {
+    return ALL_FACES_CONNECTED;
+  }
+
+  FaceConnections connections = 0;
+  uint16_t stack[4096];
+  auto fill = [&](int startX, int startY, int startZ) {
+    if (!(open[startY * 16 + startZ] >> startX & 1)) {
+      return;
+    }
+    open[startY * 16 + startZ] &= ~(1 << startX);
+    int size = 0;
+    stack[size++] = (startY * 16 + startZ) * 16 + startX;
+
+    unsigned faces = 0;
+    while (size) {
+      int i = stack[--size];
+      int x = i & 15;
+      int z = i >> 4 & 15;
+      int y = i >> 8;
+      faces |= (y == 0) << static_cast<int>(Direction::Down) |
+               (y == 15) << static_cast<int>(Direction::Up) |
+               (z == 0) << static_cast<int>(Direction::North) |
+               (z == 15) << static_cast<int>(Direction::South) |
+               (x == 0) << static_cast<int>(Direction::West) |
+               (x == 15) << static_cast<int>(Direction::East);
+
+      for (const auto &offset : DIRECTION_OFFSETS) {
+        int nx = x + offset[0];
+        int ny = y + offset[1];
+        int nz = z + offset[2];
+        if ((nx | ny | nz) & ~15) {
+          continue;
+        }
+        uint16_t &row = open[ny * 16 + nz];
+        if (row >> nx & 1) {
+          row &= ~(1 << nx);
+          stack[size++] = (ny * 16 + nz) * 16 + nx;
+        }
+      }
+    }
+
+    for (int a = 0; a < DIRECTION_COUNT; a++) {
+      if (faces >> a & 1) {
+        connections |= static_cast<FaceConnections>(faces) << (a * 6);
+      }
+    }
+  };
+
+  // Areas that don't reach the boundary can't connect anything, so only
+  // start from boundary blocks
+  for (int y = 0; y < 16; y++) {
+    for (int z = 0; z < 16; z++) {
+      bool boundaryRow = y == 0 || y == 15 || z == 0 || z == 15;
+      for (int x = 0; x < 16; x += boundaryRow ? 1 : 15) {
+        fill(x, y, z);
+      }
+    }
+  }
+  return connections;
+}
+
+bool VisibilityGraph::findVisible(SectionPos camera, const Frustum &frustum,
+                                  std::unordered_set<SectionPos> &out) const {
+  auto start = sections.find(camera);
+  if (start == sections.end()) {
+    return false;
+  }
+
+  struct Step {
+    SectionPos pos;
+    FaceConnections connections;
+    // Face the walk came in through, or -1 in the camera's section
+    int entry;
+    // Directions moved in on the way here
+    unsigned travelled;
+  };
+
+  out.clear();
+  out.insert(camera);
+  std::vector<Step> queue = {{camera, start->second, -1, 0}};
+  for (size_t head = 0; head < queue.size(); head++) {
+    Step step = queue[head];
+    for (int d = 0; d < DIRECTION_COUNT; d++) {
+      auto direction = static_cast<Direction>(d);
+      if (step.travelled >> static_cast<int>(opposite(direction)) & 1) {
+        continue;
+      }
+      if (step.entry >= 0 &&
+          !facesConnected(step.connections, static_cast<Direction>(step.entry),
+                          direction)) {
+        continue;
+      }
+
+      SectionPos next{step.pos.x + DIRECTION_OFFSETS[d][0],
+                      step.pos.y + DIRECTION_OFFSETS[d][1],
+                      step.pos.z + DIRECTION_OFFSETS[d][2]};
+      if (out.contains(next)) {
+        continue;
+      }
+      auto it = sections.find(next);
+      if (it == sections.end()) {
+        continue;
+      }
+      const float min[3] = {next.x * 16.0f, next.y * 16.0f, next.z * 16.0f};
+      const float max[3] = {min[0] + 16, min[1] + 16, min[2] + 16};
+      if (!frustum.intersects(min, max)) {
+        continue;
+      }
+
+      out.insert(next);
+      queue.push_back({next, it->second,
+                       static_cast<int>(opposite(direction)),
+                       step.travelled | 1u << d});
+    }
+  }
+  return true;
+}
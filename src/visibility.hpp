@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "block_model.hpp"
+#include "coords.hpp"
+#include "frustum.hpp"
+
+// Which pairs of a section's faces are joined by a path through blocks that
+// don't occlude, bit a * 6 + b for directions a and b
+using FaceConnections = uint64_t;
+
+const FaceConnections ALL_FACES_CONNECTED = (uint64_t(1) << 36) - 1;
+
+inline bool facesConnected(FaceConnections connections, Direction a,
+                           Direction b) {
+  return connections >> (static_cast<int>(a) * 6 + static_cast<int>(b)) & 1;
+}
+
+// Flood fills the section from its faces. occluding holds the padded row
+// masks the mesher builds, see MASK_ROWS.
+FaceConnections computeFaceConnections(const uint32_t *occluding);
+
+// Cave culling: finds the sections the camera may see by walking from its
+// section to neighbours, only leaving a section through a face connected to
+// the one it was entered by, never heading back towards the camera, and
+// never into sections outside the frustum. Underground sections enclosed by
+// stone are never reached from the surface.
+class VisibilityGraph {
+public:
+  void set(SectionPos pos, FaceConnections connections) {
+    sections[pos] = connections;
+  }
+  void remove(SectionPos pos) { sections.erase(pos); }
+
+  // Returns false, leaving out untouched, when the camera isn't in a known
+  // section and nothing can be culled
+  bool findVisible(SectionPos camera, const Frustum &frustum,
+                   std::unordered_set<SectionPos> &out) const;
+
+private:
+  // Every loaded section, all air sections are fully connected
+  std::unordered_map<SectionPos, FaceConnections> sections;
+};
@@ -0,0 +1,192 @@
+#include "vk_util.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+uint32_t findMemoryType(vk::PhysicalDevice physicalDevice, uint32_t typeFilter,
+                        vk::MemoryPropertyFlags properties) {
+  auto memProperties = physicalDevice.getMemoryProperties();
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) &&
+        (memProperties.memoryTypes[i].propertyFlags & properties) ==
+            properties) {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("failed to find suitable memory type");
+}
+
+Buffer createBuffer(const VulkanContext &ctx, vk::DeviceSize size,
+                    vk::BufferUsageFlags usage,
+                    vk::MemoryPropertyFlags properties) {
+  Buffer buffer;
+  buffer.size = size;
+
+  vk::BufferCreateInfo createInfo({}, size, usage, vk::SharingMode::eExclusive);
+  buffer.buffer = ctx.device.createBuffer(createInfo);
+
+  auto memRequirements = ctx.device.getBufferMemoryRequirements(buffer.buffer);
+  vk::MemoryAllocateInfo allocInfo(
+      memRequirements.size,
+      findMemoryType(ctx.physicalDevice, memRequirements.memoryTypeBits,
+                     properties));
+  buffer.memory = ctx.device.allocateMemory(allocInfo);
+  ctx.device.bindBufferMemory(buffer.buffer, buffer.memory, 0);
+
+  return buffer;
+}
+
+Buffer createMappedBuffer(const VulkanContext &ctx, vk::DeviceSize size,
+                          vk::BufferUsageFlags usage) {
+  Buffer buffer = createBuffer(ctx, size, usage,
+                               vk::MemoryPropertyFlagBits::eHostVisible |
+                                   vk::MemoryPropertyFlagBits::eHostCoherent);
+  buffer.mapped = ctx.device.mapMemory(buffer.memory, 0, size);
+  return buffer;
+}
+
+Buffer createDeviceLocalBuffer(const VulkanContext &ctx, const void *data,
+                               vk::DeviceSize size,
+                               vk::BufferUsageFlags usage) {
+  Buffer staging =
+      createMappedBuffer(ctx, size, vk::BufferUsageFlagBits::eTransferSrc);
+  memcpy(staging.mapped, data, size);
+
+  Buffer buffer =
+      createBuffer(ctx, size, usage | vk::BufferUsageFlagBits::eTransferDst,
+                   vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+  auto commandBuffer = beginSingleTimeCommands(ctx);
+  commandBuffer.copyBuffer(staging.buffer, buffer.buffer,
+                           {vk::BufferCopy(0, 0, size)});
+  endSingleTimeCommands(ctx, commandBuffer);
+
+  destroyBuffer(ctx.device, staging);
+  return buffer;
+}
+
+void destroyBuffer(vk::Device device, Buffer &buffer) {
+  if (buffer.mapped) {
+    device.unmapMemory(buffer.memory);
+  }
+  device.destroyBuffer(buffer.buffer);
+  device.freeMemory(buffer.memory);
+  buffer = {};
+}
+
+vk::CommandBuffer beginSingleTimeCommands(const VulkanContext &ctx) {
+  vk::CommandBufferAllocateInfo allocInfo(ctx.commandPool,
+                                          vk::CommandBufferLevel::ePrimary, 1);
+  auto commandBuffer = ctx.device.allocateCommandBuffers(allocInfo)[0];
+
+  vk::CommandBufferBeginInfo beginInfo(
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+  commandBuffer.begin(beginInfo);
+  return commandBuffer;
+}
+
+void endSingleTimeCommands(const VulkanContext &ctx,
+                           vk::CommandBuffer commandBuffer) {
+  commandBuffer.end();
+
+  vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &commandBuffer);
+  ctx.graphicsQueue.submit({submitInfo});
+  ctx.graphicsQueue.waitIdle();
+
+  ctx.device.freeCommandBuffers(ctx.commandPool, {commandBuffer});
+}
+
+Image createImage(const VulkanContext &ctx, uint32_t width, uint32_t height,
+                  uint32_t layers, vk::Format format, vk::ImageUsageFlags usage,
+                  vk::ImageViewType viewType, vk::ImageAspectFlags aspect) {
+  Image image;
+
+  vk::ImageCreateInfo createInfo(
+      {}, vk::ImageType::e2D, format, vk::Extent3D(width, height, 1), 1,
+      layers, vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, usage,
+      vk::SharingMode::eExclusive, 0, nullptr, vk::ImageLayout::eUndefined);
+  image.image = ctx.device.createImage(createInfo);
+
+  auto memRequirements = ctx.device.getImageMemoryRequirements(image.image);
+  vk::MemoryAllocateInfo allocInfo(
+      memRequirements.size,
+      findMemoryType(ctx.physicalDevice, memRequirements.memoryTypeBits,
+                     vk::MemoryPropertyFlagBits::eDeviceLocal));
+  image.memory = ctx.device.allocateMemory(allocInfo);
+  ctx.device.bindImageMemory(image.image, image.memory, 0);
+
+  vk::ImageSubresourceRange subresourceRange(aspect, 0, 1, 0, layers);
+  vk::ImageViewCreateInfo viewInfo({}, image.image, viewType, format, {},
+                                   subresourceRange);
+  image.view = ctx.device.createImageView(viewInfo);
+
+  return image;
+}
+
+void destroyImage(vk::Device device, Image &image) {
+  device.destroyImageView(image.view);
+  device.destroyImage(image.image);
+  device.freeMemory(image.memory);
+  image = {};
+}
+
+void transitionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image,
+                           uint32_t layers, vk::ImageLayout oldLayout,
+                           vk::ImageLayout newLayout) {
+  vk::ImageMemoryBarrier barrier(
+      {}, {}, oldLayout, newLayout, vk::QueueFamilyIgnored,
+      vk::QueueFamilyIgnored, image,
+      vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0,
+                                layers));
+
+  vk::PipelineStageFlags srcStage;
+  vk::PipelineStageFlags dstStage;
+  if (oldLayout == vk::ImageLayout::eUndefined &&
+      newLayout == vk::ImageLayout::eTransferDstOptimal) {
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+    srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
+    dstStage = vk::PipelineStageFlagBits::eTransfer;
+  } else if (oldLayout == vk::ImageLayout::eTransferDstOptimal &&
+             newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    srcStage = vk::PipelineStageFlagBits::eTransfer;
+    dstStage = vk::PipelineStageFlagBits::eFragmentShader;
+  } else {
+    throw std::invalid_argument("unsupported layout transition");
+  }
+
+  commandBuffer.pipelineBarrier(srcStage, dstStage, {}, {}, {}, {barrier});
+}
+
+void uploadImageLayers(const VulkanContext &ctx, vk::Image image,
+                       uint32_t width, uint32_t height, uint32_t layers,
+                       const void *data, vk::DeviceSize size) {
+  Buffer staging =
+      createMappedBuffer(ctx, size, vk::BufferUsageFlagBits::eTransferSrc);
+  memcpy(staging.mapped, data, size);
+
+  auto commandBuffer = beginSingleTimeCommands(ctx);
+  transitionImageLayout(commandBuffer, image, layers,
+                        vk::ImageLayout::eUndefined,
+                        vk::ImageLayout::eTransferDstOptimal);
+
+  // Layers are consecutive in the staging buffer, so a single region covers
+  // all of them
+  vk::BufferImageCopy region(
+      0, 0, 0,
+      vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0,
+                                 layers),
+      {0, 0, 0}, {width, height, 1});
+  commandBuffer.copyBufferToImage(staging.buffer, image,
+                                  vk::ImageLayout::eTransferDstOptimal,
+                                  {region});
+
+  transitionImageLayout(commandBuffer, image, layers,
+                        vk::ImageLayout::eTransferDstOptimal,
+                        vk::ImageLayout::eShaderReadOnlyOptimal);
+  endSingleTimeCommands(ctx, commandBuffer);
+
+  destroyBuffer(ctx.device, staging);
+}
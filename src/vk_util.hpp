@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+// The handles most helpers need, filled in by the application once the
+// device and command pool exist.
+struct VulkanContext {
+  vk::PhysicalDevice physicalDevice;
+  vk::Device device;
+  vk::Queue graphicsQueue;
+  vk::CommandPool commandPool;
+};
+
+struct Buffer {
+  vk::Buffer buffer;
+  vk::DeviceMemory memory;
+  vk::DeviceSize size = 0;
+  // Only set for host visible buffers
+  void *mapped = nullptr;
+};
+
+struct Image {
+  vk::Image image;
+  vk::DeviceMemory memory;
+  vk::ImageView view;
+};
+
+uint32_t findMemoryType(vk::PhysicalDevice physicalDevice, uint32_t typeFilter,
+                        vk::MemoryPropertyFlags properties);
+
+Buffer createBuffer(const VulkanContext &ctx, vk::DeviceSize size,
+                    vk::BufferUsageFlags usage,
+                    vk::MemoryPropertyFlags properties);
+// Creates a persistently mapped, host coherent buffer
+Buffer createMappedBuffer(const VulkanContext &ctx, vk::DeviceSize size,
+                          vk::BufferUsageFlags usage);
+// Creates a device local buffer and fills it through a staging buffer
+Buffer createDeviceLocalBuffer(const VulkanContext &ctx, const void *data,
+                               vk::DeviceSize size, vk::BufferUsageFlags usage);
+void destroyBuffer(vk::Device device, Buffer &buffer);
+
+vk::CommandBuffer beginSingleTimeCommands(const VulkanContext &ctx);
+void endSingleTimeCommands(const VulkanContext &ctx,
+                           vk::CommandBuffer commandBuffer);
+
+Image createImage(const VulkanContext &ctx, uint32_t width, uint32_t height,
+                  uint32_t layers, vk::Format format, vk::ImageUsageFlags usage,
+                  vk::ImageViewType viewType, vk::ImageAspectFlags aspect);
+void destroyImage(vk::Device device, Image &image);
+
+void transitionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image,
+                           uint32_t layers, vk::ImageLayout oldLayout,
+                           vk::ImageLayout newLayout);
+
+// Uploads tightly packed layers to a whole image and leaves it ready for
+// sampling in fragment shaders
+void uploadImageLayers(const VulkanContext &ctx, vk::Image image,
+                       uint32_t width, uint32_t height, uint32_t layers,
+                       const void *data, vk::DeviceSize size);